@@ -0,0 +1,94 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventOutcome;
+
+/* Round trip of a request to a running chart: post an event and learn what
+ * it did. Chart::postAcknowledged() waited on as a future, against posting
+ * then sleeping 1 ms before reading the state, which is both slower and not
+ * guaranteed to see the outcome.
+ *
+ * usage: ack_roundtrip [requests=20000]
+ */
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+template<typename RequestT>
+void measure(const char * name, size_t requests, RequestT request)
+{
+  auto chart = Chart::createChart("toggle");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event flip{"flip"};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(flip);
+  b->createTransition(a)->addEvent(flip);
+  chart->spinAsync();
+  chart->waitForState(*a, std::chrono::seconds(5));
+
+  std::vector<double> latencies;
+  latencies.reserve(requests);
+  size_t consumed = 0;
+  for (size_t i = 0; i < requests; ++i) {
+    auto start = Clock::now();
+    consumed += request(*chart, flip);
+    latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+  }
+  chart->stop();
+
+  std::sort(latencies.begin(), latencies.end());
+  std::printf(
+    "%-24s %10.1f %10.1f %10.1f %10zu\n", name, latencies[latencies.size() / 2],
+    latencies[latencies.size() * 99 / 100], latencies.back(), consumed);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+
+  std::printf(
+    "%-24s %10s %10s %10s %10s\n", "request", "p50 us", "p99 us", "max us", "consumed");
+  measure(
+    "postAcknowledged()", requests,
+    [](Chart & chart, Event & event) {
+      return chart.postAcknowledged(event).get().outcome == EventOutcome::Consumed;
+    });
+  measure(
+    "post() + 1 ms sleep", requests / 20,
+    [](Chart & chart, Event & event) {
+      auto before = chart.getCurrentStateName();
+      chart.post(event);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return chart.getCurrentStateName() != before;
+    });
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/event_bus.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventBus;
+
+/* Events per second sent to 256 charts sharing 64 events, each chart cycling
+ * through 8 states on 8 of them, by 1 to 64 producer threads: first with
+ * Event::trigger(), then through an EventBus. One thread keeps stepping the
+ * charts meanwhile.
+ *
+ * usage: bus_throughput [milliseconds per run]
+ */
+using Clock = std::chrono::steady_clock;
+
+const int chartCount = 256;
+const int eventCount = 64;
+const int ringSize = 8;
+
+std::vector<std::shared_ptr<Chart>> makeCharts(std::vector<std::unique_ptr<Event>> & events)
+{
+  std::vector<std::shared_ptr<Chart>> charts;
+  for (int c = 0; c < chartCount; ++c) {
+    auto chart = Chart::createChart("chart" + std::to_string(c));
+    std::vector<std::shared_ptr<mogi::statechart::State>> ring;
+    for (int s = 0; s < ringSize; ++s) {
+      ring.push_back(chart->createState("s" + std::to_string(s)));
+    }
+    chart->getInitialState()->createTransition(ring[0]);
+    for (int s = 0; s < ringSize; ++s) {
+      ring[s]->createTransition(ring[(s + 1) % ringSize])->addEvent(
+        *events[(c * ringSize + s) % eventCount]);
+    }
+    charts.push_back(chart);
+  }
+  return charts;
+}
+
+template<typename SendT>
+double run(
+  int producers, int milliseconds,
+  const std::vector<std::shared_ptr<Chart>> & charts, SendT send)
+{
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> sent{0};
+  std::thread stepper{[&]() {
+      while (!done) {
+        for (const auto & chart : charts) {
+          chart->spinOnce();
+        }
+      }
+    }};
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back(
+      [&, p]() {
+        uint64_t count = 0;
+        unsigned next = p;
+        while (!done) {
+          next = next * 1103515245u + 12345u;
+          send((next >> 16) % eventCount);
+          count++;
+        }
+        sent += count;
+      });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+  done = true;
+  for (auto & t : threads) {
+    t.join();
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  stepper.join();
+  return sent.load() / elapsed;
+}
+
+int main(int argc, char ** argv)
+{
+  int milliseconds = argc > 1 ? std::atoi(argv[1]) : 200;
+
+  /* each set of charts has its own events */
+  std::vector<std::unique_ptr<Event>> events, routedEvents;
+  for (int e = 0; e < eventCount; ++e) {
+    events.emplace_back(new Event("e" + std::to_string(e)));
+    routedEvents.emplace_back(new Event("e" + std::to_string(e)));
+  }
+  auto triggered = makeCharts(events);
+  auto routed = makeCharts(routedEvents);
+  EventBus bus;
+  std::vector<uint32_t> topics;
+  for (const auto & event : routedEvents) {
+    topics.push_back(bus.topic(event->name()));
+  }
+  for (const auto & chart : routed) {
+    bus.attach(chart);
+  }
+
+  std::cout << "producers   trigger/s       bus/s" << std::endl;
+  for (int producers = 1; producers <= 64; producers *= 2) {
+    auto trigger = run(
+      producers, milliseconds, triggered,
+      [&events](unsigned e) {events[e]->trigger();});
+    auto published = run(
+      producers, milliseconds, routed,
+      [&bus, &topics](unsigned e) {bus.publish(topics[e]);});
+    std::cout << producers << "\t" << static_cast<uint64_t>(trigger) << "\t" <<
+      static_cast<uint64_t>(published) << std::endl;
+  }
+  std::cout << bus.shardCount() << " shards, " << bus.droppedCount() <<
+    " deliveries dropped on full inboxes" << std::endl;
+  return 0;
+}
@@ -0,0 +1,166 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mogi_statechart/function.hpp"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::BasicCallback;
+using mogi::statechart::Chart;
+using mogi::statechart::FunctionPointer;
+using mogi::statechart::FunctionRef;
+using mogi::statechart::InplaceFunction;
+
+/* Cost of the callback storage policies (see function.hpp):
+ *  - calling a guard through BasicCallback::invokeCached() with each storage,
+ *    and replacing it with set()
+ *  - steps of a locked chart of 16 states with 8 guarded transitions each,
+ *    one of them satisfied, the guards given as a lambda with a 48 bytes
+ *    capture, a FunctionPointer or a FunctionRef. The chart stores them in
+ *    its own storage, std::function unless the library was configured with
+ *    -DMOGI_STATECHART_INPLACE_CALLBACKS=<bytes>: build it both ways to
+ *    compare
+ *
+ * usage: callback_storage [calls=10000000] [steps=200000]
+ */
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+/* the state a guard looks at, big enough to defeat std::function's small
+ * buffer when captured by value
+ */
+struct Sensor
+{
+  std::array<int, 12> readings{};
+  bool ready() const {return readings[0] >= 0;}
+};
+
+bool sensorReady(void * sensor) {return static_cast<Sensor *>(sensor)->ready();}
+
+template<typename StorageT>
+void invokeCost(const char * name, StorageT guard, StorageT other, size_t calls)
+{
+  BasicCallback<StorageT, bool> callback{std::move(guard)};
+  size_t satisfied = 0;
+  auto start = Clock::now();
+  for (size_t i = 0; i < calls; ++i) {
+    satisfied += callback.invokeCached();
+  }
+  auto invoke = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / calls;
+
+  const size_t sets = calls / 100;
+  start = Clock::now();
+  for (size_t i = 0; i < sets; ++i) {
+    callback.set(other);
+  }
+  auto set = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / sets;
+  std::printf("%-28s %10.2f %10.1f %s\n", name, invoke, set, satisfied == calls ? "" : "?");
+}
+
+template<typename MakeGuardT>
+double stepCost(MakeGuardT makeGuard, size_t steps)
+{
+  auto chart = Chart::createChart("guards");
+  std::vector<std::shared_ptr<mogi::statechart::State>> states;
+  for (int i = 0; i < 16; ++i) {
+    states.push_back(chart->createState("s" + std::to_string(i)));
+  }
+  chart->getInitialState()->createTransition(states[0]);
+  for (size_t i = 0; i < states.size(); ++i) {
+    for (size_t t = 0; t < 8; ++t) {
+      auto transition = states[i]->createTransition(states[(i + t + 1) % states.size()]);
+      transition->createGuard(makeGuard(t == 0));
+    }
+  }
+  chart->lock();
+  for (size_t i = 0; i < 64; ++i) {
+    chart->spinOnce();
+  }
+  auto start = Clock::now();
+  for (size_t i = 0; i < steps; ++i) {
+    chart->spinOnce();
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / steps;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t calls = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+  const size_t steps = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+
+  Sensor sensor;
+  auto byValue = [sensor]() {return sensor.ready();};
+  auto byReference = [&sensor]() {return sensor.ready();};
+
+  std::printf("%-28s %10s %10s\n", "storage", "invoke ns", "set ns");
+  invokeCost<std::function<bool()>>(
+    "std::function, small", byReference, byReference, calls);
+  invokeCost<std::function<bool()>>(
+    "std::function, 48B capture", byValue, byValue, calls);
+  invokeCost<InplaceFunction<bool(), 64>>(
+    "InplaceFunction<64>", byValue, byValue, calls);
+  invokeCost<FunctionPointer<bool()>>(
+    "FunctionPointer", {&sensorReady, &sensor}, {&sensorReady, &sensor}, calls);
+  invokeCost<FunctionRef<bool()>>(
+    "FunctionRef", byValue, byValue, calls);
+
+#if defined(MOGI_STATECHART_INPLACE_CALLBACKS)
+  std::printf(
+    "\nchart callbacks: InplaceFunction<%d>\n", MOGI_STATECHART_INPLACE_CALLBACKS);
+#else
+  std::printf("\nchart callbacks: std::function\n");
+#endif
+  std::printf("%-28s %10s\n", "guards given as", "ns/step");
+  std::vector<Sensor> sensors(8);
+  sensors[0].readings[0] = 0;
+  for (size_t i = 1; i < sensors.size(); ++i) {
+    sensors[i].readings[0] = -1;
+  }
+  std::printf(
+    "%-28s %10.1f\n", "lambda, 48B capture",
+    stepCost(
+      [&sensors](bool satisfied) {
+        auto s = sensors[satisfied ? 0 : 1];
+        return [s]() {return s.ready();};
+      }, steps));
+  std::printf(
+    "%-28s %10.1f\n", "FunctionPointer",
+    stepCost(
+      [&sensors](bool satisfied) {
+        return FunctionPointer<bool()>{&sensorReady, &sensors[satisfied ? 0 : 1]};
+      }, steps));
+  std::vector<std::function<bool()>> kept;
+  kept.reserve(2);
+  kept.emplace_back([&sensors]() {return sensors[0].ready();});
+  kept.emplace_back([&sensors]() {return sensors[1].ready();});
+  std::printf(
+    "%-28s %10.1f\n", "FunctionRef",
+    stepCost(
+      [&kept](bool satisfied) {
+        return FunctionRef<bool()>{kept[satisfied ? 0 : 1]};
+      }, steps));
+  return 0;
+}
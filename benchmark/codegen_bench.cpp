@@ -0,0 +1,102 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "mogi_statechart/scxml.hpp"
+#include "ring_machine.hpp"
+
+using mogi::statechart::Event;
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::ScxmlRegistry;
+
+/* Compares the runtime Chart with the code generated from the same
+ * definition (benchmark/charts/ring.scxml): every step triggers `next` and
+ * spins the chart once, which takes one guarded transition and one entry
+ * action.
+ *
+ * usage: codegen_bench [steps]
+ */
+struct Hooks
+{
+  void count() {counter++;}
+  bool always() {return true;}
+  long counter{0};
+};
+
+template<typename StepT>
+double measure(long steps, StepT && step)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < steps; ++i) {
+    step();
+  }
+  return std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - start).count() / steps;
+}
+
+int main(int argc, char ** argv)
+{
+  long steps = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+  ScxmlRegistry registry;
+  long runtimeCounter{0};
+  registry.registerAction("count", [&runtimeCounter]() {runtimeCounter++;});
+  registry.registerGuard("always", []() {return true;});
+  ScxmlLoader loader{registry};
+  auto chart = loader.loadFile(RING_SCXML);
+  auto & next = loader.event("next");
+  chart->spinOnce();
+  double runtime = measure(
+    steps, [&chart, &next]() {
+      next.trigger();
+      chart->spinOnce();
+    });
+
+  Hooks hooks;
+  bench::RingMachine<Hooks> machine{hooks};
+  machine.spinOnce();
+  double generated = measure(
+    steps, [&machine]() {
+      machine.trigger(bench::RingMachine<Hooks>::EventId::next);
+      machine.spinOnce();
+    });
+
+  Hooks boundHooks;
+  bench::RingMachine<Hooks> bound{boundHooks};
+  Event boundNext{"next"};
+  bound.bind(bench::RingMachine<Hooks>::EventId::next, boundNext);
+  bound.spinOnce();
+  double generatedBound = measure(
+    steps, [&bound, &boundNext]() {
+      boundNext.trigger();
+      bound.spinOnce();
+    });
+
+  if (runtimeCounter != hooks.counter || hooks.counter != boundHooks.counter) {
+    std::cerr << "codegen_bench: charts diverged (" << runtimeCounter << " vs " <<
+      hooks.counter << " vs " << boundHooks.counter << ")" << std::endl;
+    return 1;
+  }
+
+  std::cout << "codegen_bench: " << steps << " steps" << std::endl;
+  std::cout << "  runtime Chart          " << runtime << " ns/step" << std::endl;
+  std::cout << "  generated              " << generated << " ns/step (" <<
+    runtime / generated << "x)" << std::endl;
+  std::cout << "  generated, bound Event " << generatedBound << " ns/step (" <<
+    runtime / generatedBound << "x)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Configuration;
+
+/* Reads per second of the active configuration of a running chart, by
+ * monitoring threads polling either Chart::configuration() or
+ * getCurrentStateNameFull(), while the chart keeps moving between the
+ * states of a subchart.
+ *
+ * usage: config_snapshot [readers] [seconds]
+ */
+using Clock = std::chrono::steady_clock;
+
+template<typename ReadT>
+double readsPerSecond(int readers, double seconds, ReadT read)
+{
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> total{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < readers; ++i) {
+    threads.emplace_back(
+      [&]() {
+        uint64_t count = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+          read();
+          ++count;
+        }
+        total += count;
+      });
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  done = true;
+  for (auto & t : threads) {
+    t.join();
+  }
+  return total.load() / seconds;
+}
+
+int main(int argc, char ** argv)
+{
+  int readers = argc > 1 ? std::atoi(argv[1]) : 2;
+  double seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+
+  /* big: initial ---> sub [initial ---> a <---> b] */
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto a = sub->createState("a");
+  auto b = sub->createState("b");
+  sub->getInitialState()->createTransition(a);
+  a->createTransition(b);
+  b->createTransition(a);
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+  big->spinAsync();
+
+  std::cout << readers << " reader(s), " << seconds << " s each" << std::endl;
+  volatile uint32_t sink = 0;
+  auto snapshot = readsPerSecond(
+    readers, seconds, [&big, &sink]() {
+      auto c = big->configuration();
+      sink = c.path[c.depth - 1];
+    });
+  std::cout << "  configuration()          " << snapshot / 1e6 << " M reads/s" << std::endl;
+  auto names = readsPerSecond(
+    readers, seconds, [&big, &sink]() {
+      sink = static_cast<uint32_t>(big->getCurrentStateNameFull().size());
+    });
+  std::cout << "  getCurrentStateNameFull() " << names / 1e6 << " M reads/s" << std::endl;
+  auto c = big->configuration();
+  std::cout << "  chart at step " << c.step << ", " << big->configurationName(c) << std::endl;
+  big->stop();
+  return 0;
+}
@@ -0,0 +1,84 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mogi_statechart/dot.hpp"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::DotExporter;
+using mogi::statechart::DotOptions;
+using mogi::statechart::Event;
+
+/* DotExporter on growing charts: 1k to 100k states in subcharts of 100,
+ * each state with 3 transitions on events, the subcharts chained by an
+ * event never triggered. Profiled over a few thousand steps so that the
+ * heat map has something to show. The time per state should stay flat.
+ *
+ * usage: dot_export [max states=100000]
+ */
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char ** argv)
+{
+  const size_t maxStates = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+  std::printf("%10s %12s %12s %12s\n", "states", "bytes", "ms", "ns/state");
+  for (size_t states = 1000; states <= maxStates; states *= 10) {
+    auto chart = Chart::createChart("top");
+    std::vector<std::unique_ptr<Event>> events;
+    for (int e = 0; e < 3; ++e) {
+      events.emplace_back(new Event("e" + std::to_string(e)));
+    }
+    Event next{"next"};
+    std::shared_ptr<mogi::statechart::AbstractState> previousSub = chart->getInitialState();
+    for (size_t s = 0; s < states / 100; ++s) {
+      auto sub = Chart::createChart("sub" + std::to_string(s));
+      std::vector<std::shared_ptr<mogi::statechart::State>> inner;
+      for (int i = 0; i < 100; ++i) {
+        inner.push_back(sub->createState("s" + std::to_string(i)));
+      }
+      sub->getInitialState()->createTransition(inner[0]);
+      for (size_t i = 0; i < inner.size(); ++i) {
+        for (size_t e = 0; e < events.size(); ++e) {
+          auto t = inner[i]->createTransition(inner[(i + e + 1) % inner.size()]);
+          t->addEvent(*events[e]);
+        }
+      }
+      chart->addSubchart(sub);
+      auto t = previousSub->createTransition(sub);
+      if (s > 0) {
+        t->addEvent(next);
+      }
+      previousSub = sub;
+    }
+    chart->setProfiling(true);
+    for (int step = 0; step < 4000; ++step) {
+      events[step % 7 == 0 ? 2 : step % 2]->trigger();
+      chart->spinOnce();
+    }
+
+    auto start = Clock::now();
+    auto dot = DotExporter::toString(*chart, DotOptions{true});
+    auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::printf("%10zu %12zu %12.1f %12.1f\n", states, dot.size(), ms, ms * 1e6 / states);
+  }
+  return 0;
+}
@@ -0,0 +1,126 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/farm.hpp"
+#include "mogi_statechart/scxml.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::ChartDescription;
+using mogi::statechart::ChartFarm;
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::ScxmlRegistry;
+using mogi::statechart::StateDescription;
+using mogi::statechart::ThreadPoolExecutor;
+using mogi::statechart::TransitionDescription;
+
+/* Fleet simulation: a battery powered device chart, cycling between idle,
+ * working and charging on data driven guards over a per-device battery
+ * level. Compares a ChartFarm (serial, then on a thread pool) with one
+ * runtime Chart per device, in ns per device step.
+ *
+ * usage: farm_bench [devices] [steps] [chart devices]
+ */
+using Clock = std::chrono::steady_clock;
+
+ChartDescription device()
+{
+  ChartDescription d;
+  d.name = "device";
+  d.initial = "idle";
+  StateDescription idle{"idle", false, {}, {}, {}, {}, nullptr};
+  idle.transitions.push_back(TransitionDescription{"working", {}, {"charged"}, {}});
+  StateDescription working{"working", false, {}, {}, {}, {}, nullptr};
+  working.transitions.push_back(TransitionDescription{"charging", {}, {"depleted"}, {}});
+  StateDescription charging{"charging", false, {}, {}, {}, {}, nullptr};
+  charging.transitions.push_back(TransitionDescription{"idle", {}, {"full"}, {}});
+  d.states = {idle, working, charging};
+  return d;
+}
+
+/* battery levels drift, vectorizable */
+void simulate(std::vector<float> & battery, int step)
+{
+  const float drift = step % 7 < 4 ? -0.05f : 0.08f;
+  for (auto & b : battery) {
+    b = std::min(1.0f, std::max(0.0f, b + drift));
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  size_t devices = argc > 1 ? std::atol(argv[1]) : 1000000;
+  int steps = argc > 2 ? std::atoi(argv[2]) : 20;
+  size_t chartDevices = argc > 3 ? std::atol(argv[3]) : 10000;
+
+  std::vector<float> battery(devices);
+  for (size_t i = 0; i < devices; ++i) {
+    battery[i] = static_cast<float>(i % 100) / 100.0f;
+  }
+  ChartFarm farm{device(), devices};
+  farm.bindGuard("charged", battery.data(), ChartFarm::Comparison::Greater, 0.5f);
+  farm.bindGuard("depleted", battery.data(), ChartFarm::Comparison::Less, 0.2f);
+  farm.bindGuard("full", battery.data(), ChartFarm::Comparison::GreaterEqual, 0.95f);
+
+  auto measure = [&](auto && step) {
+      auto start = Clock::now();
+      for (int s = 0; s < steps; ++s) {
+        simulate(battery, s);
+        step();
+      }
+      return std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+             (static_cast<double>(steps) * devices);
+    };
+  std::cout << devices << " devices, " << steps << " steps" << std::endl;
+  std::cout << "  farm, serial          " << measure([&farm]() {farm.step();}) <<
+    " ns/device step" << std::endl;
+  auto threads = std::max(1u, std::thread::hardware_concurrency());
+  ThreadPoolExecutor pool{threads};
+  farm.reset();
+  std::cout << "  farm, " << threads << " thread(s)       " <<
+    measure([&farm, &pool]() {farm.step(pool);}) << " ns/device step" << std::endl;
+  std::cout << "  working " << farm.countInState(farm.stateIndex("working")) <<
+    ", charging " << farm.countInState(farm.stateIndex("charging")) << std::endl;
+
+  /* one object graph per device, on fewer devices */
+  std::vector<float> chartBattery(battery.begin(), battery.begin() + chartDevices);
+  std::vector<std::shared_ptr<Chart>> charts;
+  for (size_t i = 0; i < chartDevices; ++i) {
+    ScxmlRegistry registry;
+    registry.registerGuard("charged", [&chartBattery, i]() {return chartBattery[i] > 0.5f;});
+    registry.registerGuard("depleted", [&chartBattery, i]() {return chartBattery[i] < 0.2f;});
+    registry.registerGuard("full", [&chartBattery, i]() {return chartBattery[i] >= 0.95f;});
+    ScxmlLoader loader{registry};
+    charts.push_back(loader.build(device()));
+  }
+  auto start = Clock::now();
+  for (int s = 0; s < steps; ++s) {
+    simulate(chartBattery, s);
+    for (auto & chart : charts) {
+      chart->spinOnce();
+    }
+  }
+  std::cout << "  Chart per device      " <<
+    std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+    (static_cast<double>(steps) * chartDevices) << " ns/device step (" << chartDevices <<
+    " devices)" << std::endl;
+  return 0;
+}
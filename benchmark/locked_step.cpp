@@ -0,0 +1,78 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+
+/* Time per step of a ring of 16 states, each with a guarded transition to
+ * the next one and 3 transitions on events never triggered, before and
+ * after Chart::lock().
+ *
+ * usage: locked_step [steps]
+ */
+using Clock = std::chrono::steady_clock;
+
+std::shared_ptr<Chart> ring(std::vector<std::unique_ptr<Event>> & events)
+{
+  auto chart = Chart::createChart("ring");
+  std::vector<std::shared_ptr<mogi::statechart::State>> states;
+  for (int i = 0; i < 16; ++i) {
+    states.push_back(chart->createState("s" + std::to_string(i)));
+  }
+  chart->getInitialState()->createTransition(states[0]);
+  for (size_t i = 0; i < states.size(); ++i) {
+    states[i]->createTransition(states[(i + 1) % states.size()])->createGuard(
+      []() {return true;});
+    for (size_t e = 0; e < 3; ++e) {
+      events.emplace_back(new Event("e"));
+      states[i]->createTransition(states[(i + e + 2) % states.size()])->addEvent(
+        *events.back());
+    }
+  }
+  return chart;
+}
+
+double nsPerStep(const std::shared_ptr<Chart> & chart, int steps)
+{
+  auto start = Clock::now();
+  for (int i = 0; i < steps; ++i) {
+    chart->spinOnce();
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / steps;
+}
+
+int main(int argc, char ** argv)
+{
+  int steps = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  std::vector<std::unique_ptr<Event>> events;
+  auto chart = ring(events);
+  /* warm up */
+  nsPerStep(chart, steps / 10);
+
+  auto unlocked = nsPerStep(chart, steps);
+  chart->lock();
+  auto locked = nsPerStep(chart, steps);
+  std::cout << "unlocked " << unlocked << " ns/step" << std::endl;
+  std::cout << "locked   " << locked << " ns/step (x" << unlocked / locked << ")" << std::endl;
+  return 0;
+}
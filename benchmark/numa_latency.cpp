@@ -0,0 +1,157 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/placement.hpp"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::NumaNode;
+using mogi::statechart::Placement;
+using mogi::statechart::RealTimeOptions;
+
+/* Trigger to transition latency across NUMA nodes. A producer thread on one
+ * node triggers an event and waits until the chart, stepped from a thread
+ * on another (or the same) node, took it. The chart is built either from a
+ * thread of its own node, so that its states, transitions and event
+ * observers are local to it, or from the producer's node as a chart set up
+ * by the main thread would be.
+ *
+ * Needs a multi-node host, or one emulated with the numa=fake=2 kernel
+ * parameter. On a single node only the local case is measured.
+ *
+ * usage: numa_latency [events=20000]
+ */
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+struct Result
+{
+  double p50;
+  double p99;
+  double max;
+};
+
+struct Ring
+{
+  std::shared_ptr<Chart> chart;
+  std::vector<std::unique_ptr<Event>> events;
+  std::atomic<uint64_t> consumed{0};
+};
+
+/* 16 states in a ring, each moving on its own event */
+void build(Ring & ring)
+{
+  ring.chart = Chart::createChart("ring");
+  std::vector<std::shared_ptr<mogi::statechart::State>> states;
+  for (int i = 0; i < 16; ++i) {
+    states.push_back(ring.chart->createState("s" + std::to_string(i)));
+    ring.events.emplace_back(new Event("e" + std::to_string(i)));
+  }
+  ring.chart->getInitialState()->createTransition(states[0]);
+  for (size_t i = 0; i < states.size(); ++i) {
+    states[i]->createTransition(states[(i + 1) % states.size()])->addEvent(*ring.events[i]);
+    states[i]->setCallbackEntry([&ring]() {ring.consumed++;});
+  }
+  ring.chart->lock();
+}
+
+Result measure(int producerNode, int chartNode, int topologyNode, size_t events)
+{
+  RealTimeOptions topology;
+  topology.numaNode = topologyNode;
+  Ring ring;
+  std::thread{[&]() {
+      Placement::setUpThread(topology);
+      build(ring);
+    }}.join();
+
+  RealTimeOptions options;
+  options.numaNode = chartNode;
+  ring.chart->spinAsync(options);
+  while (ring.consumed.load() == 0) {
+    std::this_thread::yield();
+  }
+
+  std::vector<double> latencies;
+  latencies.reserve(events);
+  std::thread producer{[&]() {
+      RealTimeOptions placement;
+      placement.numaNode = producerNode;
+      Placement::setUpThread(placement);
+      for (size_t i = 0; i < events; ++i) {
+        auto before = ring.consumed.load();
+        auto start = Clock::now();
+        ring.events[i % ring.events.size()]->trigger();
+        while (ring.consumed.load() == before) {
+          std::this_thread::yield();
+        }
+        latencies.push_back(
+          std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+      }
+    }};
+  producer.join();
+  ring.chart->stop();
+
+  std::sort(latencies.begin(), latencies.end());
+  return Result{latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100],
+    latencies.back()};
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+  std::vector<NumaNode> nodes;
+  for (const auto & node : Placement::numaNodes()) {
+    if (!node.cpus.empty()) {
+      nodes.push_back(node);
+    }
+  }
+  if (nodes.size() < 2) {
+    std::printf("single NUMA node, cross-node cases skipped (try numa=fake=2)\n");
+  }
+
+  std::printf(
+    "%8s %8s %8s %10s %10s %10s\n", "producer", "chart", "topology", "p50 us", "p99 us",
+    "max us");
+  for (const auto & producer : nodes) {
+    for (const auto & chart : nodes) {
+      std::vector<int> topologies{chart.id};
+      if (producer.id != chart.id) {
+        topologies.push_back(producer.id);
+      }
+      for (auto topology : topologies) {
+        auto r = measure(producer.id, chart.id, topology, events);
+        std::printf(
+          "%8d %8d %8d %10.2f %10.2f %10.2f\n", producer.id, chart.id, topology,
+          r.p50, r.p99, r.max);
+      }
+    }
+  }
+  return 0;
+}
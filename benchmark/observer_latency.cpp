@@ -0,0 +1,91 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include "mogi_statechart/channel.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::OverflowPolicy;
+using mogi::statechart::StateChangeRecord;
+
+/* Time per state change of a chart flipping between two states, observed
+ * by a slow subscriber (about 20 us per notification): first through a state
+ * change callback, run by the chart, then through a StateChangeChannel
+ * drained by the subscriber's own thread.
+ *
+ * usage: observer_latency [steps]
+ */
+using Clock = std::chrono::steady_clock;
+
+std::shared_ptr<Chart> flipFlop()
+{
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b);
+  b->createTransition(a);
+  return chart;
+}
+
+void slowSubscriber()
+{
+  auto until = Clock::now() + std::chrono::microseconds(20);
+  while (Clock::now() < until) {
+  }
+}
+
+double nsPerStep(const std::shared_ptr<Chart> & chart, int steps)
+{
+  auto start = Clock::now();
+  for (int i = 0; i < steps; ++i) {
+    chart->spinOnce();
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / steps;
+}
+
+int main(int argc, char ** argv)
+{
+  int steps = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+  auto chart = flipFlop();
+  chart->createStateChangeCallback([](const std::string &) {slowSubscriber();});
+  std::cout << "callback " << nsPerStep(chart, steps) << " ns/step" << std::endl;
+
+  chart = flipFlop();
+  auto channel = chart->createStateChangeChannel(4096, OverflowPolicy::DropOldest);
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> consumed{0};
+  std::thread subscriber{[&]() {
+      StateChangeRecord record;
+      while (!done) {
+        if (channel->receive(record, std::chrono::milliseconds(10))) {
+          slowSubscriber();
+          consumed++;
+        }
+      }
+    }};
+  std::cout << "channel  " << nsPerStep(chart, steps) << " ns/step";
+  done = true;
+  subscriber.join();
+  std::cout << ", " << consumed.load() << " records consumed, " <<
+    channel->droppedCount() << " dropped" << std::endl;
+  return 0;
+}
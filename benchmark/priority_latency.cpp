@@ -0,0 +1,103 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventPriority;
+
+/* Latency of a high priority event posted to a running chart while its low
+ * priority queue is saturated with telemetry.
+ *
+ * Before each sample the low priority queue (1024 events) is topped up, then
+ * the stop event is posted: once at the same priority as the telemetry, i.e.
+ * one FIFO, and once as Critical.
+ *
+ * usage: priority_latency [samples]
+ */
+using Clock = std::chrono::steady_clock;
+
+void report(const char * label, std::vector<double> & latencies)
+{
+  std::sort(latencies.begin(), latencies.end());
+  auto at = [&latencies](double q) {
+      return latencies[static_cast<size_t>(q * (latencies.size() - 1))];
+    };
+  std::cout << "  " << label << " p50 " << at(0.5) << " us, p99 " << at(0.99) <<
+    " us, max " << latencies.back() << " us" << std::endl;
+}
+
+std::vector<double> run(int samples, EventPriority stopPriority)
+{
+  Event telemetry{"telemetry"}, stop{"stop"};
+  auto chart = Chart::createChart("chart");
+  auto running = chart->createState("running");
+  chart->getInitialState()->createTransition(running);
+
+  std::atomic<int64_t> postedAt{0};
+  std::atomic<bool> seen{false};
+  std::vector<double> latencies;
+  latencies.reserve(samples);
+  long telemetryCount = 0;
+  running->createEventCallback(telemetry, [&telemetryCount](const Event &) {telemetryCount++;});
+  running->createEventCallback(
+    stop, [&postedAt, &seen, &latencies](const Event &) {
+      auto now = Clock::now().time_since_epoch().count();
+      latencies.push_back((now - postedAt.load()) / 1000.0);
+      seen.store(true);
+    });
+  chart->spinAsync();
+  /* events posted before that would be delivered to the initial state */
+  while (!running->isActive()) {
+    std::this_thread::yield();
+  }
+
+  for (int i = 0; i < samples; ++i) {
+    /* make sure the low priority queue is full, whatever the scheduler did */
+    while (chart->post(telemetry, EventPriority::Low)) {
+    }
+    seen.store(false);
+    postedAt.store(Clock::now().time_since_epoch().count());
+    /* a full FIFO has to make room first, that is part of the latency */
+    while (!chart->post(stop, stopPriority)) {
+      std::this_thread::yield();
+    }
+    while (!seen.load()) {
+      std::this_thread::yield();
+    }
+  }
+  chart->stop();
+  return latencies;
+}
+
+int main(int argc, char ** argv)
+{
+  int samples = argc > 1 ? std::atoi(argv[1]) : 1000;
+  std::cout << "priority_latency: " << samples << " samples, saturating low priority load" <<
+    std::endl;
+  auto fifo = run(samples, EventPriority::Low);
+  report("same priority (FIFO)", fifo);
+  auto critical = run(samples, EventPriority::Critical);
+  report("critical            ", critical);
+  return 0;
+}
@@ -0,0 +1,286 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventPriority;
+
+/* Many producer threads hammering one running chart, 1, 2, 4... up to N of
+ * them, first with Event::trigger() then with Chart::post().
+ *
+ * The chart has a single state with one self transition per producer, on the
+ * producer's own event. Each producer sends its event, then waits for the
+ * chart to react before sending the next one. The transition's guard, only
+ * evaluated once the chart has seen the event, tells the producer which step
+ * consumed it, and the step counter when that step is over. Counted:
+ *  - lost: the event's transition was never taken, either because the chart
+ *    never consumed the event (waited for a second) or because it was merged
+ *  - merged, of the lost ones: the event was consumed by a step that took the
+ *    transition of another producer. Only one transition is taken per step
+ *    (see Chart::process()), so triggers of transitions of the same state
+ *    reaching the chart within one step lose all but one. Posted events are
+ *    delivered one per step and never merged
+ *  - duplicated: the transition was taken more often than its event was sent
+ *  - late: the chart consumed the event past the deadline
+ * Latencies are from sending the event to the chart consuming it, events/s
+ * include the producers noticing, which is bound by the scheduler once there
+ * are more threads than cores.
+ *
+ * Exits with 1 if an event was never consumed or duplicated, so that it can be
+ * run by a ThreadSanitizer build (-DMOGI_STATECHART_SANITIZER=thread) as a
+ * race check. Merged triggers are only reported: concurrent triggers of one
+ * state merge by design. --fail-on-merged counts them as failures too, e.g.
+ * to check that a chart is never fed faster than it steps. Exits with 2 on
+ * invalid arguments.
+ *
+ * usage: producer_stress [--fail-on-merged] [max producers] [events per producer]
+ *                        [deadline us]
+ */
+using Clock = std::chrono::steady_clock;
+
+enum class Mode {Trigger, Post};
+
+/* spinning producers would keep the chart from running on a machine with
+ * fewer cores than threads, past a few polls they sleep a little
+ */
+void backOff(int & polls)
+{
+  if (++polls < 64) {
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(10));
+  }
+}
+
+/* one per producer, padded so that their counters don't share a cache line
+ * (C++14 new ignores alignas beyond the default alignment)
+ */
+struct Producer
+{
+  char padding[64];
+  std::unique_ptr<Event> event;
+  std::atomic<uint64_t> taken{0};
+  std::atomic<uint64_t> consumed{0};
+  std::atomic<uint64_t> consumedAtStep{0};
+  std::atomic<int64_t> consumedAt{0};
+  uint64_t sent{0};
+  uint64_t merged{0};
+  uint64_t lost{0};
+  uint64_t late{0};
+  std::vector<double> latencies;
+};
+
+struct Result
+{
+  double eventsPerSecond{0};
+  std::vector<double> latencies;
+  uint64_t sent{0}, merged{0}, lost{0}, duplicated{0}, late{0};
+};
+
+Result run(Mode mode, int producerCount, int eventsPerProducer, double deadlineUs)
+{
+  auto chart = Chart::createChart("stress");
+  auto running = chart->createState("running");
+  chart->getInitialState()->createTransition(running);
+  chart->setEventQueueCapacity(static_cast<size_t>(producerCount) * 2);
+
+  /* transitions taken */
+  std::atomic<uint64_t> steps{0};
+  std::unique_ptr<Producer[]> producers{new Producer[producerCount]};
+  for (int p = 0; p < producerCount; ++p) {
+    auto & producer = producers[p];
+    producer.event.reset(new Event{"e" + std::to_string(p)});
+    producer.latencies.reserve(eventsPerProducer);
+    auto transition = running->createTransition(
+      running, [&producer, &steps]() {
+        producer.taken.fetch_add(1);
+        steps.fetch_add(1);
+      });
+    transition->addEvent(*producer.event);
+    transition->createGuard(
+      [&producer, &steps]() {
+        producer.consumedAt.store(Clock::now().time_since_epoch().count());
+        producer.consumedAtStep.store(steps.load());
+        producer.consumed.fetch_add(1);
+        return true;
+      });
+  }
+  chart->spinAsync();
+  while (!running->isActive()) {
+    std::this_thread::yield();
+  }
+
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producerCount; ++p) {
+    threads.emplace_back(
+      [&, p]() {
+        auto & producer = producers[p];
+        ready.fetch_add(1);
+        while (!go.load()) {
+          std::this_thread::yield();
+        }
+        for (int i = 0; i < eventsPerProducer; ++i) {
+          auto takenBefore = producer.taken.load();
+          auto consumedBefore = producer.consumed.load();
+          auto sentAt = Clock::now();
+          if (mode == Mode::Trigger) {
+            producer.event->trigger();
+          } else {
+            while (!chart->post(*producer.event, EventPriority::Normal)) {
+              std::this_thread::yield();
+            }
+          }
+          producer.sent++;
+          /* the step consuming the event takes a transition, ours or not */
+          auto giveUp = sentAt + std::chrono::seconds(1);
+          bool reacted = false;
+          int polls = 0;
+          while (!(reacted = producer.consumed.load() > consumedBefore) &&
+            Clock::now() < giveUp)
+          {
+            backOff(polls);
+          }
+          while (reacted && steps.load() <= producer.consumedAtStep.load()) {
+            backOff(polls);
+          }
+          if (!reacted) {
+            producer.lost++;
+            continue;
+          }
+          auto latency = (producer.consumedAt.load() - sentAt.time_since_epoch().count()) / 1000.0;
+          producer.latencies.push_back(latency);
+          producer.late += latency > deadlineUs;
+          if (producer.taken.load() == takenBefore) {
+            producer.merged++;
+            producer.lost++;
+          }
+        }
+      });
+  }
+  while (ready.load() < producerCount) {
+    std::this_thread::yield();
+  }
+  auto start = Clock::now();
+  go.store(true);
+  for (auto & t : threads) {
+    t.join();
+  }
+  auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  chart->stop();
+
+  Result result;
+  for (int p = 0; p < producerCount; ++p) {
+    auto & producer = producers[p];
+    result.sent += producer.sent;
+    result.merged += producer.merged;
+    result.lost += producer.lost;
+    result.late += producer.late;
+    auto taken = producer.taken.load();
+    result.duplicated += taken > producer.sent ? taken - producer.sent : 0;
+    result.latencies.insert(
+      result.latencies.end(), producer.latencies.begin(), producer.latencies.end());
+  }
+  result.eventsPerSecond = result.sent / elapsed;
+  std::sort(result.latencies.begin(), result.latencies.end());
+  return result;
+}
+
+void report(const char * label, int producerCount, const Result & r)
+{
+  auto at = [&r](double q) {
+      return r.latencies.empty() ? 0.0 :
+             r.latencies[static_cast<size_t>(q * (r.latencies.size() - 1))];
+    };
+  std::cout << std::setw(8) << label << std::setw(10) << producerCount <<
+    std::setw(12) << static_cast<uint64_t>(r.eventsPerSecond) <<
+    std::setw(10) << at(0.5) << std::setw(10) << at(0.99) << std::setw(12) << at(1.0) <<
+    std::setw(6) << r.lost << std::setw(8) << r.merged << std::setw(6) << r.duplicated <<
+    std::setw(6) << r.late << std::endl;
+}
+
+/* a positive number making up the whole argument, 0 otherwise */
+double positive(const char * arg)
+{
+  char * end;
+  auto value = std::strtod(arg, &end);
+  return end != arg && *end == '\0' && value > 0 ? value : 0;
+}
+
+int main(int argc, char ** argv)
+{
+  const char * usage =
+    "usage: producer_stress [--fail-on-merged] [max producers] [events per producer] "
+    "[deadline us]";
+  bool failOnMerged = false;
+  std::vector<double> numbers{32, 1000, 10000};
+  size_t given = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+      std::cout << usage << std::endl;
+      return 0;
+    }
+    if (std::strcmp(argv[i], "--fail-on-merged") == 0) {
+      failOnMerged = true;
+      continue;
+    }
+    auto value = positive(argv[i]);
+    /* counts are whole numbers, the deadline needs not be */
+    if (given == numbers.size() || value == 0 ||
+      (given < 2 && (std::floor(value) != value || value > 1e6)))
+    {
+      std::cerr << "producer_stress: invalid argument '" << argv[i] << "'\n" << usage <<
+        std::endl;
+      return 2;
+    }
+    numbers[given++] = value;
+  }
+  int maxProducers = static_cast<int>(numbers[0]);
+  int eventsPerProducer = static_cast<int>(numbers[1]);
+  double deadlineUs = numbers[2];
+  std::cout << "producer_stress: up to " << maxProducers << " producers, " <<
+    eventsPerProducer << " events each, late past " << deadlineUs << " us" << std::endl;
+  std::cout << std::fixed << std::setprecision(1) << std::setw(8) << "mode" <<
+    std::setw(10) << "producers" << std::setw(12) << "events/s" << std::setw(10) << "p50 us" <<
+    std::setw(10) << "p99 us" << std::setw(12) << "max us" << std::setw(6) << "lost" <<
+    std::setw(8) << "merged" << std::setw(6) << "dup" << std::setw(6) << "late" << std::endl;
+
+  bool failed = false;
+  for (auto mode : {Mode::Trigger, Mode::Post}) {
+    for (int n = 1; n <= maxProducers; n *= 2) {
+      auto result = run(mode, n, eventsPerProducer, deadlineUs);
+      report(mode == Mode::Trigger ? "trigger" : "post", n, result);
+      auto lost = result.lost - (failOnMerged ? 0 : result.merged);
+      failed |= lost > 0 || result.duplicated > 0;
+    }
+  }
+  return failed ? 1 : 0;
+}
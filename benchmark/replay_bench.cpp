@@ -0,0 +1,108 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include "mogi_statechart/recorder.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventLog;
+using mogi::statechart::EventRecorder;
+using mogi::statechart::EventReplayer;
+
+/* Replays an event log as fast as possible.
+ *
+ * Without a log file, a synthetic one is recorded first: a ring of 8 states
+ * driven by the `next` event. Recording overhead is reported as well.
+ *
+ * usage: replay_bench [events]
+ */
+std::shared_ptr<Chart> makeRing(Event & next)
+{
+  auto chart = Chart::createChart("ring");
+  std::shared_ptr<mogi::statechart::AbstractState> first, previous;
+  for (int i = 0; i < 8; ++i) {
+    auto s = chart->createState("s" + std::to_string(i));
+    if (previous) {
+      previous->createTransition(s)->addEvent(next);
+    } else {
+      chart->getInitialState()->createTransition(s);
+      first = s;
+    }
+    previous = s;
+  }
+  previous->createTransition(first)->addEvent(next);
+  return chart;
+}
+
+double run(long events, Event & next, const std::shared_ptr<Chart> & chart)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < events; ++i) {
+    next.trigger();
+    chart->spinOnce();
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv)
+{
+  long events = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+  Event plainNext{"next"};
+  auto plain = makeRing(plainNext);
+  plain->spinToState("s0");
+  double plainTime = run(events, plainNext, plain);
+
+  Event next{"next"};
+  auto chart = makeRing(next);
+  std::ostringstream out;
+  double recordTime;
+  {
+    EventRecorder recorder{out};
+    recorder.watch(next);
+    recorder.watch(chart);
+    chart->spinToState("s0");
+    recordTime = run(events, next, chart);
+  }
+  auto data = out.str();
+
+  std::istringstream in{data};
+  auto parseStart = std::chrono::steady_clock::now();
+  EventReplayer replayer{EventLog::read(in)};
+  double parseTime = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - parseStart).count();
+
+  Event replayNext{"next"};
+  replayer.bind("next", replayNext);
+  auto result = replayer.replay(makeRing(replayNext));
+  double replayTime = std::chrono::duration<double>(result.elapsed).count();
+
+  std::cout << "replay_bench: " << events << " events, " <<
+    replayer.log().records.size() << " records, " << data.size() / 1024 << " KiB log (" <<
+    static_cast<double>(data.size()) / replayer.log().records.size() << " bytes/record)" <<
+    std::endl;
+  std::cout << "  unrecorded   " << events / plainTime << " events/s" << std::endl;
+  std::cout << "  recording    " << events / recordTime << " events/s" << std::endl;
+  std::cout << "  log parse    " << replayer.log().records.size() / parseTime <<
+    " records/s" << std::endl;
+  std::cout << "  replay       " << result.events / replayTime << " events/s, " <<
+    (result.divergedAt < 0 ? "no divergence" : "DIVERGED") << std::endl;
+  return result.divergedAt < 0 ? 0 : 1;
+}
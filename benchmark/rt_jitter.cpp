@@ -0,0 +1,133 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::RealTimeOptions;
+
+/* Wake up latency of a chart stepped at a fixed rate by Chart::spinAsync():
+ * a ring of 8 states, half moving on a guard and half on an event triggered
+ * by another thread, locked and run with a period. Every step stamps the
+ * time its do-callback ran, the lateness of step k is that time minus the
+ * k-th deadline, and the duration of the step is the time to the next
+ * do-callback minus the period.
+ *
+ * Asks for SCHED_FIFO, locked memory and a prefaulted stack, and falls back
+ * to the default policy when not permitted (e.g. no CAP_SYS_NICE).
+ *
+ * usage: rt_jitter [steps=5000] [period us=1000] [priority=80] [cpu=-1]
+ */
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char ** argv)
+{
+  const size_t steps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 5000;
+  const auto period = std::chrono::microseconds(argc > 2 ? std::atoi(argv[2]) : 1000);
+  const int priority = argc > 3 ? std::atoi(argv[3]) : 80;
+  const int cpu = argc > 4 ? std::atoi(argv[4]) : -1;
+
+  auto chart = Chart::createChart("jitter");
+  Event tick{"tick"};
+  std::vector<Clock::time_point> stamps(steps);
+  std::atomic<size_t> count{0};
+  std::vector<std::shared_ptr<mogi::statechart::State>> states;
+  for (int i = 0; i < 8; ++i) {
+    states.push_back(chart->createState("s" + std::to_string(i)));
+  }
+  chart->getInitialState()->createTransition(states[0]);
+  for (size_t i = 0; i < states.size(); ++i) {
+    auto transition = states[i]->createTransition(states[(i + 1) % states.size()]);
+    if (i % 2) {
+      transition->addEvent(tick);
+    } else {
+      transition->createGuard([]() {return true;});
+    }
+    states[i]->setCallbackDo(
+      [&stamps, &count]() {
+        auto k = count.load(std::memory_order_relaxed);
+        if (k < stamps.size()) {
+          stamps[k] = Clock::now();
+          count.store(k + 1, std::memory_order_release);
+        }
+      });
+  }
+  chart->lock();
+
+  RealTimeOptions options;
+  options.priority = priority;
+  options.lockMemory = true;
+  options.prefaultStack = 256 * 1024;
+  options.period = period;
+  if (cpu >= 0) {
+    options.cpus.push_back(cpu);
+  }
+  std::string policy = priority ? "SCHED_FIFO " + std::to_string(priority) : "SCHED_OTHER";
+  try {
+    chart->spinAsync(options);
+  } catch (const std::runtime_error & e) {
+    std::cerr << e.what() << ", falling back to the default policy" << std::endl;
+    options.priority = 0;
+    options.lockMemory = false;
+    policy = "SCHED_OTHER";
+    chart->spinAsync(options);
+  }
+
+  while (count.load(std::memory_order_acquire) < steps) {
+    tick.trigger();
+    std::this_thread::sleep_for(period / 3);
+  }
+  chart->stop();
+
+  /* deadlines are counted from the first stamped step */
+  std::vector<double> lateness(steps);
+  std::vector<double> duration(steps - 1);
+  for (size_t k = 0; k < steps; ++k) {
+    lateness[k] = std::chrono::duration<double, std::micro>(
+      stamps[k] - (stamps[0] + static_cast<int64_t>(k) * period)).count();
+    if (k + 1 < steps) {
+      duration[k] = std::chrono::duration<double, std::micro>(
+        stamps[k + 1] - stamps[k] - period).count();
+    }
+  }
+  auto worst = *std::max_element(lateness.begin(), lateness.end());
+  auto worstStep = *std::max_element(duration.begin(), duration.end());
+  std::sort(lateness.begin(), lateness.end());
+  auto at = [&lateness](double q) {
+      return lateness[static_cast<size_t>(q * (lateness.size() - 1))];
+    };
+
+  std::printf(
+    "%s, period %lld us, %zu steps\n", policy.c_str(),
+    static_cast<long long>(period.count()), steps);
+  std::printf("%12s %10s %10s %10s %12s\n", "lateness us", "p50", "p99", "p99.9", "max");
+  std::printf(
+    "%12s %10.1f %10.1f %10.1f %12.1f\n", "", at(0.5), at(0.99), at(0.999), worst);
+  std::printf("worst step overran the period by %.1f us\n", worstStep);
+  return 0;
+}
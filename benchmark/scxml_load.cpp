@@ -0,0 +1,115 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "mogi_statechart/scxml.hpp"
+
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::ScxmlRegistry;
+
+/* Measures the time to import a generated SCXML document.
+ *
+ * The document is a ring of N states grouped into subcharts of 100 states,
+ * every state has an entry action and a guarded, event driven transition to
+ * its successor.
+ *
+ * usage: scxml_load [states] [repetitions]
+ *        scxml_load --check
+ *
+ * --check loads 2500 then 10000 states and fails unless the time per state
+ * stays within 2.5x, i.e. loading is linear (a quadratic load makes it 4x)
+ */
+std::string generate(int states)
+{
+  const int groupSize = 100;
+  std::ostringstream doc;
+  doc << "<scxml name='bench' initial='g0'>\n";
+  int groups = (states + groupSize - 1) / groupSize;
+  for (int g = 0; g < groups; ++g) {
+    doc << " <state id='g" << g << "'>\n";
+    doc << "  <transition event='leave' target='g" << (g + 1) % groups << "'/>\n";
+    for (int i = 0; i < groupSize && g * groupSize + i < states; ++i) {
+      doc << "  <state id='s" << i << "'>\n" <<
+        "   <onentry><script>count</script></onentry>\n" <<
+        "   <transition event='next' cond='always' target='s" <<
+        (i + 1) % groupSize << "'/>\n" <<
+        "  </state>\n";
+    }
+    doc << " </state>\n";
+  }
+  doc << "</scxml>\n";
+  return doc.str();
+}
+
+/* best load time in ms */
+double load(const std::string & doc, int repetitions, double * mean = nullptr)
+{
+  ScxmlRegistry registry;
+  int counter{0};
+  registry.registerAction("count", [&counter]() {counter++;});
+  registry.registerGuard("always", []() {return true;});
+
+  double best = 1e300, total = 0;
+  for (int r = 0; r < repetitions; ++r) {
+    ScxmlLoader loader{registry};
+    auto start = std::chrono::steady_clock::now();
+    auto chart = loader.loadString(doc);
+    auto elapsed = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, elapsed);
+    total += elapsed;
+  }
+  if (mean) {
+    *mean = total / repetitions;
+  }
+  return best;
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc > 1 && std::string{argv[1]} == "--check") {
+    const int small = 2500, large = 10000;
+    auto perSmall = load(generate(small), 5) / small;
+    auto perLarge = load(generate(large), 5) / large;
+    std::cout << "scxml_load: " << perSmall * 1e3 << " us/state at " << small << " states, " <<
+      perLarge * 1e3 << " us/state at " << large << " states" << std::endl;
+    if (perLarge > 2.5 * perSmall) {
+      std::cout << "  FAILED: load time grows faster than the number of states" << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  int states = argc > 1 ? std::atoi(argv[1]) : 10000;
+  int repetitions = argc > 2 ? std::atoi(argv[2]) : 20;
+  if (states <= 0 || repetitions <= 0) {
+    std::cerr << "usage: scxml_load [states] [repetitions] | --check" << std::endl;
+    return 1;
+  }
+
+  auto doc = generate(states);
+  double mean;
+  auto best = load(doc, repetitions, &mean);
+
+  std::cout << "scxml_load: " << states << " states, " << doc.size() / 1024 <<
+    " KiB document" << std::endl;
+  std::cout << "  best " << best << " ms, mean " << mean <<
+    " ms over " << repetitions << " runs" << std::endl;
+  return 0;
+}
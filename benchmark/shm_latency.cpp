@@ -0,0 +1,175 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/shm_transport.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::ShmEventReceiver;
+using mogi::statechart::ShmEventSender;
+
+/* Event to transition latency between two processes: a child process sends
+ * timestamped events to a running chart flipping between two states, first
+ * over a unix socket read by a thread posting to the chart, then through a
+ * ShmEventReceiver ring. Latency is measured in the transition action.
+ *
+ * usage: shm_latency [events]
+ *
+ * Needs a core for the polling thread besides the chart and the sender, the
+ * ring loses to the socket otherwise.
+ */
+using Clock = std::chrono::steady_clock;
+
+const uint32_t pingId = 1;
+
+uint64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    Clock::now().time_since_epoch()).count();
+}
+
+struct Bench
+{
+  Event ping{"ping"};
+  std::atomic<uint64_t> sentAt{0};
+  std::vector<uint64_t> latencies;
+  std::shared_ptr<Chart> chart;
+
+  explicit Bench(int events)
+  {
+    latencies.reserve(events);
+    chart = Chart::createChart("chart");
+    auto a = chart->createState("a");
+    auto b = chart->createState("b");
+    auto record = [this]() {latencies.push_back(nowNs() - sentAt.load());};
+    chart->getInitialState()->createTransition(a);
+    a->createTransition(b, record)->addEvent(ping);
+    b->createTransition(a, record)->addEvent(ping);
+  }
+
+  void waitFor(size_t count)
+  {
+    auto deadline = Clock::now() + std::chrono::seconds(10);
+    while (latencies.size() < count && Clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void report(const std::string & name)
+  {
+    chart->stop();
+    if (latencies.empty()) {
+      std::cout << name << ": nothing received" << std::endl;
+      return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [this](double q) {
+        return latencies[static_cast<size_t>(q * (latencies.size() - 1))] / 1000.0;
+      };
+    std::cout << name << ": " << latencies.size() << " events, p50 " << at(0.5) <<
+      " us, p99 " << at(0.99) << " us, max " << at(1.0) << " us" << std::endl;
+  }
+};
+
+/* the child paces its sends so that latency is not queueing */
+template<typename SendT>
+void sendPaced(int events, SendT send)
+{
+  for (int i = 0; i < events; ++i) {
+    auto until = Clock::now() + std::chrono::microseconds(50);
+    while (Clock::now() < until) {
+    }
+    send(nowNs());
+  }
+}
+
+void socketRun(int events)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    std::cerr << "socketpair failed" << std::endl;
+    return;
+  }
+  pid_t child = fork();
+  if (child == 0) {
+    close(fds[0]);
+    sendPaced(
+      events, [&fds](uint64_t t) {
+        if (write(fds[1], &t, sizeof(t)) != sizeof(t)) {
+          _exit(1);
+        }
+      });
+    _exit(0);
+  }
+  close(fds[1]);
+  Bench bench{events};
+  bench.chart->spinAsync();
+  std::thread reader{[&]() {
+      uint64_t t;
+      while (read(fds[0], &t, sizeof(t)) == sizeof(t)) {
+        bench.sentAt.store(t);
+        bench.chart->post(bench.ping);
+      }
+    }};
+  bench.waitFor(events);
+  waitpid(child, nullptr, 0);
+  reader.join();
+  close(fds[0]);
+  bench.report("socket");
+}
+
+void shmRun(int events)
+{
+  Bench bench{events};
+  ShmEventReceiver receiver{"/mogi_statechart_shm_latency", bench.chart};
+  receiver.bind(
+    pingId, bench.ping, [&bench](const void * data, size_t) {
+      bench.sentAt.store(*static_cast<const uint64_t *>(data));
+    });
+  pid_t child = fork();
+  if (child == 0) {
+    ShmEventSender sender{receiver.name()};
+    sendPaced(events, [&sender](uint64_t t) {sender.sendValue(pingId, t);});
+    _exit(0);
+  }
+  bench.chart->spinAsync();
+  receiver.start();
+  bench.waitFor(events);
+  waitpid(child, nullptr, 0);
+  receiver.stop();
+  bench.report("shm   ");
+}
+
+int main(int argc, char ** argv)
+{
+  int events = argc > 1 ? std::atoi(argv[1]) : 20000;
+  socketRun(events);
+  shmRun(events);
+  return 0;
+}
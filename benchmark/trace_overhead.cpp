@@ -0,0 +1,80 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/trace.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::Tracer;
+
+/* Cost of tracing a chart toggling between two states of a subchart on
+ * every step, each transition guarded: stepped with tracing stopped and
+ * with tracing into a file. Run it from a build with and one without
+ * MOGI_STATECHART_TRACING, the stopped row of the latter is the baseline.
+ *
+ * usage: trace_overhead [steps=1000000] [file=/tmp/mogi_statechart_trace.json]
+ */
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+void measure(const char * name, Chart & chart, Event & flip, size_t steps)
+{
+  auto start = Clock::now();
+  for (size_t i = 0; i < steps; ++i) {
+    flip.trigger();
+    chart.spinOnce();
+  }
+  auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+  std::printf("%-20s %12.1f\n", name, ns / steps);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t steps = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+  const std::string file = argc > 2 ? argv[2] : "/tmp/mogi_statechart_trace.json";
+
+  auto chart = Chart::createChart("top");
+  auto sub = Chart::createChart("sub");
+  auto a = sub->createState("a");
+  auto b = sub->createState("b");
+  Event flip{"flip"};
+  sub->getInitialState()->createTransition(a);
+  auto ab = a->createTransition(b);
+  ab->addEvent(flip);
+  ab->createGuard([]() {return true;});
+  auto ba = b->createTransition(a);
+  ba->addEvent(flip);
+  ba->createGuard([]() {return true;});
+  chart->addSubchart(sub);
+  chart->getInitialState()->createTransition(sub);
+  chart->lock();
+
+  std::printf("trace points %s\n", Tracer::isCompiledIn() ? "compiled in" : "compiled out");
+  std::printf("%-20s %12s\n", "tracing", "ns/step");
+  measure("stopped", *chart, flip, steps);
+  Tracer::start(file);
+  measure("started", *chart, flip, steps / 10);
+  Tracer::stop();
+  return 0;
+}
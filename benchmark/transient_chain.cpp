@@ -0,0 +1,88 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+
+/* Startup of a locked chart through a chain of transient states: initial,
+ * then length pseudo-states each with a single unconditional transition,
+ * then a state waiting for an event. Measures the steps and the time
+ * runToQuiescence() takes to get there from a restart, stepping one
+ * transition per step or collapsing the chain, with the entry, do and exit
+ * callbacks and the transition actions left unset (skipped by the chart) or
+ * set to empty lambdas. A chart stepped by spinAsync() with a period spends
+ * that many periods to get there.
+ *
+ * usage: transient_chain [length=16] [runs=100000]
+ */
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+void measure(const char * name, size_t length, size_t runs, bool collapse, bool callbacks)
+{
+  auto chart = Chart::createChart("chain");
+  Event go{"go"};
+  auto previous = chart->getInitialState();
+  for (size_t i = 0; i < length; ++i) {
+    auto p = chart->createState("p" + std::to_string(i));
+    if (callbacks) {
+      p->setCallbackEntry([]() {});
+      p->setCallbackDo([]() {});
+      p->setCallbackExit([]() {});
+      previous->createTransition(p, []() {});
+    } else {
+      previous->createTransition(p);
+    }
+    previous = p;
+  }
+  auto waiting = chart->createState("waiting");
+  previous->createTransition(waiting);
+  waiting->createTransition(chart->getFinalState())->addEvent(go);
+  chart->setCollapseTransients(collapse);
+  chart->lock();
+
+  size_t steps = 0;
+  auto start = Clock::now();
+  for (size_t i = 0; i < runs; ++i) {
+    chart->reset();
+    steps = chart->runToQuiescence();
+  }
+  auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / runs;
+  std::printf("%-34s %8zu %12.1f\n", name, steps, ns);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t length = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+  const size_t runs = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+
+  std::printf("%-34s %8s %12s\n", "stepping", "steps", "ns to settle");
+  measure("per transition, empty callbacks", length, runs, false, true);
+  measure("per transition, unset callbacks", length, runs, false, false);
+  measure("collapsed, empty callbacks", length, runs, true, true);
+  measure("collapsed, unset callbacks", length, runs, true, false);
+  return 0;
+}
@@ -0,0 +1,114 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+
+/* Time from entering a state to a waiting thread noticing it, and CPU
+ * time the waiter burnt meanwhile: Chart::waitForState() against polling
+ * getCurrentStateName() with a 1 ms sleep. Two states toggled by an event,
+ * the entry of each one stamps the time.
+ *
+ * usage: wait_latency [rounds=2000]
+ */
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+
+double cpuSeconds()
+{
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+template<typename WaitT>
+void measure(const char * name, size_t rounds, WaitT wait)
+{
+  auto chart = Chart::createChart("toggle");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event flip{"flip"};
+  std::atomic<int64_t> entered{0};
+  auto stamp = [&entered]() {
+      entered.store(Clock::now().time_since_epoch().count());
+    };
+  a->setCallbackEntry(stamp);
+  b->setCallbackEntry(stamp);
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(flip);
+  b->createTransition(a)->addEvent(flip);
+  chart->spinAsync();
+  chart->waitForState(*a, std::chrono::seconds(5));
+
+  std::vector<double> latencies;
+  latencies.reserve(rounds);
+  double cpu = 0;
+  for (size_t i = 0; i < rounds; ++i) {
+    auto & next = i % 2 ? *a : *b;
+    std::thread waiter{[&]() {
+        auto start = cpuSeconds();
+        wait(*chart, next);
+        auto woke = Clock::now().time_since_epoch().count();
+        cpu += cpuSeconds() - start;
+        latencies.push_back((woke - entered.load()) / 1000.0);
+      }};
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    flip.trigger();
+    waiter.join();
+  }
+  chart->stop();
+
+  std::sort(latencies.begin(), latencies.end());
+  std::printf(
+    "%-22s %10.1f %10.1f %10.1f %12.1f\n", name, latencies[latencies.size() / 2],
+    latencies[latencies.size() * 99 / 100], latencies.back(), cpu / rounds * 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  const size_t rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+
+  std::printf(
+    "%-22s %10s %10s %10s %12s\n", "waiting by", "p50 us", "p99 us", "max us",
+    "cpu us/wait");
+  measure(
+    "waitForState()", rounds,
+    [](Chart & chart, mogi::statechart::State & state) {
+      chart.waitForState(state, std::chrono::seconds(5));
+    });
+  measure(
+    "polling, 1 ms sleep", rounds,
+    [](Chart & chart, mogi::statechart::State & state) {
+      while (chart.getCurrentStateName() != state.name()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  return 0;
+}
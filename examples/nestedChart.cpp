@@ -32,6 +32,8 @@ using mogi::statechart::Event;
  * into {subchart} and an event (eFinish) on [tFinal] to indicate we should go to
  * the final state. Also an event (eAgain) on [tAgain] will grant the transition
  * to put us back to state1
+ * A completion transition [tDone] from {subchart} to final is taken as soon as
+ * {subchart} reaches its own final state.
  * We add one event (eSub) on the subchart as well.
  *
  * {chart} will look like the following
@@ -41,6 +43,8 @@ using mogi::statechart::Event;
  *        [tInit]         [tSub]      (eSub)     [tFinal]
  * initial -----> state1 --------->  {subchart}  -------> final
  *                 /\     <gReady>       |       (eFinish)
+ *                 |                     |  [tDone]
+ *                 |                     +---------> final
  *                 |                     |
  *                 |      [tAgain]       |
  *                 +---------------------+
@@ -67,7 +71,8 @@ using mogi::statechart::Event;
  * subchart again but with {subchart} running from its own initial, i.e.
  * {subchart} is reset upon each re-entry. On the other hand, if an event
  * of (eFinish) is trigger while we are in {subchart} state, we will
- * transit to the final state and finish off.
+ * transit to the final state and finish off. The same happens without any
+ * event once {subchart} itself reaches its final state.
  *
  */
 
@@ -206,6 +211,9 @@ int main(void)
   auto tAgain = subchart->createTransition(
     state1,
     []() {std::cout << "[tAgain]" << std::endl;});
+  subchart->createCompletionTransition(
+    chart->getFinalState(),
+    []() {std::cout << "[tDone]" << std::endl;});
 
   /* ==== add guards and events ==== */
   bool gReadyFlag{false};
@@ -270,27 +278,10 @@ int main(void)
   gReadyFlag = true;
   while (!subchart->getInitialState()->isActive()) {}
 
-  /* now we want to advance subchart to reach its final state, and we also
-   * want the main chart to move to final once the subchart hits its own
-   * final state. To do that, we can create yet another state observer for
-   * subchart and listens to its state change, upon entrying subchart's final
-   * this observer will trigger our event (eFinish) to move the main chart to
-   * its final
-   *
-   * Since we don't support dynamic reconfiguration (yet), we need to stop the
-   * chart before doing so (add stateChangeObserver) and restart thereafter
+  /* now we want to advance subchart to reach its final state, the main chart
+   * then moves to final through [tDone] within the same step
    */
 
-  std::cout << "------ setup tFinal hook ------" << std::endl;
-  chart->stop();
-  subchart->createStateChangeCallback(
-    [&eFinish](auto s) {
-      if (s == "final") {
-        eFinish.trigger();
-      }
-    });
-  chart->spinAsync();
-
   /* grant guard g1 and g2 in subchart */
   subChartControl.g1Flag = true;
   subChartControl.g2Flag = true;
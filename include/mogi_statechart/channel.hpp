@@ -0,0 +1,112 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__CHANNEL_HPP_
+#define MOGI_STATECHART__CHANNEL_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include "mogi_statechart/mpmc_queue.hpp"
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @struct StateChangeRecord
+ \brief A state change, as published to a StateChangeChannel. Names can be
+ looked up with Chart::stateName()
+ */
+struct StateChangeRecord
+{
+  /*! steady_clock time of the change */
+  std::chrono::steady_clock::time_point time;
+  /*! Configuration::step of the outmost chart */
+  uint64_t step{0};
+  /*! id() of the chart changing state */
+  uint32_t chart{0};
+  /*! id() of the new current state */
+  uint32_t state{0};
+};
+
+/*!
+ @class StateChangeChannel
+ \brief Lock-free queue of the state changes of a chart, for subscribers
+ consuming them on their own threads instead of in a state change callback
+ run by the chart. See Chart::createStateChangeChannel().
+
+ Only the chart publishes, any number of threads may receive. Unless the
+ policy is Block the chart never waits on subscribers, records not fitting
+ are dropped and counted. The chart only keeps a weak reference, dropping
+ the last shared_ptr unsubscribes.
+ */
+class MOGI_STATECHART_PUBLIC StateChangeChannel
+{
+  friend class Chart;
+
+public:
+  /*!
+   \brief Throws runtime_error for Coalesce, records are all different
+   */
+  StateChangeChannel(size_t capacity, OverflowPolicy policy)
+  : queue_(capacity), policy_(policy)
+  {
+    if (policy == OverflowPolicy::Coalesce) {
+      throw std::runtime_error("state change channels cannot coalesce");
+    }
+  }
+
+  /*!
+   \brief Takes the oldest record, false if there is none
+   */
+  bool tryReceive(StateChangeRecord & record) {return queue_.pop(record);}
+
+  /*!
+   \brief Takes the oldest record, polling for up to timeout if there is
+   none yet
+   @return false on timeout
+   */
+  bool receive(StateChangeRecord & record, std::chrono::nanoseconds timeout);
+
+  /*!
+   \brief Records discarded because the channel was full
+   */
+  uint64_t droppedCount() const {return dropped_.load(std::memory_order_relaxed);}
+
+  /*!
+   \brief Records waiting, approximate while the chart is publishing
+   */
+  size_t size() const {return queue_.size();}
+
+  OverflowPolicy policy() const {return policy_;}
+
+private:
+  void publish(const StateChangeRecord & record);
+
+  MpmcQueue<StateChangeRecord> queue_;
+  const OverflowPolicy policy_;
+  std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__CHANNEL_HPP_
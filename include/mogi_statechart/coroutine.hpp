@@ -0,0 +1,327 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOGI_STATECHART__COROUTINE_HPP_
+#define MOGI_STATECHART__COROUTINE_HPP_
+
+#if !defined(__cpp_impl_coroutine)
+#error "mogi_statechart/coroutine.hpp needs C++20 coroutines, build with -std=c++20"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "mogi_statechart/statechart.hpp"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ \brief Anything with a `bool ready()` member can be co_await-ed by a Task,
+ the chart polls it on every step and resumes the task once it returns true
+ */
+template<typename T>
+concept Pollable = requires(T t) {
+  {t.ready()} -> std::convertible_to<bool>;
+};
+
+/*!
+ @class Task
+ \brief Coroutine type of do-activities, see coroutineActivity().
+
+ A Task never runs on its own: it is stepped by the chart, from the chart's
+ thread, and only suspends on Pollable awaitables (nextStep(), sleepFor(),
+ waitFor(), waitUntil()...) or on another Task, which then runs as part of
+ this one. Every co_await gives the chart at least one step. Destroying a
+ suspended Task cancels it, unwinding its frame.
+ */
+class Task
+{
+  struct ChildAwaiter;
+
+public:
+  struct promise_type
+  {
+    Task get_return_object()
+    {
+      return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept {return {};}
+    std::suspend_always final_suspend() noexcept {return {};}
+    void return_void() {}
+    void unhandled_exception() {exception = std::current_exception();}
+
+    template<Pollable P>
+    auto await_transform(P && pollable)
+    {
+      return PollAwaiter<std::remove_cvref_t<P>>{std::forward<P>(pollable), this};
+    }
+
+    ChildAwaiter await_transform(Task && task);
+
+    /* what the coroutine is suspended on, a poll function or a child task */
+    bool (* poll)(void *) {nullptr};
+    void * pollArg {nullptr};
+    Task * child {nullptr};
+    std::exception_ptr exception;
+  };
+
+  Task(Task && other) noexcept
+  : handle_(std::exchange(other.handle_, {})) {}
+
+  Task & operator=(Task && other) noexcept
+  {
+    if (this != &other) {
+      destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task & operator=(const Task &) = delete;
+
+  ~Task() {destroy();}
+
+  bool done() const {return !handle_ || handle_.done();}
+
+  /*!
+   \brief Runs the task until it waits on something not ready yet.
+   Rethrows anything the task let escape
+   @return true once the task has completed
+   */
+  bool resume()
+  {
+    auto finished = step();
+    if (finished && handle_ && handle_.promise().exception) {
+      std::rethrow_exception(std::exchange(handle_.promise().exception, nullptr));
+    }
+    return finished;
+  }
+
+private:
+  template<typename P>
+  struct PollAwaiter
+  {
+    P pollable;
+    promise_type * promise;
+
+    bool await_ready() const noexcept {return false;}
+    void await_suspend(std::coroutine_handle<>) noexcept
+    {
+      promise->poll = [](void * self) -> bool {
+          return static_cast<bool>(static_cast<PollAwaiter *>(self)->pollable.ready());
+        };
+      promise->pollArg = this;
+    }
+    void await_resume() const noexcept {}
+  };
+
+  explicit Task(std::coroutine_handle<promise_type> handle)
+  : handle_(handle) {}
+
+  /* child tasks keep their exception for the parent's co_await */
+  bool step()
+  {
+    if (done()) {
+      return true;
+    }
+    auto & p = handle_.promise();
+    if (p.child) {
+      if (!p.child->step()) {
+        return false;
+      }
+      p.child = nullptr;
+    } else if (p.poll) {
+      if (!p.poll(p.pollArg)) {
+        return false;
+      }
+      p.poll = nullptr;
+    }
+    handle_.resume();
+    /* a task just awaited gets to run in the same step */
+    while (!handle_.done() && p.child) {
+      if (!p.child->step()) {
+        return false;
+      }
+      p.child = nullptr;
+      handle_.resume();
+    }
+    return handle_.done();
+  }
+
+  void destroy()
+  {
+    if (handle_) {
+      handle_.destroy();
+      handle_ = {};
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/* a Task holds its awaiters, so this one can only be defined past Task */
+struct Task::ChildAwaiter
+{
+  Task task;
+  promise_type * promise;
+
+  bool await_ready() const noexcept {return task.done();}
+  void await_suspend(std::coroutine_handle<>) noexcept {promise->child = &task;}
+  void await_resume()
+  {
+    if (task.handle_ && task.handle_.promise().exception) {
+      std::rethrow_exception(std::exchange(task.handle_.promise().exception, nullptr));
+    }
+  }
+};
+
+inline Task::ChildAwaiter Task::promise_type::await_transform(Task && task)
+{
+  return ChildAwaiter{std::move(task), this};
+}
+
+/*!
+ \brief Adapts a Task to the Activity interface
+ */
+class CoroutineActivity : public Activity
+{
+public:
+  explicit CoroutineActivity(Task task)
+  : task_(std::move(task)) {}
+
+  bool resume() override {return task_.resume();}
+
+private:
+  Task task_;
+};
+
+/*!
+ \brief Makes an activity factory for State::setActivity() out of a callable
+ returning a Task, called on every entry of the state:
+ \code
+ state->setActivity(coroutineActivity([&]() -> Task {
+   co_await sleepFor(std::chrono::milliseconds(10));
+   co_await waitFor(ready);
+ }));
+ \endcode
+ The callable is kept by the state, captures stay valid while the activity
+ runs.
+ */
+template<typename FuncT>
+std::function<std::unique_ptr<Activity>()> coroutineActivity(FuncT func)
+{
+  return [func = std::move(func)]() -> std::unique_ptr<Activity> {
+           return std::make_unique<CoroutineActivity>(func());
+         };
+}
+
+/*!
+ \brief Resumes on the next chart step
+ */
+struct NextStep
+{
+  bool ready() const {return true;}
+};
+inline NextStep nextStep() {return {};}
+
+/*!
+ \brief Resumes on the first chart step past deadline
+ */
+struct SleepUntil
+{
+  std::chrono::steady_clock::time_point deadline;
+  bool ready() const {return std::chrono::steady_clock::now() >= deadline;}
+};
+inline SleepUntil sleepUntil(std::chrono::steady_clock::time_point deadline) {return {deadline};}
+
+template<typename Rep, typename Period>
+SleepUntil sleepFor(std::chrono::duration<Rep, Period> duration)
+{
+  return {std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration)};
+}
+
+/*!
+ \brief Resumes on the first chart step where predicate holds
+ */
+template<typename PredicateT>
+struct WaitUntil
+{
+  PredicateT predicate;
+  bool ready() {return predicate();}
+};
+
+template<typename PredicateT>
+WaitUntil<PredicateT> waitUntil(PredicateT predicate) {return {std::move(predicate)};}
+
+/*!
+ \brief Resumes on the first chart step after event was triggered. The
+ subscription starts when waitFor() is called and ends with the wait, the
+ event must outlive it
+ */
+class WaitFor
+{
+public:
+  explicit WaitFor(Event & event)
+  : event_(&event), latch_(std::make_shared<Latch>())
+  {
+    event_->addObserver(latch_);
+  }
+
+  WaitFor(WaitFor && other) noexcept
+  : event_(std::exchange(other.event_, nullptr)), latch_(std::move(other.latch_)) {}
+
+  WaitFor(const WaitFor &) = delete;
+  WaitFor & operator=(const WaitFor &) = delete;
+  WaitFor & operator=(WaitFor &&) = delete;
+
+  ~WaitFor()
+  {
+    if (event_) {
+      event_->removeObserver(latch_);
+    }
+  }
+
+  bool ready() const {return latch_->triggered.load();}
+
+private:
+  class Latch : public EventObserver
+  {
+  public:
+    std::atomic<bool> triggered {false};
+
+  protected:
+    void notify(const Event &) override {triggered.store(true);}
+  };
+
+  Event * event_;
+  std::shared_ptr<Latch> latch_;
+};
+
+inline WaitFor waitFor(Event & event) {return WaitFor{event};}
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__COROUTINE_HPP_
@@ -0,0 +1,72 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOGI_STATECHART__DESCRIPTION_HPP_
+#define MOGI_STATECHART__DESCRIPTION_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ \brief Plain data description of a chart, as read from a chart definition
+ file. Behavior (actions, guards, events) is only referred to by name.
+
+ This is the common ground of the SCXML importer and the code generator, it
+ carries no runtime state and can be built by hand as well.
+ */
+struct TransitionDescription
+{
+  /*! Name of the destination state, must be in the same chart */
+  std::string target;
+  /*! Any of these events grants the transition */
+  std::vector<std::string> events;
+  /*! Guards, all of them must be satisfied */
+  std::vector<std::string> guards;
+  /*! Actions performed in order when the transition is taken */
+  std::vector<std::string> actions;
+};
+
+struct ChartDescription;
+
+struct StateDescription
+{
+  std::string name;
+  /*! A final state maps onto the auto-generated `final` state of the chart */
+  bool isFinal{false};
+  std::vector<std::string> entry;
+  std::vector<std::string> activity;
+  std::vector<std::string> exit;
+  std::vector<TransitionDescription> transitions;
+  /*! Set if this state is a subchart */
+  std::shared_ptr<ChartDescription> subchart;
+};
+
+struct ChartDescription
+{
+  std::string name;
+  /*! Target of the transition out of `initial`, empty for none */
+  std::string initial;
+  std::vector<StateDescription> states;
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__DESCRIPTION_HPP_
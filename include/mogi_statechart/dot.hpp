@@ -0,0 +1,82 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__DOT_HPP_
+#define MOGI_STATECHART__DOT_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @struct DotOptions
+ \brief What DotExporter writes besides the structure
+ */
+struct DotOptions
+{
+  /*! label transitions with their fires and mean action time, states with
+   * their visits and mean dwell time, and colour both from blue (idle) to
+   * red (the busiest one). Needs a chart that was Chart::setProfiling()
+   */
+  bool heatMap{false};
+};
+
+/*!
+ @class DotExporter
+ \brief Writes a chart as a Graphviz digraph: its states, subcharts as
+ clusters, transitions labelled with their events and guard count, the
+ active states in bold. In time linear in the size of the chart. Safe on a
+ running chart, which is read as it goes
+ \code
+ std::ofstream out{"chart.dot"};
+ DotExporter::write(out, *chart, DotOptions{true});   // dot -Tsvg chart.dot
+ \endcode
+ */
+class MOGI_STATECHART_PUBLIC DotExporter
+{
+public:
+  static void write(std::ostream & out, const Chart & chart, const DotOptions & options = {});
+
+  static std::string toString(const Chart & chart, const DotOptions & options = {});
+
+private:
+  /* busiest transition and state of the whole chart, the heat map scale */
+  struct Scale
+  {
+    uint64_t fires{0};
+    std::chrono::nanoseconds dwellTime{0};
+  };
+
+  static void measure(const Chart & chart, Scale & scale);
+  static void writeStates(
+    std::ostream & out, std::ostream & edges, const Chart & chart,
+    const DotOptions & options, const Scale & scale, const std::string & indent);
+  static void writeTransition(
+    std::ostream & edges, const Transition & transition, const AbstractState & src,
+    const DotOptions & options, const Scale & scale);
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__DOT_HPP_
@@ -0,0 +1,144 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__EVENT_BUS_HPP_
+#define MOGI_STATECHART__EVENT_BUS_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mogi_statechart/rcu.hpp"
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class EventBus
+ \brief Routes topics to the charts subscribed to them, for setups where
+ many charts share the same events.
+
+ A topic is a small integer naming an event, see topic(). publish() looks
+ the topic up and pushes the subscribed Event onto a lock-free inbox of each
+ subscribed chart, without pausing a chart; the chart then delivers it from
+ its own thread, to its active states only, one event per step after the
+ events it was post()-ed. Other observers of the Event (other charts,
+ recorders...) are not notified.
+
+ The routing table is read-mostly and replicated in one shard per core,
+ producers are spread over the shards so that concurrent publishers do not
+ share a cache line. Subscribing is slower, it updates every shard.
+ Snapshotting a shard's table is an atomic shared_ptr load, which libstdc++
+ guards with a small global lock table: publishers hardly contend on it,
+ but publish() is not lock-free.
+ */
+class MOGI_STATECHART_PUBLIC EventBus
+{
+public:
+  /*!
+   @param shards number of routing table replicas, one per hardware thread
+   if 0
+   @param inboxCapacity capacity of the inbox of each chart, allocated by its
+   first subscription to any bus
+   */
+  explicit EventBus(size_t shards = 0, size_t inboxCapacity = 1024);
+
+  EventBus(const EventBus &) = delete;
+  EventBus & operator=(const EventBus &) = delete;
+
+  /*!
+   \brief ID of the topic called name, created on first use
+   */
+  uint32_t topic(const std::string & name);
+
+  /*!
+   \brief Routes topic to chart (its outmost chart if a subchart), which then
+   delivers event to its active states
+   */
+  void subscribe(uint32_t topic, const std::shared_ptr<Chart> & chart, const Event & event);
+
+  /*!
+   \brief Subscribes chart, with its subcharts, to the topic named after each
+   event it has a transition, callback or deferral for, and to nothing else
+   @return number of events subscribed
+   */
+  size_t attach(const std::shared_ptr<Chart> & chart);
+
+  /*!
+   \brief Removes every route to chart
+   */
+  void detach(const std::shared_ptr<Chart> & chart);
+
+  /*!
+   \brief Routes topic to its subscribers, never waits for a full inbox nor
+   for a chart. Safe to call from any thread
+   @return false if the inbox of a subscriber was full, the event is dropped
+   for that chart
+   */
+  bool publish(uint32_t topic);
+
+  /*!
+   \brief Number of charts subscribed to topic
+   */
+  size_t subscriberCount(uint32_t topic) const;
+
+  /*!
+   \brief Deliveries dropped because an inbox was full
+   */
+  uint64_t droppedCount() const;
+
+  size_t shardCount() const {return shardCount_;}
+
+private:
+  struct Route
+  {
+    std::shared_ptr<MpmcQueue<const Event *>> inbox;
+    const Event * event;
+    const Chart * chart;
+  };
+  using RouteTableT = std::vector<std::vector<Route>>;
+
+  struct Shard
+  {
+    Rcu<RouteTableT> routes;
+    std::atomic<uint64_t> dropped{0};
+    /* keeps the next shard off this one's cache lines */
+    char pad[64];
+  };
+
+  size_t shardIndex() const;
+  template<typename ModifyT>
+  void updateRoutes(ModifyT && modify);
+
+  const size_t shardCount_;
+  const size_t inboxCapacity_;
+  std::unique_ptr<Shard[]> shards_;
+  /* serializes subscribers, guards topics_ */
+  std::mutex mutex_;
+  std::unordered_map<std::string, uint32_t> topics_;
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__EVENT_BUS_HPP_
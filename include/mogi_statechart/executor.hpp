@@ -0,0 +1,201 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__EXECUTOR_HPP_
+#define MOGI_STATECHART__EXECUTOR_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class Executor
+ \brief Runs the work of asynchronous actions, see asyncAction()
+ */
+class MOGI_STATECHART_PUBLIC Executor
+{
+public:
+  using TaskT = std::function<void ()>;
+
+  virtual ~Executor() = default;
+
+  /*!
+   \brief Schedules task, must not block the caller (the chart's thread) on
+   the task itself. task never throws
+   */
+  virtual void execute(TaskT task) = 0;
+};
+
+/*!
+ @class InlineExecutor
+ \brief Runs tasks right away in the calling thread, the action then behaves
+ like a synchronous one. Handy for tests and deterministic replays
+ */
+class MOGI_STATECHART_PUBLIC InlineExecutor : public Executor
+{
+public:
+  void execute(TaskT task) override {task();}
+};
+
+/*!
+ @class ThreadPoolExecutor
+ \brief Runs tasks on a fixed set of worker threads, in submission order.
+ The destructor finishes the queued tasks before joining the workers
+ */
+class MOGI_STATECHART_PUBLIC ThreadPoolExecutor : public Executor
+{
+public:
+  explicit ThreadPoolExecutor(size_t threads = 1);
+
+  /*!
+   \brief Same, each worker being set up by Placement::setUpThread(placement)
+   before taking tasks, e.g. to step a ChartFarm from the CPUs of one NUMA
+   node. Throws runtime_error if the system refuses a setting, other
+   exceptions of the set-up as they are, after joining the started workers
+   */
+  ThreadPoolExecutor(size_t threads, const RealTimeOptions & placement);
+  ~ThreadPoolExecutor();
+
+  ThreadPoolExecutor(const ThreadPoolExecutor &) = delete;
+  ThreadPoolExecutor & operator=(const ThreadPoolExecutor &) = delete;
+
+  void execute(TaskT task) override;
+
+  /*!
+   \brief Number of tasks queued or running
+   */
+  size_t pendingCount() const;
+
+private:
+  void run();
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<TaskT> tasks_;
+  size_t running_{0};
+  bool stopping_{false};
+  std::vector<std::thread> workers_;
+};
+
+/*!
+ \brief Makes an action running work on executor instead of the chart's
+ thread. The action returns as soon as work is scheduled and the chart goes
+ on processing other events and regions; when work returns, completion is
+ post()-ed to chart, and delivered from the chart's thread like any other
+ posted event:
+ \code
+ auto pool = std::make_shared<ThreadPoolExecutor>(2);
+ calibrating->setCallbackEntry(asyncAction(pool, chart, calibrated, writeCalibration));
+ calibrating->createTransition(ready)->addEvent(calibrated);
+ \endcode
+ If work throws, failure is posted instead, or completion when failure is
+ null, so that a chart waiting on the action never stalls. When the queue
+ of the event's priority is full the event is triggered from the executor's
+ thread instead of being dropped.
+
+ The completion is not tied to the visit of calibrating that started the
+ work: should the state be left and entered again meanwhile, it is taken by
+ the new visit. The overload taking a state discards it instead.
+
+ The action keeps the executor alive, it only holds a weak reference to the
+ chart: completions of a destroyed chart are discarded. The events must
+ outlive the action and any work in flight
+ */
+template<typename WorkT>
+std::function<void ()> asyncAction(
+  const std::shared_ptr<Executor> & executor,
+  const std::shared_ptr<Chart> & chart,
+  Event & completion, WorkT && work, Event * failure = nullptr)
+{
+  return asyncAction(executor, chart, nullptr, completion, std::forward<WorkT>(work), failure);
+}
+
+/*!
+ \brief Same as asyncAction() above, the completion being delivered only
+ during the AbstractState::visit() of state current when the action runs:
+ the visit that runs it as an entry, do or exit action, the next one for a
+ transition action into state. A completion arriving after state was left is
+ discarded, see Chart::post(Event &, const std::shared_ptr<AbstractState> &, uint64_t).
+ \code
+ calibrating->setCallbackEntry(
+   asyncAction(pool, chart, calibrating, calibrated, writeCalibration));
+ \endcode
+ Only a weak reference to state is held
+ */
+template<typename WorkT>
+std::function<void ()> asyncAction(
+  const std::shared_ptr<Executor> & executor,
+  const std::shared_ptr<Chart> & chart, const std::shared_ptr<AbstractState> & state,
+  Event & completion, WorkT && work, Event * failure = nullptr)
+{
+  std::weak_ptr<Chart> target = chart;
+  std::weak_ptr<AbstractState> visited = state;
+  bool bound = state != nullptr;
+  auto shared = std::make_shared<typename std::decay<WorkT>::type>(std::forward<WorkT>(work));
+  Event * done = &completion;
+  return [executor, target, visited, bound, shared, done, failure]() {
+           uint64_t visit = 0;
+           if (bound) {
+             auto s = visited.lock();
+             if (!s) {
+               return;
+             }
+             visit = s->visit();
+           }
+           executor->execute(
+             [target, visited, bound, visit, shared, done, failure]() {
+               Event * result = done;
+               try {
+                 (*shared)();
+               } catch (...) {
+                 if (failure) {
+                   result = failure;
+                 }
+               }
+               auto c = target.lock();
+               if (!c) {
+                 return;
+               }
+               if (!bound) {
+                 if (!c->post(*result)) {
+                   result->trigger();
+                 }
+                 return;
+               }
+               auto s = visited.lock();
+               if (s && !c->post(*result, s, visit) && s->visit() == visit) {
+                 result->trigger();
+               }
+             });
+         };
+}
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__EXECUTOR_HPP_
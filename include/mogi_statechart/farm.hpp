@@ -0,0 +1,222 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__FARM_HPP_
+#define MOGI_STATECHART__FARM_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mogi_statechart/description.hpp"
+#include "mogi_statechart/executor.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class ChartFarm
+ \brief Many instances of one flat chart, stepped in batches.
+
+ The topology is compiled once from a ChartDescription into flat tables,
+ each instance only owns its current state, its process phase and a bitmask
+ of pending events, stored as structure of arrays (11 bytes per instance).
+ step() advances every instance exactly like one Chart::spinOnce() would,
+ except that when several transitions are satisfied the last one in
+ document order wins (as in generated code).
+
+ Behavior is bound by name, with the instance index as argument. Guards
+ can also be data driven, i.e. a comparison of a per-instance column with a
+ constant: those are evaluated for a whole chunk of instances at once in
+ tight loops the compiler vectorizes, instead of one call per instance.
+
+ Subcharts are not supported, and a chart is limited to 64 events and
+ 65535 states. Instances are independent: with step(executor) chunks run in
+ parallel and bound callbacks are called concurrently for different
+ instances. Nothing else may touch the farm while it steps.
+ */
+class MOGI_STATECHART_PUBLIC ChartFarm
+{
+public:
+  using ActionT = std::function<void (size_t instance)>;
+  using GuardT = std::function<bool (size_t instance)>;
+
+  enum class Comparison {Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual};
+
+  /*!
+   \brief Compiles description, throws runtime_error if it can't be farmed
+   */
+  ChartFarm(const ChartDescription & description, size_t instances);
+
+  size_t size() const {return state_.size();}
+
+  /*!
+   \brief Binds every use of an action, in entry/do/exit lists or on a
+   transition
+   */
+  void bindAction(const std::string & name, ActionT action);
+
+  /*!
+   \brief Binds a guard to a callback, called once per instance
+   */
+  void bindGuard(const std::string & name, GuardT guard);
+
+  /*!
+   \brief Binds a guard to `values[instance] <comparison> threshold`.
+   values must hold size() floats and outlive the farm, it is read on
+   every step
+   */
+  void bindGuard(
+    const std::string & name, const float * values,
+    Comparison comparison, float threshold);
+
+  /*!
+   \brief Binds a guard to `flags[instance] != 0`, same requirements as
+   above
+   */
+  void bindGuard(const std::string & name, const uint8_t * flags);
+
+  /*!
+   \brief Index of a state, "initial" and "final" included, -1 if unknown
+   */
+  int stateIndex(const std::string & name) const;
+  const std::string & stateName(size_t state) const {return stateNames_.at(state);}
+  size_t stateCount() const {return stateNames_.size();}
+
+  /*!
+   \brief Index of an event, -1 if no transition listens to it
+   */
+  int eventIndex(const std::string & name) const;
+
+  /*!
+   \brief Raises an event for one instance, consumed by its next step.
+   Throws runtime_error if event is not an eventIndex(), -1 included
+   */
+  void trigger(size_t instance, int event) {events_[instance] |= eventBit(event);}
+
+  /*!
+   \brief Raises an event for every instance, throws like trigger()
+   */
+  void triggerAll(int event);
+
+  /*!
+   \brief Advances every instance by one step, in the calling thread
+   */
+  void step();
+
+  /*!
+   \brief Advances every instance by one step, chunks of chunkSize instances
+   run on executor, returns once all of them are done
+   */
+  void step(Executor & executor, size_t chunkSize = 16384);
+
+  /*!
+   \brief Current state of an instance
+   */
+  uint16_t currentState(size_t instance) const {return state_[instance];}
+
+  /*!
+   \brief Number of instances whose current state is state
+   */
+  size_t countInState(size_t state) const;
+
+  /*!
+   \brief Puts every instance back to its initial state, nothing pending
+   */
+  void reset();
+
+private:
+  struct DataGuard
+  {
+    const float * values{nullptr};
+    const uint8_t * flags{nullptr};
+    Comparison comparison{Comparison::Equal};
+    float threshold{0};
+  };
+
+  /* per guard name: a callback or a data guard, one of them */
+  struct GuardSlot
+  {
+    std::string name;
+    GuardT callback;
+    DataGuard data;
+  };
+
+  struct ActionSlot
+  {
+    std::string name;
+    ActionT callback;
+  };
+
+  /* index ranges into the flat tables, [begin, end) */
+  struct Range
+  {
+    uint32_t begin{0};
+    uint32_t end{0};
+  };
+
+  struct StateRow
+  {
+    Range entry, activity, exit, transitions;
+  };
+
+  struct TransitionRow
+  {
+    uint16_t dst;
+    uint64_t events;
+    Range guards, actions;
+  };
+
+  uint32_t actionId(const std::string & name);
+  uint32_t guardId(const std::string & name);
+  Range actionList(const std::vector<std::string> & names);
+  void checkBound() const;
+  uint64_t eventBit(int event) const
+  {
+    if (event < 0 || static_cast<size_t>(event) >= eventIds_.size()) {
+      throwUnknownEvent(event);
+    }
+    return uint64_t{1} << event;
+  }
+  [[noreturn]] static void throwUnknownEvent(int event);
+  void runActions(const Range & range, size_t instance) const;
+  void stepChunk(size_t begin, size_t end);
+
+  /* topology */
+  std::vector<std::string> stateNames_;
+  std::vector<StateRow> states_;
+  std::vector<TransitionRow> transitions_;
+  std::vector<uint32_t> actionLists_;
+  std::vector<uint32_t> guardLists_;
+  std::vector<ActionSlot> actions_;
+  std::vector<GuardSlot> guards_;
+  std::unordered_map<std::string, int> eventIds_;
+  uint16_t initial_{0};
+
+  /* instances, structure of arrays */
+  std::vector<uint16_t> state_;
+  std::vector<uint8_t> entered_;
+  std::vector<uint64_t> events_;
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__FARM_HPP_
@@ -0,0 +1,266 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__FUNCTION_HPP_
+#define MOGI_STATECHART__FUNCTION_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mogi
+{
+namespace statechart
+{
+
+namespace detail
+{
+
+/* true if FuncT can be called with ArgsT and returns something usable as RetT,
+ * same constraint as the converting constructor of std::function
+ */
+template<typename FuncT, typename RetT, typename = void, typename ... ArgsT>
+struct IsCallableImpl : std::false_type {};
+
+template<typename FuncT, typename RetT, typename ... ArgsT>
+struct IsCallableImpl<FuncT, RetT,
+  decltype(void(std::declval<FuncT &>()(std::declval<ArgsT>()...))), ArgsT...>
+  : std::integral_constant<bool,
+    std::is_void<RetT>::value ||
+    std::is_convertible<decltype(std::declval<FuncT &>()(std::declval<ArgsT>()...)),
+    RetT>::value> {};
+
+template<typename FuncT, typename RetT, typename ... ArgsT>
+using IsCallable = IsCallableImpl<FuncT, RetT, void, ArgsT...>;
+
+}  // namespace detail
+
+/*!
+ @class InplaceFunction
+ \brief Owning function wrapper keeping the callable in a buffer of Capacity
+ bytes inside itself: never allocates, a callable that doesn't fit is a
+ compile error rather than a heap allocation. Same interface as
+ std::function otherwise, calling an empty one throws bad_function_call
+ */
+template<typename SignatureT, size_t Capacity = 64>
+class InplaceFunction;
+
+template<typename RetT, typename ... ArgsT, size_t Capacity>
+class InplaceFunction<RetT(ArgsT...), Capacity>
+{
+public:
+  InplaceFunction() = default;
+  InplaceFunction(std::nullptr_t) {}  // NOLINT(runtime/explicit)
+
+  template<typename FuncT, typename StoredT = typename std::decay<FuncT>::type,
+    typename = typename std::enable_if<
+      !std::is_same<StoredT, InplaceFunction>::value &&
+      detail::IsCallable<StoredT, RetT, ArgsT...>::value>::type>
+  InplaceFunction(FuncT && func)  // NOLINT(runtime/explicit)
+  {
+    static_assert(
+      sizeof(StoredT) <= Capacity,
+      "callable too large for InplaceFunction, raise Capacity or keep it elsewhere "
+      "and pass a FunctionRef");
+    static_assert(
+      alignof(StoredT) <= alignof(std::max_align_t), "callable over-aligned for InplaceFunction");
+    new (&storage_) StoredT(std::forward<FuncT>(func));
+    ops_ = OpsFor<StoredT>::ops();
+  }
+
+  InplaceFunction(const InplaceFunction & other)
+  : ops_(other.ops_)
+  {
+    if (ops_) {
+      ops_->copy(&other.storage_, &storage_);
+    }
+  }
+
+  InplaceFunction(InplaceFunction && other) noexcept
+  : ops_(other.ops_)
+  {
+    if (ops_) {
+      ops_->move(&other.storage_, &storage_);
+    }
+  }
+
+  InplaceFunction & operator=(const InplaceFunction & other)
+  {
+    if (this != &other) {
+      reset();
+      if (other.ops_) {
+        other.ops_->copy(&other.storage_, &storage_);
+        ops_ = other.ops_;
+      }
+    }
+    return *this;
+  }
+
+  InplaceFunction & operator=(InplaceFunction && other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      if (other.ops_) {
+        other.ops_->move(&other.storage_, &storage_);
+        ops_ = other.ops_;
+      }
+    }
+    return *this;
+  }
+
+  ~InplaceFunction() {reset();}
+
+  RetT operator()(ArgsT... args) const
+  {
+    if (!ops_) {
+      throw std::bad_function_call();
+    }
+    return ops_->invoke(&storage_, std::forward<ArgsT>(args)...);
+  }
+
+  explicit operator bool() const {return ops_ != nullptr;}
+
+private:
+  struct Ops
+  {
+    RetT (* invoke)(const void *, ArgsT && ...);
+    void (* copy)(const void *, void *);
+    void (* move)(void *, void *);
+    void (* destroy)(void *);
+  };
+
+  template<typename StoredT>
+  struct OpsFor
+  {
+    /* calls the callable as non const, like std::function */
+    static RetT invoke(const void * f, ArgsT && ... args)
+    {
+      return (*static_cast<StoredT *>(const_cast<void *>(f)))(std::forward<ArgsT>(args)...);
+    }
+    static void copy(const void * from, void * to)
+    {
+      new (to) StoredT(*static_cast<const StoredT *>(from));
+    }
+    static void move(void * from, void * to)
+    {
+      new (to) StoredT(std::move(*static_cast<StoredT *>(from)));
+    }
+    static void destroy(void * f) {static_cast<StoredT *>(f)->~StoredT();}
+
+    static const Ops * ops()
+    {
+      static const Ops table{&invoke, &copy, &move, &destroy};
+      return &table;
+    }
+  };
+
+  void reset()
+  {
+    if (ops_) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type storage_;
+  const Ops * ops_{nullptr};
+};
+
+/*!
+ @class FunctionPointer
+ \brief A function pointer and the context it is called with: two words,
+ trivially copyable, no type erasure beyond the pointer itself. Built from a
+ capture-less lambda or a plain function, or from a function taking the
+ context first:
+ \code
+ bool isReady(void * robot) {return static_cast<Robot *>(robot)->ready();}
+ transition->createGuard(FunctionPointer<bool()>{&isReady, &robot});
+ \endcode
+ */
+template<typename SignatureT>
+class FunctionPointer;
+
+template<typename RetT, typename ... ArgsT>
+class FunctionPointer<RetT(ArgsT...)>
+{
+public:
+  using ContextFunctionT = RetT (*)(void *, ArgsT...);
+  using PlainFunctionT = RetT (*)(ArgsT...);
+
+  FunctionPointer(ContextFunctionT function, void * context)
+  : function_(function), context_(context) {}
+
+  FunctionPointer(PlainFunctionT function)  // NOLINT(runtime/explicit)
+  : function_(&callPlain), context_(reinterpret_cast<void *>(function)) {}
+
+  /* capture-less lambdas */
+  template<typename FuncT, typename = typename std::enable_if<
+      std::is_convertible<FuncT, PlainFunctionT>::value>::type>
+  FunctionPointer(FuncT func)  // NOLINT(runtime/explicit)
+  : FunctionPointer(static_cast<PlainFunctionT>(func)) {}
+
+  RetT operator()(ArgsT... args) const {return function_(context_, std::forward<ArgsT>(args)...);}
+
+private:
+  static RetT callPlain(void * function, ArgsT... args)
+  {
+    return reinterpret_cast<PlainFunctionT>(function)(std::forward<ArgsT>(args)...);
+  }
+
+  ContextFunctionT function_;
+  void * context_;
+};
+
+/*!
+ @class FunctionRef
+ \brief Non-owning view of a callable kept elsewhere, which must outlive the
+ view and every copy of it. Two words, whatever the size of the callable:
+ \code
+ auto check = [&, big = std::move(table)]() {return lookup(big);};
+ transition->createGuard(FunctionRef<bool()>{check});
+ \endcode
+ */
+template<typename SignatureT>
+class FunctionRef;
+
+template<typename RetT, typename ... ArgsT>
+class FunctionRef<RetT(ArgsT...)>
+{
+public:
+  template<typename FuncT, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<FuncT>::type, FunctionRef>::value &&
+      detail::IsCallable<FuncT, RetT, ArgsT...>::value>::type>
+  FunctionRef(FuncT & func)  // NOLINT(runtime/explicit)
+  : function_(&call<FuncT>), callable_(const_cast<void *>(static_cast<const void *>(&func))) {}
+
+  RetT operator()(ArgsT... args) const {return function_(callable_, std::forward<ArgsT>(args)...);}
+
+private:
+  template<typename FuncT>
+  static RetT call(void * callable, ArgsT... args)
+  {
+    return (*static_cast<FuncT *>(callable))(std::forward<ArgsT>(args)...);
+  }
+
+  RetT (* function_)(void *, ArgsT...);
+  void * callable_;
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__FUNCTION_HPP_
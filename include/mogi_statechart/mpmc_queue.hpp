@@ -0,0 +1,142 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__MPMC_QUEUE_HPP_
+#define MOGI_STATECHART__MPMC_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class MpmcQueue
+ \brief Bounded lock-free queue, any number of producers and consumers.
+
+ Every slot carries a sequence number telling whether it is free for the
+ producer or filled for the consumer of a given lap (D. Vyukov's bounded
+ MPMC queue), so neither side ever waits on the other: push() fails when
+ the queue is full and pop() when it is empty. Capacity is rounded up to a
+ power of two and allocated once.
+ */
+template<typename T>
+class MpmcQueue
+{
+public:
+  explicit MpmcQueue(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    slots_.reset(new Slot[size]);
+    for (size_t i = 0; i < size; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpmcQueue(const MpmcQueue &) = delete;
+  MpmcQueue & operator=(const MpmcQueue &) = delete;
+
+  /*!
+   \brief Appends item, returns false if the queue is full
+   */
+  bool push(T item)
+  {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      auto & slot = slots_[pos & mask_];
+      auto seq = slot.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          slot.item = std::move(item);
+          slot.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /*!
+   \brief Takes the oldest item, returns false if the queue is empty
+   */
+  bool pop(T & item)
+  {
+    auto pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      auto & slot = slots_[pos & mask_];
+      auto seq = slot.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          item = std::move(slot.item);
+          slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /*!
+   \brief Approximate number of items, exact when no thread is pushing or
+   popping
+   */
+  size_t size() const
+  {
+    auto tail = tail_.load(std::memory_order_acquire);
+    auto head = head_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+
+  size_t capacity() const {return mask_ + 1;}
+
+private:
+  struct Slot
+  {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  /* producers and consumers on separate cache lines, padded rather than
+   * aligned since C++14 new ignores over-alignment
+   */
+  char pad0_[64];
+  std::atomic<size_t> tail_{0};
+  char pad1_[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> head_{0};
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__MPMC_QUEUE_HPP_
@@ -0,0 +1,85 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__PLACEMENT_HPP_
+#define MOGI_STATECHART__PLACEMENT_HPP_
+
+#include <string>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @struct NumaNode
+ \brief A memory node of the host and the CPUs attached to it
+ */
+struct NumaNode
+{
+  int id;
+  std::vector<int> cpus;
+};
+
+/*!
+ @class Placement
+ \brief Where threads run and allocate from, see RealTimeOptions.
+
+ Memory is allocated on the node of the thread touching it first, so a chart
+ is best built from a thread set up for the node its own thread will run on:
+ \code
+ RealTimeOptions options;
+ options.numaNode = 1;
+ std::thread{[&]() {
+     Placement::setUpThread(options);
+     chart = buildChart();
+   }}.join();
+ chart->spinAsync(options);
+ \endcode
+ States, transitions and event observers are then local to the chart's
+ thread, and spinAsync() reallocates the chart's event queues on the node.
+ */
+class MOGI_STATECHART_PUBLIC Placement
+{
+public:
+  /*!
+   \brief The online nodes of the host, read from sysfs. A host without NUMA
+   support (or not Linux) is one node 0 holding every CPU
+   */
+  static std::vector<NumaNode> numaNodes();
+
+  /*!
+   \brief CPUs of node, throws runtime_error if the host has no such node
+   */
+  static std::vector<int> cpusOf(int node);
+
+  /*!
+   \brief Sets the calling thread up as described by options: CPU affinity
+   (the CPUs of numaNode when cpus is empty), allocations preferring
+   numaNode, SCHED_FIFO priority and prefaulted stack. Throws runtime_error
+   if the system refuses a setting, or before changing any if a CPU is out of
+   range or prefaultStack doesn't fit in the thread's stack. lockMemory is
+   left to the caller, it is process wide
+   */
+  static void setUpThread(const RealTimeOptions & options);
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__PLACEMENT_HPP_
@@ -0,0 +1,173 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__RCU_HPP_
+#define MOGI_STATECHART__RCU_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class Rcu
+ \brief Read-copy-update cell holding a value shared by the chart's thread
+ and the threads reconfiguring it.
+
+ Readers take an immutable snapshot with read() and keep using it however
+ long they need. Writers serialize on a mutex, modify a private copy and
+ publish it atomically; the previous version is reclaimed once its last
+ reader drops its snapshot. Meant for data read on every step and changed
+ rarely.
+
+ The copy is published by the first read after the write, and further
+ writes until then go to the same copy: a run of writes with no read in
+ between, such as building a chart, costs a single copy instead of one per
+ write. A reader only ever waits for a writer then, for as long as its
+ modify runs.
+ */
+template<typename T>
+class Rcu
+{
+public:
+  using SnapshotT = std::shared_ptr<const T>;
+
+  Rcu()
+  : current_(std::make_shared<const T>()) {}
+
+  explicit Rcu(T value)
+  : current_(std::make_shared<const T>(std::move(value))) {}
+
+  /* copies share the snapshot, updates then diverge */
+  Rcu(const Rcu & other)
+  : current_(other.read()) {}
+
+  Rcu & operator=(const Rcu & other)
+  {
+    if (this != &other) {
+      std::lock_guard<std::mutex> lock{writer_};
+      publishLocked(other.read());
+    }
+    return *this;
+  }
+
+  /*!
+   \brief Current version, valid until the returned pointer is released
+   */
+  SnapshotT read() const
+  {
+    if (dirty_.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock{writer_};
+      flushLocked();
+    }
+    return std::atomic_load(&current_);
+  }
+
+  /*!
+   \brief Same as read(), for the thread stepping the chart only: the
+   snapshot is kept between calls and only replaced once a writer published
+   a new version, so that the steady state neither locks (libstdc++ guards
+   atomic shared_ptr loads with a lock) nor counts references. Not thread
+   safe, valid until the next call
+   */
+  const T & readCached() const
+  {
+    auto version = version_.load(std::memory_order_acquire);
+    if (!cache_ || version != cacheVersion_) {
+      cache_ = read();
+      cacheVersion_ = version;
+    }
+    return *cache_;
+  }
+
+  /*!
+   \brief Calls modify on a copy of the current version, published by the
+   next read. modify runs under the writer lock, so state kept next to the
+   cell can be updated consistently from it. It must not read the cell, and
+   if it throws it must leave the value unchanged
+   */
+  template<typename ModifyT>
+  void update(ModifyT && modify)
+  {
+    std::lock_guard<std::mutex> lock{writer_};
+    bool copied = !draft_;
+    if (copied) {
+      draft_ = std::make_shared<T>(*current_);
+    }
+    try {
+      modify(*draft_);
+    } catch (...) {
+      if (copied) {
+        draft_.reset();
+      }
+      throw;
+    }
+    dirty_.store(true, std::memory_order_release);
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  /*!
+   \brief Replaces the value without copying the current version
+   */
+  void publish(T value)
+  {
+    std::lock_guard<std::mutex> lock{writer_};
+    publishLocked(std::make_shared<const T>(std::move(value)));
+  }
+
+  /*!
+   \brief Number of versions written so far
+   */
+  uint64_t version() const {return version_.load(std::memory_order_acquire);}
+
+private:
+  void publishLocked(SnapshotT next)
+  {
+    draft_.reset();
+    dirty_.store(false, std::memory_order_relaxed);
+    std::atomic_store(&current_, std::move(next));
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  void flushLocked() const
+  {
+    if (draft_) {
+      std::atomic_store(&current_, SnapshotT{std::move(draft_)});
+      draft_.reset();
+    }
+    dirty_.store(false, std::memory_order_release);
+  }
+
+  mutable SnapshotT current_;
+  std::atomic<uint64_t> version_{0};
+  mutable std::mutex writer_;
+  /* written and not read yet, see update() */
+  mutable std::shared_ptr<T> draft_;
+  mutable std::atomic<bool> dirty_{false};
+  /* readCached() */
+  mutable SnapshotT cache_;
+  mutable uint64_t cacheVersion_{0};
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__RCU_HPP_
@@ -0,0 +1,214 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOGI_STATECHART__RECORDER_HPP_
+#define MOGI_STATECHART__RECORDER_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @struct LogRecord
+ \brief One entry of an event log, names are indices into EventLog::names
+ */
+struct LogRecord
+{
+  enum class Type : uint8_t {Trigger = 1, StateChange = 2};
+
+  Type type;
+  /*! nanoseconds since the recorder was created */
+  uint64_t time;
+  /*! Trigger: the event name. StateChange: the chart name */
+  uint32_t source;
+  /*! StateChange: name of the new state, unused for Trigger */
+  uint32_t state;
+};
+
+/*!
+ @class EventLog
+ \brief In memory form of a log written by EventRecorder.
+
+ The binary format is a magic string followed by tagged records, integers are
+ LEB128 varints and timestamps are deltas to the previous record, so a
+ trigger usually takes 3 to 5 bytes. Names are written once, the first time
+ they are used.
+ */
+class MOGI_STATECHART_PUBLIC EventLog
+{
+public:
+  /*!
+   \brief Reads a whole log, throws runtime_error on malformed input.
+   A log cut short (e.g. the recording process crashed) is read up to its
+   last complete record
+   */
+  static EventLog read(std::istream & in);
+
+  /*!
+   \brief Reads the log file at path
+   */
+  static EventLog readFile(const std::string & path);
+
+  const std::string & name(uint32_t index) const {return names.at(index);}
+
+  std::vector<std::string> names;
+  std::vector<LogRecord> records;
+};
+
+/*!
+ @class EventRecorder
+ \brief Writes every trigger of the watched events, and every state change of
+ the watched charts, with a monotonic timestamp.
+
+ Triggers may come from any thread, records are serialized under a mutex in
+ the order they happened. The stream is flushed by flush() and on
+ destruction.
+ */
+class MOGI_STATECHART_PUBLIC EventRecorder
+{
+public:
+  explicit EventRecorder(std::ostream & out);
+  ~EventRecorder();
+
+  EventRecorder(const EventRecorder &) = delete;
+  EventRecorder & operator=(const EventRecorder &) = delete;
+
+  /*!
+   \brief Records every trigger() of event, events are told apart by name
+   */
+  void watch(Event & event);
+
+  /*!
+   \brief Records the state changes of chart, charts are told apart by name.
+   Subcharts have to be watched on their own
+   */
+  void watch(const std::shared_ptr<Chart> & chart);
+
+  /*!
+   \brief Flushes buffered records to the stream
+   */
+  void flush();
+
+  /*!
+   \brief Number of records written so far
+   */
+  uint64_t recordCount() const;
+
+private:
+  class Observer;
+
+  void record(LogRecord::Type type, const std::string & source, const std::string & state);
+  uint32_t intern(const std::string & name);
+  void writeVarint(uint64_t value);
+
+  mutable std::mutex mutex_;
+  std::ostream & out_;
+  std::string buffer_;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t last_{0};
+  uint64_t count_{0};
+  std::unordered_map<std::string, uint32_t> names_;
+  std::shared_ptr<Observer> observer_;
+  std::vector<std::pair<std::weak_ptr<Chart>,
+    std::shared_ptr<Chart::StateChangeCallbackT>>> charts_;
+};
+
+/*!
+ @struct ReplayResult
+ \brief Summary of EventReplayer::replay()
+ */
+struct ReplayResult
+{
+  /*! events triggered */
+  uint64_t events{0};
+  /*! recorded triggers of events that were not bound, hence skipped */
+  uint64_t skipped{0};
+  /*! state changes of the replayed chart */
+  uint64_t transitions{0};
+  /*! index of the first state change differing from the log, -1 if none */
+  int64_t divergedAt{-1};
+  /*! wall time of the replay */
+  std::chrono::nanoseconds elapsed{0};
+};
+
+/*!
+ @class EventReplayer
+ \brief Feeds a recorded log back into a fresh chart.
+
+ Recorded events are bound by name to the events the new chart listens to.
+ Every trigger is followed by one spinOnce() of the chart, same as a
+ spinAsync()-ed chart picking the event up, and when the log shows a state
+ change the replayed chart has not made yet the chart is spun until it
+ catches up (see setCatchUpSteps()). The state changes of the replayed chart
+ are compared with the ones recorded for the chart of the same name.
+
+ If the chart isRunning() the replayer only triggers events, leaving the
+ stepping to the chart's own thread.
+ */
+class MOGI_STATECHART_PUBLIC EventReplayer
+{
+public:
+  enum class Pace
+  {
+    /*! keep the recorded time between events */
+    RealTime,
+    /*! trigger events back to back, to measure throughput */
+    AsFastAsPossible,
+  };
+
+  explicit EventReplayer(EventLog log)
+  : log_(std::move(log)) {}
+
+  /*!
+   \brief Binds a recorded event name to an event of the replayed chart
+   */
+  void bind(const std::string & name, Event & event) {events_[name] = &event;}
+
+  /*!
+   \brief Maximum number of spinOnce() spent waiting for a recorded state
+   change before calling it a divergence, 64 by default
+   */
+  void setCatchUpSteps(int steps) {catchUpSteps_ = steps;}
+
+  const EventLog & log() const {return log_;}
+
+  /*!
+   \brief Replays the whole log into chart
+   */
+  ReplayResult replay(const std::shared_ptr<Chart> & chart, Pace pace = Pace::AsFastAsPossible);
+
+private:
+  EventLog log_;
+  std::unordered_map<std::string, Event *> events_;
+  int catchUpSteps_{64};
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__RECORDER_HPP_
@@ -0,0 +1,103 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOGI_STATECHART__RING_BUFFER_HPP_
+#define MOGI_STATECHART__RING_BUFFER_HPP_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class RingBuffer
+ \brief Fixed capacity FIFO, storage is allocated once by reserve() and
+ never while pushing or popping.
+
+ Not thread safe, guard it with a lock when shared.
+ */
+template<typename T>
+class RingBuffer
+{
+public:
+  explicit RingBuffer(size_t capacity = 0) {reserve(capacity);}
+
+  /*!
+   \brief Changes the capacity, keeping the oldest items that fit
+   */
+  void reserve(size_t capacity)
+  {
+    std::vector<T> items(capacity);
+    size_t kept = 0;
+    while (kept < capacity && !empty()) {
+      items[kept++] = std::move(front());
+      pop();
+    }
+    items_ = std::move(items);
+    head_ = 0;
+    size_ = kept;
+  }
+
+  /*!
+   \brief Appends item, returns false if the buffer is full
+   */
+  bool push(T item)
+  {
+    if (full()) {
+      return false;
+    }
+    items_[(head_ + size_) % items_.size()] = std::move(item);
+    ++size_;
+    return true;
+  }
+
+  T & front() {return items_[head_];}
+
+  /*!
+   \brief i-th item from the front
+   */
+  T & operator[](size_t i) {return items_[(head_ + i) % items_.size()];}
+  const T & operator[](size_t i) const {return items_[(head_ + i) % items_.size()];}
+
+  void pop()
+  {
+    head_ = (head_ + 1) % items_.size();
+    --size_;
+  }
+
+  void clear()
+  {
+    head_ = 0;
+    size_ = 0;
+  }
+
+  size_t size() const {return size_;}
+  size_t capacity() const {return items_.size();}
+  bool empty() const {return size_ == 0;}
+  bool full() const {return size_ == items_.size();}
+
+private:
+  std::vector<T> items_;
+  size_t head_{0};
+  size_t size_{0};
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__RING_BUFFER_HPP_
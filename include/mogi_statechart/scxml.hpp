@@ -0,0 +1,178 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOGI_STATECHART__SCXML_HPP_
+#define MOGI_STATECHART__SCXML_HPP_
+
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "mogi_statechart/description.hpp"
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class ScxmlRegistry
+ \brief Name based lookup table of actions, guards and events used while
+ importing an SCXML document.
+
+ SCXML documents only refer to behavior by name, the registry is where those
+ names get bound to real callbacks:
+ * `<script>name</script>` inside `<onentry>`, `<onexit>` or `<transition>`
+   looks up an action
+ * `cond="a && b"` on a `<transition>` looks up guards `a` and `b`
+ * `event="e"` on a `<transition>` looks up an event, if the event is not
+   registered the loader will create (and own) one
+ */
+class ScxmlRegistry
+{
+public:
+  using ActionT = std::function<void()>;
+  using GuardT = std::function<bool()>;
+
+  /*!
+   \brief Binds an action callback to a name
+   */
+  template<typename CallbackT>
+  void registerAction(const std::string & name, CallbackT && callback)
+  {
+    actions_[name] = std::forward<CallbackT>(callback);
+  }
+
+  /*!
+   \brief Binds a guard callback to a name
+   */
+  template<typename CallbackT>
+  void registerGuard(const std::string & name, CallbackT && callback)
+  {
+    guards_[name] = std::forward<CallbackT>(callback);
+  }
+
+  /*!
+   \brief Binds an user owned event to a name, the event must outlive any
+   chart loaded with this registry
+   */
+  void registerEvent(const std::string & name, Event & event) {events_[name] = &event;}
+
+  const ActionT * findAction(const std::string & name) const
+  {
+    auto it = actions_.find(name);
+    return it == actions_.end() ? nullptr : &it->second;
+  }
+
+  const GuardT * findGuard(const std::string & name) const
+  {
+    auto it = guards_.find(name);
+    return it == guards_.end() ? nullptr : &it->second;
+  }
+
+  Event * findEvent(const std::string & name) const
+  {
+    auto it = events_.find(name);
+    return it == events_.end() ? nullptr : it->second;
+  }
+
+private:
+  std::unordered_map<std::string, ActionT> actions_;
+  std::unordered_map<std::string, GuardT> guards_;
+  std::unordered_map<std::string, Event *> events_;
+};
+
+/*!
+ @class ScxmlLoader
+ \brief Builds a Chart out of an SCXML document.
+
+ The document is read as a stream of tags into a ChartDescription, no
+ document tree is kept in memory. Mapping rules:
+ * `<scxml>` becomes the returned chart, named after its `name` attribute
+ * an atomic `<state>` becomes a State, a `<state>` with child states becomes
+   a subchart
+ * every `<final>` of a chart maps onto the chart's own `final` state, their
+   actions are chained in document order
+ * the `initial` attribute (or `<initial>` element, or the first child state)
+   becomes a transition out of the chart's `initial` state
+ * transitions may only target states of the same chart, same as
+   AbstractState::createTransition()
+
+ `<parallel>`, targetless transitions, scripts of an `<initial>` transition
+ and any reference to an unregistered action or guard are rejected with a
+ runtime_error.
+
+ The loader owns every event it had to create, so it must outlive the charts
+ it returned.
+ */
+class MOGI_STATECHART_PUBLIC ScxmlLoader
+{
+public:
+  explicit ScxmlLoader(const ScxmlRegistry & registry = ScxmlRegistry{})
+  : registry_(registry) {}
+
+  /*!
+   \brief Loads the SCXML file at path
+   */
+  std::shared_ptr<Chart> loadFile(const std::string & path);
+
+  /*!
+   \brief Loads an SCXML document held in memory
+   */
+  std::shared_ptr<Chart> loadString(const std::string & document);
+
+  /*!
+   \brief Loads an SCXML document from a stream
+   */
+  std::shared_ptr<Chart> load(std::istream & in);
+
+  /*!
+   \brief Reads an SCXML document into a description without binding any
+   behavior, throws runtime_error on malformed or unsupported documents
+   */
+  static ChartDescription parse(std::istream & in);
+
+  /*!
+   \brief Builds a chart from a description, binding names through the
+   registry
+   */
+  std::shared_ptr<Chart> build(const ChartDescription & description);
+
+  /*!
+   \brief Returns the event bound to name, either registered or created while
+   loading. Throws runtime_error if there is no such event
+   */
+  Event & event(const std::string & name);
+
+  /*!
+   \brief test if an event of this name is known to the loader
+   */
+  bool hasEvent(const std::string & name) const;
+
+private:
+  void build(const ChartDescription & description, const std::shared_ptr<Chart> & chart);
+  Event & resolveEvent(const std::string & name);
+
+  ScxmlRegistry registry_;
+  std::unordered_map<std::string, std::unique_ptr<Event>> events_;
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__SCXML_HPP_
@@ -0,0 +1,174 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__SHM_TRANSPORT_HPP_
+#define MOGI_STATECHART__SHM_TRANSPORT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include "mogi_statechart/rcu.hpp"
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class ShmEventReceiver
+ \brief Receiving end of a shared memory event transport between processes
+ of the same host.
+
+ Creates a POSIX shared memory object (shm_open()) holding a bounded
+ lock-free ring of messages, an event ID and a small payload each, written
+ by ShmEventSender in other processes. Each message bound to an Event is
+ post()-ed to the chart, after its payload has been handed to the binding's
+ handler. The ring is drained by poll(), or continuously by a thread started
+ with start(). The shared memory object is removed on destruction.
+ */
+class MOGI_STATECHART_PUBLIC ShmEventReceiver
+{
+public:
+  using PayloadHandlerT = std::function<void (const void *, size_t)>;
+
+  /*!
+   @param name name of the shared memory object, "/something"
+   @param chart chart the events are posted to
+   @param capacity messages the ring holds, rounded up to a power of two
+   @param maxPayload largest payload accepted, in bytes
+   Throws runtime_error if the object cannot be created, or if a receiver
+   of a running process already owns name. The leftover of a receiver that
+   died is replaced
+   */
+  ShmEventReceiver(
+    const std::string & name, const std::shared_ptr<Chart> & chart,
+    size_t capacity = 1024, size_t maxPayload = 64);
+  ~ShmEventReceiver();
+
+  ShmEventReceiver(const ShmEventReceiver &) = delete;
+  ShmEventReceiver & operator=(const ShmEventReceiver &) = delete;
+
+  /*!
+   \brief Posts event for every message carrying id. handler, if any, gets
+   the payload first, on the thread draining the ring: whatever it stores
+   for the chart has to be synchronized with the chart's thread
+   */
+  void bind(uint32_t id, Event & event, PayloadHandlerT handler = {});
+
+  /*!
+   \brief Delivers the messages waiting in the ring. The receiver is the
+   ring's only consumer, do not call it while start()-ed
+   @return number of messages taken
+   */
+  size_t poll();
+
+  /*!
+   \brief Starts a thread polling the ring until stop(), it never sleeps so
+   that latency stays in the microseconds
+   */
+  void start();
+  void stop();
+
+  /*! messages delivered to the chart */
+  uint64_t receivedCount() const {return received_.load(std::memory_order_relaxed);}
+  /*! messages with an unbound id, a payload larger than maxPayload, or not
+   * fitting the chart's queue */
+  uint64_t discardedCount() const {return discarded_.load(std::memory_order_relaxed);}
+  /*! messages senders could not write because the ring was full */
+  uint64_t droppedCount() const;
+
+  const std::string & name() const {return name_;}
+
+private:
+  struct Binding
+  {
+    Event * event;
+    PayloadHandlerT handler;
+  };
+
+  const std::string name_;
+  std::weak_ptr<Chart> chart_;
+  void * memory_{nullptr};
+  size_t size_{0};
+  /* the layout, as created */
+  uint64_t capacity_{0};
+  uint64_t slotSize_{0};
+  uint64_t maxPayload_{0};
+  Rcu<std::unordered_map<uint32_t, Binding>> bindings_;
+  std::atomic<uint64_t> received_{0};
+  std::atomic<uint64_t> discarded_{0};
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+};
+
+/*!
+ @class ShmEventSender
+ \brief Sending end of the transport, opens the ring created by a
+ ShmEventReceiver. Any number of senders, in any number of processes and
+ threads, may share a ring; send() never blocks.
+ */
+class MOGI_STATECHART_PUBLIC ShmEventSender
+{
+public:
+  /*!
+   \brief Throws runtime_error if no receiver created name, or if the object
+   does not hold a valid ring
+   */
+  explicit ShmEventSender(const std::string & name);
+  ~ShmEventSender();
+
+  ShmEventSender(const ShmEventSender &) = delete;
+  ShmEventSender & operator=(const ShmEventSender &) = delete;
+
+  /*!
+   \brief Writes a message, throws runtime_error if size exceeds
+   maxPayload()
+   @return false if the ring is full, the message is dropped and counted
+   */
+  bool send(uint32_t id, const void * payload = nullptr, size_t size = 0);
+
+  /*!
+   \brief Sends a trivially copyable value as payload
+   */
+  template<typename T>
+  bool sendValue(uint32_t id, const T & value)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "payloads are copied bytewise");
+    return send(id, &value, sizeof(T));
+  }
+
+  size_t maxPayload() const;
+
+private:
+  void * memory_{nullptr};
+  size_t size_{0};
+  /* the layout, as validated when opened */
+  uint64_t capacity_{0};
+  uint64_t slotSize_{0};
+  uint64_t maxPayload_{0};
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+#endif  // MOGI_STATECHART__SHM_TRANSPORT_HPP_
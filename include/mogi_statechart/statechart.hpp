@@ -15,17 +15,28 @@
 #ifndef MOGI_STATECHART__STATECHART_HPP_
 #define MOGI_STATECHART__STATECHART_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <initializer_list>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <unordered_set>
 #include <unordered_map>
 #include <utility>
 #include <vector>
+#include "mogi_statechart/function.hpp"
+#include "mogi_statechart/mpmc_queue.hpp"
+#include "mogi_statechart/rcu.hpp"
+#include "mogi_statechart/ring_buffer.hpp"
 #include "mogi_statechart/visibility_control.h"
 
 namespace mogi
@@ -35,11 +46,10 @@ namespace mogi
  * @namespace Mogi::StateChart
  * \brief An implementation of UML style state models.
  *
- * \note This implementation does not support dynamic reconfiguration of the
- * chart, i.e. you will need to stop() the chart to change some configurations
- * like state callbacks and transitions etc. if the chart is running
- * (start()-ed)
- * Future implementation might add this support if there's a high demand
+ * \note A running chart can be reconfigured (callbacks, states, transitions,
+ * guards, events) from any thread without stop()-ing it. Configuration is
+ * kept in read-copy-update cells (see Rcu): every step of the chart works on
+ * one consistent version, changes take effect from the next read on.
  */
 namespace statechart
 {
@@ -47,38 +57,152 @@ namespace statechart
 class AbstractState;
 class MOGI_STATECHART_PUBLIC State;
 class MOGI_STATECHART_PUBLIC Chart;
+class MOGI_STATECHART_PUBLIC StateChangeChannel;
+class MOGI_STATECHART_PUBLIC EventBus;
+class MOGI_STATECHART_PUBLIC DotExporter;
 
 /*!
- @class Callback
+ \brief Storage of the callbacks held by the library (actions, guards, state
+ change and event callbacks): std::function, or InplaceFunction when built
+ with MOGI_STATECHART_INPLACE_CALLBACKS set to a capture size in bytes, so
+ that captures are stored and invoked without allocating. Setting a callback
+ still allocates, the new version is published through an Rcu cell
  */
-template<typename RetT, typename ... ArgsT>
-class Callback
+#if defined(MOGI_STATECHART_INPLACE_CALLBACKS)
+template<typename SignatureT>
+using CallbackStorageT = InplaceFunction<SignatureT, MOGI_STATECHART_INPLACE_CALLBACKS>;
+#else
+template<typename SignatureT>
+using CallbackStorageT = std::function<SignatureT>;
+#endif
+
+/*!
+ @class BasicCallback
+ \brief Replaceable function handle, set() may be called while another
+ thread invoke()s it. StorageT holds the function: std::function,
+ InplaceFunction, FunctionPointer or FunctionRef (see function.hpp)
+ */
+template<typename StorageT, typename RetT, typename ... ArgsT>
+class BasicCallback
 {
 public:
-  using CallbackT = std::function<RetT(ArgsT... args)>;
+  using CallbackT = StorageT;
 
-  explicit Callback(CallbackT && callback)
+  explicit BasicCallback(CallbackT && callback)
   : func_(std::forward<CallbackT>(callback)) {}
 
   /*!
    \brief User-definable callback method.
    */
-  RetT invoke(ArgsT... args) const {return func_(args ...);}
+  RetT invoke(ArgsT... args) const {return (*func_.read())(args ...);}
+
+  /*!
+   \brief Same as invoke(), from the thread stepping the chart only, see
+   Rcu::readCached()
+   */
+  RetT invokeCached(ArgsT... args) const {return func_.readCached()(args ...);}
 
   /*!
-   \brief Sets internal function handle
+   \brief Sets internal function handle. A thread in invoke() or
+   invokeCached() may still run the previous one until it returns
    */
   template<typename FuncT>
   void set(FuncT && func)
   {
-    func_ = std::forward<FuncT>(func);
+    func_.publish(CallbackT(std::forward<FuncT>(func)));
   }
 
 private:
-  CallbackT func_;
+  Rcu<CallbackT> func_;
+};
+
+template<typename RetT, typename ... ArgsT>
+using Callback = BasicCallback<CallbackStorageT<RetT(ArgsT...)>, RetT, ArgsT...>;
+
+/*!
+ \brief Action of the transitions created without one, the chart doesn't
+ call it
+ */
+struct NoAction
+{
+  void operator()() const {}
+};
+
+/*!
+ @struct TransitionStats
+ \brief Counters of a transition, kept while its chart isProfiling()
+ */
+struct TransitionStats
+{
+  /*! times the transition was taken */
+  uint64_t fires{0};
+  /*! time spent in its action, all fires */
+  std::chrono::nanoseconds actionTime{0};
+};
+
+/*!
+ @struct StateStats
+ \brief Counters of a state, kept while its chart isProfiling()
+ */
+struct StateStats
+{
+  /*! times the state was left */
+  uint64_t visits{0};
+  /*! time spent in the state from entry to exit, all visits */
+  std::chrono::nanoseconds dwellTime{0};
 };
 
 class EventObserver;
+
+/*!
+ \brief Priority classes of events posted to a chart, see Chart::post()
+ */
+enum class EventPriority : uint8_t
+{
+  Critical,
+  High,
+  Normal,
+  Low,
+};
+
+/*!
+ \brief What a full bounded queue does with a new item
+ */
+enum class OverflowPolicy : uint8_t
+{
+  /*! discard the oldest item to make room, the queue keeps the latest */
+  DropOldest,
+  /*! wait for a consumer to make room, this stalls the producer */
+  Block,
+  /*! discard the new item and count it, i.e. reject it */
+  CountDrops,
+  /*! keep at most one instance of each item waiting, a new one already
+   * waiting is merged into it; other new items are rejected when full */
+  Coalesce,
+};
+
+/*!
+ @struct EventQueueStats
+ \brief Snapshot of the event queues of a chart, see Chart::eventQueueStats()
+ */
+struct EventQueueStats
+{
+  /*! events waiting, all priorities */
+  size_t depth{0};
+  /*! largest depth seen since the chart was created */
+  size_t highWater{0};
+  /*! events accepted by post() */
+  uint64_t posted{0};
+  /*! events rejected, or discarded by DropOldest */
+  uint64_t dropped{0};
+  /*! events merged into one already waiting by Coalesce */
+  uint64_t coalesced{0};
+  /*! Block producers that gave up after the timeout, counted in dropped too */
+  uint64_t timedOut{0};
+  /*! events the queues hold, all priorities. 0 until they are allocated */
+  size_t capacity{0};
+};
+
 /*!
  @class Event
  \brief A representation of an event in UML
@@ -86,6 +210,8 @@ class EventObserver;
  */
 class MOGI_STATECHART_PUBLIC Event
 {
+  friend class Chart;
+
 public:
   explicit Event(const std::string & n = "anonymous")
   : name_(n) {}
@@ -115,10 +241,29 @@ public:
    */
   int observerCount() const;
 
+  /*!
+   \brief Sets the priority used when this event is posted to a chart
+   */
+  void setPriority(EventPriority priority) {priority_ = priority;}
+
+  /*!
+   \brief Priority used when this event is posted to a chart, Normal by
+   default
+   */
+  EventPriority priority() const {return priority_;}
+
 private:
-  std::vector<std::weak_ptr<EventObserver>> eventObservers;
+  using ObserverPtr = std::weak_ptr<EventObserver>;
+
+  Rcu<std::vector<ObserverPtr>> eventObservers;
+  /* membership index of eventObservers, keeps addObserver() from scanning
+   * the whole list when an event is shared by many transitions. Only
+   * touched under the writer lock of eventObservers
+   */
+  std::set<ObserverPtr, std::owner_less<ObserverPtr>> observerIndex_;
 
   std::string name_;
+  EventPriority priority_{EventPriority::Normal};
 };
 /*!
  @class EventObserver
@@ -128,6 +273,8 @@ private:
 class EventObserver : public std::enable_shared_from_this<EventObserver>
 {
   friend void Event::trigger();
+  /* delivers posted events, see Chart::post() */
+  friend class Chart;
 
 public:
   virtual ~EventObserver() = default;
@@ -150,8 +297,8 @@ protected:
 class Guard : public Callback<bool>
 {
 public:
-  explicit Guard(Callback::CallbackT && callback)
-  : Callback<bool>(std::forward<Callback::CallbackT>(callback)) {}
+  explicit Guard(CallbackT && callback)
+  : Callback<bool>(std::forward<CallbackT>(callback)) {}
 
   /*!
    \brief Guard method, calls provided callback in constructor
@@ -166,13 +313,17 @@ public:
 
  This is only creatable by calling State::createTransition() to help ensure a
  properly connected diagram.  This follows the UML style of transition by having
- configurable guards, events, and an action.  If no guard (future event?) is set
- then this will be treated like a completion transition.
+ configurable guards, events, and an action.  A transition without event is
+ taken as soon as its guards are satisfied, one made by
+ AbstractState::createCompletionTransition() only once its source state
+ isCompleted() as well.
  @since 12-03-2020
  */
 class MOGI_STATECHART_PUBLIC Transition : public EventObserver
 { // public EventObserver { // event observer for transition performance.
   friend class Chart;
+  friend class AbstractState;
+  friend class DotExporter;
 
 private:
   const std::weak_ptr<Chart> container;
@@ -193,17 +344,43 @@ private:
    */
   bool shouldPerform();
 
-  std::vector<std::shared_ptr<Guard>> guards;
-  std::unordered_set<const Event *> events_;
-  std::atomic<bool> eventTriggered_{false};
+  Rcu<std::vector<std::shared_ptr<Guard>>> guards;
+  Rcu<std::unordered_set<const Event *>> events_;
+  /* AbstractState::activation_ of src when the event was latched, 0 if none
+   */
+  std::atomic<uint64_t> eventTriggered_{0};
+  bool consumeTrigger(const AbstractState & srcState);
+  const bool completion_;
+
+  /* set by Chart::lock(): the structure cannot change, the chart reads it
+   * from these instead of the Rcu cells
+   */
+  std::atomic<bool> frozen_{false};
+  Rcu<std::vector<std::shared_ptr<Guard>>>::SnapshotT frozenGuards_;
+  bool frozenHasEvents_{false};
+  AbstractState * frozenSrc_{nullptr};
+  AbstractState * frozenDst_{nullptr};
+  void freeze(bool frozen);
+  void checkMutable() const;
 
   Callback<void> action_callback_ {[]() {}};
+  const bool hasAction_;
+  /* see Chart::setProfiling() */
+  std::atomic<uint64_t> fires_{0};
+  std::atomic<uint64_t> actionNs_{0};
+  /* guard-free transition on no event, see Chart::setCollapseTransients() */
+  bool isUnconditional() const;
 
 protected:
   /*!
    \brief Called when the transition is being performed.
    */
-  void action() {action_callback_.invoke();}
+  void action()
+  {
+    if (hasAction_) {
+      action_callback_.invokeCached();
+    }
+  }
   /*!
    \brief Event notification.
    @param event The event that cause the notification.
@@ -224,9 +401,10 @@ private:
     Enabler, const std::weak_ptr<Chart> & c,
     const std::shared_ptr<AbstractState> & s,
     const std::shared_ptr<AbstractState> & d,
-    ActionT && action)
-  : container(c), src(s), dst(d),
-    action_callback_(std::forward<ActionT>(action)) {}
+    ActionT && action, bool completion = false)
+  : container(c), src(s), dst(d), completion_(completion),
+    action_callback_(std::forward<ActionT>(action)),
+    hasAction_(!std::is_same<typename std::decay<ActionT>::type, NoAction>::value) {}
 
   /*!
    \brief Appends a Guard to the transition.
@@ -237,20 +415,23 @@ private:
   template<typename CallbackT>
   std::shared_ptr<Guard> createGuard(CallbackT && callback)
   {
+    checkMutable();
     auto g = std::make_shared<Guard>(std::forward<CallbackT>(callback));
-    guards.push_back(g);
+    guards.update([&g](std::vector<std::shared_ptr<Guard>> & list) {list.push_back(g);});
     return g;
   }
 
   /*!
-   \brief Removes an appended guard
+   \brief Removes an appended guard. A chart stepping in another thread may
+   still call it until the step in progress ends, what it captures must
+   outlive that step
    @param g Returned from createGuard()
    */
   void removeGuard(const std::shared_ptr<Guard> & g);
 
   /*!
    \brief Adds the event that performs this transition when guards have been
-   satisfied.
+   satisfied. Completion transitions take no event and throw runtime_error
    @param event The event that performs calls transition.
    */
   bool addEvent(Event & event);
@@ -264,7 +445,7 @@ private:
   /*!
    \brief Number of events this transition is subscribed to
    */
-  int eventCount() const {return events_.size();}
+  int eventCount() const {return events_.read()->size();}
 
   /*!
    \brief Destiny state this transition is pointing to
@@ -274,7 +455,21 @@ private:
   /*!
    \brief Number of guards on this transition
    */
-  int getGuardCount() const {return guards.size();}
+  int getGuardCount() const {return guards.read()->size();}
+
+  /*!
+   \brief true if made by AbstractState::createCompletionTransition()
+   */
+  bool isCompletion() const {return completion_;}
+
+  /*!
+   \brief Fires and action time counted while the chart isProfiling()
+   */
+  TransitionStats stats() const
+  {
+    return TransitionStats{fires_.load(std::memory_order_relaxed),
+      std::chrono::nanoseconds(actionNs_.load(std::memory_order_relaxed))};
+  }
 
   // ~Transition() { std::cout<<"~Transition()"<<std::endl; }
 };
@@ -282,6 +477,8 @@ private:
 class MOGI_STATECHART_PUBLIC AbstractState : public EventObserver
 {
   friend class Chart;
+  friend class Transition;
+  friend class DotExporter;
   using EventCallbackT = Callback<void, const Event &>;
 
 public:
@@ -292,35 +489,58 @@ public:
   explicit AbstractState(
     const std::string & n,
     const std::shared_ptr<Chart> & c = {})
-  : label(n), container(c) {}
+  : label(n), container(c), id_(nextId()) {}
   virtual ~AbstractState() = default;
 
+  /*!
+   \brief Process wide unique, non zero, numeric ID of the state, see
+   Chart::configuration()
+   */
+  uint32_t id() const {return id_;}
+
+  /*!
+   \brief Tells the visits of the state apart: the same number for as long as
+   the state stays active, another one once it is left, be it by a
+   self-transition. While the state is not active, the number of its next
+   visit. See Chart::post(Event &, const std::shared_ptr<AbstractState> &, uint64_t)
+   */
+  uint64_t visit() const {return activation_.load() | 1;}
+
   /*!
    \brief Creates a new Transition to another state with action callback.
    @param dst The State to transition to.
    @param action Action callback, called when transition is triggered
    @return The newly created Transition.
    */
-  template<typename ActionT = Callback<void>>
+  template<typename ActionT = NoAction>
   std::shared_ptr<Transition> createTransition(
     const std::shared_ptr<AbstractState> & dst,
-    ActionT action = Callback<void>{[]() {}})
+    ActionT action = NoAction{})
   {
-    /* if dst is not contained in the same chart, throw an exception */
-    if (container.lock() != dst->container.lock()) {
-      throw std::runtime_error(
-              dst->name() + " and " + name() + " are not in the same chart");
-    }
-    auto transition = std::make_shared<Transition>(
-      Transition::Enabler{}, container,
-      sharedPtr<AbstractState>(), dst,
-      std::forward<ActionT>(action));
-    outgoingTransitions.insert(transition);
-    return transition;
+    return makeTransition(dst, std::forward<ActionT>(action), false);
   }
 
   /*!
-   \brief Removes a Transition from this state.
+   \brief Creates a UML completion transition: it is taken, within the same
+   step, as soon as this state isCompleted(), i.e. a subchart entered its
+   final state or the do-activity of a State finished. Guards may be added,
+   events may not.
+   @param dst The State to transition to.
+   @param action Action callback, called when transition is triggered
+   @return The newly created Transition.
+   */
+  template<typename ActionT = NoAction>
+  std::shared_ptr<Transition> createCompletionTransition(
+    const std::shared_ptr<AbstractState> & dst,
+    ActionT action = NoAction{})
+  {
+    return makeTransition(dst, std::forward<ActionT>(action), true);
+  }
+
+  /*!
+   \brief Removes a Transition from this state. A chart stepping in another
+   thread may still take it, and call its action and guards, until the step
+   in progress ends
    @param transition The Transition to be removed.
    */
   void removeTransition(const std::shared_ptr<Transition> & transition);
@@ -334,7 +554,7 @@ public:
   /*!
    \brief Number of transitions coming out of this state
   */
-  int getTransistionCount() const {return outgoingTransitions.size();}
+  int getTransistionCount() const {return outgoingTransitions.read()->size();}
 
   /*!
    \brief Check if this state is currently active in the chart
@@ -352,11 +572,16 @@ public:
   bool createEventCallback(Event & event, CallbackT && callback)
   {
     event.addObserver(sharedPtr<EventObserver>());
-    return eventCallbacks.emplace(
-      std::make_pair(
-        &event,
-        std::forward<CallbackT>(callback)))
-           .second;
+    bool inserted = false;
+    eventCallbacks.update(
+      [&](EventCallbackMapT & callbacks) {
+        inserted = callbacks.emplace(
+          std::make_pair(
+            &event,
+            std::forward<CallbackT>(callback)))
+        .second;
+      });
+    return inserted;
   }
 
   /*!
@@ -369,7 +594,33 @@ public:
   /*!
    \brief Number of events this state is subscribed to
   */
-  int eventCount() {return eventCallbacks.size();}
+  int eventCount() {return eventCallbacks.read()->size();}
+
+  /*!
+   \brief Defers an event while this state is active (UML deferred event).
+   Unless a transition out of this state is subscribed to it, the event is
+   kept in the containing chart's deferral queue and dispatched again after
+   the chart's next state change, one event per step so that none is lost to
+   another one taking the same transition
+   @param event Event to be deferred
+   @return true on success
+  */
+  bool deferEvent(Event & event);
+
+  /*!
+   \brief Stops deferring an event
+   @param event Previously deferred event
+   @return true on success
+  */
+  bool removeDeferredEvent(Event & event);
+
+  /*!
+   \brief test if this state defers event
+  */
+  bool defersEvent(const Event & event) const
+  {
+    return deferredEvents.read()->count(&event) > 0;
+  }
 
   /*!
    \brief Travers the chart as far as neccessary to retrieve the outmost containing chart
@@ -381,6 +632,22 @@ public:
    */
   virtual const std::string & name() const {return label;}
 
+  /*!
+   \brief true once the work of the state is done and its completion
+   transitions may be taken. Only meaningful while the state is active
+   */
+  virtual bool isCompleted() const {return true;}
+
+  /*!
+   \brief Visits and dwell time counted while the chart isProfiling(), the
+   current visit is counted once the state is left
+   */
+  StateStats stats() const
+  {
+    return StateStats{visits_.load(std::memory_order_relaxed),
+      std::chrono::nanoseconds(dwellNs_.load(std::memory_order_relaxed))};
+  }
+
 protected:
   /*! The state's name.
    */
@@ -404,20 +671,191 @@ protected:
   void notify(const Event &) override;
 
 private:
+  using TransitionSetT = std::unordered_set<std::shared_ptr<Transition>>;
+  using EventCallbackMapT = std::unordered_map<const Event *, EventCallbackT>;
+
+  template<typename ActionT>
+  std::shared_ptr<Transition> makeTransition(
+    const std::shared_ptr<AbstractState> & dst,
+    ActionT && action, bool completion)
+  {
+    /* if dst is not contained in the same chart, throw an exception */
+    if (container.lock() != dst->container.lock()) {
+      throw std::runtime_error(
+              dst->name() + " and " + name() + " are not in the same chart");
+    }
+    checkMutable();
+    /* the kind is fixed before publishing, the chart may already see it */
+    auto transition = std::make_shared<Transition>(
+      Transition::Enabler{}, container,
+      sharedPtr<AbstractState>(), dst,
+      std::forward<ActionT>(action), completion);
+    outgoingTransitions.update([&transition](TransitionSetT & set) {set.insert(transition);});
+    return transition;
+  }
+
   std::weak_ptr<Chart> container;
-  std::unordered_set<std::shared_ptr<Transition>> outgoingTransitions;
+  Rcu<TransitionSetT> outgoingTransitions;
   std::atomic<bool> is_active_{false};
-  std::unordered_map<const Event *, EventCallbackT> eventCallbacks;
+  /* counts entries and exits, tells the activations of the state apart.
+   * Odd from the moment the chart commits to entering the state until it
+   * leaves it, events are latched for transitions out of it meanwhile
+   */
+  std::atomic<uint64_t> activation_{0};
+  /* activation the state was entered in from another state, self-transitions
+   * keep it: latches of any activation since are still taken. Only used by
+   * the thread stepping the chart
+   */
+  uint64_t enteredActivation_{0};
+  /* see Chart::setProfiling(), enteredAt_ is only used by the chart thread */
+  std::atomic<uint64_t> visits_{0};
+  std::atomic<uint64_t> dwellNs_{0};
+  std::chrono::steady_clock::time_point enteredAt_;
+  const uint32_t id_;
+  Rcu<EventCallbackMapT> eventCallbacks;
+  Rcu<std::unordered_set<const Event *>> deferredEvents;
 
   void setActive(bool active) {is_active_.store(active);}
+  void beginActivation();
+  void endActivation(bool reentering = false);
+  bool hasTransitionOn(const Event & event) const;
+  static uint32_t nextId();
+
+  /* see Chart::lock() */
+  std::atomic<bool> frozen_{false};
+  std::vector<Transition *> frozenTransitions_;
+  bool frozenTransient_{false};
+  void freeze(bool frozen);
+  void checkMutable() const;
+
+  /* has an unconditional transition, from the thread stepping the chart */
+  bool isTransient() const;
+};
+
+/*!
+ @struct RealTimeOptions
+ \brief Scheduling of the thread started by Chart::spinAsync(), for charts
+ stepped at a fixed rate by a real-time controller. The defaults start a
+ plain thread stepping back to back
+ */
+struct RealTimeOptions
+{
+  /*! SCHED_FIFO priority, 1 to 99, 0 keeps the default policy */
+  int priority{0};
+  /*! CPUs the thread may run on, empty for any. Each from 0 to
+   * CPU_SETSIZE - 1 */
+  std::vector<int> cpus;
+  /*! lock the pages of the process, current and future, in memory */
+  bool lockMemory{false};
+  /*! bytes of stack touched before the first step, so that steps don't page
+   * fault on it. Must fit in the thread's stack */
+  size_t prefaultStack{0};
+  /*! time between the beginnings of two steps, on absolute deadlines.
+   * Zero steps back to back */
+  std::chrono::nanoseconds period{0};
+  /*! NUMA node the thread allocates from, and runs on when cpus is empty,
+   * -1 for none. See Placement */
+  int numaNode{-1};
+};
+
+/*!
+ @struct ValidationIssue
+ \brief A defect found by Chart::validate()
+ */
+struct ValidationIssue
+{
+  enum class Kind : uint8_t
+  {
+    /*! initial has no outgoing transition */
+    MissingInitialTransition,
+    /*! no path from initial leads to the state */
+    UnreachableState,
+    /*! the destination of a transition no longer exists */
+    DanglingTransition,
+    /*! the destination of a transition was removed from the chart */
+    RemovedTarget,
+    /*! two guard-free transitions out of a state share their trigger */
+    Nondeterministic,
+  };
+
+  Kind kind;
+  /*! name of the chart the state belongs to */
+  std::string chart;
+  /*! name of the offending state */
+  std::string state;
+  std::string message;
+};
+
+/*!
+ @struct Configuration
+ \brief Fixed size record of a chart's active configuration, see
+ Chart::configuration()
+ */
+struct Configuration
+{
+  /*! nesting levels recorded, deeper ones are cut off */
+  static constexpr size_t maxDepth = 8;
+
+  /*! steps taken by the chart, i.e. Do phases of the outmost chart */
+  uint64_t step{0};
+  /*! number of valid entries in path */
+  uint32_t depth{0};
+  /*! AbstractState::id() of the current state of each level, outmost first */
+  uint32_t path[maxDepth] {};
+
+  /*! true if the state with the given id is active at some level */
+  bool contains(uint32_t id) const
+  {
+    for (uint32_t i = 0; i < depth && i < maxDepth; ++i) {
+      if (path[i] == id) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+/*!
+ \brief What a chart did with an event posted with an acknowledgement, see
+ Chart::post()
+ */
+enum class EventOutcome : uint8_t
+{
+  /*! a transition on the event was taken */
+  Consumed,
+  /*! no active state had a use for it, or guards held its transitions back */
+  Ignored,
+  /*! an active state deferred it */
+  Deferred,
+  /*! never delivered: its queue was full, or the chart was destroyed first */
+  Dropped,
+};
+
+/*!
+ @struct EventAck
+ \brief Acknowledgement of a posted event, once the chart processed it: at
+ the end of the step it was delivered in
+ */
+struct EventAck
+{
+  EventOutcome outcome{EventOutcome::Dropped};
+  /*! AbstractState::id() of the innermost active state, 0 if dropped */
+  uint32_t state{0};
+  /*! the active configuration, step included */
+  Configuration configuration;
 };
 
 class Chart final : public AbstractState
 {
   friend void Transition::notify(const Event & event);
+  friend void AbstractState::notify(const Event & event);
+  friend class EventBus;
+  friend class DotExporter;
 
 public:
   using StateChangeCallbackT = Callback<void, const std::string &>;
+  using ConfigurationPredicateT = std::function<bool(const Configuration &)>;
+  using EventAckCallbackT = std::function<void(const EventAck &)>;
   /*!
    \brief Creates a new state chart, which includes two automatically generated
    states `Initial` and `Final`
@@ -458,12 +896,17 @@ public:
   /*!
    \brief get auto-generated `Initial` state
    */
-  const std::shared_ptr<AbstractState> & getInitialState() {return states_.at("initial");}
+  const std::shared_ptr<AbstractState> & getInitialState() {return initial_;}
 
   /*!
    \brief get auto-generated `Final` state
    */
-  const std::shared_ptr<AbstractState> & getFinalState() {return states_.at("final");}
+  const std::shared_ptr<AbstractState> & getFinalState() {return final_;}
+
+  /*!
+   \brief true while the chart is in its final state
+   */
+  bool isCompleted() const override {return currentState.load() == final_.get();}
 
   /*!
    \brief get active state name
@@ -476,13 +919,30 @@ public:
   /*!
    \brief get full qualified name of active state name, with containing
    subchart name as prefix if applicable
+   \note Walks the chart while it may be changing, threads monitoring a
+   running chart should poll configuration() instead
    */
   const std::string getCurrentStateNameFull() const;
 
+  /*!
+   \brief Copies the active configuration of this chart, as of its last
+   state change or step. Safe from any number of threads: it neither locks
+   nor allocates, and only retries while the chart thread is in the middle
+   of publishing a new record. Only meaningful on an outmost chart
+  */
+  Configuration configuration() const;
+
+  /*!
+   \brief Names a configuration of this chart the way
+   getCurrentStateNameFull() does, e.g. "sub:inner". Allocates, meant for
+   logging. Unknown IDs (removed states) are named "?"
+  */
+  std::string configurationName(const Configuration & configuration) const;
+
   /*!
    \brief get number of states contained in this chart
    */
-  int getStateCount() const {return states_.size();}
+  int getStateCount() const {return states_.read()->size();}
 
   /*!
    \brief Adds a state change callback on this chart. Upon any state transition
@@ -495,22 +955,61 @@ public:
   createStateChangeCallback(CallbackT callback)
   {
     auto c = std::make_shared<StateChangeCallbackT>(std::forward<CallbackT>(callback));
-    stateChangeCallbacks.push_back(c);
+    stateChangeCallbacks.update(
+      [&c](std::vector<std::shared_ptr<StateChangeCallbackT>> & callbacks) {
+        callbacks.push_back(c);
+      });
     return c;
   }
 
   /*!
-   \brief remove a state change callback
+   \brief remove a state change callback. A chart stepping in another thread
+   may still call it until the step in progress ends, what it captures must
+   outlive that step
    @param callback Callback function to be removed, should have been returned
    by calling createStateChangeCallback() previously
   */
   void removeStateChangeCallback(const std::shared_ptr<StateChangeCallbackT> & c);
 
+  /*!
+   \brief Subscribes a channel to the state changes of this chart (not of its
+   subcharts). Unlike state change callbacks, records are queued without
+   allocation and consumed by the subscriber from its own thread, see
+   StateChangeChannel in mogi_statechart/channel.hpp
+   @param capacity Records the channel holds, rounded up to a power of two
+   @param policy What to do when the channel is full
+   @return The channel, the subscription ends with its last reference
+  */
+  std::shared_ptr<StateChangeChannel> createStateChangeChannel(
+    size_t capacity = 1024,
+    OverflowPolicy policy = OverflowPolicy::CountDrops);
+
+  /*!
+   \brief Name of the state with the given id() in this chart or its
+   subcharts, "?" if there is none
+  */
+  std::string stateName(uint32_t id) const;
+
   /*!
    \brief start the chart process asyncronously
    this will start a new thread
   */
-  void spinAsync();
+  void spinAsync() {spinAsync(RealTimeOptions{});}
+
+  /*!
+   \brief Same as spinAsync(), the thread being set up as described by
+   options before its first step. Throws runtime_error, without starting, if
+   the system refuses a setting (e.g. SCHED_FIFO without CAP_SYS_NICE or an
+   rtprio limit); other exceptions of the set-up are rethrown as they are.
+
+   Once lock()ed and warmed up, i.e. every state visited once, a step does
+   not allocate nor lock, as long as the chart's own callbacks don't (guards,
+   actions, state change callbacks and channels), events triggered from other
+   threads included. Events triggered from an action, posted events and
+   events routed by an EventBus still lock, and so do do-activities when
+   created and state changes while a when() future is pending
+  */
+  void spinAsync(const RealTimeOptions & options);
 
   /*!
    \brief stop updating the chart
@@ -532,6 +1031,101 @@ public:
   */
   void spinToState(const std::string & name);
 
+  /*!
+   \brief Blocks the calling thread until the state with the given id() is
+   active, at any level, or timeout elapsed. The chart thread wakes the
+   waiter when it enters a state, there is no polling. Safe from any number
+   of threads, not from the one stepping the chart
+   @return false on timeout
+  */
+  bool waitForState(uint32_t id, std::chrono::nanoseconds timeout);
+
+  bool waitForState(const AbstractState & state, std::chrono::nanoseconds timeout)
+  {
+    return waitForState(state.id(), timeout);
+  }
+
+  /*!
+   \brief Same as waitForState(), until predicate holds for configuration().
+   It is evaluated in the calling thread on every state change, holding a
+   lock the chart thread takes to report the change: keep it short
+   @return false on timeout
+  */
+  bool waitUntil(const ConfigurationPredicateT & predicate, std::chrono::nanoseconds timeout);
+
+  /*!
+   \brief Future made ready with the configuration once the state with the
+   given id() is active, at any level. Ready at once if it already is
+  */
+  std::future<Configuration> whenState(uint32_t id);
+
+  /*!
+   \brief Same as whenState(), given up after timeout, see when()
+  */
+  std::future<Configuration> whenState(uint32_t id, std::chrono::nanoseconds timeout);
+
+  /*!
+   \brief Future made ready with the first configuration, from now on, that
+   satisfies predicate. Unlike waitUntil(), predicate is evaluated by the
+   chart thread on each state change while the future is pending: it should
+   not block. A future still pending when the chart is destroyed reports a
+   broken promise.
+
+   A pending future can't be cancelled, dropping it is not enough: until
+   predicate holds, every state change takes a lock and evaluates it, locked
+   charts included. Give a timeout to bound that
+  */
+  std::future<Configuration> when(ConfigurationPredicateT predicate);
+
+  /*!
+   \brief Same as when(), given up after timeout: the first state change
+   past it reports runtime_error through the future and forgets predicate
+  */
+  std::future<Configuration> when(
+    ConfigurationPredicateT predicate,
+    std::chrono::nanoseconds timeout);
+
+  /*!
+   \brief Steps the chart until a step takes no transition and no posted,
+   routed or replayable deferred event is left to deliver, e.g. it waits for
+   an event, a guard or an activity. Only for an outmost chart that is not
+   running. Throws runtime_error, naming the states it was still moving
+   through, if it hasn't settled within maxSteps steps: a livelock such as a
+   cycle of transitions that are always eligible
+   @return number of steps that took a transition, 0 if the chart was
+   already settled
+  */
+  size_t runToQuiescence(size_t maxSteps = 1000);
+
+  /*!
+   \brief When set, a step doesn't stop in a transient state, one with a
+   transition that has neither guard nor event (e.g. initial): the step
+   goes on through it, and through chains of them, up to the first state
+   that has to wait. Their entry, do and exit callbacks are still called
+   and state changes reported. Off by default: one transition per step.
+   Applies to the subcharts this chart has at the time of the call
+  */
+  void setCollapseTransients(bool collapse);
+
+  bool collapsesTransients() const {return collapseTransients_.load();}
+
+  /*!
+   \brief When set, the chart thread counts the fires and action time of
+   every transition and the visits and dwell time of every state, see
+   Transition::stats(), AbstractState::stats() and DotExporter. Costs two
+   clock reads per transition. Applies to the subcharts this chart has at
+   the time of the call
+  */
+  void setProfiling(bool profiling);
+
+  bool isProfiling() const {return profiling_.load();}
+
+  /*!
+   \brief Most transient states a step goes through, the step ends in the
+   last one so that a cycle of them cannot hold it forever
+  */
+  static constexpr unsigned maxTransientChain = 64;
+
   /*!
    \brief reset the chart to initial status
    if the state is running asyncronously it will be stopped
@@ -539,15 +1133,161 @@ public:
   */
   void reset();
 
+  /*!
+   \brief Checks the structure of the chart and its subcharts: a transition
+   out of initial, every state reachable from initial, no transition to a
+   state destroyed or removed, no two guard-free transitions of a state on
+   the same trigger
+   @return the issues found, empty if the chart is sound
+  */
+  std::vector<ValidationIssue> validate() const;
+
+  /*!
+   \brief Validates the chart, throwing runtime_error on any issue, then
+   freezes its structure and that of its subcharts: states, transitions,
+   guards and transition events can no longer be added or removed (doing so
+   throws runtime_error) and the chart steps without the checks and lookups
+   a changing structure needs. Callbacks and event callbacks can still be
+   set. Briefly pauses a running chart
+  */
+  void lock();
+
+  /*!
+   \brief Undoes lock()
+  */
+  void unlock();
+
+  bool isLocked() const {return frozen_.load();}
+
   /*!
    \brief return true is the chart is running
   */
   bool isRunning() {return is_running_;}
 
+  /*!
+   \brief Queues an event to be triggered by the chart itself, from the
+   thread running it, instead of triggering it from the calling thread.
+   Unlike Event::trigger() posted events are never merged, each is given a
+   step of its own.
+
+   Each priority class has its own queue, one event is delivered at the
+   beginning of each step, highest priority first (see setStarvationLimit()),
+   and ahead of events routed by an EventBus.
+   Posting to a subchart posts to its outmost chart. Only the states and
+   transitions of that chart and its subcharts see the event, not those of
+   other charts listening to it; recorders and coroutines waiting for it do.
+   Safe to call from any thread.
+   @return false if the queue of this priority is full, the event is dropped
+  */
+  bool post(Event & event) {return post(event, event.priority());}
+
+  /*!
+   \brief Same as post(event), overriding the event's priority
+  */
+  bool post(Event & event, EventPriority priority);
+
+  /*!
+   \brief Same as post(event), acknowledge being called with the outcome once
+   the chart processed the event, from the chart thread. Acknowledged posts
+   are never coalesced. When an event is dropped to make room for another
+   (DropOldest), acknowledge is called from the posting thread, as it is
+   from the destructor of the chart for the events still queued
+   @return false if the queue is full, acknowledge is not called then
+  */
+  bool post(Event & event, EventAckCallbackT acknowledge)
+  {
+    return post(event, event.priority(), std::move(acknowledge));
+  }
+
+  bool post(Event & event, EventPriority priority, EventAckCallbackT acknowledge);
+
+  /*!
+   \brief post() with an acknowledgement, as a future. A full queue makes
+   it ready at once, with EventOutcome::Dropped
+  */
+  std::future<EventAck> postAcknowledged(Event & event)
+  {
+    return postAcknowledged(event, event.priority());
+  }
+
+  std::future<EventAck> postAcknowledged(Event & event, EventPriority priority);
+
+  /*!
+   \brief Same as post(event), for the given visit() of state only: when
+   state has been left since, or destroyed, the event is discarded instead
+   of being delivered. E.g. the completion of work started by a visit of the
+   state, which must not be taken by the next one. Never coalesced
+   @return false if the queue is full, the event is dropped
+  */
+  bool post(Event & event, const std::shared_ptr<AbstractState> & state, uint64_t visit);
+
+  /*!
+   \brief Capacity of each priority queue, 1024 events by default. The queues
+   are allocated once, by this call or by the first post(). When shrinking,
+   the newest events that don't fit are dropped and acknowledged as such
+  */
+  void setEventQueueCapacity(size_t capacity);
+
+  /*!
+   \brief What post() does when the queue of the event's priority is full,
+   CountDrops (reject) by default. Block makes the producer wait for room up
+   to blockTimeout, then reject; posting from the thread stepping the chart
+   (its spinAsync() thread, or the caller of spinOnce(), runToQuiescence()...)
+   never blocks. Coalesce scans the queue, in O(depth)
+  */
+  void setEventQueuePolicy(
+    OverflowPolicy policy,
+    std::chrono::nanoseconds blockTimeout = std::chrono::milliseconds(10));
+
+  /*!
+   \brief Depth, high-water mark and drop counters of the event queues
+  */
+  EventQueueStats eventQueueStats() const;
+
+  /*!
+   \brief Starvation protection: once a queued event has been passed over by
+   limit events of higher priority, it is delivered next. 0 disables the
+   protection, i.e. strict priority. 32 by default
+  */
+  void setStarvationLimit(unsigned limit);
+
+  /*!
+   \brief Number of posted events not delivered yet
+  */
+  size_t queuedEventCount() const;
+
+  /*!
+   \brief Number of posted events dropped because their queue was full
+  */
+  uint64_t droppedEventCount() const;
+
+  /*!
+   \brief Sets the capacity of the deferral queue, 1024 events by default.
+   The queue is allocated once, by this call or when the first event gets
+   deferred, never per event. Events deferred while the queue is full, or
+   that don't fit a smaller capacity, are dropped
+  */
+  void setDeferredQueueCapacity(size_t capacity);
+
+  /*!
+   \brief Number of events waiting in the deferral queue
+  */
+  size_t deferredEventCount() const;
+
+  /*!
+   \brief Events the deferral queue holds, 0 until it is allocated
+  */
+  size_t deferredQueueCapacity() const;
+
+  /*!
+   \brief Number of deferred events dropped because the queue was full
+  */
+  uint64_t droppedDeferredEventCount() const;
+
   void printStates()
   {
     std::cout << name() << ":[ ";
-    for (const auto & s : states_) {
+    for (const auto & s : *states_.read()) {
       auto c = dynamic_cast<Chart *>(s.second.get());
       if (c) {
         c->printStates();
@@ -585,21 +1325,181 @@ private:
 
   std::shared_ptr<Chart> getSharedPtr() {return sharedPtr<Chart>();}
 
-  std::unordered_map<std::string, std::shared_ptr<AbstractState>> states_;
+  using StateMapT = std::unordered_map<std::string, std::shared_ptr<AbstractState>>;
+
+  Rcu<StateMapT> states_;
+  /* never removed, kept apart so that references to them stay valid */
+  std::shared_ptr<AbstractState> initial_;
+  std::shared_ptr<AbstractState> final_;
   std::atomic<AbstractState *> currentState;
   std::atomic<Transition *> pendingTransition;
 
-  std::vector<std::shared_ptr<StateChangeCallbackT>> stateChangeCallbacks;
+  /* one step: process() up to a Do phase, see setCollapseTransients() */
+  void step();
+  std::atomic<bool> collapseTransients_{false};
+  std::atomic<bool> profiling_{false};
+  /* states entered by the chart and its subcharts, counted on the outmost
+   * chart by its thread
+   */
+  uint64_t entries_{0};
+
+  Rcu<std::vector<std::shared_ptr<StateChangeCallbackT>>> stateChangeCallbacks;
+  Rcu<std::vector<std::weak_ptr<StateChangeChannel>>> stateChangeChannels_;
+  void publishStateChange(uint64_t step);
+
+  /* events posted to this chart, one queue per EventPriority */
+  static constexpr size_t priorityCount = 4;
+  mutable std::mutex queueMutex_;
+  struct Posted
+  {
+    Event * event{nullptr};
+    std::unique_ptr<EventAckCallbackT> ack;
+    /* delivered only during this AbstractState::visit() of the state, if set */
+    std::weak_ptr<AbstractState> visited;
+    uint64_t visit{0};
+  };
+  RingBuffer<Posted> queues_[priorityCount];
+  /* how many times the head of each queue was passed over */
+  unsigned passedOver_[priorityCount] {};
+  unsigned starvationLimit_{32};
+  std::atomic<size_t> queuedCount_{0};
+  uint64_t queueDropped_{0};
+  OverflowPolicy queuePolicy_{OverflowPolicy::CountDrops};
+  std::chrono::nanoseconds blockTimeout_{std::chrono::milliseconds(10)};
+  /* Block producers waiting for room */
+  std::condition_variable queueSpace_;
+  unsigned blockedProducers_{0};
+  EventQueueStats queueStats_;
+  void deliverQueued();
+  bool enqueue(
+    Event & event, EventPriority priority, std::unique_ptr<EventAckCallbackT> ack,
+    const std::shared_ptr<AbstractState> & visited = {}, uint64_t visit = 0);
+  /* acknowledgement of the event being delivered, sent at the end of the
+   * step, by the outmost chart
+   */
+  std::unique_ptr<EventAckCallbackT> ack_;
+  bool ackDeferred_{false};
+  /* the event of ack_, and whether a transition on it was taken since by
+   * this chart or a subchart
+   */
+  const Event * acknowledgedEvent_{nullptr};
+  bool acknowledgedConsumed_{false};
+  void acknowledge();
+  /* records a transition taken in this chart's step for ack_ */
+  void noteTaken(const Transition & transition);
+  /* reallocates the queues from the calling thread, i.e. on its NUMA node */
+  void relocateQueues();
+
+  void freezeAll(bool frozen);
+  void validateInto(std::vector<ValidationIssue> & issues) const;
+
+  /* events routed to this chart by an EventBus, created by the first
+   * subscription and kept for the chart's lifetime
+   */
+  using InboxT = MpmcQueue<const Event *>;
+  std::shared_ptr<InboxT> inbox_;
+  std::atomic<InboxT *> inboxPtr_{nullptr};
+  std::shared_ptr<InboxT> busInbox(size_t capacity);
+  void deliverInbox();
+  /* notifies the active configuration only, unlike Event::trigger() */
+  void deliverLocal(const Event & event);
+  /* notifies the states and transitions of this chart and its subcharts,
+   * and if others the observers which are neither (recorders, coroutines
+   * waiting for the event), unlike Event::trigger()
+   */
+  void deliverOwn(const Event & event, bool others);
+  /* events the states of this chart and its subcharts react to */
+  void listenedEvents(std::unordered_set<const Event *> & events) const;
+
+  /* events deferred by states of this chart, see AbstractState::deferEvent()
+   */
+  mutable std::mutex deferredMutex_;
+  RingBuffer<const Event *> deferred_;
+  std::atomic<size_t> deferredCount_{0};
+  uint64_t deferredDropped_{0};
+  /* events at the front of the queue still to replay in this state, chart
+   * thread only
+   */
+  size_t replayable_{0};
+  void pushDeferred(const Event & event);
+  void dispatchDeferred();
+  /* events still to deliver by the next steps: posted, routed, or deferred
+   * and replayable in the active configuration. Chart thread only
+   */
+  bool hasPendingEvents() const;
+
+  /* seqlock of the configuration record, written by the chart thread only.
+   * The record is kept in atomics so that readers racing the writer are
+   * well defined, the sequence number tells them to retry
+   */
+  std::atomic<uint64_t> configSeq_{0};
+  std::atomic<uint64_t> configStep_{0};
+  std::atomic<uint32_t> configDepth_{0};
+  std::atomic<uint32_t> configPath_[Configuration::maxDepth] {};
+  uint64_t steps_{0};
+  void publishConfiguration();
+  void publishStep();
+
+  /* threads blocked in waitUntil() and pending when() futures, woken by
+   * the chart thread on state changes. The count spares it the lock when
+   * nobody waits
+   */
+  struct Watch
+  {
+    ConfigurationPredicateT predicate;
+    std::promise<Configuration> promise;
+    std::chrono::steady_clock::time_point deadline;
+  };
+  std::mutex waitMutex_;
+  std::condition_variable waitCv_;
+  std::vector<Watch> watches_;
+  std::atomic<size_t> waiters_{0};
+  void notifyWaiters();
+  std::future<Configuration> watch(
+    ConfigurationPredicateT predicate,
+    std::chrono::steady_clock::time_point deadline);
 
   enum class ProcessState {Entry, Do, Exit} processState{ProcessState::Entry};
   void process();
+
+  /* restores the initial state, reset() less the stop() */
+  void restart();
+  /* steps until stop(), one step per period if not zero */
+  void run(std::chrono::nanoseconds period);
+
+  /* serializes spinAsync() and stop() */
+  std::mutex runMutex_;
+  /* of the last spinAsync(), to restart the same way */
+  RealTimeOptions runOptions_;
   std::thread process_thread_;
-  std::promise<void> exit_signal_;
-  std::shared_future<void> future_;
+  /* of the thread in step(), spin() or spinAsync() */
+  std::atomic<std::thread::id> processThreadId_{};
 
   std::atomic<bool> is_running_ {false};
 };
 
+/*!
+ @class Activity
+ \brief A long running do-activity, stepped by the chart instead of blocking
+ it. See State::setActivity()
+
+ A new activity is created each time its state is entered, resume() is
+ called on every chart step until it reports completion, and the activity
+ is destroyed when the state is left, finished or not. Cancellation is the
+ destructor's job.
+ */
+class Activity
+{
+public:
+  virtual ~Activity() = default;
+
+  /*!
+   \brief Runs the activity until it needs to wait again
+   @return true once the activity has completed
+   */
+  virtual bool resume() = 0;
+};
+
 class State : public AbstractState
 {
   friend std::shared_ptr<State> Chart::createState(const std::string & n);
@@ -613,6 +1513,12 @@ private:
   Callback<void> entry_callback_ {[]() {}};
   Callback<void> do_callback_ {[]() {}};
   Callback<void> exit_callback_ {[]() {}};
+  /* which of them were set, the others are not called */
+  enum CallbackBit : uint8_t {EntryBit = 1, DoBit = 2, ExitBit = 4};
+  std::atomic<uint8_t> setCallbacks_{0};
+  Rcu<std::function<std::unique_ptr<Activity>()>> activity_factory_;
+  std::unique_ptr<Activity> activity_;
+  bool activity_done_ {false};
 
 public:
   /*!
@@ -623,6 +1529,7 @@ public:
   void setCallbackEntry(CallbackT && callback)
   {
     entry_callback_.set(std::forward<CallbackT>(callback));
+    setCallbacks_.fetch_or(EntryBit, std::memory_order_release);
   }
 
   /*!
@@ -634,6 +1541,7 @@ public:
   void setCallbackDo(CallbackT && callback)
   {
     do_callback_.set(std::forward<CallbackT>(callback));
+    setCallbacks_.fetch_or(DoBit, std::memory_order_release);
   }
 
   /*!
@@ -644,23 +1552,46 @@ public:
   void setCallbackExit(CallbackT && callback)
   {
     exit_callback_.set(std::forward<CallbackT>(callback));
+    setCallbacks_.fetch_or(ExitBit, std::memory_order_release);
+  }
+
+  /*!
+   \brief Sets a do-activity. factory is called upon entering this state and
+   the Activity it returns is resumed on every chart spin*() after the Do
+   callback, until it completes. Leaving the state destroys the activity,
+   cancelling it if it is still running
+  */
+  template<typename FactoryT>
+  void setActivity(FactoryT && factory)
+  {
+    activity_factory_.publish(std::forward<FactoryT>(factory));
   }
 
+  /*!
+   \brief true once the activity started by the last entry completed
+  */
+  bool isActivityDone() const {return activity_done_;}
+
+  /*!
+   \brief true once the do-activity finished, right away without activity
+   */
+  bool isCompleted() const override {return !activity_ || activity_done_;}
+
 protected:
   /*!
    \brief Called when the state becomes the current state in the Diagram.
    */
-  void actionEntry() override {entry_callback_.invoke();}
+  void actionEntry() override;
   /*!
    \brief Called on each call Diagram::process() when this state is current in
    the Diagram.
    */
-  void actionDo() override {do_callback_.invoke();}
+  void actionDo() override;
   /*!
    \brief Called just before transition out of this state, when current in the
    Diagram.
    */
-  void actionExit() override {exit_callback_.invoke();}
+  void actionExit() override;
   /*!
    \brief Called on each occurrence of an Event when this state is current in the
    Diagram.
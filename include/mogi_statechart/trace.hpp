@@ -0,0 +1,126 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOGI_STATECHART__TRACE_HPP_
+#define MOGI_STATECHART__TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include "mogi_statechart/visibility_control.h"
+
+namespace mogi
+{
+namespace statechart
+{
+
+/*!
+ @class Tracer
+ \brief Writes a Chrome Trace Event file, to open in chrome://tracing or
+ ui.perfetto.dev.
+
+ A library built with MOGI_STATECHART_TRACING traces every chart step, the
+ entry, do and exit callbacks of its states, guard evaluations and the
+ actions of the transitions taken, subcharts nested inside their parent's
+ step. Built without it (the default) the library has no trace point at all.
+ The application adds its own slices to the same timeline:
+ \code
+ Tracer::start("chart.json");
+ {
+   Tracer::Slice slice{"request", "handle"};
+   chart->post(go);
+ }
+ Tracer::stop();
+ \endcode
+ Each thread buffers its events and writes them to the file in blocks of
+ Tracer::bufferSize bytes, when it exits and on stop()
+ */
+class MOGI_STATECHART_PUBLIC Tracer
+{
+public:
+  /*! bytes of events a thread buffers before writing them out */
+  static constexpr size_t bufferSize = 64 * 1024;
+
+  /*!
+   @class Slice
+   \brief Traces its own lifetime as a slice of the calling thread. Costs an
+   atomic load when tracing is stopped, the name is only built when started
+   */
+  class MOGI_STATECHART_PUBLIC Slice
+  {
+public:
+    Slice(const char * category, const char * name);
+    Slice(const char * category, const std::string & name);
+    /*! prefix + name, then " -> " + *to if given */
+    Slice(
+      const char * category, const char * prefix, const std::string & name,
+      const std::string * to = nullptr);
+    ~Slice();
+
+    Slice(const Slice &) = delete;
+    Slice & operator=(const Slice &) = delete;
+
+private:
+    const char * category_;
+    std::string name_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  /*!
+   \brief Starts tracing into a new file at path, throws runtime_error if it
+   cannot be created or tracing is already started
+   */
+  static void start(const std::string & path);
+
+  /*!
+   \brief Writes out every thread's buffer and closes the file. Slices still
+   open are not traced
+   */
+  static void stop();
+
+  static bool isEnabled() {return enabled_.load(std::memory_order_relaxed);}
+
+  /*!
+   \brief Whether the library's own trace points were compiled in, i.e. it
+   was built with MOGI_STATECHART_TRACING
+   */
+  static bool isCompiledIn();
+
+  /*!
+   \brief Names the calling thread in the trace, threads are otherwise
+   numbered in the order they first trace
+   */
+  static void setThreadName(const std::string & name);
+
+private:
+  static std::atomic<bool> enabled_;
+};
+
+}  // namespace statechart
+}  // namespace mogi
+
+/* the library's trace points, nothing unless built with MOGI_STATECHART_TRACING */
+#if defined(MOGI_STATECHART_TRACING)
+#define MOGI_STATECHART_TRACE_CONCAT_(a, b) a ## b
+#define MOGI_STATECHART_TRACE_VARIABLE_(line) MOGI_STATECHART_TRACE_CONCAT_(traceSlice, line)
+#define MOGI_STATECHART_TRACE_SLICE(...) \
+  ::mogi::statechart::Tracer::Slice MOGI_STATECHART_TRACE_VARIABLE_(__LINE__) {__VA_ARGS__}
+#define MOGI_STATECHART_TRACE_THREAD(name) ::mogi::statechart::Tracer::setThreadName(name)
+#else
+#define MOGI_STATECHART_TRACE_SLICE(...)
+#define MOGI_STATECHART_TRACE_THREAD(name)
+#endif
+
+#endif  // MOGI_STATECHART__TRACE_HPP_
@@ -0,0 +1,72 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "mogi_statechart/channel.hpp"
+
+using mogi::statechart::OverflowPolicy;
+using mogi::statechart::StateChangeChannel;
+using mogi::statechart::StateChangeRecord;
+
+bool StateChangeChannel::receive(StateChangeRecord & record, std::chrono::nanoseconds timeout)
+{
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  /* spin a little, then back off to sleeps: the chart never signals */
+  auto pause = std::chrono::microseconds(1);
+  for (int spins = 0; !queue_.pop(record); ++spins) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      return false;
+    }
+    if (spins < 64) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(
+        std::min<std::chrono::nanoseconds>(pause, deadline - now));
+      pause = std::min(pause * 2, std::chrono::microseconds(1000));
+    }
+  }
+  return true;
+}
+
+void StateChangeChannel::publish(const StateChangeRecord & record)
+{
+  switch (policy_) {
+    case OverflowPolicy::CountDrops:
+    case OverflowPolicy::Coalesce:
+      if (!queue_.push(record)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+      }
+      break;
+    case OverflowPolicy::Block:
+      while (!queue_.push(record)) {
+        std::this_thread::yield();
+      }
+      break;
+    case OverflowPolicy::DropOldest:
+      {
+        StateChangeRecord oldest;
+        while (!queue_.push(record)) {
+          /* a subscriber may take it first, then there is room anyway */
+          if (queue_.pop(oldest)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      }
+      break;
+  }
+}
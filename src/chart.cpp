@@ -12,14 +12,77 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sys/mman.h>
+#include <time.h>
+
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <utility>
+#include <vector>
+#include "mogi_statechart/channel.hpp"
+#include "mogi_statechart/placement.hpp"
 #include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/trace.hpp"
 
+using mogi::statechart::AbstractState;
 using mogi::statechart::Chart;
+using mogi::statechart::Configuration;
+using mogi::statechart::Event;
+using mogi::statechart::EventAck;
+using mogi::statechart::EventOutcome;
+using mogi::statechart::EventPriority;
+using mogi::statechart::EventQueueStats;
+using mogi::statechart::OverflowPolicy;
+using mogi::statechart::Placement;
+using mogi::statechart::RealTimeOptions;
 using mogi::statechart::State;
+using mogi::statechart::StateChangeChannel;
+using mogi::statechart::StateChangeRecord;
+using mogi::statechart::Transition;
+using mogi::statechart::ValidationIssue;
+
+namespace
+{
+const size_t defaultDeferredQueueCapacity = 1024;
+const size_t defaultEventQueueCapacity = 1024;
+
+/* the calling thread steps the chart for as long as it is in scope, see
+ * OverflowPolicy::Block. Nests, e.g. in the steps of spinAsync()'s thread
+ */
+class SteppingThread
+{
+public:
+  explicit SteppingThread(std::atomic<std::thread::id> & id)
+  : id_(id), previous_(id.exchange(std::this_thread::get_id(), std::memory_order_relaxed)) {}
+
+  ~SteppingThread() {id_.store(previous_, std::memory_order_relaxed);}
+
+private:
+  std::atomic<std::thread::id> & id_;
+  std::thread::id previous_;
+};
+
+/* a huge timeout is no timeout, rather than an overflow */
+std::chrono::steady_clock::time_point deadlineAfter(std::chrono::nanoseconds timeout)
+{
+  auto now = std::chrono::steady_clock::now();
+  auto left = std::chrono::steady_clock::time_point::max() - now;
+  return timeout < left ?
+         now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout) :
+         std::chrono::steady_clock::time_point::max();
+}
+}
 
 std::shared_ptr<Chart> Chart::createChart(const std::string & n)
 {
@@ -29,15 +92,29 @@ std::shared_ptr<Chart> Chart::createChart(const std::string & n)
   }
 
   std::shared_ptr<Chart> p(new Chart(n));
-  p->currentState.store(p->createState("initial").get());
+  p->initial_ = p->createState("initial");
+  p->final_ = p->createState("final");
+  p->currentState.store(p->initial_.get());
   p->pendingTransition.store(nullptr);
-  p->createState("final");
+  p->publishConfiguration();
   return p;
 }
 
 Chart::~Chart()
 {
   stop();
+  /* the acknowledgements of events that will never be delivered */
+  for (auto & queue : queues_) {
+    for (; !queue.empty(); queue.pop()) {
+      auto ack = std::move(queue.front().ack);
+      if (ack) {
+        (*ack)(EventAck{});
+      }
+    }
+  }
+  if (ack_) {
+    (*ack_)(EventAck{});
+  }
 }
 
 std::shared_ptr<State> Chart::createState(const std::string & n)
@@ -46,22 +123,31 @@ std::shared_ptr<State> Chart::createState(const std::string & n)
   if (n == "") {
     throw std::runtime_error("State name is empty");
   }
+  checkMutable();
 
-  /* return if same state already exist */
-  auto hasState = states_.find(n);
-  if (hasState != states_.end()) {
-    return std::dynamic_pointer_cast<State>(hasState->second);
-  }
-
-  std::shared_ptr<State> s(new State(getSharedPtr(), n));
-  states_.emplace(std::make_pair(n, s));
+  /* the existing state if there is one. Looked up by the update, a read
+   * would publish the states on every call, copying them each time
+   */
+  std::shared_ptr<State> s;
+  auto self = getSharedPtr();
+  states_.update(
+    [&](StateMapT & states) {
+      auto existing = states.find(n);
+      if (existing != states.end()) {
+        s = std::dynamic_pointer_cast<State>(existing->second);
+        return;
+      }
+      s.reset(new State(self, n));
+      states.emplace(n, s);
+    });
   return s;
 }
 
 void Chart::addSubchart(const std::shared_ptr<Chart> & s)
 {
+  checkMutable();
   s->container = getSharedPtr();
-  states_.insert({s->name(), s});
+  states_.update([&s](StateMapT & states) {states.insert({s->name(), s});});
 }
 
 void Chart::removeState(const std::string & n)
@@ -70,13 +156,14 @@ void Chart::removeState(const std::string & n)
   if (n == "initial" || n == "final") {
     return;
   }
+  checkMutable();
 
   /* we just remove the states here.
    * all the transitions that have this state as
    * dst will be cleaned out as the dangling
    * weak_ptr is examined in the update loop
    */
-  states_.erase(n);
+  states_.update([&n](StateMapT & states) {states.erase(n);});
 }
 
 void Chart::removeState(const std::shared_ptr<AbstractState> & s)
@@ -86,10 +173,10 @@ void Chart::removeState(const std::shared_ptr<AbstractState> & s)
 
 bool Chart::hasState(const std::string & n)
 {
-  return states_.find(n) != states_.end();
+  return states_.read()->count(n) > 0;
 }
 
-void Chart::spinAsync()
+void Chart::spinAsync(const RealTimeOptions & options)
 {
   if (!container.expired() ) {
     // if this chart is contained in another chart as a subchart,
@@ -97,28 +184,76 @@ void Chart::spinAsync()
     return;
   }
 
-  auto wasRunning = is_running_.exchange(true);
-  if (!wasRunning) {
-    exit_signal_ = {};
-    future_ = exit_signal_.get_future();
+  std::lock_guard<std::mutex> lock{runMutex_};
+  if (is_running_.load()) {
+    return;
+  }
+  /* process wide, only pages touched from now on would fault otherwise */
+  if (options.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    throw std::runtime_error(std::string{"mlockall failed: "} + std::strerror(errno));
+  }
+  is_running_.store(true);
+  runOptions_ = options;
+  std::promise<void> setUp;
+  auto setUpResult = setUp.get_future();
+  try {
     process_thread_ = std::thread(
-      [this]() -> void {
-        std::future_status status;
-        do {
-          do {
-            this->process();
-          } while (processState != ProcessState::Do);
-          status = this->future_.wait_for(std::chrono::seconds(0));
-        } while (status == std::future_status::timeout);
+      [this, options, &setUp]() -> void {
+        /* anything escaping the thread would terminate the process */
+        try {
+          Placement::setUpThread(options);
+          if (options.numaNode >= 0) {
+            relocateQueues();
+          }
+        } catch (...) {
+          setUp.set_exception(std::current_exception());
+          return;
+        }
+        setUp.set_value();
+        MOGI_STATECHART_TRACE_THREAD(name());
+        processThreadId_.store(std::this_thread::get_id());
+        run(options.period);
+        processThreadId_.store(std::thread::id{});
       });
+  } catch (...) {
+    is_running_.store(false);
+    throw;
+  }
+  try {
+    setUpResult.get();
+  } catch (const std::runtime_error & e) {
+    process_thread_.join();
+    is_running_.store(false);
+    throw std::runtime_error("chart " + name() + ": " + e.what());
+  } catch (...) {
+    process_thread_.join();
+    is_running_.store(false);
+    throw;
+  }
+}
+
+void Chart::run(std::chrono::nanoseconds period)
+{
+  timespec next{};
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  while (is_running_.load(std::memory_order_relaxed)) {
+    step();
+    if (period.count() > 0) {
+      auto ns = next.tv_nsec + period.count();
+      next.tv_sec += ns / 1000000000;
+      next.tv_nsec = ns % 1000000000;
+      /* retried when interrupted by a signal, it sleeps until an absolute time */
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR) {
+      }
+    }
   }
 }
 
 void Chart::stop()
 {
+  std::lock_guard<std::mutex> lock{runMutex_};
   auto wasRunning = is_running_.exchange(false);
   if (wasRunning) {
-    exit_signal_.set_value();
     process_thread_.join();
   }
 }
@@ -129,6 +264,7 @@ void Chart::spin()
     return;
   }
 
+  SteppingThread stepping{processThreadId_};
   while (true) {
     process();
   }
@@ -140,13 +276,7 @@ void Chart::spinOnce()
     return;
   }
 
-  /* return after we reached to a Do state
-   * i.e. if this is a transient state (Entry/Exit)
-   * we should keep processing
-   */
-  do {
-    process();
-  } while (processState != ProcessState::Do);
+  step();
 }
 
 void Chart::spinToState(const std::string & name)
@@ -155,18 +285,114 @@ void Chart::spinToState(const std::string & name)
     return;
   }
 
+  SteppingThread stepping{processThreadId_};
   while (currentState.load()->name() != name) {
     process();
   }
 }
 
+size_t Chart::runToQuiescence(size_t maxSteps)
+{
+  if (!container.expired()) {
+    throw std::runtime_error("chart " + name() + " is a subchart, run its outmost chart instead");
+  }
+  if (is_running_) {
+    throw std::runtime_error("chart " + name() + " is running, stop() it first");
+  }
+  /* the configurations of the last steps, to name a livelock */
+  constexpr size_t kept = 16;
+  Configuration recent[kept];
+  size_t moved = 0;
+  for (size_t i = 0; i < maxSteps; ++i) {
+    auto entries = entries_;
+    step();
+    /* events are delivered one per step, an ignored one doesn't settle it */
+    bool took = entries_ != entries;
+    if (!took && !hasPendingEvents()) {
+      return moved;
+    }
+    moved += took;
+    recent[i % kept] = configuration();
+  }
+
+  std::vector<std::string> names;
+  for (size_t i = maxSteps > kept ? maxSteps - kept : 0; i < maxSteps; ++i) {
+    auto n = configurationName(recent[i % kept]);
+    if (std::find(names.begin(), names.end(), n) == names.end()) {
+      names.push_back(n);
+    }
+  }
+  std::string through;
+  for (const auto & n : names) {
+    through += (through.empty() ? "" : ", ") + n;
+  }
+  throw std::runtime_error(
+          "chart " + name() + " did not settle within " + std::to_string(maxSteps) +
+          " steps, still moving through " + through);
+}
+
+void Chart::setCollapseTransients(bool collapse)
+{
+  for (const auto & s : *states_.read()) {
+    auto subchart = dynamic_cast<Chart *>(s.second.get());
+    if (subchart) {
+      subchart->setCollapseTransients(collapse);
+    }
+  }
+  collapseTransients_.store(collapse);
+}
+
+void Chart::setProfiling(bool profiling)
+{
+  for (const auto & s : *states_.read()) {
+    auto subchart = dynamic_cast<Chart *>(s.second.get());
+    if (subchart) {
+      subchart->setProfiling(profiling);
+    }
+  }
+  profiling_.store(profiling);
+}
+
+void Chart::step()
+{
+  /* a step ends in a Do phase: one that took no transition, or that of the
+   * state just entered unless it is transient and collapsing
+   */
+  MOGI_STATECHART_TRACE_SLICE("chart", "step ", name());
+  SteppingThread stepping{processThreadId_};
+  unsigned chained = 0;
+  while (true) {
+    auto phase = processState;
+    process();
+    if (processState != ProcessState::Do) {
+      continue;
+    }
+    if (phase == ProcessState::Do ||
+      !collapseTransients_.load(std::memory_order_relaxed) ||
+      chained++ == maxTransientChain || !currentState.load()->isTransient())
+    {
+      return;
+    }
+  }
+}
+
 void Chart::reset()
 {
   stop();
+  restart();
+}
+
+void Chart::restart()
+{
   currentState.load()->setActive(false);
-  currentState.store(states_.at("initial").get());
+  currentState.load()->endActivation();
+  currentState.store(initial_.get());
   processState = ProcessState::Entry;
   pendingTransition.store(nullptr);
+  /* subcharts are reset from their parent's process(), which publishes */
+  if (container.expired()) {
+    publishConfiguration();
+  }
 }
 
 void Chart::process()
@@ -175,21 +401,82 @@ void Chart::process()
     case ProcessState::Entry:
       /* there's a pending transition, take it */
       if (pendingTransition.load()) {
-        auto d = pendingTransition.load()->dst.lock();
-        if (d) {
-          currentState.store(d.get());
+        if (frozen_.load(std::memory_order_relaxed)) {
+          /* validated by lock(), the destination is a state of this chart */
+          pendingTransition.load()->frozenDst_->beginActivation();
+          currentState.store(pendingTransition.load()->frozenDst_);
           pendingTransition.store(nullptr);
+        } else {
+          auto d = pendingTransition.load()->dst.lock();
+          if (d) {
+            d->beginActivation();
+            currentState.store(d.get());
+            pendingTransition.store(nullptr);
+          }
+        }
+      }
+      /* events are latched from here on, before anyone sees the new state */
+      currentState.load()->beginActivation();
+      currentState.load()->enteredAt_ = profiling_.load(std::memory_order_relaxed) ?
+        std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+      {
+        MOGI_STATECHART_TRACE_SLICE("state", "entry ", currentState.load()->name());
+        currentState.load()->actionEntry();
+      }
+      {
+        auto mainChart = outmostContainer();
+        mainChart->entries_++;
+        mainChart->publishConfiguration();
+        if (!stateChangeChannels_.readCached().empty()) {
+          publishStateChange(mainChart->steps_);
         }
       }
-      currentState.load()->actionEntry();
-      for (const auto & callback : stateChangeCallbacks) {
-        callback->invoke(currentState.load()->name());
+      for (const auto & callback : stateChangeCallbacks.readCached()) {
+        callback->invokeCached(currentState.load()->name());
       }
       processState = ProcessState::Do;
       currentState.load()->setActive(true);
+      /* what was deferred so far gets another chance in the new state, replayed
+       * one per step from the next Do on
+       */
+      replayable_ = deferredCount_.load();
+      if (ack_) {
+        acknowledge();
+      }
       break;
     case ProcessState::Do:
-      currentState.load()->actionDo();
+      if (container.expired()) {
+        publishStep();
+      }
+      if (replayable_) {
+        dispatchDeferred();
+      } else if (queuedCount_.load()) {
+        deliverQueued();
+      } else if (inboxPtr_.load()) {
+        deliverInbox();
+      }
+      {
+        /* a subchart's step nests in here */
+        MOGI_STATECHART_TRACE_SLICE("state", "do ", currentState.load()->name());
+        currentState.load()->actionDo();
+      }
+      if (frozen_.load(std::memory_order_relaxed)) {
+        /* locked: nothing can expire, transitions are read without Rcu */
+        Transition * t = nullptr;
+        for (auto tt : currentState.load()->frozenTransitions_) {
+          if (tt->shouldPerform()) {
+            t = tt;
+          }
+        }
+        if (t) {
+          noteTaken(*t);
+          pendingTransition.store(t);
+          processState = ProcessState::Exit;
+        } else if (ack_) {
+          acknowledge();
+        }
+        break;
+      }
       currentState.load()->purgeExpiredTransitions();
       {
         /*
@@ -215,25 +502,61 @@ void Chart::process()
          * case and the implementation choose the last examined one that
          * passes its `shouldPerform()` check
          */
-        std::shared_ptr<Transition> t{};
+        /* one consistent version of the transitions for the whole step */
+        const auto & transitions = currentState.load()->outgoingTransitions.readCached();
+        Transition * t = nullptr;
         std::for_each(
-          currentState.load()->outgoingTransitions.begin(),
-          currentState.load()->outgoingTransitions.end(),
-          [&t](auto tt) {
+          transitions.begin(),
+          transitions.end(),
+          [&t](const std::shared_ptr<Transition> & tt) {
             if (tt->shouldPerform()) {
-              t = tt;
+              t = tt.get();
             }
           });
         if (t) {
-          pendingTransition.store(t.get());
+          noteTaken(*t);
+          pendingTransition.store(t);
           processState = ProcessState::Exit;
+        } else if (ack_) {
+          acknowledge();
         }
       }
       break;
     case ProcessState::Exit:
-      currentState.load()->actionExit();
-      pendingTransition.load()->action();
-      currentState.load()->setActive(false);
+      {
+        auto t = pendingTransition.load();
+        auto s = currentState.load();
+        auto d = frozen_.load(std::memory_order_relaxed) ? t->frozenDst_ : t->dst.lock().get();
+        {
+          MOGI_STATECHART_TRACE_SLICE("state", "exit ", s->name());
+          s->actionExit();
+        }
+        MOGI_STATECHART_TRACE_SLICE(
+          "transition", "transition ", s->name(), d ? &d->name() : nullptr);
+        if (profiling_.load(std::memory_order_relaxed)) {
+          auto start = std::chrono::steady_clock::now();
+          t->action();
+          auto end = std::chrono::steady_clock::now();
+          t->fires_.fetch_add(1, std::memory_order_relaxed);
+          t->actionNs_.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+            std::memory_order_relaxed);
+          /* a state entered before profiling started has no entry time */
+          if (s->enteredAt_ != std::chrono::steady_clock::time_point{}) {
+            s->visits_.fetch_add(1, std::memory_order_relaxed);
+            s->dwellNs_.fetch_add(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(start - s->enteredAt_).count(),
+              std::memory_order_relaxed);
+          }
+        } else {
+          t->action();
+        }
+        s->setActive(false);
+        /* events triggered during a self-transition are taken on the next
+         * activation, as if they came right after the step
+         */
+        s->endActivation(d == s);
+      }
       processState = ProcessState::Entry;
       break;
   }
@@ -249,26 +572,810 @@ const std::string Chart::getCurrentStateNameFull() const
   }
 }
 
+void Chart::publishConfiguration()
+{
+  uint32_t path[Configuration::maxDepth];
+  uint32_t depth = 0;
+  const Chart * c = this;
+  while (c && depth < Configuration::maxDepth) {
+    auto s = c->currentState.load();
+    path[depth++] = s->id();
+    c = dynamic_cast<const Chart *>(s);
+  }
+
+  auto seq = configSeq_.load(std::memory_order_relaxed);
+  configSeq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  configStep_.store(steps_, std::memory_order_relaxed);
+  configDepth_.store(depth, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < depth; ++i) {
+    configPath_[i].store(path[i], std::memory_order_relaxed);
+  }
+  configSeq_.store(seq + 2, std::memory_order_release);
+  notifyWaiters();
+}
+
+void Chart::notifyWaiters()
+{
+  /* pairs with the fence of the waiters: either they see the new
+   * configuration, or this sees them
+   */
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiters_.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{waitMutex_};
+  if (!watches_.empty()) {
+    auto c = configuration();
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < watches_.size(); ) {
+      bool met = watches_[i].predicate(c);
+      if (met) {
+        watches_[i].promise.set_value(c);
+      } else if (now >= watches_[i].deadline) {
+        watches_[i].promise.set_exception(
+          std::make_exception_ptr(
+            std::runtime_error("chart " + name() + ": timed out waiting for a configuration")));
+      }
+      if (met || now >= watches_[i].deadline) {
+        if (i + 1 != watches_.size()) {
+          watches_[i] = std::move(watches_.back());
+        }
+        watches_.pop_back();
+        waiters_.fetch_sub(1);
+      } else {
+        ++i;
+      }
+    }
+  }
+  waitCv_.notify_all();
+}
+
+bool Chart::waitForState(uint32_t id, std::chrono::nanoseconds timeout)
+{
+  return waitUntil([id](const Configuration & c) {return c.contains(id);}, timeout);
+}
+
+bool Chart::waitUntil(const ConfigurationPredicateT & predicate, std::chrono::nanoseconds timeout)
+{
+  auto mainChart = outmostContainer();
+  if (mainChart.get() != this) {
+    return mainChart->waitUntil(predicate, timeout);
+  }
+  auto deadline = deadlineAfter(timeout);
+  auto holds = [this, &predicate]() {return predicate(configuration());};
+  std::unique_lock<std::mutex> lock{waitMutex_};
+  waiters_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool met = true;
+  if (deadline == std::chrono::steady_clock::time_point::max()) {
+    waitCv_.wait(lock, holds);
+  } else {
+    met = waitCv_.wait_until(lock, deadline, holds);
+  }
+  waiters_.fetch_sub(1);
+  return met;
+}
+
+std::future<Configuration> Chart::whenState(uint32_t id)
+{
+  return when([id](const Configuration & c) {return c.contains(id);});
+}
+
+std::future<Configuration> Chart::whenState(uint32_t id, std::chrono::nanoseconds timeout)
+{
+  return when([id](const Configuration & c) {return c.contains(id);}, timeout);
+}
+
+std::future<Configuration> Chart::when(ConfigurationPredicateT predicate)
+{
+  return watch(std::move(predicate), std::chrono::steady_clock::time_point::max());
+}
+
+std::future<Configuration> Chart::when(
+  ConfigurationPredicateT predicate,
+  std::chrono::nanoseconds timeout)
+{
+  return watch(std::move(predicate), deadlineAfter(timeout));
+}
+
+std::future<Configuration> Chart::watch(
+  ConfigurationPredicateT predicate,
+  std::chrono::steady_clock::time_point deadline)
+{
+  auto mainChart = outmostContainer();
+  if (mainChart.get() != this) {
+    return mainChart->watch(std::move(predicate), deadline);
+  }
+  std::promise<Configuration> promise;
+  auto future = promise.get_future();
+  std::lock_guard<std::mutex> lock{waitMutex_};
+  waiters_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto c = configuration();
+  if (predicate(c)) {
+    waiters_.fetch_sub(1);
+    promise.set_value(c);
+  } else {
+    watches_.push_back(Watch{std::move(predicate), std::move(promise), deadline});
+  }
+  return future;
+}
+
+void Chart::publishStep()
+{
+  auto seq = configSeq_.load(std::memory_order_relaxed);
+  configSeq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  configStep_.store(++steps_, std::memory_order_relaxed);
+  configSeq_.store(seq + 2, std::memory_order_release);
+}
+
+Configuration Chart::configuration() const
+{
+  Configuration c;
+  uint64_t before, after;
+  do {
+    before = configSeq_.load(std::memory_order_acquire);
+    c.step = configStep_.load(std::memory_order_relaxed);
+    c.depth = std::min<uint32_t>(
+      configDepth_.load(std::memory_order_relaxed), Configuration::maxDepth);
+    for (uint32_t i = 0; i < c.depth; ++i) {
+      c.path[i] = configPath_[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = configSeq_.load(std::memory_order_relaxed);
+  } while ((before & 1) || before != after);
+  return c;
+}
+
+std::string Chart::configurationName(const Configuration & configuration) const
+{
+  std::string name;
+  const Chart * c = this;
+  for (uint32_t i = 0; i < configuration.depth; ++i) {
+    const AbstractState * found = nullptr;
+    if (c) {
+      auto states = c->states_.read();
+      for (const auto & s : *states) {
+        if (s.second->id() == configuration.path[i]) {
+          found = s.second.get();
+          break;
+        }
+      }
+    }
+    if (i) {
+      name += ":";
+    }
+    name += found ? found->name() : "?";
+    c = dynamic_cast<const Chart *>(found);
+  }
+  return name;
+}
+
+std::string Chart::stateName(uint32_t id) const
+{
+  auto states = states_.read();
+  for (const auto & s : *states) {
+    if (s.second->id() == id) {
+      return s.second->name();
+    }
+    auto c = dynamic_cast<const Chart *>(s.second.get());
+    if (c) {
+      auto name = c->stateName(id);
+      if (name != "?") {
+        return name;
+      }
+    }
+  }
+  return "?";
+}
+
+std::shared_ptr<StateChangeChannel> Chart::createStateChangeChannel(
+  size_t capacity, OverflowPolicy policy)
+{
+  auto channel = std::make_shared<StateChangeChannel>(capacity, policy);
+  stateChangeChannels_.update(
+    [&channel](std::vector<std::weak_ptr<StateChangeChannel>> & channels) {
+      channels.push_back(channel);
+    });
+  return channel;
+}
+
+void Chart::publishStateChange(uint64_t step)
+{
+  StateChangeRecord record;
+  record.time = std::chrono::steady_clock::now();
+  record.step = step;
+  record.chart = id();
+  record.state = currentState.load()->id();
+  bool expired = false;
+  for (const auto & c : stateChangeChannels_.readCached()) {
+    auto channel = c.lock();
+    if (channel) {
+      channel->publish(record);
+    } else {
+      expired = true;
+    }
+  }
+  if (expired) {
+    stateChangeChannels_.update(
+      [](std::vector<std::weak_ptr<StateChangeChannel>> & channels) {
+        channels.erase(
+          std::remove_if(
+            channels.begin(), channels.end(),
+            [](const std::weak_ptr<StateChangeChannel> & c) {return c.expired();}),
+          channels.end());
+      });
+  }
+}
+
+std::vector<ValidationIssue> Chart::validate() const
+{
+  std::vector<ValidationIssue> issues;
+  validateInto(issues);
+  return issues;
+}
+
+void Chart::validateInto(std::vector<ValidationIssue> & issues) const
+{
+  using Kind = ValidationIssue::Kind;
+  auto states = states_.read();
+  auto report = [this, &issues](Kind kind, const AbstractState & state, std::string message) {
+      issues.push_back(ValidationIssue{kind, name(), state.name(), std::move(message)});
+    };
+  std::unordered_set<const AbstractState *> members;
+  for (const auto & s : *states) {
+    members.insert(s.second.get());
+  }
+
+  if (initial_->outgoingTransitions.read()->empty()) {
+    report(Kind::MissingInitialTransition, *initial_, "initial of " + name() + " has no transition");
+  }
+
+  std::unordered_set<const AbstractState *> reached{initial_.get()};
+  std::vector<const AbstractState *> pending{initial_.get()};
+  while (!pending.empty()) {
+    auto state = pending.back();
+    pending.pop_back();
+    for (const auto & t : *state->outgoingTransitions.read()) {
+      auto d = t->dst.lock();
+      if (d && members.count(d.get()) && reached.insert(d.get()).second) {
+        pending.push_back(d.get());
+      }
+    }
+  }
+
+  for (const auto & s : *states) {
+    const auto & state = *s.second;
+    if (&state != final_.get() && !reached.count(&state)) {
+      report(
+        Kind::UnreachableState, state,
+        state.name() + " of " + name() + " cannot be reached from initial");
+    }
+    /* triggers of the guard-free transitions seen so far, a null event
+     * stands for eventless (false) or completion (true) transitions
+     */
+    std::set<std::pair<bool, const Event *>> triggers;
+    for (const auto & t : *state.outgoingTransitions.read()) {
+      auto d = t->dst.lock();
+      if (!d) {
+        report(
+          Kind::DanglingTransition, state,
+          "a transition out of " + state.name() + " leads to a destroyed state");
+        continue;
+      }
+      if (!members.count(d.get())) {
+        report(
+          Kind::RemovedTarget, state,
+          "transition " + state.name() + " -> " + d->name() + " leads to a removed state");
+        continue;
+      }
+      if (!t->guards.read()->empty()) {
+        continue;
+      }
+      auto events = t->events_.read();
+      std::vector<std::pair<bool, const Event *>> keys;
+      if (events->empty()) {
+        keys.emplace_back(t->isCompletion(), nullptr);
+      }
+      for (auto e : *events) {
+        keys.emplace_back(false, e);
+      }
+      for (const auto & key : keys) {
+        if (!triggers.insert(key).second) {
+          auto trigger = key.second ? key.second->name() : key.first ? "completion" : "no event";
+          report(
+            Kind::Nondeterministic, state,
+            "guard-free transitions out of " + state.name() + " share trigger " + trigger);
+        }
+      }
+    }
+    auto subchart = dynamic_cast<const Chart *>(&state);
+    if (subchart) {
+      subchart->validateInto(issues);
+    }
+  }
+}
+
+void Chart::lock()
+{
+  auto issues = validate();
+  if (!issues.empty()) {
+    auto more = issues.size() > 1 ?
+      " (and " + std::to_string(issues.size() - 1) + " more)" : std::string{};
+    throw std::runtime_error(
+            "chart " + name() + " failed validation: " + issues.front().message + more);
+  }
+  auto mainChart = outmostContainer();
+  bool wasRunning = mainChart->isRunning();
+  mainChart->stop();
+  freezeAll(true);
+  if (wasRunning) {
+    mainChart->spinAsync(mainChart->runOptions_);
+  }
+}
+
+void Chart::unlock()
+{
+  auto mainChart = outmostContainer();
+  bool wasRunning = mainChart->isRunning();
+  mainChart->stop();
+  freezeAll(false);
+  if (wasRunning) {
+    mainChart->spinAsync(mainChart->runOptions_);
+  }
+}
+
+void Chart::freezeAll(bool frozen)
+{
+  for (const auto & s : *states_.read()) {
+    auto subchart = dynamic_cast<Chart *>(s.second.get());
+    if (subchart) {
+      subchart->freezeAll(frozen);
+    } else {
+      s.second->freeze(frozen);
+    }
+  }
+  /* transitions out of this chart as a subchart, and the flag */
+  freeze(frozen);
+}
+
 void Chart::actionEntry()
 {
-  reset();
+  restart();
 }
 
 void Chart::actionDo()
 {
-  do {
-    process();
-  } while (processState != ProcessState::Do);
+  step();
 }
 
 void Chart::actionExit() {}
 
 void Chart::removeStateChangeCallback(const std::shared_ptr<StateChangeCallbackT> & c)
 {
-  stateChangeCallbacks.erase(
-    std::remove(
-      stateChangeCallbacks.begin(),
-      stateChangeCallbacks.end(),
-      c),
-    stateChangeCallbacks.end());
+  stateChangeCallbacks.update(
+    [&c](std::vector<std::shared_ptr<StateChangeCallbackT>> & callbacks) {
+      callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), c), callbacks.end());
+    });
+}
+
+void Chart::setDeferredQueueCapacity(size_t capacity)
+{
+  std::lock_guard<std::mutex> lock{deferredMutex_};
+  /* reserve() keeps the oldest, the newest that don't fit are lost */
+  if (deferred_.size() > capacity) {
+    deferredDropped_ += deferred_.size() - capacity;
+  }
+  deferred_.reserve(capacity);
+  deferredCount_.store(deferred_.size());
+}
+
+size_t Chart::deferredEventCount() const
+{
+  return deferredCount_.load();
+}
+
+size_t Chart::deferredQueueCapacity() const
+{
+  std::lock_guard<std::mutex> lock{deferredMutex_};
+  return deferred_.capacity();
+}
+
+uint64_t Chart::droppedDeferredEventCount() const
+{
+  std::lock_guard<std::mutex> lock{deferredMutex_};
+  return deferredDropped_;
+}
+
+void Chart::pushDeferred(const Event & event)
+{
+  std::lock_guard<std::mutex> lock{deferredMutex_};
+  if (deferred_.capacity() == 0) {
+    deferred_.reserve(defaultDeferredQueueCapacity);
+  }
+  if (deferred_.push(&event)) {
+    deferredCount_.store(deferred_.size());
+  } else {
+    deferredDropped_++;
+  }
+}
+
+bool Chart::hasPendingEvents() const
+{
+  if (queuedCount_.load() || (inboxPtr_.load() && inboxPtr_.load()->size())) {
+    return true;
+  }
+  /* each chart of the active configuration replays its own deferrals */
+  for (auto c = this; c; c = dynamic_cast<const Chart *>(c->currentState.load())) {
+    if (c->replayable_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Chart::dispatchDeferred()
+{
+  /* one event per step, so that each gets a transition of its own. Only what
+   * was deferred before the last state change: an event deferred again by the
+   * new state goes back to the end of the queue, after the replayable ones
+   */
+  const Event * event;
+  {
+    std::lock_guard<std::mutex> lock{deferredMutex_};
+    if (deferred_.empty()) {
+      replayable_ = 0;
+      return;
+    }
+    event = deferred_.front();
+    deferred_.pop();
+    deferredCount_.store(deferred_.size());
+  }
+  replayable_ = std::min(replayable_ - 1, deferredCount_.load());
+  /* observers outside this chart (recorders, other charts...) have seen the
+   * event already
+   */
+  deliverOwn(*event, false);
+}
+
+void Chart::deliverOwn(const Event & event, bool others)
+{
+  auto self = outmostContainer();
+  for (const auto & observer : *event.eventObservers.read()) {
+    auto o = observer.lock();
+    if (!o) {
+      continue;
+    }
+    auto transition = dynamic_cast<Transition *>(o.get());
+    if (transition) {
+      auto c = transition->container.lock();
+      if (c && c->outmostContainer() == self) {
+        transition->notify(event);
+      }
+      continue;
+    }
+    auto state = dynamic_cast<AbstractState *>(o.get());
+    if (state) {
+      if (state->outmostContainer() == self) {
+        state->notify(event);
+      }
+    } else if (others) {
+      o->notify(event);
+    }
+  }
+}
+
+bool Chart::post(Event & event, EventPriority priority)
+{
+  return enqueue(event, priority, nullptr);
+}
+
+bool Chart::post(Event & event, EventPriority priority, EventAckCallbackT acknowledge)
+{
+  return enqueue(
+    event, priority, std::unique_ptr<EventAckCallbackT>{new EventAckCallbackT(
+        std::move(acknowledge))});
+}
+
+bool Chart::post(Event & event, const std::shared_ptr<AbstractState> & state, uint64_t visit)
+{
+  return enqueue(event, event.priority(), nullptr, state, visit);
+}
+
+std::future<EventAck> Chart::postAcknowledged(Event & event, EventPriority priority)
+{
+  auto promise = std::make_shared<std::promise<EventAck>>();
+  auto future = promise->get_future();
+  if (!post(event, priority, [promise](const EventAck & ack) {promise->set_value(ack);})) {
+    promise->set_value(EventAck{});
+  }
+  return future;
+}
+
+bool Chart::enqueue(
+  Event & event, EventPriority priority,
+  std::unique_ptr<EventAckCallbackT> ack,
+  const std::shared_ptr<AbstractState> & visited, uint64_t visit)
+{
+  auto mainChart = outmostContainer();
+  if (mainChart.get() != this) {
+    return mainChart->enqueue(event, priority, std::move(ack), visited, visit);
+  }
+
+  /* acknowledged as dropped once the lock is released */
+  std::unique_ptr<EventAckCallbackT> evicted;
+  std::unique_lock<std::mutex> lock{queueMutex_};
+  auto & queue = queues_[static_cast<size_t>(priority)];
+  if (queue.capacity() == 0) {
+    queue.reserve(defaultEventQueueCapacity);
+  }
+  if (queuePolicy_ == OverflowPolicy::Coalesce && !ack && !visited) {
+    for (size_t i = 0; i < queue.size(); ++i) {
+      if (queue[i].event == &event) {
+        queueStats_.coalesced++;
+        return true;
+      }
+    }
+  }
+  if (queue.full()) {
+    switch (queuePolicy_) {
+      case OverflowPolicy::DropOldest:
+        evicted = std::move(queue.front().ack);
+        queue.pop();
+        queuedCount_.fetch_sub(1);
+        queueDropped_++;
+        break;
+      case OverflowPolicy::Block:
+        /* the thread stepping the chart would wait on itself */
+        if (std::this_thread::get_id() != processThreadId_.load()) {
+          blockedProducers_++;
+          auto room = queueSpace_.wait_for(
+            lock, blockTimeout_, [&queue]() {return !queue.full();});
+          blockedProducers_--;
+          if (room) {
+            break;
+          }
+          queueStats_.timedOut++;
+        }
+        queueDropped_++;
+        return false;
+      default:
+        queueDropped_++;
+        return false;
+    }
+  }
+  queue.push(Posted{&event, std::move(ack), visited, visit});
+  auto depth = queuedCount_.fetch_add(1) + 1;
+  queueStats_.highWater = std::max(queueStats_.highWater, depth);
+  queueStats_.posted++;
+  lock.unlock();
+  if (evicted) {
+    (*evicted)(EventAck{});
+  }
+  return true;
+}
+
+void Chart::setEventQueuePolicy(OverflowPolicy policy, std::chrono::nanoseconds blockTimeout)
+{
+  std::lock_guard<std::mutex> lock{queueMutex_};
+  queuePolicy_ = policy;
+  blockTimeout_ = blockTimeout;
+}
+
+EventQueueStats Chart::eventQueueStats() const
+{
+  std::lock_guard<std::mutex> lock{queueMutex_};
+  auto stats = queueStats_;
+  stats.depth = queuedCount_.load();
+  stats.dropped = queueDropped_;
+  for (const auto & queue : queues_) {
+    stats.capacity += queue.capacity();
+  }
+  return stats;
+}
+
+std::shared_ptr<Chart::InboxT> Chart::busInbox(size_t capacity)
+{
+  std::lock_guard<std::mutex> lock{queueMutex_};
+  if (!inbox_) {
+    inbox_ = std::make_shared<InboxT>(capacity);
+    inboxPtr_.store(inbox_.get());
+  }
+  return inbox_;
+}
+
+void Chart::deliverInbox()
+{
+  const Event * event;
+  if (inboxPtr_.load()->pop(event)) {
+    deliverLocal(*event);
+  }
+}
+
+void Chart::deliverLocal(const Event & event)
+{
+  /* only the active states can react */
+  for (auto state = currentState.load(); state; ) {
+    state->notify(event);
+    for (const auto & t : state->outgoingTransitions.readCached()) {
+      if (t->events_.readCached().count(&event)) {
+        t->notify(event);
+      }
+    }
+    auto subchart = dynamic_cast<Chart *>(state);
+    state = subchart ? subchart->currentState.load() : nullptr;
+  }
+}
+
+void Chart::listenedEvents(std::unordered_set<const Event *> & events) const
+{
+  for (const auto & s : *states_.read()) {
+    const auto & state = s.second;
+    for (const auto & t : *state->outgoingTransitions.read()) {
+      auto transitionEvents = t->events_.read();
+      events.insert(transitionEvents->begin(), transitionEvents->end());
+    }
+    for (const auto & c : *state->eventCallbacks.read()) {
+      events.insert(c.first);
+    }
+    auto deferred = state->deferredEvents.read();
+    events.insert(deferred->begin(), deferred->end());
+    auto subchart = dynamic_cast<const Chart *>(state.get());
+    if (subchart) {
+      subchart->listenedEvents(events);
+    }
+  }
+}
+
+void Chart::setEventQueueCapacity(size_t capacity)
+{
+  /* acknowledged as dropped once the lock is released */
+  std::vector<std::unique_ptr<EventAckCallbackT>> evicted;
+  {
+    std::lock_guard<std::mutex> lock{queueMutex_};
+    size_t queued = 0;
+    for (auto & queue : queues_) {
+      /* reserve() keeps the oldest, the newest that don't fit are dropped */
+      for (size_t i = capacity; i < queue.size(); ++i) {
+        if (queue[i].ack) {
+          evicted.push_back(std::move(queue[i].ack));
+        }
+        queueDropped_++;
+      }
+      queue.reserve(capacity);
+      queued += queue.size();
+    }
+    queuedCount_.store(queued);
+    queueSpace_.notify_all();
+  }
+  for (auto & ack : evicted) {
+    (*ack)(EventAck{});
+  }
+}
+
+void Chart::relocateQueues()
+{
+  /* a reserve() to the same capacity copies into storage of this thread. The
+   * queues not allocated yet get their default capacity now, from this
+   * thread rather than from whichever producer would post first
+   */
+  {
+    std::lock_guard<std::mutex> lock{queueMutex_};
+    for (auto & queue : queues_) {
+      queue.reserve(queue.capacity() ? queue.capacity() : defaultEventQueueCapacity);
+    }
+  }
+  std::lock_guard<std::mutex> lock{deferredMutex_};
+  deferred_.reserve(deferred_.capacity() ? deferred_.capacity() : defaultDeferredQueueCapacity);
+}
+
+void Chart::setStarvationLimit(unsigned limit)
+{
+  std::lock_guard<std::mutex> lock{queueMutex_};
+  starvationLimit_ = limit;
+}
+
+size_t Chart::queuedEventCount() const
+{
+  return queuedCount_.load();
+}
+
+uint64_t Chart::droppedEventCount() const
+{
+  std::lock_guard<std::mutex> lock{queueMutex_};
+  return queueDropped_;
+}
+
+void Chart::deliverQueued()
+{
+  Event * event = nullptr;
+  std::unique_ptr<EventAckCallbackT> ack;
+  std::weak_ptr<AbstractState> visited;
+  uint64_t visit = 0;
+  {
+    std::lock_guard<std::mutex> lock{queueMutex_};
+    /* highest priority first, unless a lower one waited too long */
+    size_t chosen = priorityCount;
+    for (size_t p = 0; p < priorityCount; ++p) {
+      if (queues_[p].empty()) {
+        continue;
+      }
+      if (chosen == priorityCount) {
+        chosen = p;
+      } else if (starvationLimit_ && passedOver_[p] >= starvationLimit_) {
+        chosen = p;
+        break;
+      }
+    }
+    if (chosen == priorityCount) {
+      return;
+    }
+    for (size_t p = 0; p < priorityCount; ++p) {
+      if (p == chosen || queues_[p].empty()) {
+        passedOver_[p] = 0;
+      } else {
+        passedOver_[p]++;
+      }
+    }
+    auto & posted = queues_[chosen].front();
+    event = posted.event;
+    ack = std::move(posted.ack);
+    visited = std::move(posted.visited);
+    visit = posted.visit;
+    queues_[chosen].pop();
+    queuedCount_.fetch_sub(1);
+    if (blockedProducers_) {
+      queueSpace_.notify_all();
+    }
+  }
+  /* meant for a visit of the state that is over */
+  if (visit) {
+    auto state = visited.lock();
+    if (!state || state->visit() != visit) {
+      return;
+    }
+  }
+  if (ack) {
+    /* same test as AbstractState::notify(), before the event is seen */
+    ackDeferred_ = false;
+    for (auto state = currentState.load(); state; ) {
+      ackDeferred_ |= state->isActive() && state->defersEvent(*event) &&
+        !state->hasTransitionOn(*event);
+      auto subchart = dynamic_cast<Chart *>(state);
+      state = subchart ? subchart->currentState.load() : nullptr;
+    }
+    ack_ = std::move(ack);
+    acknowledgedEvent_ = event;
+    acknowledgedConsumed_ = false;
+  }
+  /* posted to this chart: the states and transitions of other charts on the
+   * same event don't see it
+   */
+  deliverOwn(*event, true);
+}
+
+void Chart::noteTaken(const Transition & transition)
+{
+  /* the acknowledgement is pending on the outmost chart, whose step this is */
+  auto mainChart = outmostContainer();
+  if (mainChart->acknowledgedEvent_ &&
+    transition.events_.readCached().count(mainChart->acknowledgedEvent_))
+  {
+    mainChart->acknowledgedConsumed_ = true;
+  }
+}
+
+void Chart::acknowledge()
+{
+  EventAck ack;
+  ack.outcome = acknowledgedConsumed_ ? EventOutcome::Consumed :
+    ackDeferred_ ? EventOutcome::Deferred : EventOutcome::Ignored;
+  ack.configuration = configuration();
+  auto depth = std::min<uint32_t>(ack.configuration.depth, Configuration::maxDepth);
+  ack.state = depth ? ack.configuration.path[depth - 1] : 0;
+  acknowledgedEvent_ = nullptr;
+  auto callback = std::move(ack_);
+  (*callback)(ack);
 }
@@ -0,0 +1,226 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "mogi_statechart/dot.hpp"
+
+using mogi::statechart::AbstractState;
+using mogi::statechart::Chart;
+using mogi::statechart::DotExporter;
+using mogi::statechart::DotOptions;
+using mogi::statechart::Transition;
+
+namespace
+{
+
+std::string quoted(const std::string & text)
+{
+  std::string q{"\""};
+  for (auto c : text) {
+    if (c == '\n') {
+      q += "\\n";
+      continue;
+    }
+    if (c == '"' || c == '\\') {
+      q += '\\';
+    }
+    q += c;
+  }
+  return q + "\"";
+}
+
+std::string nodeId(const AbstractState & state)
+{
+  return "s" + std::to_string(state.id());
+}
+
+std::string duration(double ns)
+{
+  char text[32];
+  if (ns < 1e3) {
+    std::snprintf(text, sizeof(text), "%.0f ns", ns);
+  } else if (ns < 1e6) {
+    std::snprintf(text, sizeof(text), "%.3g us", ns / 1e3);
+  } else if (ns < 1e9) {
+    std::snprintf(text, sizeof(text), "%.3g ms", ns / 1e6);
+  } else {
+    std::snprintf(text, sizeof(text), "%.3g s", ns / 1e9);
+  }
+  return text;
+}
+
+/* blue for 0, red for 1, as a Graphviz HSV colour */
+std::string heatColor(double heat, double saturation)
+{
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.3f %.2f 0.95", 0.66 * (1.0 - heat), saturation);
+  return text;
+}
+
+}  // namespace
+
+void DotExporter::write(std::ostream & out, const Chart & chart, const DotOptions & options)
+{
+  Scale scale;
+  if (options.heatMap) {
+    measure(chart, scale);
+  }
+  /* edges go after every node, outside the clusters */
+  std::ostringstream edges;
+  out << "digraph " << quoted(chart.name()) << " {\n"
+      << "  compound=true;\n"
+      << "  rankdir=LR;\n"
+      << "  node [shape=box, style=rounded];\n";
+  writeStates(out, edges, chart, options, scale, "  ");
+  out << edges.str() << "}\n";
+}
+
+std::string DotExporter::toString(const Chart & chart, const DotOptions & options)
+{
+  std::ostringstream out;
+  write(out, chart, options);
+  return out.str();
+}
+
+void DotExporter::measure(const Chart & chart, Scale & scale)
+{
+  for (const auto & named : *chart.states_.read()) {
+    const auto & state = *named.second;
+    scale.dwellTime = std::max(scale.dwellTime, state.stats().dwellTime);
+    for (const auto & t : *state.outgoingTransitions.read()) {
+      scale.fires = std::max(scale.fires, t->stats().fires);
+    }
+    auto subchart = dynamic_cast<const Chart *>(&state);
+    if (subchart) {
+      measure(*subchart, scale);
+    }
+  }
+}
+
+void DotExporter::writeStates(
+  std::ostream & out, std::ostream & edges, const Chart & chart,
+  const DotOptions & options, const Scale & scale, const std::string & indent)
+{
+  const auto current = chart.currentState.load();
+  for (const auto & named : *chart.states_.read()) {
+    const auto & state = *named.second;
+    for (const auto & t : *state.outgoingTransitions.read()) {
+      writeTransition(edges, *t, state, options, scale);
+    }
+
+    auto subchart = dynamic_cast<const Chart *>(&state);
+    if (subchart) {
+      out << indent << "subgraph cluster_" << state.id() << " {\n"
+          << indent << "  label=" << quoted(state.name()) << ";\n";
+      if (&state == current) {
+        out << indent << "  penwidth=2;\n";
+      }
+      writeStates(out, edges, *subchart, options, scale, indent + "  ");
+      out << indent << "}\n";
+      continue;
+    }
+
+    std::string label = state.name();
+    std::vector<std::string> style{"rounded"};
+    std::string attributes;
+    if (&state == chart.initial_.get()) {
+      attributes += ", shape=circle";
+    } else if (&state == chart.final_.get()) {
+      attributes += ", shape=doublecircle";
+    }
+    if (&state == current) {
+      style.push_back("bold");
+    }
+    if (options.heatMap) {
+      auto stats = state.stats();
+      if (stats.visits) {
+        label += "\n" + std::to_string(stats.visits) + "x, " +
+          duration(static_cast<double>(stats.dwellTime.count()) / stats.visits);
+        auto heat = scale.dwellTime.count() ?
+          static_cast<double>(stats.dwellTime.count()) / scale.dwellTime.count() : 0.0;
+        style.push_back("filled");
+        attributes += ", fillcolor=" + quoted(heatColor(heat, 0.5));
+      }
+    }
+    std::string styles;
+    for (const auto & s : style) {
+      styles += (styles.empty() ? "" : ",") + s;
+    }
+    out << indent << nodeId(state) << " [label=" << quoted(label) << ", style=" <<
+      quoted(styles) << attributes << "];\n";
+  }
+}
+
+void DotExporter::writeTransition(
+  std::ostream & edges, const Transition & transition, const AbstractState & src,
+  const DotOptions & options, const Scale & scale)
+{
+  auto dst = transition.dst.lock();
+  if (!dst) {
+    return;
+  }
+  /* a subchart is drawn as a cluster, edges end on its initial state and
+   * start from its final state, clipped at the cluster's border
+   */
+  std::string attributes;
+  auto from = nodeId(src);
+  auto srcChart = dynamic_cast<const Chart *>(&src);
+  if (srcChart) {
+    from = nodeId(*srcChart->final_);
+    attributes += ", ltail=cluster_" + std::to_string(src.id());
+  }
+  auto to = nodeId(*dst);
+  auto dstChart = dynamic_cast<const Chart *>(dst.get());
+  if (dstChart) {
+    to = nodeId(*dstChart->initial_);
+    attributes += ", lhead=cluster_" + std::to_string(dst->id());
+  }
+
+  std::vector<std::string> events;
+  for (auto e : *transition.events_.read()) {
+    events.push_back(e->name());
+  }
+  std::sort(events.begin(), events.end());
+  std::string label = transition.isCompletion() ? "(completion)" : "";
+  for (const auto & e : events) {
+    label += (label.empty() ? "" : ", ") + e;
+  }
+  auto guards = transition.guards.read()->size();
+  if (guards) {
+    label += (label.empty() ? "[" : " [") + std::to_string(guards) +
+      (guards == 1 ? " guard]" : " guards]");
+  }
+
+  if (options.heatMap) {
+    auto stats = transition.stats();
+    if (stats.fires) {
+      label += (label.empty() ? "" : "\n") + std::to_string(stats.fires) + "x, " +
+        duration(static_cast<double>(stats.actionTime.count()) / stats.fires);
+      auto heat = scale.fires ? static_cast<double>(stats.fires) / scale.fires : 0.0;
+      char width[16];
+      std::snprintf(width, sizeof(width), "%.2f", 1.0 + 4.0 * heat);
+      attributes += ", color=" + quoted(heatColor(heat, 0.9)) + ", penwidth=" + width;
+    } else {
+      attributes += ", color=gray70";
+    }
+  }
+  edges << "  " << from << " -> " << to << " [label=" << quoted(label) << attributes << "];\n";
+}
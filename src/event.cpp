@@ -20,7 +20,9 @@ using mogi::statechart::Event;
 
 void Event::trigger()
 {
-  for (auto const & observer : eventObservers) {
+  /* observers may be added or removed meanwhile, from notify() too */
+  auto observers = eventObservers.read();
+  for (auto const & observer : *observers) {
     auto lockedObserver = observer.lock();
     if (lockedObserver) {
       lockedObserver->notify(*this);
@@ -30,31 +32,33 @@ void Event::trigger()
 
 void Event::addObserver(const std::shared_ptr<EventObserver> & observer)
 {
-  auto hasObserver = std::find_if(
-    eventObservers.begin(),
-    eventObservers.end(),
-    [&observer](auto ob) {
-      return ob.lock() == observer;
+  eventObservers.update(
+    [this, &observer](std::vector<ObserverPtr> & observers) {
+      if (observerIndex_.insert(observer).second) {
+        observers.push_back(observer);
+      }
     });
-  if (hasObserver != eventObservers.end()) {
-    return;
-  }
-  eventObservers.push_back(observer);
 }
 
 void Event::removeObserver(const std::shared_ptr<EventObserver> & observer)
 {
-  eventObservers.erase(
-    std::remove_if(
-      eventObservers.begin(),
-      eventObservers.end(),
-      [&observer](auto ob) {
-        return ob.lock() == observer;
-      }),
-    eventObservers.end());
+  eventObservers.update(
+    [this, &observer](std::vector<ObserverPtr> & observers) {
+      if (observerIndex_.erase(observer) == 0) {
+        return;
+      }
+      observers.erase(
+        std::remove_if(
+          observers.begin(),
+          observers.end(),
+          [&observer](auto ob) {
+            return ob.lock() == observer;
+          }),
+        observers.end());
+    });
 }
 
 int Event::observerCount() const
 {
-  return eventObservers.size();
+  return eventObservers.read()->size();
 }
@@ -0,0 +1,140 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "mogi_statechart/event_bus.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventBus;
+
+EventBus::EventBus(size_t shards, size_t inboxCapacity)
+: shardCount_(shards ? shards : std::max(1u, std::thread::hardware_concurrency())),
+  inboxCapacity_(inboxCapacity), shards_(new Shard[shardCount_]) {}
+
+uint32_t EventBus::topic(const std::string & name)
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  return topics_.emplace(name, static_cast<uint32_t>(topics_.size())).first->second;
+}
+
+template<typename ModifyT>
+void EventBus::updateRoutes(ModifyT && modify)
+{
+  /* every shard gets the same table, a publisher sees either version */
+  for (size_t i = 0; i < shardCount_; ++i) {
+    shards_[i].routes.update(modify);
+  }
+}
+
+void EventBus::subscribe(
+  uint32_t topic, const std::shared_ptr<Chart> & chart,
+  const Event & event)
+{
+  auto mainChart = chart->outmostContainer();
+  if (!mainChart) {
+    mainChart = chart;
+  }
+  Route route{mainChart->busInbox(inboxCapacity_), &event, mainChart.get()};
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  updateRoutes(
+    [topic, &route](RouteTableT & table) {
+      if (table.size() <= topic) {
+        table.resize(topic + 1);
+      }
+      auto & routes = table[topic];
+      auto known = std::find_if(
+        routes.begin(), routes.end(),
+        [&route](const Route & r) {return r.chart == route.chart && r.event == route.event;});
+      if (known == routes.end()) {
+        routes.push_back(route);
+      }
+    });
+}
+
+size_t EventBus::attach(const std::shared_ptr<Chart> & chart)
+{
+  std::unordered_set<const Event *> events;
+  chart->listenedEvents(events);
+  for (auto event : events) {
+    subscribe(topic(event->name()), chart, *event);
+  }
+  return events.size();
+}
+
+void EventBus::detach(const std::shared_ptr<Chart> & chart)
+{
+  auto mainChart = chart->outmostContainer();
+  const Chart * target = mainChart ? mainChart.get() : chart.get();
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  updateRoutes(
+    [target](RouteTableT & table) {
+      for (auto & routes : table) {
+        routes.erase(
+          std::remove_if(
+            routes.begin(), routes.end(),
+            [target](const Route & r) {return r.chart == target;}),
+          routes.end());
+      }
+    });
+}
+
+bool EventBus::publish(uint32_t topic)
+{
+  auto & shard = shards_[shardIndex()];
+  auto table = shard.routes.read();
+  if (topic >= table->size()) {
+    return true;
+  }
+  bool delivered = true;
+  for (const auto & route : (*table)[topic]) {
+    if (!route.inbox->push(route.event)) {
+      shard.dropped.fetch_add(1, std::memory_order_relaxed);
+      delivered = false;
+    }
+  }
+  return delivered;
+}
+
+size_t EventBus::subscriberCount(uint32_t topic) const
+{
+  auto table = shards_[0].routes.read();
+  return topic < table->size() ? (*table)[topic].size() : 0;
+}
+
+uint64_t EventBus::droppedCount() const
+{
+  uint64_t dropped = 0;
+  for (size_t i = 0; i < shardCount_; ++i) {
+    dropped += shards_[i].dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
+
+size_t EventBus::shardIndex() const
+{
+  /* threads are numbered on their first publish, then spread round robin */
+  static std::atomic<size_t> threads{0};
+  thread_local size_t thread = threads.fetch_add(1, std::memory_order_relaxed);
+  return thread % shardCount_;
+}
@@ -0,0 +1,140 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mogi_statechart/executor.hpp"
+#include "mogi_statechart/placement.hpp"
+
+using mogi::statechart::Placement;
+using mogi::statechart::RealTimeOptions;
+using mogi::statechart::ThreadPoolExecutor;
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t threads)
+{
+  if (threads == 0) {
+    throw std::runtime_error("ThreadPoolExecutor needs at least one thread");
+  }
+  workers_.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this]() {run();});
+  }
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t threads, const RealTimeOptions & placement)
+{
+  if (threads == 0) {
+    throw std::runtime_error("ThreadPoolExecutor needs at least one thread");
+  }
+  workers_.reserve(threads);
+  std::vector<std::future<void>> setUp;
+  std::exception_ptr error;
+  try {
+    for (size_t i = 0; i < threads; ++i) {
+      auto result = std::make_shared<std::promise<void>>();
+      setUp.push_back(result->get_future());
+      workers_.emplace_back(
+        [this, placement, result]() {
+          /* anything escaping the thread would terminate the process */
+          try {
+            Placement::setUpThread(placement);
+          } catch (...) {
+            result->set_exception(std::current_exception());
+            return;
+          }
+          result->set_value();
+          run();
+        });
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+  for (auto & s : setUp) {
+    try {
+      s.get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    /* the destructor won't run, stop the workers that did start */
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto & worker : workers_) {
+      worker.join();
+    }
+    try {
+      std::rethrow_exception(error);
+    } catch (const std::runtime_error & e) {
+      throw std::runtime_error(std::string{"ThreadPoolExecutor: "} + e.what());
+    }
+  }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor()
+{
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto & worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPoolExecutor::execute(TaskT task)
+{
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    tasks_.push_back(std::move(task));
+  }
+  wake_.notify_one();
+}
+
+size_t ThreadPoolExecutor::pendingCount() const
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  return tasks_.size() + running_;
+}
+
+void ThreadPoolExecutor::run()
+{
+  std::unique_lock<std::mutex> lock{mutex_};
+  while (true) {
+    wake_.wait(lock, [this]() {return stopping_ || !tasks_.empty();});
+    if (tasks_.empty()) {
+      return;
+    }
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    ++running_;
+    lock.unlock();
+    task();
+    lock.lock();
+    --running_;
+  }
+}
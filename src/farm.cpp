@@ -0,0 +1,378 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "mogi_statechart/farm.hpp"
+
+using mogi::statechart::ChartDescription;
+using mogi::statechart::ChartFarm;
+using mogi::statechart::Executor;
+
+namespace
+{
+const size_t maxEvents = 64;
+const size_t maxStates = 65535;
+
+template<typename CompareT>
+void compareAll(const float * values, size_t n, float threshold, uint8_t * out, CompareT compare)
+{
+  /* branch free, so that it vectorizes */
+  for (size_t k = 0; k < n; ++k) {
+    out[k] = compare(values[k], threshold);
+  }
+}
+}  // namespace
+
+ChartFarm::ChartFarm(const ChartDescription & description, size_t instances)
+{
+  stateNames_ = {"initial", "final"};
+  std::unordered_map<std::string, uint16_t> byName{{"initial", 0}, {"final", 1}};
+  std::vector<uint16_t> ids;
+  for (const auto & s : description.states) {
+    if (s.subchart) {
+      throw std::runtime_error("farm: subchart " + s.name + " is not supported");
+    }
+    if (s.isFinal) {
+      byName.emplace(s.name, 1);
+      ids.push_back(1);
+      continue;
+    }
+    if (stateNames_.size() >= maxStates) {
+      throw std::runtime_error("farm: too many states");
+    }
+    auto id = static_cast<uint16_t>(stateNames_.size());
+    if (!byName.emplace(s.name, id).second) {
+      throw std::runtime_error("farm: duplicated state " + s.name);
+    }
+    stateNames_.push_back(s.name);
+    ids.push_back(id);
+  }
+  auto resolve = [&byName](const std::string & name) {
+      auto it = byName.find(name);
+      if (it == byName.end()) {
+        throw std::runtime_error("farm: unknown target state " + name);
+      }
+      return it->second;
+    };
+
+  states_.resize(stateNames_.size());
+  /* rows are laid out state by state, transitions of a state contiguous */
+  if (!description.initial.empty()) {
+    states_[0].transitions.begin = 0;
+    transitions_.push_back(TransitionRow{resolve(description.initial), 0, {}, {}});
+    states_[0].transitions.end = 1;
+  }
+  for (size_t i = 0; i < description.states.size(); ++i) {
+    const auto & s = description.states[i];
+    auto & row = states_[ids[i]];
+    row.entry = actionList(s.entry);
+    row.activity = actionList(s.activity);
+    row.exit = actionList(s.exit);
+    row.transitions.begin = static_cast<uint32_t>(transitions_.size());
+    for (const auto & t : s.transitions) {
+      TransitionRow tr{resolve(t.target), 0, {}, {}};
+      for (const auto & e : t.events) {
+        auto it = eventIds_.find(e);
+        if (it == eventIds_.end()) {
+          if (eventIds_.size() >= maxEvents) {
+            throw std::runtime_error("farm: more than 64 events");
+          }
+          it = eventIds_.emplace(e, static_cast<int>(eventIds_.size())).first;
+        }
+        tr.events |= uint64_t{1} << it->second;
+      }
+      tr.guards.begin = static_cast<uint32_t>(guardLists_.size());
+      for (const auto & g : t.guards) {
+        guardLists_.push_back(guardId(g));
+      }
+      tr.guards.end = static_cast<uint32_t>(guardLists_.size());
+      tr.actions = actionList(t.actions);
+      transitions_.push_back(tr);
+    }
+    row.transitions.end = static_cast<uint32_t>(transitions_.size());
+  }
+
+  state_.assign(instances, initial_);
+  entered_.assign(instances, 0);
+  events_.assign(instances, 0);
+}
+
+uint32_t ChartFarm::actionId(const std::string & name)
+{
+  for (size_t i = 0; i < actions_.size(); ++i) {
+    if (actions_[i].name == name) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  actions_.push_back(ActionSlot{name, nullptr});
+  return static_cast<uint32_t>(actions_.size() - 1);
+}
+
+uint32_t ChartFarm::guardId(const std::string & name)
+{
+  for (size_t i = 0; i < guards_.size(); ++i) {
+    if (guards_[i].name == name) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  guards_.push_back(GuardSlot{name, nullptr, {}});
+  return static_cast<uint32_t>(guards_.size() - 1);
+}
+
+ChartFarm::Range ChartFarm::actionList(const std::vector<std::string> & names)
+{
+  Range range;
+  range.begin = static_cast<uint32_t>(actionLists_.size());
+  for (const auto & name : names) {
+    actionLists_.push_back(actionId(name));
+  }
+  range.end = static_cast<uint32_t>(actionLists_.size());
+  return range;
+}
+
+void ChartFarm::bindAction(const std::string & name, ActionT action)
+{
+  for (auto & a : actions_) {
+    if (a.name == name) {
+      a.callback = std::move(action);
+      return;
+    }
+  }
+  throw std::runtime_error("farm: no action named " + name);
+}
+
+void ChartFarm::bindGuard(const std::string & name, GuardT guard)
+{
+  for (auto & g : guards_) {
+    if (g.name == name) {
+      g.callback = std::move(guard);
+      g.data = {};
+      return;
+    }
+  }
+  throw std::runtime_error("farm: no guard named " + name);
+}
+
+void ChartFarm::bindGuard(
+  const std::string & name, const float * values,
+  Comparison comparison, float threshold)
+{
+  for (auto & g : guards_) {
+    if (g.name == name) {
+      g.callback = nullptr;
+      g.data = DataGuard{values, nullptr, comparison, threshold};
+      return;
+    }
+  }
+  throw std::runtime_error("farm: no guard named " + name);
+}
+
+void ChartFarm::bindGuard(const std::string & name, const uint8_t * flags)
+{
+  for (auto & g : guards_) {
+    if (g.name == name) {
+      g.callback = nullptr;
+      g.data = DataGuard{nullptr, flags, Comparison::NotEqual, 0};
+      return;
+    }
+  }
+  throw std::runtime_error("farm: no guard named " + name);
+}
+
+int ChartFarm::stateIndex(const std::string & name) const
+{
+  auto it = std::find(stateNames_.begin(), stateNames_.end(), name);
+  return it == stateNames_.end() ? -1 : static_cast<int>(it - stateNames_.begin());
+}
+
+int ChartFarm::eventIndex(const std::string & name) const
+{
+  auto it = eventIds_.find(name);
+  return it == eventIds_.end() ? -1 : it->second;
+}
+
+void ChartFarm::throwUnknownEvent(int event)
+{
+  throw std::runtime_error("farm: no event with index " + std::to_string(event));
+}
+
+void ChartFarm::triggerAll(int event)
+{
+  const auto bit = eventBit(event);
+  for (auto & e : events_) {
+    e |= bit;
+  }
+}
+
+size_t ChartFarm::countInState(size_t state) const
+{
+  return std::count(state_.begin(), state_.end(), static_cast<uint16_t>(state));
+}
+
+void ChartFarm::reset()
+{
+  std::fill(state_.begin(), state_.end(), initial_);
+  std::fill(entered_.begin(), entered_.end(), 0);
+  std::fill(events_.begin(), events_.end(), 0);
+}
+
+void ChartFarm::checkBound() const
+{
+  for (const auto & a : actions_) {
+    if (!a.callback) {
+      throw std::runtime_error("farm: action " + a.name + " is not bound");
+    }
+  }
+  for (const auto & g : guards_) {
+    if (!g.callback && !g.data.values && !g.data.flags) {
+      throw std::runtime_error("farm: guard " + g.name + " is not bound");
+    }
+  }
+}
+
+void ChartFarm::runActions(const Range & range, size_t instance) const
+{
+  for (auto a = range.begin; a < range.end; ++a) {
+    actions_[actionLists_[a]].callback(instance);
+  }
+}
+
+void ChartFarm::step()
+{
+  checkBound();
+  stepChunk(0, size());
+}
+
+void ChartFarm::step(Executor & executor, size_t chunkSize)
+{
+  checkBound();
+  chunkSize = std::max<size_t>(chunkSize, 1);
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t remaining = (size() + chunkSize - 1) / chunkSize;
+  std::exception_ptr error;
+  for (size_t begin = 0; begin < size(); begin += chunkSize) {
+    auto end = std::min(begin + chunkSize, size());
+    executor.execute(
+      [&, begin, end]() {
+        std::exception_ptr e;
+        try {
+          stepChunk(begin, end);
+        } catch (...) {
+          e = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        if (e && !error) {
+          error = e;
+        }
+        if (--remaining == 0) {
+          finished.notify_all();
+        }
+      });
+  }
+  std::unique_lock<std::mutex> lock{mutex};
+  finished.wait(lock, [&remaining]() {return remaining == 0;});
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ChartFarm::stepChunk(size_t begin, size_t end)
+{
+  const size_t n = end - begin;
+  /* data guards first, one column at a time */
+  thread_local std::vector<uint8_t> scratch;
+  scratch.resize(guards_.size() * n);
+  for (size_t g = 0; g < guards_.size(); ++g) {
+    const auto & data = guards_[g].data;
+    auto out = scratch.data() + g * n;
+    if (data.flags) {
+      for (size_t k = 0; k < n; ++k) {
+        out[k] = data.flags[begin + k] != 0;
+      }
+      continue;
+    }
+    if (!data.values) {
+      continue;
+    }
+    auto values = data.values + begin;
+    switch (data.comparison) {
+      case Comparison::Less:
+        compareAll(values, n, data.threshold, out, [](float v, float t) {return v < t;});
+        break;
+      case Comparison::LessEqual:
+        compareAll(values, n, data.threshold, out, [](float v, float t) {return v <= t;});
+        break;
+      case Comparison::Greater:
+        compareAll(values, n, data.threshold, out, [](float v, float t) {return v > t;});
+        break;
+      case Comparison::GreaterEqual:
+        compareAll(values, n, data.threshold, out, [](float v, float t) {return v >= t;});
+        break;
+      case Comparison::Equal:
+        compareAll(values, n, data.threshold, out, [](float v, float t) {return v == t;});
+        break;
+      case Comparison::NotEqual:
+        compareAll(values, n, data.threshold, out, [](float v, float t) {return v != t;});
+        break;
+    }
+  }
+
+  for (size_t i = begin; i < end; ++i) {
+    /* the first step only enters initial, as Chart::spinOnce() does; events
+     * raised before are lost since nothing was active yet
+     */
+    if (!entered_[i]) {
+      entered_[i] = 1;
+      events_[i] = 0;
+      runActions(states_[state_[i]].entry, i);
+      continue;
+    }
+    const auto & s = states_[state_[i]];
+    runActions(s.activity, i);
+    const auto pending = events_[i];
+    events_[i] = 0;
+    const TransitionRow * chosen = nullptr;
+    for (auto t = s.transitions.begin; t < s.transitions.end; ++t) {
+      const auto & tr = transitions_[t];
+      if (tr.events && !(tr.events & pending)) {
+        continue;
+      }
+      bool satisfied = true;
+      for (auto g = tr.guards.begin; g < tr.guards.end; ++g) {
+        auto id = guardLists_[g];
+        const auto & guard = guards_[id];
+        satisfied &= guard.callback ? guard.callback(i) : scratch[id * n + (i - begin)] != 0;
+      }
+      if (satisfied) {
+        chosen = &tr;
+      }
+    }
+    if (chosen) {
+      runActions(s.exit, i);
+      runActions(chosen->actions, i);
+      state_[i] = chosen->dst;
+      runActions(states_[chosen->dst].entry, i);
+    }
+  }
+}
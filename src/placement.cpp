@@ -0,0 +1,215 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/placement.hpp"
+
+using mogi::statechart::NumaNode;
+using mogi::statechart::Placement;
+using mogi::statechart::RealTimeOptions;
+
+namespace
+{
+
+const char nodeDirectory[] = "/sys/devices/system/node/";
+
+/* sysfs list format, e.g. "0-3,8-11" */
+std::vector<int> parseList(const std::string & list)
+{
+  std::vector<int> values;
+  std::istringstream in{list};
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    auto dash = range.find('-');
+    auto first = std::stoi(range.substr(0, dash));
+    auto last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int v = first; v <= last; ++v) {
+      values.push_back(v);
+    }
+  }
+  return values;
+}
+
+bool readLine(const std::string & path, std::string & line)
+{
+  std::ifstream in{path};
+  return in && std::getline(in, line);
+}
+
+/* MPOL_PREFERRED from <numaif.h>, libnuma is not needed for one syscall */
+const int preferredPolicy = 1;
+
+void preferNode(int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+  const size_t bits = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> mask(node / bits + 1, 0);
+  mask[node / bits] = 1ul << (node % bits);
+  if (syscall(SYS_set_mempolicy, preferredPolicy, mask.data(), mask.size() * bits + 1) != 0) {
+    throw std::runtime_error(
+            "cannot allocate from NUMA node " + std::to_string(node) + ": " +
+            std::strerror(errno));
+  }
+#else
+  if (node != 0) {
+    throw std::runtime_error("NUMA placement is not supported on this platform");
+  }
+#endif
+}
+
+#if defined(__linux__)
+/* bytes of the calling thread's stack below frame, the stack grows down */
+size_t stackLeft(const volatile char * frame)
+{
+  pthread_attr_t attr;
+  auto error = pthread_getattr_np(pthread_self(), &attr);
+  if (error) {
+    throw std::runtime_error(std::string{"cannot read the stack size: "} + std::strerror(error));
+  }
+  void * base = nullptr;
+  size_t size = 0;
+  pthread_attr_getstack(&attr, &base, &size);
+  pthread_attr_destroy(&attr);
+  auto bottom = static_cast<const char *>(base);
+  auto here = const_cast<const char *>(frame);
+  return here > bottom && here <= bottom + size ? static_cast<size_t>(here - bottom) : 0;
+}
+
+/* left to the frames of the prefaulting loop and the guard page */
+const size_t stackMargin = 16 * 1024;
+#endif
+
+}  // namespace
+
+std::vector<NumaNode> Placement::numaNodes()
+{
+  std::vector<NumaNode> nodes;
+  std::string online;
+  if (readLine(std::string{nodeDirectory} + "online", online)) {
+    for (auto id : parseList(online)) {
+      std::string cpus;
+      readLine(std::string{nodeDirectory} + "node" + std::to_string(id) + "/cpulist", cpus);
+      /* memory only nodes have no CPU */
+      nodes.push_back(NumaNode{id, parseList(cpus)});
+    }
+  }
+  if (nodes.empty()) {
+    NumaNode node{0, {}};
+    for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+      node.cpus.push_back(static_cast<int>(cpu));
+    }
+    nodes.push_back(node);
+  }
+  return nodes;
+}
+
+std::vector<int> Placement::cpusOf(int node)
+{
+  for (const auto & n : numaNodes()) {
+    if (n.id == node) {
+      return n.cpus;
+    }
+  }
+  throw std::runtime_error("no NUMA node " + std::to_string(node));
+}
+
+void Placement::setUpThread(const RealTimeOptions & options)
+{
+#if defined(__linux__)
+  /* checked before any setting is changed */
+  for (auto cpu : options.cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      throw std::runtime_error(
+              "no CPU " + std::to_string(cpu) + ", CPUs go from 0 to " +
+              std::to_string(CPU_SETSIZE - 1));
+    }
+  }
+#endif
+  if (options.prefaultStack) {
+#if defined(__linux__)
+    volatile char frame = 0;
+    auto left = stackLeft(&frame);
+    if (options.prefaultStack + stackMargin > left) {
+      throw std::runtime_error(
+              "cannot prefault " + std::to_string(options.prefaultStack) + " bytes of stack, " +
+              std::to_string(left > stackMargin ? left - stackMargin : 0) + " are left");
+    }
+#else
+    throw std::runtime_error("stack prefaulting is not supported on this platform");
+#endif
+  }
+  auto cpus = options.cpus;
+  if (options.numaNode >= 0) {
+    if (cpus.empty()) {
+      cpus = cpusOf(options.numaNode);
+    } else {
+      /* still checks that the node exists */
+      cpusOf(options.numaNode);
+    }
+    preferNode(options.numaNode);
+  }
+#if defined(__linux__)
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus) {
+      CPU_SET(cpu, &set);
+    }
+    auto error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error) {
+      throw std::runtime_error(std::string{"cannot set the CPU affinity: "} + std::strerror(error));
+    }
+  }
+#else
+  if (!cpus.empty()) {
+    throw std::runtime_error("CPU affinity is not supported on this platform");
+  }
+#endif
+  if (options.priority > 0) {
+    sched_param param{};
+    param.sched_priority = options.priority;
+    auto error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error) {
+      throw std::runtime_error(
+              "cannot set SCHED_FIFO priority " + std::to_string(options.priority) + ": " +
+              std::strerror(error));
+    }
+  }
+  if (options.prefaultStack) {
+    /* touch the pages below the current frame, mlockall() keeps them */
+    auto stack = static_cast<volatile char *>(alloca(options.prefaultStack));
+    for (size_t i = 0; i < options.prefaultStack; i += 4096) {
+      stack[i] = 0;
+    }
+  }
+}
@@ -0,0 +1,373 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mogi_statechart/recorder.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventLog;
+using mogi::statechart::EventObserver;
+using mogi::statechart::EventRecorder;
+using mogi::statechart::EventReplayer;
+using mogi::statechart::LogRecord;
+using mogi::statechart::ReplayResult;
+
+namespace
+{
+
+const char magic[] = "MSCLOG1\n";
+const size_t magicSize = sizeof(magic) - 1;
+/* records are written to the stream in chunks of this size */
+const size_t flushThreshold = 64 * 1024;
+/* tag of a record defining the next name index */
+const uint8_t nameTag = 0;
+
+class Reader
+{
+public:
+  explicit Reader(const std::string & data)
+  : data_(data) {}
+
+  bool atEnd() const {return pos_ >= data_.size();}
+
+  /* false if the log is cut short */
+  bool varint(uint64_t & value)
+  {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (atEnd()) {
+        return false;
+      }
+      auto byte = static_cast<uint8_t>(data_[pos_++]);
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    throw std::runtime_error("event log: malformed integer at offset " + std::to_string(pos_));
+  }
+
+  bool byte(uint8_t & value)
+  {
+    if (atEnd()) {
+      return false;
+    }
+    value = static_cast<uint8_t>(data_[pos_++]);
+    return true;
+  }
+
+  bool bytes(size_t n, std::string & out)
+  {
+    if (data_.size() - pos_ < n) {
+      return false;
+    }
+    out.assign(data_, pos_, n);
+    pos_ += n;
+    return true;
+  }
+
+  size_t offset() const {return pos_;}
+
+private:
+  const std::string & data_;
+  size_t pos_{magicSize};
+};
+
+/* states entered during a replay, shared with the state change callback which
+ * a running chart may still call once it is removed
+ */
+struct Observed
+{
+  std::mutex mutex;
+  std::vector<std::string> states;
+};
+
+}  // namespace
+
+EventLog EventLog::read(std::istream & in)
+{
+  std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+  if (data.compare(0, magicSize, magic) != 0) {
+    throw std::runtime_error("event log: bad magic, not a recorder log");
+  }
+
+  EventLog log;
+  Reader r{data};
+  uint64_t time = 0;
+  while (!r.atEnd()) {
+    uint8_t tag;
+    r.byte(tag);
+    if (tag == nameTag) {
+      uint64_t size;
+      std::string name;
+      if (!r.varint(size) || !r.bytes(size, name)) {
+        break;
+      }
+      log.names.push_back(std::move(name));
+      continue;
+    }
+    if (tag != static_cast<uint8_t>(LogRecord::Type::Trigger) &&
+      tag != static_cast<uint8_t>(LogRecord::Type::StateChange))
+    {
+      throw std::runtime_error(
+              "event log: unknown record at offset " + std::to_string(r.offset() - 1));
+    }
+    LogRecord record{static_cast<LogRecord::Type>(tag), 0, 0, 0};
+    uint64_t delta, source, state = 0;
+    if (!r.varint(delta) || !r.varint(source)) {
+      break;
+    }
+    if (record.type == LogRecord::Type::StateChange && !r.varint(state)) {
+      break;
+    }
+    if (source >= log.names.size() || state >= log.names.size()) {
+      throw std::runtime_error(
+              "event log: undefined name at offset " + std::to_string(r.offset()));
+    }
+    time += delta;
+    record.time = time;
+    record.source = static_cast<uint32_t>(source);
+    record.state = static_cast<uint32_t>(state);
+    log.records.push_back(record);
+  }
+  return log;
+}
+
+EventLog EventLog::readFile(const std::string & path)
+{
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    throw std::runtime_error("event log: cannot open " + path);
+  }
+  return read(in);
+}
+
+/* shared with the events and charts watched, which may still hold it after
+ * the recorder is gone: records go nowhere once detached
+ */
+class EventRecorder::Observer : public EventObserver
+{
+public:
+  explicit Observer(EventRecorder & recorder)
+  : recorder_(&recorder) {}
+
+  void record(LogRecord::Type type, const std::string & source, const std::string & state)
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (recorder_) {
+      recorder_->record(type, source, state);
+    }
+  }
+
+  /* waits for a record in progress */
+  void detach()
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    recorder_ = nullptr;
+  }
+
+protected:
+  void notify(const Event & event) override
+  {
+    record(LogRecord::Type::Trigger, event.name(), {});
+  }
+
+private:
+  std::mutex mutex_;
+  EventRecorder * recorder_;
+};
+
+EventRecorder::EventRecorder(std::ostream & out)
+: out_(out), start_(std::chrono::steady_clock::now()),
+  observer_(std::make_shared<Observer>(*this))
+{
+  buffer_.reserve(flushThreshold * 2);
+  buffer_.append(magic, magicSize);
+}
+
+EventRecorder::~EventRecorder()
+{
+  observer_->detach();
+  for (const auto & c : charts_) {
+    auto chart = c.first.lock();
+    if (chart) {
+      chart->removeStateChangeCallback(c.second);
+    }
+  }
+  flush();
+}
+
+void EventRecorder::watch(Event & event)
+{
+  event.addObserver(observer_);
+}
+
+void EventRecorder::watch(const std::shared_ptr<Chart> & chart)
+{
+  auto name = chart->name();
+  auto observer = observer_;
+  auto callback = chart->createStateChangeCallback(
+    [observer, name](const std::string & state) {
+      observer->record(LogRecord::Type::StateChange, name, state);
+    });
+  charts_.emplace_back(chart, callback);
+}
+
+void EventRecorder::flush()
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  out_.write(buffer_.data(), buffer_.size());
+  out_.flush();
+  buffer_.clear();
+}
+
+uint64_t EventRecorder::recordCount() const
+{
+  std::lock_guard<std::mutex> lock{mutex_};
+  return count_;
+}
+
+void EventRecorder::record(
+  LogRecord::Type type, const std::string & source,
+  const std::string & state)
+{
+  auto now = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start_).count());
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto sourceIndex = intern(source);
+  auto stateIndex = type == LogRecord::Type::StateChange ? intern(state) : 0;
+  /* threads may race between reading the clock and taking the lock */
+  now = std::max(now, last_);
+  buffer_.push_back(static_cast<char>(type));
+  writeVarint(now - last_);
+  writeVarint(sourceIndex);
+  if (type == LogRecord::Type::StateChange) {
+    writeVarint(stateIndex);
+  }
+  last_ = now;
+  ++count_;
+  if (buffer_.size() >= flushThreshold) {
+    out_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+}
+
+uint32_t EventRecorder::intern(const std::string & name)
+{
+  auto it = names_.find(name);
+  if (it != names_.end()) {
+    return it->second;
+  }
+  auto index = static_cast<uint32_t>(names_.size());
+  names_.emplace(name, index);
+  buffer_.push_back(static_cast<char>(nameTag));
+  writeVarint(name.size());
+  buffer_.append(name);
+  return index;
+}
+
+void EventRecorder::writeVarint(uint64_t value)
+{
+  while (value >= 0x80) {
+    buffer_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  buffer_.push_back(static_cast<char>(value));
+}
+
+ReplayResult EventReplayer::replay(const std::shared_ptr<Chart> & chart, Pace pace)
+{
+  ReplayResult result;
+  const auto & chartName = chart->name();
+
+  /* resolve names once, the hot loop only deals with indices */
+  std::vector<Event *> events(log_.names.size(), nullptr);
+  for (size_t i = 0; i < log_.names.size(); ++i) {
+    auto it = events_.find(log_.names[i]);
+    if (it != events_.end()) {
+      events[i] = it->second;
+    }
+  }
+  std::vector<const std::string *> expected;
+
+  auto observed = std::make_shared<Observed>();
+  size_t observedCount = 0;
+  const bool running = chart->isRunning();
+  auto callback = chart->createStateChangeCallback(
+    [observed](const std::string & state) {
+      std::lock_guard<std::mutex> lock{observed->mutex};
+      observed->states.push_back(state);
+    });
+  auto replayed = [&observed]() {
+      std::lock_guard<std::mutex> lock{observed->mutex};
+      return observed->states.size();
+    };
+
+  const uint64_t origin = log_.records.empty() ? 0 : log_.records.front().time;
+  auto start = std::chrono::steady_clock::now();
+  for (const auto & record : log_.records) {
+    if (pace == Pace::RealTime) {
+      std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.time - origin));
+    }
+    if (record.type == LogRecord::Type::Trigger) {
+      auto event = events[record.source];
+      if (!event) {
+        ++result.skipped;
+        continue;
+      }
+      event->trigger();
+      ++result.events;
+      if (!running) {
+        chart->spinOnce();
+      }
+    } else if (log_.names[record.source] == chartName) {
+      expected.push_back(&log_.names[record.state]);
+      if (running) {
+        continue;
+      }
+      observedCount = replayed();
+      for (int step = 0; observedCount < expected.size() && step < catchUpSteps_; ++step) {
+        chart->spinOnce();
+        observedCount = replayed();
+      }
+    }
+  }
+  result.elapsed = std::chrono::steady_clock::now() - start;
+  chart->removeStateChangeCallback(callback);
+
+  std::lock_guard<std::mutex> lock{observed->mutex};
+  const auto & states = observed->states;
+  result.transitions = states.size();
+  auto common = std::min(states.size(), expected.size());
+  for (size_t i = 0; i < common; ++i) {
+    if (states[i] != *expected[i]) {
+      result.divergedAt = static_cast<int64_t>(i);
+      return result;
+    }
+  }
+  if (states.size() != expected.size()) {
+    result.divergedAt = static_cast<int64_t>(common);
+  }
+  return result;
+}
@@ -0,0 +1,825 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cctype>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "mogi_statechart/scxml.hpp"
+
+using mogi::statechart::AbstractState;
+using mogi::statechart::Chart;
+using mogi::statechart::ChartDescription;
+using mogi::statechart::Event;
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::ScxmlRegistry;
+using mogi::statechart::State;
+using mogi::statechart::StateDescription;
+using mogi::statechart::Transition;
+using mogi::statechart::TransitionDescription;
+
+namespace
+{
+
+/* A minimal pull parser for the subset of XML that SCXML documents use.
+ * Input is consumed in fixed size chunks and only the current tag is held
+ * in memory, so the cost of a document is linear in its size and the memory
+ * footprint does not depend on it.
+ */
+class XmlReader
+{
+public:
+  enum class Token {StartElement, EndElement, Text, End};
+
+  explicit XmlReader(std::istream & in)
+  : in_(in), buffer_(1 << 16) {}
+
+  Token next()
+  {
+    if (pendingEnd_) {
+      /* a self closing tag is reported as a start followed by an end */
+      pendingEnd_ = false;
+      return Token::EndElement;
+    }
+    text_.clear();
+    while (true) {
+      int c = peek();
+      if (c < 0) {
+        return Token::End;
+      }
+      if (c != '<') {
+        readText();
+        return Token::Text;
+      }
+      get();
+      c = peek();
+      if (c == '?') {
+        skipPast("?>");
+      } else if (c == '!') {
+        get();
+        if (consume("--")) {
+          skipPast("-->");
+        } else if (consume("[CDATA[")) {
+          readUntil("]]>", text_);
+          return Token::Text;
+        } else {
+          skipDeclaration();
+        }
+      } else if (c == '/') {
+        get();
+        readName();
+        skipSpaces();
+        expect('>');
+        return Token::EndElement;
+      } else {
+        readName();
+        readAttributes();
+        return Token::StartElement;
+      }
+    }
+  }
+
+  const std::string & name() const {return name_;}
+  const std::string & text() const {return text_;}
+  int line() const {return line_;}
+
+  const std::string * attribute(const char * key) const
+  {
+    for (const auto & a : attributes_) {
+      if (a.first == key) {
+        return &a.second;
+      }
+    }
+    return nullptr;
+  }
+
+  [[noreturn]] void fail(const std::string & what) const
+  {
+    throw std::runtime_error("scxml:" + std::to_string(line_) + ": " + what);
+  }
+
+private:
+  int peek()
+  {
+    if (pos_ == end_) {
+      if (!in_) {
+        return -1;
+      }
+      in_.read(buffer_.data(), buffer_.size());
+      pos_ = 0;
+      end_ = static_cast<size_t>(in_.gcount());
+      if (end_ == 0) {
+        return -1;
+      }
+    }
+    return static_cast<unsigned char>(buffer_[pos_]);
+  }
+
+  int get()
+  {
+    int c = peek();
+    if (c >= 0) {
+      ++pos_;
+      if (c == '\n') {
+        ++line_;
+      }
+    }
+    return c;
+  }
+
+  void expect(char e)
+  {
+    if (get() != e) {
+      fail(std::string("expected '") + e + "'");
+    }
+  }
+
+  bool consume(const char * s)
+  {
+    /* only used right after a '<!', where a mismatch is a syntax error
+     * for everything but a <!DOCTYPE>
+     */
+    for (const char * p = s; *p; ++p) {
+      if (peek() != *p) {
+        if (p != s) {
+          fail("malformed markup declaration");
+        }
+        return false;
+      }
+      get();
+    }
+    return true;
+  }
+
+  void skipSpaces()
+  {
+    int c = peek();
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      get();
+      c = peek();
+    }
+  }
+
+  void readUntil(const char * terminator, std::string & out)
+  {
+    const std::string t{terminator};
+    while (true) {
+      int c = get();
+      if (c < 0) {
+        fail("unexpected end of document, missing '" + t + "'");
+      }
+      out.push_back(static_cast<char>(c));
+      if (out.size() >= t.size() &&
+        out.compare(out.size() - t.size(), t.size(), t) == 0)
+      {
+        out.resize(out.size() - t.size());
+        return;
+      }
+    }
+  }
+
+  void skipPast(const char * terminator)
+  {
+    scratch_.clear();
+    readUntil(terminator, scratch_);
+  }
+
+  void skipDeclaration()
+  {
+    /* <!DOCTYPE ...> possibly with an internal [ ... ] subset */
+    int depth = 0;
+    while (true) {
+      int c = get();
+      if (c < 0) {
+        fail("unexpected end of document in declaration");
+      } else if (c == '[') {
+        ++depth;
+      } else if (c == ']') {
+        --depth;
+      } else if (c == '>' && depth <= 0) {
+        return;
+      }
+    }
+  }
+
+  static bool isNameChar(int c)
+  {
+    return c > 0 && c != ' ' && c != '\t' && c != '\r' && c != '\n' &&
+           c != '/' && c != '>' && c != '=' && c != '<';
+  }
+
+  void readName()
+  {
+    name_.clear();
+    int c = peek();
+    while (isNameChar(c)) {
+      name_.push_back(static_cast<char>(get()));
+      c = peek();
+    }
+    if (name_.empty()) {
+      fail("expected a tag name");
+    }
+    /* namespaces are of no interest here, drop any prefix */
+    auto colon = name_.find(':');
+    if (colon != std::string::npos) {
+      name_.erase(0, colon + 1);
+    }
+  }
+
+  void readAttributes()
+  {
+    attributes_.clear();
+    while (true) {
+      skipSpaces();
+      int c = peek();
+      if (c == '>') {
+        get();
+        return;
+      }
+      if (c == '/') {
+        get();
+        expect('>');
+        pendingEnd_ = true;
+        return;
+      }
+      std::pair<std::string, std::string> attr;
+      while (isNameChar(peek())) {
+        attr.first.push_back(static_cast<char>(get()));
+      }
+      if (attr.first.empty()) {
+        fail("malformed attribute in <" + name_ + ">");
+      }
+      skipSpaces();
+      expect('=');
+      skipSpaces();
+      int quote = get();
+      if (quote != '"' && quote != '\'') {
+        fail("attribute value must be quoted in <" + name_ + ">");
+      }
+      while (true) {
+        c = get();
+        if (c < 0) {
+          fail("unexpected end of document in attribute value");
+        }
+        if (c == quote) {
+          break;
+        }
+        if (c == '&') {
+          readEntity(attr.second);
+        } else {
+          attr.second.push_back(static_cast<char>(c));
+        }
+      }
+      attributes_.push_back(std::move(attr));
+    }
+  }
+
+  void readText()
+  {
+    while (true) {
+      int c = peek();
+      if (c < 0 || c == '<') {
+        return;
+      }
+      get();
+      if (c == '&') {
+        readEntity(text_);
+      } else {
+        text_.push_back(static_cast<char>(c));
+      }
+    }
+  }
+
+  void readEntity(std::string & out)
+  {
+    scratch_.clear();
+    readUntil(";", scratch_);
+    if (scratch_ == "lt") {
+      out.push_back('<');
+    } else if (scratch_ == "gt") {
+      out.push_back('>');
+    } else if (scratch_ == "amp") {
+      out.push_back('&');
+    } else if (scratch_ == "quot") {
+      out.push_back('"');
+    } else if (scratch_ == "apos") {
+      out.push_back('\'');
+    } else if (scratch_.size() > 1 && scratch_[0] == '#') {
+      appendUtf8(characterReference(), out);
+    } else {
+      fail("unknown entity &" + scratch_ + ";");
+    }
+  }
+
+  /* code point of the &#...; held by scratch_ */
+  unsigned long characterReference()  // NOLINT(runtime/int)
+  {
+    bool hex = scratch_[1] == 'x';
+    size_t first = hex ? 2 : 1;
+    unsigned long code = 0;  // NOLINT(runtime/int)
+    for (size_t i = first; i < scratch_.size(); ++i) {
+      auto c = static_cast<unsigned char>(scratch_[i]);
+      int digit = std::isdigit(c) ? c - '0' :
+        hex && std::isxdigit(c) ? std::tolower(c) - 'a' + 10 : -1;
+      if (digit < 0) {
+        fail("bad character reference &" + scratch_ + ";");
+      }
+      code = code * (hex ? 16 : 10) + digit;
+      if (code > 0x10FFFF) {
+        fail("character reference &" + scratch_ + "; is out of the unicode range");
+      }
+    }
+    if (scratch_.size() == first || code == 0 || (code >= 0xD800 && code <= 0xDFFF)) {
+      fail("bad character reference &" + scratch_ + ";");
+    }
+    return code;
+  }
+
+  static void appendUtf8(unsigned long code, std::string & out)  // NOLINT(runtime/int)
+  {
+    if (code < 0x80) {
+      out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+      out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+      out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+      out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+  }
+
+  std::istream & in_;
+  std::vector<char> buffer_;
+  size_t pos_{0};
+  size_t end_{0};
+  int line_{1};
+  bool pendingEnd_{false};
+
+  std::string name_;
+  std::string text_;
+  std::string scratch_;
+  std::vector<std::pair<std::string, std::string>> attributes_;
+};
+
+std::vector<std::string> split(const std::string & s, const std::string & sep)
+{
+  std::vector<std::string> tokens;
+  size_t begin = 0;
+  while (begin <= s.size()) {
+    auto end = sep.empty() ? std::string::npos : s.find(sep, begin);
+    if (end == std::string::npos) {
+      end = s.size();
+    }
+    auto first = s.find_first_not_of(" \t\r\n", begin);
+    auto last = s.find_last_not_of(" \t\r\n", end == 0 ? 0 : end - 1);
+    if (first != std::string::npos && first < end && last >= first) {
+      tokens.push_back(s.substr(first, last - first + 1));
+    }
+    begin = end + sep.size();
+  }
+  return tokens;
+}
+
+std::vector<std::string> splitSpaces(const std::string & s)
+{
+  std::vector<std::string> tokens;
+  const char * spaces = " \t\r\n";
+  auto begin = s.find_first_not_of(spaces);
+  while (begin != std::string::npos) {
+    auto end = s.find_first_of(spaces, begin);
+    tokens.push_back(s.substr(begin, end - begin));
+    begin = end == std::string::npos ? end : s.find_first_not_of(spaces, end);
+  }
+  return tokens;
+}
+
+using ActionList = std::vector<const ScxmlRegistry::ActionT *>;
+
+/* wrap a list of registered actions into a single callback */
+std::function<void()> chain(const ActionList & actions)
+{
+  if (actions.size() == 1) {
+    return *actions.front();
+  }
+  std::vector<ScxmlRegistry::ActionT> copies;
+  copies.reserve(actions.size());
+  for (auto a : actions) {
+    copies.push_back(*a);
+  }
+  return [copies]() {
+           for (const auto & a : copies) {
+             a();
+           }
+         };
+}
+
+/* a <state>, <final> or <scxml> that is still being read */
+struct Frame
+{
+  StateDescription state;
+  /* initial child given by the initial attribute or <initial> */
+  std::string initial;
+  /* first child state, default initial */
+  std::string firstChild;
+};
+
+enum class Element
+{
+  Scxml, State, Final, Initial, Transition, OnEntry, OnExit, Script, Ignored
+};
+
+}  // namespace
+
+ChartDescription ScxmlLoader::parse(std::istream & in)
+{
+  XmlReader reader{in};
+  std::vector<Element> elements;
+  std::vector<Frame> frames;
+  ChartDescription root;
+  bool hasRoot{false};
+  std::string scriptText;
+
+  auto currentActions = [&]() -> std::vector<std::string> * {
+      if (elements.size() < 2 || frames.empty()) {
+        return nullptr;
+      }
+      auto & s = frames.back().state;
+      switch (elements[elements.size() - 2]) {
+        case Element::OnEntry:
+          return &s.entry;
+        case Element::OnExit:
+          return &s.exit;
+        case Element::Transition:
+          /* scripts of an <initial> transition are rejected when opened */
+          return &s.transitions.back().actions;
+        default:
+          return nullptr;
+      }
+    };
+
+  /* chart owning the states of a frame, states only become subcharts once
+   * their first child state shows up
+   */
+  auto closeChart = [](Frame & f, ChartDescription & chart) {
+      chart.initial = f.initial.empty() ? f.firstChild : f.initial;
+    };
+
+  auto closeState = [&]() {
+      auto f = std::move(frames.back());
+      frames.pop_back();
+      if (f.state.subchart) {
+        closeChart(f, *f.state.subchart);
+      }
+      auto & parent = frames.back();
+      if (parent.firstChild.empty() && !f.state.isFinal) {
+        parent.firstChild = f.state.name;
+      }
+      auto chart = frames.size() == 1 ? &root : parent.state.subchart.get();
+      chart->states.push_back(std::move(f.state));
+    };
+
+  while (true) {
+    auto token = reader.next();
+    if (token == XmlReader::Token::End) {
+      break;
+    }
+
+    if (token == XmlReader::Token::Text) {
+      if (!elements.empty() && elements.back() == Element::Script) {
+        scriptText += reader.text();
+      }
+      continue;
+    }
+
+    if (token == XmlReader::Token::EndElement) {
+      if (elements.empty()) {
+        reader.fail("unbalanced closing tag </" + reader.name() + ">");
+      }
+      switch (elements.back()) {
+        case Element::Scxml:
+          closeChart(frames.back(), root);
+          frames.pop_back();
+          break;
+        case Element::State:
+        case Element::Final:
+          closeState();
+          break;
+        case Element::Script:
+          {
+            auto actions = currentActions();
+            if (actions) {
+              for (auto & n : splitSpaces(scriptText)) {
+                actions->push_back(std::move(n));
+              }
+            }
+            scriptText.clear();
+          }
+          break;
+        default:
+          break;
+      }
+      elements.pop_back();
+      continue;
+    }
+
+    /* start element */
+    const auto & tag = reader.name();
+    if (!elements.empty() && elements.back() == Element::Ignored) {
+      elements.push_back(Element::Ignored);
+    } else if (tag == "scxml") {
+      if (hasRoot) {
+        reader.fail("nested <scxml> element");
+      }
+      hasRoot = true;
+      auto n = reader.attribute("name");
+      root.name = n && !n->empty() ? *n : "scxml";
+      Frame f;
+      if (auto i = reader.attribute("initial")) {
+        f.initial = *i;
+      }
+      frames.push_back(std::move(f));
+      elements.push_back(Element::Scxml);
+    } else if (!hasRoot) {
+      reader.fail("expected <scxml> as the document element, got <" + tag + ">");
+    } else if (elements.empty()) {
+      reader.fail("content after the </scxml> document element");
+    } else if (tag == "state" || tag == "final") {
+      if (elements.back() != Element::Scxml && elements.back() != Element::State) {
+        reader.fail("<" + tag + "> is not allowed here");
+      }
+      if (elements.back() == Element::State) {
+        auto & parent = frames.back().state;
+        if (!parent.subchart) {
+          parent.subchart = std::make_shared<ChartDescription>();
+          parent.subchart->name = parent.name;
+        }
+      }
+      auto id = reader.attribute("id");
+      if (!id || id->empty()) {
+        reader.fail("<" + tag + "> without an id");
+      }
+      Frame f;
+      f.state.name = *id;
+      f.state.isFinal = tag == "final";
+      if (auto i = reader.attribute("initial")) {
+        f.initial = *i;
+      }
+      elements.push_back(f.state.isFinal ? Element::Final : Element::State);
+      frames.push_back(std::move(f));
+    } else if (tag == "initial") {
+      if (elements.back() != Element::State) {
+        reader.fail("<initial> is only supported inside a <state>");
+      }
+      elements.push_back(Element::Initial);
+    } else if (tag == "transition") {
+      auto target = reader.attribute("target");
+      if (elements.back() == Element::Initial) {
+        if (!target) {
+          reader.fail("<initial> transition without a target");
+        }
+        frames.back().initial = *target;
+      } else if (elements.back() == Element::State) {
+        if (!target || target->empty()) {
+          reader.fail("targetless transitions are not supported");
+        }
+        auto targets = splitSpaces(*target);
+        if (targets.size() != 1) {
+          reader.fail("transitions with multiple targets are not supported");
+        }
+        TransitionDescription t;
+        t.target = targets.front();
+        if (auto e = reader.attribute("event")) {
+          t.events = splitSpaces(*e);
+        }
+        if (auto c = reader.attribute("cond")) {
+          t.guards = split(*c, "&&");
+        }
+        frames.back().state.transitions.push_back(std::move(t));
+      } else {
+        reader.fail("<transition> is not allowed here");
+      }
+      elements.push_back(Element::Transition);
+    } else if (tag == "onentry" || tag == "onexit") {
+      if (elements.back() != Element::State && elements.back() != Element::Final) {
+        reader.fail("<" + tag + "> is not allowed here");
+      }
+      elements.push_back(tag == "onentry" ? Element::OnEntry : Element::OnExit);
+    } else if (tag == "script") {
+      if (elements.back() == Element::Transition &&
+        elements[elements.size() - 2] == Element::Initial)
+      {
+        reader.fail("<script> in an <initial> transition is not supported");
+      }
+      elements.push_back(Element::Script);
+      scriptText.clear();
+      if (auto src = reader.attribute("src")) {
+        scriptText = *src;
+      }
+    } else if (tag == "parallel") {
+      reader.fail("<parallel> is not supported");
+    } else {
+      /* datamodel, log, invoke etc. have no counterpart, skip the subtree */
+      elements.push_back(Element::Ignored);
+    }
+  }
+
+  if (!hasRoot) {
+    throw std::runtime_error("scxml: document has no <scxml> element");
+  }
+  if (!elements.empty()) {
+    reader.fail("unexpected end of document");
+  }
+  return root;
+}
+
+std::shared_ptr<Chart> ScxmlLoader::loadFile(const std::string & path)
+{
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    throw std::runtime_error("Cannot open scxml file " + path);
+  }
+  return load(in);
+}
+
+std::shared_ptr<Chart> ScxmlLoader::loadString(const std::string & document)
+{
+  std::istringstream in{document};
+  return load(in);
+}
+
+std::shared_ptr<Chart> ScxmlLoader::load(std::istream & in)
+{
+  return build(parse(in));
+}
+
+std::shared_ptr<Chart> ScxmlLoader::build(const ChartDescription & description)
+{
+  auto chart = Chart::createChart(description.name);
+  build(description, chart);
+  return chart;
+}
+
+void ScxmlLoader::build(
+  const ChartDescription & description,
+  const std::shared_ptr<Chart> & chart)
+{
+  auto fail = [&chart](const std::string & what) {
+      throw std::runtime_error("scxml: chart " + chart->name() + ": " + what);
+    };
+  auto actions = [this, &fail](const std::vector<std::string> & names) {
+      ActionList list;
+      list.reserve(names.size());
+      for (const auto & n : names) {
+        auto a = registry_.findAction(n);
+        if (!a) {
+          fail("action '" + n + "' is not registered");
+        }
+        list.push_back(a);
+      }
+      return list;
+    };
+
+  /* create every state first, transitions may point forward */
+  std::unordered_map<std::string, std::shared_ptr<AbstractState>> states;
+  states.reserve(description.states.size());
+  /* every <final> is the chart's final state, their actions are chained */
+  std::vector<std::string> finalEntry, finalActivity, finalExit;
+  for (const auto & s : description.states) {
+    std::shared_ptr<AbstractState> state;
+    if (s.subchart) {
+      if (!s.entry.empty() || !s.activity.empty() || !s.exit.empty()) {
+        fail("entry/do/exit actions on compound state " + s.name + " are not supported");
+      }
+      auto sub = Chart::createChart(s.name);
+      if (states.count(s.name) || s.name == "initial" || s.name == "final") {
+        fail("duplicated state id " + s.name);
+      }
+      chart->addSubchart(sub);
+      build(*s.subchart, sub);
+      state = sub;
+    } else {
+      std::shared_ptr<State> atomic;
+      if (s.isFinal) {
+        atomic = std::dynamic_pointer_cast<State>(chart->getFinalState());
+        finalEntry.insert(finalEntry.end(), s.entry.begin(), s.entry.end());
+        finalActivity.insert(finalActivity.end(), s.activity.begin(), s.activity.end());
+        finalExit.insert(finalExit.end(), s.exit.begin(), s.exit.end());
+      } else {
+        if (states.count(s.name) || s.name == "initial" || s.name == "final") {
+          fail("duplicated state id " + s.name);
+        }
+        atomic = chart->createState(s.name);
+      }
+      const auto & entry = s.isFinal ? finalEntry : s.entry;
+      const auto & activity = s.isFinal ? finalActivity : s.activity;
+      const auto & exit = s.isFinal ? finalExit : s.exit;
+      if (!entry.empty()) {
+        atomic->setCallbackEntry(chain(actions(entry)));
+      }
+      if (!activity.empty()) {
+        atomic->setCallbackDo(chain(actions(activity)));
+      }
+      if (!exit.empty()) {
+        atomic->setCallbackExit(chain(actions(exit)));
+      }
+      state = atomic;
+    }
+    if (!states.emplace(s.name, state).second) {
+      fail("duplicated state id " + s.name);
+    }
+  }
+
+  auto resolve = [&states, &fail](const std::string & name) {
+      auto it = states.find(name);
+      if (it == states.end()) {
+        fail("target '" + name + "' is not a state of this chart");
+      }
+      return it->second;
+    };
+
+  for (const auto & s : description.states) {
+    auto src = states.at(s.name);
+    for (const auto & d : s.transitions) {
+      auto dst = resolve(d.target);
+      /* done.state.<id> of the source itself is its completion */
+      bool completion = d.events.size() == 1 && d.events.front() == "done.state." + s.name;
+      std::shared_ptr<Transition> t;
+      if (completion) {
+        t = d.actions.empty() ?
+          src->createCompletionTransition(dst) :
+          src->createCompletionTransition(dst, chain(actions(d.actions)));
+      } else {
+        t = d.actions.empty() ?
+          src->createTransition(dst) :
+          src->createTransition(dst, chain(actions(d.actions)));
+        for (const auto & e : d.events) {
+          t->addEvent(resolveEvent(e));
+        }
+      }
+      for (const auto & g : d.guards) {
+        auto guard = registry_.findGuard(g);
+        if (!guard) {
+          fail("guard '" + g + "' is not registered");
+        }
+        t->createGuard(ScxmlRegistry::GuardT(*guard));
+      }
+    }
+  }
+
+  if (!description.initial.empty()) {
+    chart->getInitialState()->createTransition(resolve(description.initial));
+  }
+}
+
+Event & ScxmlLoader::event(const std::string & name)
+{
+  auto e = registry_.findEvent(name);
+  if (e) {
+    return *e;
+  }
+  auto it = events_.find(name);
+  if (it == events_.end()) {
+    throw std::runtime_error("Unknown scxml event " + name);
+  }
+  return *it->second;
+}
+
+bool ScxmlLoader::hasEvent(const std::string & name) const
+{
+  return registry_.findEvent(name) || events_.find(name) != events_.end();
+}
+
+Event & ScxmlLoader::resolveEvent(const std::string & name)
+{
+  auto e = registry_.findEvent(name);
+  if (e) {
+    return *e;
+  }
+  auto & owned = events_[name];
+  if (!owned) {
+    owned.reset(new Event(name));
+  }
+  return *owned;
+}
@@ -0,0 +1,337 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "mogi_statechart/shm_transport.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::ShmEventReceiver;
+using mogi::statechart::ShmEventSender;
+
+namespace
+{
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs address free 64 bit atomics");
+
+/* bumped on any layout change, processes built apart must agree on it */
+const uint64_t ringMagic = 0x4d53434853484d32;  // "MSCHSHM2"
+const size_t cacheLine = 64;
+
+/* Layout of the shared memory object: this header, then capacity slots of
+ * slotSize bytes, each a SlotHeader followed by the payload. The ring is
+ * D. Vyukov's bounded MPMC queue, see MpmcQueue, over raw memory.
+ */
+struct RingHeader
+{
+  std::atomic<uint64_t> magic;
+  uint64_t capacity;
+  uint64_t slotSize;
+  uint64_t maxPayload;
+  /* pid of the receiver, tells a live ring from a leftover */
+  std::atomic<int64_t> owner;
+  char pad0[cacheLine - 5 * sizeof(uint64_t)];
+  std::atomic<uint64_t> tail;
+  char pad1[cacheLine - sizeof(uint64_t)];
+  std::atomic<uint64_t> head;
+  char pad2[cacheLine - sizeof(uint64_t)];
+  std::atomic<uint64_t> dropped;
+  char pad3[cacheLine - sizeof(uint64_t)];
+};
+
+struct SlotHeader
+{
+  std::atomic<uint64_t> sequence;
+  uint32_t id;
+  uint32_t size;
+};
+
+RingHeader * header(void * memory) {return static_cast<RingHeader *>(memory);}
+
+/* capacity and slotSize are the process' own copies, never read back from
+ * the object which any process mapping it may overwrite
+ */
+SlotHeader * slot(void * memory, uint64_t index, uint64_t capacity, uint64_t slotSize)
+{
+  auto base = static_cast<char *>(memory) + sizeof(RingHeader);
+  return reinterpret_cast<SlotHeader *>(base + (index & (capacity - 1)) * slotSize);
+}
+
+void * mapObject(int fd, size_t size, const std::string & name)
+{
+  auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error("cannot map " + name + ": " + std::strerror(errno));
+  }
+  return memory;
+}
+
+/* pid of the live receiver of the object called name, 0 if there is none */
+pid_t liveOwner(const std::string & name)
+{
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return 0;
+  }
+  struct stat st;
+  pid_t owner = 0;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(RingHeader)) {
+    auto memory = mmap(nullptr, sizeof(RingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (memory != MAP_FAILED) {
+      owner = static_cast<pid_t>(header(memory)->owner.load(std::memory_order_acquire));
+      munmap(memory, sizeof(RingHeader));
+    }
+  }
+  close(fd);
+  /* EPERM: alive, run by another user */
+  if (owner > 0 && (kill(owner, 0) == 0 || errno == EPERM)) {
+    return owner;
+  }
+  return 0;
+}
+
+}  // namespace
+
+ShmEventReceiver::ShmEventReceiver(
+  const std::string & name, const std::shared_ptr<Chart> & chart,
+  size_t capacity, size_t maxPayload)
+: name_(name), chart_(chart)
+{
+  uint64_t slots = 2;
+  while (slots < capacity) {
+    slots <<= 1;
+  }
+  auto slotSize = (sizeof(SlotHeader) + maxPayload + cacheLine - 1) / cacheLine * cacheLine;
+  size_ = sizeof(RingHeader) + slots * slotSize;
+  capacity_ = slots;
+  slotSize_ = slotSize;
+  maxPayload_ = maxPayload;
+
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    auto owner = liveOwner(name_);
+    if (owner) {
+      throw std::runtime_error(
+              "cannot create " + name_ + ": in use by the receiver of process " +
+              std::to_string(owner));
+    }
+    /* a leftover of a crashed receiver is replaced, senders reopen */
+    shm_unlink(name_.c_str());
+    fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    throw std::runtime_error("cannot create " + name_ + ": " + std::strerror(errno));
+  }
+  if (ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+    auto error = errno;
+    close(fd);
+    shm_unlink(name_.c_str());
+    throw std::runtime_error("cannot size " + name_ + ": " + std::strerror(error));
+  }
+  try {
+    memory_ = mapObject(fd, size_, name_);
+  } catch (...) {
+    close(fd);
+    shm_unlink(name_.c_str());
+    throw;
+  }
+  close(fd);
+
+  /* the object comes zero filled, construct the atomics in place */
+  auto h = new (memory_) RingHeader;
+  h->owner.store(getpid(), std::memory_order_release);
+  h->capacity = slots;
+  h->slotSize = slotSize;
+  h->maxPayload = maxPayload;
+  h->tail.store(0, std::memory_order_relaxed);
+  h->head.store(0, std::memory_order_relaxed);
+  h->dropped.store(0, std::memory_order_relaxed);
+  for (uint64_t i = 0; i < slots; ++i) {
+    auto s = new (slot(memory_, i, capacity_, slotSize_)) SlotHeader;
+    s->sequence.store(i, std::memory_order_relaxed);
+  }
+  /* senders refuse the ring until this is visible */
+  h->magic.store(ringMagic, std::memory_order_release);
+}
+
+ShmEventReceiver::~ShmEventReceiver()
+{
+  stop();
+  munmap(memory_, size_);
+  shm_unlink(name_.c_str());
+}
+
+void ShmEventReceiver::bind(uint32_t id, Event & event, PayloadHandlerT handler)
+{
+  bindings_.update(
+    [&](std::unordered_map<uint32_t, Binding> & bindings) {
+      bindings[id] = Binding{&event, std::move(handler)};
+    });
+}
+
+size_t ShmEventReceiver::poll()
+{
+  auto h = header(memory_);
+  auto chart = chart_.lock();
+  auto bindings = bindings_.read();
+  size_t taken = 0;
+  /* the only consumer, the head is ours */
+  auto pos = h->head.load(std::memory_order_relaxed);
+  while (true) {
+    auto s = slot(memory_, pos, capacity_, slotSize_);
+    if (s->sequence.load(std::memory_order_acquire) != pos + 1) {
+      break;
+    }
+    auto it = bindings->find(s->id);
+    /* written by another process, the handler must not read past the slot */
+    if (it == bindings->end() || !chart || s->size > maxPayload_) {
+      discarded_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      if (it->second.handler) {
+        it->second.handler(s + 1, s->size);
+      }
+      if (chart->post(*it->second.event)) {
+        received_.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        discarded_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    s->sequence.store(pos + capacity_, std::memory_order_release);
+    ++pos;
+    ++taken;
+    h->head.store(pos, std::memory_order_relaxed);
+  }
+  return taken;
+}
+
+void ShmEventReceiver::start()
+{
+  if (running_.exchange(true)) {
+    return;
+  }
+  thread_ = std::thread(
+    [this]() {
+      while (running_.load(std::memory_order_relaxed)) {
+        if (!poll()) {
+          std::this_thread::yield();
+        }
+      }
+    });
+}
+
+void ShmEventReceiver::stop()
+{
+  if (running_.exchange(false)) {
+    thread_.join();
+  }
+}
+
+uint64_t ShmEventReceiver::droppedCount() const
+{
+  return header(memory_)->dropped.load(std::memory_order_relaxed);
+}
+
+ShmEventSender::ShmEventSender(const std::string & name)
+{
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    throw std::runtime_error("cannot open " + name + ": " + std::strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(RingHeader)) {
+    close(fd);
+    throw std::runtime_error(name + " is not an event ring");
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  try {
+    memory_ = mapObject(fd, size_, name);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+  auto h = header(memory_);
+  if (h->magic.load(std::memory_order_acquire) != ringMagic) {
+    munmap(memory_, size_);
+    throw std::runtime_error(name + " is not an event ring, or not ready yet");
+  }
+  /* copied once, then slot() trusts the layout: it must fit the object */
+  capacity_ = h->capacity;
+  slotSize_ = h->slotSize;
+  maxPayload_ = h->maxPayload;
+  auto room = size_ - sizeof(RingHeader);
+  if (capacity_ == 0 || (capacity_ & (capacity_ - 1)) != 0 ||
+    slotSize_ % alignof(SlotHeader) != 0 || slotSize_ < sizeof(SlotHeader) ||
+    slotSize_ - sizeof(SlotHeader) < maxPayload_ || capacity_ > room / slotSize_)
+  {
+    munmap(memory_, size_);
+    throw std::runtime_error(name + " is not a valid event ring, its layout exceeds the object");
+  }
+}
+
+ShmEventSender::~ShmEventSender()
+{
+  munmap(memory_, size_);
+}
+
+bool ShmEventSender::send(uint32_t id, const void * payload, size_t size)
+{
+  auto h = header(memory_);
+  if (size > maxPayload_) {
+    throw std::runtime_error(
+            "payload of " + std::to_string(size) + " bytes, the ring takes " +
+            std::to_string(maxPayload_));
+  }
+  auto pos = h->tail.load(std::memory_order_relaxed);
+  while (true) {
+    auto s = slot(memory_, pos, capacity_, slotSize_);
+    auto seq = s->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+    if (diff == 0) {
+      if (h->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        s->id = id;
+        s->size = static_cast<uint32_t>(size);
+        if (size) {
+          std::memcpy(reinterpret_cast<char *>(s + 1), payload, size);
+        }
+        s->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      h->dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      pos = h->tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+size_t ShmEventSender::maxPayload() const
+{
+  return maxPayload_;
+}
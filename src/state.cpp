@@ -12,32 +12,100 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include "mogi_statechart/statechart.hpp"
 
 using mogi::statechart::Chart;
 using mogi::statechart::AbstractState;
+using mogi::statechart::State;
 
 void AbstractState::removeTransition(const std::shared_ptr<Transition> & transition)
 {
-  outgoingTransitions.erase(transition);
+  checkMutable();
+  outgoingTransitions.update(
+    [&transition](TransitionSetT & transitions) {transitions.erase(transition);});
 }
 
 void AbstractState::purgeExpiredTransitions()
 {
+  auto c = container.lock();
+  auto expired = [&c](const std::shared_ptr<Transition> & t) {
+      auto dst = t->getDst();
+      return dst == nullptr || !c->hasState(dst);
+    };
+  /* called on every step, only publish a new version if needed */
+  auto current = outgoingTransitions.read();
+  if (std::none_of(current->begin(), current->end(), expired)) {
+    return;
+  }
   /* erase_if is only available since C++20
    * thus we are doing a manual loop here
    */
-  for (auto it = outgoingTransitions.begin(), it_end = outgoingTransitions.end();
-    it != it_end; )
-  {
-    auto dst = (*it)->getDst();
-    if (dst == nullptr || !container.lock()->hasState(dst)) {
-      it = outgoingTransitions.erase(it);
-    } else {
-      ++it;
+  outgoingTransitions.update(
+    [&expired](TransitionSetT & transitions) {
+      for (auto it = transitions.begin(), it_end = transitions.end(); it != it_end; ) {
+        if (expired(*it)) {
+          it = transitions.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    });
+}
+
+void AbstractState::freeze(bool frozen)
+{
+  /* same order as the Rcu set, so the last eligible transition still wins */
+  frozenTransitions_.clear();
+  frozenTransient_ = false;
+  for (const auto & t : *outgoingTransitions.read()) {
+    t->freeze(frozen);
+    if (frozen) {
+      frozenTransitions_.push_back(t.get());
+      frozenTransient_ |= t->isUnconditional();
+    }
+  }
+  frozen_.store(frozen);
+}
+
+bool AbstractState::isTransient() const
+{
+  if (frozen_.load(std::memory_order_relaxed)) {
+    return frozenTransient_;
+  }
+  for (const auto & t : outgoingTransitions.readCached()) {
+    if (t->isUnconditional()) {
+      return true;
     }
   }
+  return false;
+}
+
+void AbstractState::checkMutable() const
+{
+  if (frozen_.load()) {
+    throw std::runtime_error("the chart is locked, unlock() it before changing " + name());
+  }
+}
+
+void AbstractState::beginActivation()
+{
+  /* a self-transition kept the activation open */
+  if (activation_.load(std::memory_order_relaxed) % 2 == 0) {
+    enteredActivation_ = activation_.fetch_add(1) + 1;
+  }
+}
+
+void AbstractState::endActivation(bool reentering)
+{
+  auto activation = activation_.load(std::memory_order_relaxed);
+  if (activation % 2 == 0) {
+    return;
+  }
+  activation_.store(activation + (reentering ? 2 : 1));
 }
 
 bool AbstractState::isActive() const
@@ -67,19 +135,77 @@ bool AbstractState::isActive() const
 
 bool AbstractState::removeEventCallback(Event & event)
 {
-  event.removeObserver(sharedPtr<EventObserver>());
-  return eventCallbacks.erase(&event) > 0;
+  bool erased = false;
+  eventCallbacks.update(
+    [&](EventCallbackMapT & callbacks) {
+      erased = callbacks.erase(&event) > 0;
+    });
+  /* still observing the event if it is deferred */
+  if (!defersEvent(event)) {
+    event.removeObserver(sharedPtr<EventObserver>());
+  }
+  return erased;
+}
+
+bool AbstractState::deferEvent(Event & event)
+{
+  event.addObserver(sharedPtr<EventObserver>());
+  bool inserted = false;
+  deferredEvents.update(
+    [&](std::unordered_set<const Event *> & events) {
+      inserted = events.insert(&event).second;
+    });
+  return inserted;
+}
+
+bool AbstractState::removeDeferredEvent(Event & event)
+{
+  bool erased = false;
+  deferredEvents.update(
+    [&](std::unordered_set<const Event *> & events) {
+      erased = events.erase(&event) > 0;
+    });
+  if (eventCallbacks.read()->count(&event) == 0) {
+    event.removeObserver(sharedPtr<EventObserver>());
+  }
+  return erased;
+}
+
+bool AbstractState::hasTransitionOn(const Event & event) const
+{
+  auto transitions = outgoingTransitions.read();
+  for (const auto & t : *transitions) {
+    if (t->events_.read()->count(&event)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void AbstractState::notify(const Event & event)
 {
   if (isActive()) {
-    auto callbackIt = eventCallbacks.find(&event);
-    if (callbackIt != eventCallbacks.end()) {
+    auto callbacks = eventCallbacks.read();
+    auto callbackIt = callbacks->find(&event);
+    if (callbackIt != callbacks->end()) {
       callbackIt->second.invoke(event);
     }
+    /* an event consumed by a transition is never deferred */
+    if (defersEvent(event) && !hasTransitionOn(event)) {
+      auto c = container.lock();
+      if (c) {
+        c->pushDeferred(event);
+      }
+    }
   }
 }
+
+uint32_t AbstractState::nextId()
+{
+  static std::atomic<uint32_t> last{0};
+  return last.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
 std::shared_ptr<Chart> AbstractState::outmostContainer()
 {
   auto mainChart = container.lock();
@@ -91,3 +217,34 @@ std::shared_ptr<Chart> AbstractState::outmostContainer()
   }
   return mainChart;
 }
+
+void State::actionEntry()
+{
+  if (setCallbacks_.load(std::memory_order_acquire) & EntryBit) {
+    entry_callback_.invokeCached();
+  }
+  activity_done_ = false;
+  const auto & factory = activity_factory_.readCached();
+  if (factory) {
+    activity_ = factory();
+  }
+}
+
+void State::actionDo()
+{
+  if (setCallbacks_.load(std::memory_order_acquire) & DoBit) {
+    do_callback_.invokeCached();
+  }
+  if (activity_ && !activity_done_) {
+    activity_done_ = activity_->resume();
+  }
+}
+
+void State::actionExit()
+{
+  /* the do-activity is aborted before the exit action, as in UML */
+  activity_.reset();
+  if (setCallbacks_.load(std::memory_order_acquire) & ExitBit) {
+    exit_callback_.invokeCached();
+  }
+}
@@ -0,0 +1,284 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#include "mogi_statechart/trace.hpp"
+
+using mogi::statechart::Tracer;
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Writer;
+
+/* the file and the threads writing to it. Locked before a Writer's mutex */
+struct Session
+{
+  std::mutex mutex;
+  std::ofstream file;
+  std::vector<Writer *> writers;
+  /* bumped by every start(), a thread's buffer from an older one is stale */
+  std::atomic<uint64_t> generation{0};
+  std::atomic<int64_t> originNs{0};
+  uint32_t threads{0};
+  long pid{1};
+};
+
+/* never destroyed, threads may exit after static destructors ran */
+Session & session()
+{
+  static Session * s = new Session;
+  return *s;
+}
+
+void appendEscaped(std::string & out, const std::string & text)
+{
+  for (auto c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+}
+
+/* a thread's buffered events, written to the file when full, when the
+ * thread exits and on stop()
+ */
+struct Writer
+{
+  std::mutex mutex;
+  std::string buffer;
+  uint64_t generation{0};
+  uint32_t tid;
+  std::string name;
+
+  Writer()
+  {
+    auto & s = session();
+    std::lock_guard<std::mutex> lock{s.mutex};
+    tid = ++s.threads;
+    name = "thread " + std::to_string(tid);
+    s.writers.push_back(this);
+  }
+
+  ~Writer()
+  {
+    auto & s = session();
+    std::lock_guard<std::mutex> lock{s.mutex};
+    s.writers.erase(std::remove(s.writers.begin(), s.writers.end(), this), s.writers.end());
+    std::lock_guard<std::mutex> bufferLock{mutex};
+    if (s.file.is_open() && generation == s.generation.load()) {
+      s.file << buffer;
+    }
+  }
+
+  /* locked, tracing started */
+  void beginSession(uint64_t current)
+  {
+    if (generation != current) {
+      buffer.clear();
+      generation = current;
+      appendThreadName();
+    }
+  }
+
+  void appendThreadName()
+  {
+    buffer += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" +
+      std::to_string(session().pid) + ",\"tid\":" + std::to_string(tid) +
+      ",\"args\":{\"name\":\"";
+    appendEscaped(buffer, name);
+    buffer += "\"}},\n";
+  }
+};
+
+Writer & localWriter()
+{
+  thread_local Writer writer;
+  return writer;
+}
+
+void record(
+  const char * category, const std::string & name, Clock::time_point start,
+  Clock::time_point end)
+{
+  auto & s = session();
+  auto & w = localWriter();
+  std::string full;
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock{w.mutex};
+    if (!Tracer::isEnabled()) {
+      return;
+    }
+    generation = s.generation.load(std::memory_order_acquire);
+    auto startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      start.time_since_epoch()).count() - s.originNs.load(std::memory_order_relaxed);
+    /* opened before this session started */
+    if (startNs < 0) {
+      return;
+    }
+    w.beginSession(generation);
+    auto durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    char times[96];
+    std::snprintf(
+      times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%u},\n",
+      startNs / 1e3, durationNs / 1e3, s.pid, w.tid);
+    w.buffer += "{\"name\":\"";
+    appendEscaped(w.buffer, name);
+    w.buffer += "\",\"cat\":\"";
+    w.buffer += category;
+    w.buffer += "\",\"ph\":\"X\",";
+    w.buffer += times;
+    if (w.buffer.size() >= Tracer::bufferSize) {
+      full.swap(w.buffer);
+    }
+  }
+  /* outside the thread's lock, stop() takes the session's lock first */
+  if (!full.empty()) {
+    std::lock_guard<std::mutex> lock{s.mutex};
+    if (s.file.is_open() && s.generation.load() == generation) {
+      s.file << full;
+    }
+  }
+}
+
+}  // namespace
+
+std::atomic<bool> Tracer::enabled_{false};
+
+Tracer::Slice::Slice(const char * category, const char * name)
+: category_(category)
+{
+  if (Tracer::isEnabled()) {
+    name_ = name;
+    start_ = Clock::now();
+  }
+}
+
+Tracer::Slice::Slice(const char * category, const std::string & name)
+: category_(category)
+{
+  if (Tracer::isEnabled()) {
+    name_ = name;
+    start_ = Clock::now();
+  }
+}
+
+Tracer::Slice::Slice(
+  const char * category, const char * prefix, const std::string & name,
+  const std::string * to)
+: category_(category)
+{
+  if (Tracer::isEnabled()) {
+    name_ = prefix + name;
+    if (to) {
+      name_ += " -> " + *to;
+    }
+    start_ = Clock::now();
+  }
+}
+
+Tracer::Slice::~Slice()
+{
+  if (start_ != Clock::time_point{}) {
+    record(category_, name_, start_, Clock::now());
+  }
+}
+
+void Tracer::start(const std::string & path)
+{
+  auto & s = session();
+  std::lock_guard<std::mutex> lock{s.mutex};
+  if (s.file.is_open()) {
+    throw std::runtime_error("tracing is already started");
+  }
+  s.file.open(path, std::ios::out | std::ios::trunc);
+  if (!s.file) {
+    s.file.close();
+    throw std::runtime_error("cannot create trace file " + path);
+  }
+#if defined(__unix__) || defined(__APPLE__)
+  s.pid = static_cast<long>(getpid());
+#endif
+  s.file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+  s.originNs.store(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+  s.generation.fetch_add(1, std::memory_order_release);
+  enabled_.store(true, std::memory_order_release);
+}
+
+void Tracer::stop()
+{
+  auto & s = session();
+  std::lock_guard<std::mutex> lock{s.mutex};
+  if (!s.file.is_open()) {
+    return;
+  }
+  /* from here on the threads record nothing, see record() */
+  enabled_.store(false);
+  auto generation = s.generation.load();
+  for (auto w : s.writers) {
+    std::lock_guard<std::mutex> bufferLock{w->mutex};
+    if (w->generation == generation) {
+      s.file << w->buffer;
+    }
+    w->buffer.clear();
+  }
+  /* the last event has no trailing comma */
+  s.file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << s.pid <<
+    ",\"tid\":0,\"args\":{\"name\":\"mogi_statechart\"}}\n]}\n";
+  s.file.close();
+}
+
+bool Tracer::isCompiledIn()
+{
+#if defined(MOGI_STATECHART_TRACING)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Tracer::setThreadName(const std::string & name)
+{
+  auto & w = localWriter();
+  std::lock_guard<std::mutex> lock{w.mutex};
+  w.name = name;
+  /* the last name of a thread wins */
+  if (isEnabled() && w.generation == session().generation.load()) {
+    w.appendThreadName();
+  }
+}
@@ -14,91 +14,154 @@
 
 #include <algorithm>
 #include <memory>
+#include <stdexcept>
+#include <vector>
 #include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/trace.hpp"
 
 using mogi::statechart::Transition;
 
+namespace
+{
+
+/* every guard is evaluated, they may count calls */
+bool allSatisfied(const std::vector<std::shared_ptr<mogi::statechart::Guard>> & guards)
+{
+  bool satisfied = true;
+  for (auto & g : guards) {
+    /* only called from the thread stepping the chart */
+    MOGI_STATECHART_TRACE_SLICE("guard", "guard");
+    satisfied &= g->invokeCached();
+  }
+  return satisfied;
+}
+
+}  // namespace
+
 bool Transition::addEvent(Event & event)
 {
+  checkMutable();
+  if (completion_) {
+    throw std::runtime_error("completion transitions take no event, got " + event.name());
+  }
   event.addObserver(sharedPtr<EventObserver>());
-  return events_.insert(&event).second;
+  bool inserted = false;
+  events_.update(
+    [&](std::unordered_set<const Event *> & events) {
+      inserted = events.insert(&event).second;
+    });
+  return inserted;
 }
 
 bool Transition::removeEvent(Event & event)
 {
+  checkMutable();
   event.removeObserver(sharedPtr<EventObserver>());
-  return events_.erase(&event) > 0;
+  bool erased = false;
+  events_.update(
+    [&](std::unordered_set<const Event *> & events) {
+      erased = events.erase(&event) > 0;
+    });
+  return erased;
 }
 
 bool Transition::shouldPerform()
 {
+  /* a locked chart: no Rcu read, no weak_ptr to lock */
+  if (frozen_.load(std::memory_order_relaxed)) {
+    if (completion_) {
+      return frozenSrc_->isCompleted() && allSatisfied(*frozenGuards_);
+    }
+    if (!frozenHasEvents_) {
+      return allSatisfied(*frozenGuards_);
+    }
+    return consumeTrigger(*frozenSrc_) && allSatisfied(*frozenGuards_);
+  }
+  auto srcState = src.lock();
+  if (completion_) {
+    return srcState && srcState->isCompleted() && guardsSatisfied();
+  }
   /* no event, check guardsSatisfied */
-  if (events_.size() <= 0) {
+  if (events_.readCached().empty()) {
     return guardsSatisfied();
   }
   /* else, if event not triggered, return false, otherwise
    * check guardsSatisfied()
    */
-  auto wasTriggered = eventTriggered_.exchange(false);
+  auto wasTriggered = srcState && consumeTrigger(*srcState);
   return wasTriggered ? guardsSatisfied() : false;
 }
 
-bool Transition::guardsSatisfied() const
+bool Transition::isUnconditional() const
 {
-  bool shouldPerform = true;
-
-  for (auto & g : guards) {
-    shouldPerform &= g->isSatisfied();
+  if (completion_) {
+    return false;
+  }
+  if (frozen_.load(std::memory_order_relaxed)) {
+    return !frozenHasEvents_ && frozenGuards_->empty();
   }
+  return events_.readCached().empty() && guards.readCached().empty();
+}
 
-  return shouldPerform;
+bool Transition::guardsSatisfied() const
+{
+  return allSatisfied(guards.readCached());
 }
 
 void Transition::removeGuard(const std::shared_ptr<Guard> & g)
 {
-  guards.erase(
-    std::remove(guards.begin(), guards.end(), g),
-    guards.end());
+  checkMutable();
+  guards.update(
+    [&g](std::vector<std::shared_ptr<Guard>> & list) {
+      list.erase(std::remove(list.begin(), list.end(), g), list.end());
+    });
 }
 
 void Transition::notify(const Event & event)
 {
   (void)event;
-  /* return immediately if src state is not active */
   auto srcState = src.lock();
-  if (!srcState || !srcState->isActive()) {
+  if (!srcState) {
+    return;
+  }
+  /* return immediately if src state is not active, nor being entered */
+  auto activation = srcState->activation_.load();
+  if (activation % 2 == 0) {
     return;
   }
 
-  /* if the outmost chart is running (async), stop it to make sure
-   * we are locked down in a state that's not changing
-   * This is neccessary to avoid a rare case where the state may
-   * become `!isActive()` right after we set the trigger flag to
-   * true, i.e. some other transition is granted at the same time,
-   * thus we miss the opportunity to check the trigger flag in the
-   * chart's process() function because we moved to another state
-   * already.
-   *
-   * Event trigger on transition should be infrequent thus the overhead
-   * should not be significant
+  /* signal that we have received an event, for this activation of src.
+   * The chart may leave src right after the check above, i.e. some other
+   * transition is granted at the same time, and even enter it again later:
+   * the latch is then ignored rather than taken on the next entry of src.
+   * Self-transitions of src don't end the activation as far as latches go
    */
-  auto mainChart = container.lock()->outmostContainer();
-  bool needToPause = mainChart->isRunning() &&
-    std::this_thread::get_id() != mainChart->process_thread_.get_id();
-  if (needToPause) {
-    mainChart->stop();
-    /* check again make sure the src state is active */
-    srcState = src.lock();
-    if (!srcState || !srcState->isActive()) {
-      mainChart->spinAsync();
-      return;
-    }
+  eventTriggered_.store(activation);
+}
+
+bool Transition::consumeTrigger(const AbstractState & srcState)
+{
+  auto latched = eventTriggered_.exchange(0);
+  /* activations only grow, a latch is never ahead of the current one */
+  return latched != 0 && latched >= srcState.enteredActivation_;
+}
+
+void Transition::freeze(bool frozen)
+{
+  if (frozen) {
+    frozenGuards_ = guards.read();
+    frozenHasEvents_ = !events_.read()->empty();
+    frozenSrc_ = src.lock().get();
+    frozenDst_ = dst.lock().get();
+  } else {
+    frozenGuards_.reset();
   }
-  /* signal that we have received an event */
-  eventTriggered_.store(true);
+  frozen_.store(frozen);
+}
 
-  /* resume if chart was running before */
-  if (needToPause) {
-    mainChart->spinAsync();
+void Transition::checkMutable() const
+{
+  if (frozen_.load()) {
+    throw std::runtime_error("the chart is locked, unlock() it before changing its transitions");
   }
 }
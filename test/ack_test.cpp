@@ -0,0 +1,206 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventAck;
+using mogi::statechart::EventOutcome;
+using mogi::statechart::OverflowPolicy;
+
+namespace
+{
+
+bool ready(const std::future<EventAck> & f)
+{
+  return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+}  // namespace
+
+TEST(AckTest, outcomes)
+{
+  /* idle --go--> running --back [open]--> idle, running defers later */
+  auto chart = Chart::createChart("chart");
+  auto idle = chart->createState("idle");
+  auto running = chart->createState("running");
+  Event go{"go"};
+  Event stray{"stray"};
+  Event later{"later"};
+  Event back{"back"};
+  bool open = false;
+  chart->getInitialState()->createTransition(idle);
+  idle->createTransition(running)->addEvent(go);
+  running->deferEvent(later);
+  auto toIdle = running->createTransition(idle);
+  toIdle->addEvent(back);
+  toIdle->createGuard([&open]() {return open;});
+  chart->spinOnce();
+  chart->spinOnce();
+
+  auto consumed = chart->postAcknowledged(go);
+  EXPECT_FALSE(ready(consumed));
+  chart->spinOnce();
+  ASSERT_TRUE(ready(consumed));
+  auto ack = consumed.get();
+  EXPECT_EQ(ack.outcome, EventOutcome::Consumed);
+  EXPECT_EQ(ack.state, running->id());
+
+  auto ignored = chart->postAcknowledged(stray);
+  chart->spinOnce();
+  ASSERT_TRUE(ready(ignored));
+  ack = ignored.get();
+  EXPECT_EQ(ack.outcome, EventOutcome::Ignored);
+  EXPECT_EQ(ack.state, running->id());
+
+  /* the guard holds the transition back */
+  auto held = chart->postAcknowledged(back);
+  chart->spinOnce();
+  ASSERT_TRUE(ready(held));
+  EXPECT_EQ(held.get().outcome, EventOutcome::Ignored);
+
+  auto deferred = chart->postAcknowledged(later);
+  chart->spinOnce();
+  ASSERT_TRUE(ready(deferred));
+  EXPECT_EQ(deferred.get().outcome, EventOutcome::Deferred);
+
+  open = true;
+  auto taken = chart->postAcknowledged(back);
+  chart->spinOnce();
+  ASSERT_TRUE(ready(taken));
+  ack = taken.get();
+  EXPECT_EQ(ack.outcome, EventOutcome::Consumed);
+  EXPECT_EQ(ack.state, idle->id());
+}
+
+TEST(AckTest, consumedBySubchart)
+{
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto inner = sub->createState("inner");
+  Event go{"go"};
+  sub->getInitialState()->createTransition(inner)->addEvent(go);
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+  big->spinOnce();
+  big->spinOnce();
+  big->spinOnce();
+
+  std::vector<EventAck> acks;
+  /* posting to a subchart posts to its outmost chart */
+  ASSERT_TRUE(sub->post(go, [&acks](const EventAck & ack) {acks.push_back(ack);}));
+  big->spinOnce();
+  ASSERT_EQ(acks.size(), 1u);
+  EXPECT_EQ(acks[0].outcome, EventOutcome::Consumed);
+  EXPECT_EQ(acks[0].state, inner->id());
+  EXPECT_EQ(acks[0].configuration.depth, 2u);
+}
+
+TEST(AckTest, chartSteppedFromAnotherChart)
+{
+  /* first: idle --go / second->spinOnce()--> done, second ignores stray */
+  auto first = Chart::createChart("first");
+  auto second = Chart::createChart("second");
+  auto idle = first->createState("idle");
+  auto done = first->createState("done");
+  auto waiting = second->createState("waiting");
+  Event go{"go"};
+  Event stray{"stray"};
+  first->getInitialState()->createTransition(idle);
+  idle->createTransition(done, [&second]() {second->spinOnce();})->addEvent(go);
+  second->getInitialState()->createTransition(waiting);
+  first->runToQuiescence();
+  second->runToQuiescence();
+
+  /* both acknowledgements are pending on this thread at once */
+  auto ignored = second->postAcknowledged(stray);
+  auto consumed = first->postAcknowledged(go);
+  first->spinOnce();
+  ASSERT_TRUE(ready(ignored));
+  EXPECT_EQ(ignored.get().outcome, EventOutcome::Ignored);
+  ASSERT_TRUE(ready(consumed));
+  EXPECT_EQ(consumed.get().outcome, EventOutcome::Consumed);
+  EXPECT_EQ(first->getCurrentStateName(), "done");
+}
+
+TEST(AckTest, dropped)
+{
+  auto chart = Chart::createChart("chart");
+  Event e{"e"};
+  chart->getInitialState()->createTransition(chart->getFinalState())->addEvent(e);
+  chart->setEventQueueCapacity(1);
+
+  auto first = chart->postAcknowledged(e);
+  auto rejected = chart->postAcknowledged(e);
+  ASSERT_TRUE(ready(rejected));
+  EXPECT_EQ(rejected.get().outcome, EventOutcome::Dropped);
+  EXPECT_FALSE(chart->post(e, [](const EventAck &) {FAIL();}));
+
+  chart->setEventQueuePolicy(OverflowPolicy::DropOldest);
+  auto latest = chart->postAcknowledged(e);
+  ASSERT_TRUE(ready(first));
+  EXPECT_EQ(first.get().outcome, EventOutcome::Dropped);
+
+  /* acknowledged by the chart's destructor */
+  chart.reset();
+  ASSERT_TRUE(ready(latest));
+  EXPECT_EQ(latest.get().outcome, EventOutcome::Dropped);
+}
+
+TEST(AckTest, droppedByShrinking)
+{
+  auto chart = Chart::createChart("chart");
+  Event e{"e"};
+  chart->getInitialState()->createTransition(chart->getFinalState())->addEvent(e);
+  chart->setEventQueueCapacity(4);
+  auto oldest = chart->postAcknowledged(e);
+  auto newest = chart->postAcknowledged(e);
+
+  /* the oldest is kept, the newest is acknowledged right away */
+  chart->setEventQueueCapacity(1);
+  EXPECT_FALSE(ready(oldest));
+  ASSERT_TRUE(ready(newest));
+  EXPECT_EQ(newest.get().outcome, EventOutcome::Dropped);
+  EXPECT_EQ(chart->eventQueueStats().dropped, 1u);
+  EXPECT_EQ(chart->queuedEventCount(), 1u);
+}
+
+TEST(AckTest, runningChartRoundTrip)
+{
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event flip{"flip"};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(flip);
+  b->createTransition(a)->addEvent(flip);
+  chart->spinAsync();
+  ASSERT_TRUE(chart->waitForState(*a, std::chrono::seconds(5)));
+
+  for (int i = 0; i < 20; ++i) {
+    auto ack = chart->postAcknowledged(flip);
+    ASSERT_EQ(ack.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    auto result = ack.get();
+    EXPECT_EQ(result.outcome, EventOutcome::Consumed);
+    EXPECT_EQ(result.state, (i % 2 ? a : b)->id());
+  }
+  chart->stop();
+}
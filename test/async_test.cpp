@@ -0,0 +1,183 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/executor.hpp"
+
+using mogi::statechart::AbstractState;
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::InlineExecutor;
+using mogi::statechart::State;
+using mogi::statechart::ThreadPoolExecutor;
+using mogi::statechart::asyncAction;
+
+class AsyncActionTest : public ::testing::Test
+{
+protected:
+  AsyncActionTest()
+  {
+    /* initial ---> calibrating ---[calibrated]---> ready
+     *                   \-------[failed]---------> error
+     */
+    chart = Chart::createChart("chart");
+    calibrating = chart->createState("calibrating");
+    ready = chart->createState("ready");
+    error = chart->createState("error");
+    chart->getInitialState()->createTransition(calibrating);
+    calibrating->createTransition(ready)->addEvent(calibrated);
+    calibrating->createTransition(error)->addEvent(failed);
+  }
+
+  /* spins until the chart reaches state, or gives up after a while */
+  bool spinUntil(const std::string & state)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (chart->getCurrentStateName() != state) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        return false;
+      }
+      chart->spinOnce();
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  Event calibrated{"calibrated"}, failed{"failed"}, ping{"ping"};
+  std::shared_ptr<Chart> chart;
+  std::shared_ptr<State> calibrating, ready, error;
+};
+
+TEST_F(AsyncActionTest, chartKeepsRunning)
+{
+  auto pool = std::make_shared<ThreadPoolExecutor>(1);
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::thread::id worker;
+  calibrating->setCallbackEntry(
+    asyncAction(
+      pool, chart, calibrated, [&worker, released]() {
+        worker = std::this_thread::get_id();
+        released.wait();
+      }));
+  int steps = 0, pings = 0;
+  calibrating->setCallbackDo([&steps]() {steps++;});
+  calibrating->createEventCallback(ping, [&pings](const Event &) {pings++;});
+
+  chart->spinToState("calibrating");
+  for (int i = 0; i < 5; ++i) {
+    chart->post(ping);
+    chart->spinOnce();
+  }
+  /* the chart went on stepping and taking events while the action runs */
+  EXPECT_EQ(chart->getCurrentStateName(), "calibrating");
+  EXPECT_GE(steps, 5);
+  EXPECT_EQ(pings, 5);
+  EXPECT_EQ(pool->pendingCount(), 1u);
+
+  release.set_value();
+  EXPECT_TRUE(spinUntil("ready"));
+  EXPECT_NE(worker, std::this_thread::get_id());
+}
+
+TEST_F(AsyncActionTest, failure)
+{
+  auto executor = std::make_shared<InlineExecutor>();
+  calibrating->setCallbackEntry(
+    asyncAction(
+      executor, chart, calibrated, []() {throw std::runtime_error("no sensor");}, &failed));
+  EXPECT_TRUE(spinUntil("error"));
+
+  /* without a failure event the completion is posted anyway */
+  chart->reset();
+  calibrating->setCallbackEntry(
+    asyncAction(executor, chart, calibrated, []() {throw std::runtime_error("no sensor");}));
+  EXPECT_TRUE(spinUntil("ready"));
+}
+
+TEST_F(AsyncActionTest, transitionAction)
+{
+  auto pool = std::make_shared<ThreadPoolExecutor>(2);
+  std::atomic<int> saved{0};
+  auto saving = chart->createState("saving");
+  ready->createTransition(
+    saving, asyncAction(pool, chart, calibrated, [&saved]() {saved++;}))->addEvent(ping);
+  saving->createTransition(calibrating)->addEvent(calibrated);
+  calibrating->setCallbackEntry(
+    asyncAction(pool, chart, calibrated, []() {}));
+
+  EXPECT_TRUE(spinUntil("ready"));
+  chart->post(ping);
+  /* saving ---[calibrated]---> calibrating ---[calibrated]---> ready */
+  EXPECT_TRUE(spinUntil("saving"));
+  EXPECT_TRUE(spinUntil("ready"));
+  EXPECT_EQ(saved.load(), 1);
+}
+
+TEST_F(AsyncActionTest, completionOfAnEarlierVisit)
+{
+  auto pool = std::make_shared<ThreadPoolExecutor>(2);
+  std::promise<void> releaseFirst, releaseSecond;
+  std::vector<std::shared_future<void>> releases{
+    releaseFirst.get_future().share(), releaseSecond.get_future().share()};
+  std::atomic<int> runs{0};
+  calibrating->setCallbackEntry(
+    asyncAction(
+      pool, chart, calibrating, calibrated, [&runs, releases]() {
+        releases[runs++].wait();
+      }));
+  calibrating->createTransition(calibrating)->addEvent(ping);
+
+  chart->spinToState("calibrating");
+  /* a new visit, while the work of the first one still runs */
+  chart->post(ping);
+  chart->spinOnce();
+  while (runs.load() < 2) {
+    std::this_thread::yield();
+  }
+
+  releaseFirst.set_value();
+  while (pool->pendingCount() > 1) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < 5; ++i) {
+    chart->spinOnce();
+  }
+  EXPECT_EQ(chart->getCurrentStateName(), "calibrating");
+
+  releaseSecond.set_value();
+  EXPECT_TRUE(spinUntil("ready"));
+}
+
+TEST(ThreadPoolExecutorTest, drainsOnDestruction)
+{
+  std::atomic<int> count{0};
+  {
+    ThreadPoolExecutor pool{3};
+    for (int i = 0; i < 100; ++i) {
+      pool.execute([&count]() {count++;});
+    }
+  }
+  EXPECT_EQ(count.load(), 100);
+  EXPECT_THROW(ThreadPoolExecutor{0}, std::runtime_error);
+}
@@ -0,0 +1,136 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/event_bus.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventBus;
+
+TEST(EventBusTest, routesToListenersOnly)
+{
+  /* a: initial ---> s1 --(go)--> final, b: initial ---> s1 --(other)--> final */
+  Event go{"go"}, other{"other"}, seen{"seen"};
+  auto a = Chart::createChart("a");
+  auto a1 = a->createState("s1");
+  a->getInitialState()->createTransition(a1);
+  a1->createTransition(a->getFinalState())->addEvent(go);
+  int seenCount = 0;
+  a1->createEventCallback(seen, [&seenCount](const Event &) {seenCount++;});
+
+  auto b = Chart::createChart("b");
+  auto b1 = b->createState("s1");
+  b->getInitialState()->createTransition(b1);
+  b1->createTransition(b->getFinalState())->addEvent(other);
+
+  EventBus bus{2};
+  EXPECT_EQ(bus.attach(a), 2u);
+  EXPECT_EQ(bus.attach(b), 1u);
+  EXPECT_EQ(bus.subscriberCount(bus.topic("go")), 1u);
+  EXPECT_EQ(bus.subscriberCount(bus.topic("nobody")), 0u);
+
+  a->spinToState("s1");
+  b->spinToState("s1");
+  EXPECT_TRUE(bus.publish(bus.topic("seen")));
+  EXPECT_TRUE(bus.publish(bus.topic("go")));
+  EXPECT_TRUE(bus.publish(bus.topic("nobody")));
+  a->spinOnce();
+  EXPECT_EQ(seenCount, 1);
+  a->spinOnce();
+  b->spinOnce();
+  EXPECT_TRUE(a->getFinalState()->isActive());
+  EXPECT_TRUE(b1->isActive());
+
+  bus.detach(b);
+  EXPECT_EQ(bus.subscriberCount(bus.topic("other")), 0u);
+  bus.publish(bus.topic("other"));
+  b->spinOnce();
+  EXPECT_TRUE(b1->isActive());
+}
+
+TEST(EventBusTest, subchartAndOverflow)
+{
+  Event tick{"tick"};
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto inner = sub->createState("inner");
+  sub->getInitialState()->createTransition(inner);
+  int ticks = 0;
+  inner->createEventCallback(tick, [&ticks](const Event &) {ticks++;});
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+
+  EventBus bus{1, 4};
+  EXPECT_EQ(bus.attach(big), 1u);
+  big->spinToState("sub");
+  big->spinOnce();
+  big->spinOnce();
+  ASSERT_EQ(big->getCurrentStateNameFull(), "sub:inner");
+
+  auto topic = bus.topic("tick");
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(bus.publish(topic));
+  }
+  EXPECT_FALSE(bus.publish(topic));
+  EXPECT_EQ(bus.droppedCount(), 1u);
+  for (int i = 0; i < 6; ++i) {
+    big->spinOnce();
+  }
+  EXPECT_EQ(ticks, 4);
+}
+
+TEST(EventBusTest, concurrentProducers)
+{
+  Event ping{"ping"};
+  std::atomic<int> received{0};
+  std::vector<std::shared_ptr<Chart>> charts;
+  EventBus bus{4, 1 << 14};
+  for (int c = 0; c < 4; ++c) {
+    auto chart = Chart::createChart("chart");
+    auto s = chart->createState("s");
+    chart->getInitialState()->createTransition(s);
+    s->createEventCallback(ping, [&received](const Event &) {received++;});
+    bus.attach(chart);
+    chart->spinToState("s");
+    charts.push_back(chart);
+  }
+
+  const int perThread = 1000;
+  std::vector<std::thread> producers;
+  auto topic = bus.topic("ping");
+  for (int p = 0; p < 4; ++p) {
+    producers.emplace_back(
+      [&bus, topic]() {
+        for (int i = 0; i < perThread; ++i) {
+          bus.publish(topic);
+        }
+      });
+  }
+  for (auto & t : producers) {
+    t.join();
+  }
+  for (int i = 0; i < 4 * perThread; ++i) {
+    for (const auto & chart : charts) {
+      chart->spinOnce();
+    }
+  }
+  EXPECT_EQ(bus.droppedCount(), 0u);
+  EXPECT_EQ(received.load(), 4 * 4 * perThread);
+}
@@ -0,0 +1,148 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/channel.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::MpmcQueue;
+using mogi::statechart::OverflowPolicy;
+using mogi::statechart::State;
+using mogi::statechart::StateChangeChannel;
+using mogi::statechart::StateChangeRecord;
+
+class ChannelTest : public ::testing::Test
+{
+protected:
+  ChannelTest()
+  {
+    /* initial ---> a <---> b, moving on every step */
+    chart = Chart::createChart("chart");
+    a = chart->createState("a");
+    b = chart->createState("b");
+    chart->getInitialState()->createTransition(a);
+    a->createTransition(b);
+    b->createTransition(a);
+  }
+
+  std::vector<std::string> drain(StateChangeChannel & channel)
+  {
+    std::vector<std::string> names;
+    StateChangeRecord record;
+    while (channel.tryReceive(record)) {
+      EXPECT_EQ(record.chart, chart->id());
+      names.push_back(chart->stateName(record.state));
+    }
+    return names;
+  }
+
+  std::shared_ptr<Chart> chart;
+  std::shared_ptr<State> a, b;
+};
+
+TEST_F(ChannelTest, overflowPolicies)
+{
+  auto counting = chart->createStateChangeChannel(4, OverflowPolicy::CountDrops);
+  auto latest = chart->createStateChangeChannel(4, OverflowPolicy::DropOldest);
+  EXPECT_EQ(counting->policy(), OverflowPolicy::CountDrops);
+  /* initial, a, b, a, b, a */
+  for (int i = 0; i < 6; ++i) {
+    chart->spinOnce();
+  }
+  EXPECT_EQ(counting->size(), 4u);
+  EXPECT_EQ(counting->droppedCount(), 2u);
+  EXPECT_EQ(drain(*counting), std::vector<std::string>({"initial", "a", "b", "a"}));
+  EXPECT_EQ(latest->droppedCount(), 2u);
+  EXPECT_EQ(drain(*latest), std::vector<std::string>({"b", "a", "b", "a"}));
+}
+
+TEST_F(ChannelTest, blockWaitsForSubscriber)
+{
+  auto channel = chart->createStateChangeChannel(2, OverflowPolicy::Block);
+  std::vector<uint64_t> steps;
+  std::thread subscriber{[&]() {
+      StateChangeRecord record;
+      while (steps.size() < 50 && channel->receive(record, std::chrono::seconds(5))) {
+        steps.push_back(record.step);
+      }
+    }};
+  for (int i = 0; i < 50; ++i) {
+    chart->spinOnce();
+  }
+  subscriber.join();
+  ASSERT_EQ(steps.size(), 50u);
+  EXPECT_EQ(channel->droppedCount(), 0u);
+  for (size_t i = 1; i < steps.size(); ++i) {
+    EXPECT_EQ(steps[i], steps[i - 1] + 1);
+  }
+}
+
+TEST_F(ChannelTest, unsubscribe)
+{
+  auto channel = chart->createStateChangeChannel();
+  chart->spinOnce();
+  EXPECT_EQ(channel->size(), 1u);
+  std::weak_ptr<StateChangeChannel> weak = channel;
+  channel.reset();
+  chart->spinOnce();
+  EXPECT_TRUE(weak.expired());
+}
+
+TEST(MpmcQueueTest, manyProducersManyConsumers)
+{
+  MpmcQueue<int> queue{100};
+  EXPECT_EQ(queue.capacity(), 128u);
+  const int perProducer = 10000;
+  std::atomic<long> sum{0};
+  std::atomic<int> received{0};
+  std::vector<std::thread> threads;
+  for (int p = 0; p < 2; ++p) {
+    threads.emplace_back(
+      [&queue]() {
+        for (int i = 1; i <= perProducer; ++i) {
+          while (!queue.push(i)) {
+            std::this_thread::yield();
+          }
+        }
+      });
+  }
+  for (int c = 0; c < 2; ++c) {
+    threads.emplace_back(
+      [&]() {
+        int item;
+        while (received.load() < 2 * perProducer) {
+          if (queue.pop(item)) {
+            sum += item;
+            received++;
+          } else {
+            std::this_thread::yield();
+          }
+        }
+      });
+  }
+  for (auto & t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(sum.load(), 2L * perProducer * (perProducer + 1) / 2);
+  int item;
+  EXPECT_FALSE(queue.pop(item));
+}
@@ -0,0 +1,178 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/scxml.hpp"
+#include "door_machine.hpp"
+#include "toggle_machine.hpp"
+
+using mogi::statechart::Event;
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::ScxmlRegistry;
+
+namespace
+{
+
+struct DoorHooks
+{
+  void enterClosed() {counts[0]++;}
+  void leaveResting() {counts[1]++;}
+  void slam() {counts[2]++;}
+  void enterResting() {counts[3]++;}
+  bool unlocked() {return isUnlocked;}
+
+  std::vector<int> counts = std::vector<int>(4);
+  bool isUnlocked{false};
+};
+
+struct ToggleHooks
+{
+  void switchedOff() {offs++;}
+  void tick() {ticks++;}
+  void click() {clicks++;}
+  bool charged() {return isCharged;}
+
+  int offs{0}, ticks{0}, clicks{0};
+  bool isCharged{false};
+};
+
+}  // namespace
+
+TEST(CodegenTest, matchesRuntimeChart)
+{
+  using Door = test::DoorMachine<DoorHooks>;
+
+  /* the runtime chart built from the same document, sharing the hooks state */
+  DoorHooks runtimeHooks;
+  ScxmlRegistry registry;
+  registry.registerAction("enterClosed", [&runtimeHooks]() {runtimeHooks.enterClosed();});
+  registry.registerAction("leaveResting", [&runtimeHooks]() {runtimeHooks.leaveResting();});
+  registry.registerAction("slam", [&runtimeHooks]() {runtimeHooks.slam();});
+  registry.registerAction("enterResting", [&runtimeHooks]() {runtimeHooks.enterResting();});
+  registry.registerGuard("unlocked", [&runtimeHooks]() {return runtimeHooks.unlocked();});
+  ScxmlLoader loader{registry};
+  auto chart = loader.loadFile(DOOR_SCXML);
+
+  DoorHooks hooks;
+  Door door{hooks};
+  EXPECT_EQ(door.currentState(), Door::StateId::initial);
+  EXPECT_STREQ(Door::eventName(Door::EventId::break_), "break");
+
+  const std::vector<std::string> names{"open", "lock", "unlock", "close", "break"};
+  const std::vector<Door::EventId> ids{
+    Door::EventId::open, Door::EventId::lock, Door::EventId::unlock, Door::EventId::close,
+    Door::EventId::break_};
+
+  std::mt19937 random{42};
+  for (int step = 0; step < 2000; ++step) {
+    int e = random() % (names.size() + 1);
+    if (e < static_cast<int>(names.size())) {
+      loader.event(names[e]).trigger();
+      door.trigger(ids[e]);
+    }
+    bool unlocked = random() % 2;
+    runtimeHooks.isUnlocked = unlocked;
+    hooks.isUnlocked = unlocked;
+
+    chart->spinOnce();
+    door.spinOnce();
+    ASSERT_EQ(door.currentStateNameFull(), chart->getCurrentStateNameFull()) << "step " << step;
+    ASSERT_EQ(hooks.counts, runtimeHooks.counts) << "step " << step;
+  }
+  EXPECT_GT(hooks.counts[2], 0);
+  EXPECT_GT(hooks.counts[3], 0);
+}
+
+TEST(CodegenTest, completionTransition)
+{
+  using Door = test::DoorMachine<DoorHooks>;
+  DoorHooks hooks;
+  hooks.isUnlocked = true;
+  Door door{hooks};
+  door.spinToState(Door::StateId::closed);
+  door.trigger(Door::EventId::open);
+  door.spinToState(Door::StateId::opened);
+  while (!door.isActive(Door::StateId::opened_resting)) {
+    door.spinOnce();
+  }
+
+  /* done.state.opened is not an event, reaching the final state takes it */
+  door.trigger(Door::EventId::break_);
+  for (int i = 0; i < 8 && door.currentState() != Door::StateId::locked; ++i) {
+    door.spinOnce();
+    EXPECT_NE(door.currentStateNameFull(), "closed");
+  }
+  EXPECT_EQ(door.currentState(), Door::StateId::locked);
+  EXPECT_EQ(Door::eventCount, 5u);
+}
+
+TEST(CodegenTest, jsonDefinition)
+{
+  using Toggle = test::ToggleMachine<ToggleHooks>;
+  ToggleHooks hooks;
+  Toggle toggle{hooks};
+
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentState(), Toggle::StateId::initial);
+  toggle.spinToState(Toggle::StateId::off);
+  EXPECT_EQ(hooks.offs, 1);
+  EXPECT_TRUE(toggle.isActive(Toggle::StateId::off));
+
+  /* events only latch on transitions out of the active state */
+  toggle.trigger(Toggle::EventId::unplug);
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentState(), Toggle::StateId::off);
+
+  Event press{"press"};
+  toggle.bind(Toggle::EventId::press, press);
+  press.trigger();
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentStateNameFull(), "on:initial");
+  EXPECT_FALSE(toggle.isActive(Toggle::StateId::off));
+
+  /* entering the subchart, then leaving its initial state */
+  toggle.spinOnce();
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentStateNameFull(), "on:dim");
+  EXPECT_TRUE(toggle.isActive(Toggle::StateId::on_dim));
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentStateNameFull(), "on:dim");
+
+  hooks.isCharged = true;
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentStateNameFull(), "on:bright");
+  EXPECT_EQ(hooks.ticks, 2);
+
+  press.trigger();
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentState(), Toggle::StateId::off);
+  EXPECT_EQ(hooks.clicks, 1);
+  EXPECT_FALSE(toggle.isActive(Toggle::StateId::on_bright));
+
+  press.trigger();
+  toggle.spinOnce();
+  toggle.trigger(Toggle::EventId::unplug);
+  toggle.spinOnce();
+  EXPECT_EQ(toggle.currentState(), Toggle::StateId::final);
+  EXPECT_STREQ(Toggle::stateName(toggle.currentState()), "final");
+  /* names are escaped in the generated string literals */
+  EXPECT_STREQ(Toggle::eventName(Toggle::EventId::dim__now__), "dim \"now\"\\");
+
+  toggle.reset();
+  toggle.spinToState(Toggle::StateId::off);
+  EXPECT_EQ(hooks.offs, 3);
+}
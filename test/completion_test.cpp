@@ -0,0 +1,117 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Activity;
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+
+namespace
+{
+
+class CountdownActivity : public Activity
+{
+public:
+  explicit CountdownActivity(int steps)
+  : steps_(steps) {}
+
+  bool resume() override {return --steps_ <= 0;}
+
+private:
+  int steps_;
+};
+
+}  // namespace
+
+TEST(CompletionTest, subchartFinal)
+{
+  /* big: initial ---> sub [initial ---> inner --(next)--> final] ===> done */
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto inner = sub->createState("inner");
+  Event next{"next"};
+  sub->getInitialState()->createTransition(inner);
+  inner->createTransition(sub->getFinalState())->addEvent(next);
+  big->addSubchart(sub);
+  auto done = big->createState("done");
+  big->getInitialState()->createTransition(sub);
+  auto t = sub->createCompletionTransition(done);
+  EXPECT_TRUE(t->isCompletion());
+
+  std::vector<std::string> changes;
+  big->createStateChangeCallback([&changes](const std::string & s) {changes.push_back(s);});
+
+  big->spinToState("sub");
+  for (int i = 0; i < 5; ++i) {
+    big->spinOnce();
+  }
+  EXPECT_EQ(big->getCurrentStateNameFull(), "sub:inner");
+  EXPECT_FALSE(sub->isCompleted());
+
+  /* the subchart reaches final and the parent leaves it in the same step */
+  next.trigger();
+  big->spinOnce();
+  EXPECT_TRUE(done->isActive());
+  EXPECT_EQ(changes, (std::vector<std::string>{"initial", "sub", "done"}));
+}
+
+TEST(CompletionTest, activityDone)
+{
+  auto chart = Chart::createChart("chart");
+  auto busy = chart->createState("busy");
+  auto idle = chart->createState("idle");
+  busy->setActivity([]() {return std::unique_ptr<Activity>(new CountdownActivity(3));});
+  chart->getInitialState()->createTransition(busy);
+  busy->createCompletionTransition(idle);
+  /* a state without activity completes right away */
+  idle->createCompletionTransition(chart->getFinalState());
+
+  chart->spinToState("busy");
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_TRUE(busy->isActive());
+  EXPECT_FALSE(busy->isCompleted());
+  chart->spinOnce();
+  EXPECT_TRUE(idle->isActive());
+  chart->spinOnce();
+  EXPECT_TRUE(chart->getFinalState()->isActive());
+}
+
+TEST(CompletionTest, guardsAndEvents)
+{
+  auto chart = Chart::createChart("chart");
+  auto s1 = chart->createState("s1");
+  chart->getInitialState()->createTransition(s1);
+  auto t = s1->createCompletionTransition(chart->getFinalState());
+  Event e{"e"};
+  EXPECT_THROW(t->addEvent(e), std::runtime_error);
+  EXPECT_EQ(t->eventCount(), 0);
+  EXPECT_FALSE(chart->getInitialState()->createTransition(s1)->isCompletion());
+
+  bool open = false;
+  t->createGuard([&open]() {return open;});
+  chart->spinToState("s1");
+  chart->spinOnce();
+  EXPECT_TRUE(s1->isActive());
+  open = true;
+  chart->spinOnce();
+  EXPECT_TRUE(chart->getFinalState()->isActive());
+}
@@ -0,0 +1,102 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Configuration;
+using mogi::statechart::Event;
+
+TEST(ConfigurationTest, nestedPath)
+{
+  /* big: initial ---> sub [initial ---> inner] */
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto inner = sub->createState("inner");
+  sub->getInitialState()->createTransition(inner);
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+
+  std::set<uint32_t> ids{big->getInitialState()->id(), sub->id(), inner->id()};
+  EXPECT_EQ(ids.size(), 3u);
+  EXPECT_EQ(ids.count(0), 0u);
+
+  auto c = big->configuration();
+  EXPECT_EQ(c.depth, 1u);
+  EXPECT_EQ(c.path[0], big->getInitialState()->id());
+  EXPECT_EQ(big->configurationName(c), "initial");
+
+  /* the first spinOnce() only enters initial, steps are Do phases */
+  for (int i = 0; i < 4; ++i) {
+    big->spinOnce();
+  }
+  c = big->configuration();
+  EXPECT_EQ(c.step, 3u);
+  ASSERT_EQ(c.depth, 2u);
+  EXPECT_EQ(c.path[0], sub->id());
+  EXPECT_EQ(c.path[1], inner->id());
+  EXPECT_EQ(big->configurationName(c), big->getCurrentStateNameFull());
+
+  big->reset();
+  EXPECT_EQ(big->configurationName(big->configuration()), "initial");
+}
+
+TEST(ConfigurationTest, concurrentReaders)
+{
+  /* initial ---> a <---[flip]---> b, monitored while it runs */
+  Event flip{"flip"};
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(flip);
+  b->createTransition(a)->addEvent(flip);
+  const std::set<uint32_t> valid{chart->getInitialState()->id(), a->id(), b->id()};
+
+  chart->spinAsync();
+  std::atomic<bool> done{false};
+  std::atomic<int> invalid{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; ++i) {
+    readers.emplace_back(
+      [&]() {
+        uint64_t last = 0;
+        while (!done) {
+          auto c = chart->configuration();
+          if (c.depth != 1 || !valid.count(c.path[0]) || c.step < last) {
+            invalid++;
+          }
+          last = c.step;
+        }
+      });
+  }
+  for (int i = 0; i < 200; ++i) {
+    flip.trigger();
+  }
+  done = true;
+  for (auto & reader : readers) {
+    reader.join();
+  }
+  chart->stop();
+  EXPECT_EQ(invalid.load(), 0);
+  auto current = chart->getCurrentStateName() == "a" ? a->id() : b->id();
+  EXPECT_EQ(chart->configuration().path[0], current);
+}
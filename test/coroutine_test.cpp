@@ -0,0 +1,202 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/coroutine.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::State;
+using mogi::statechart::Task;
+using mogi::statechart::coroutineActivity;
+using mogi::statechart::nextStep;
+using mogi::statechart::sleepFor;
+using mogi::statechart::waitFor;
+using mogi::statechart::waitUntil;
+
+namespace
+{
+
+/* counts how many frames holding it were unwound */
+struct Guard
+{
+  explicit Guard(int & c)
+  : count(c) {}
+  ~Guard() {count++;}
+  int & count;
+};
+
+}  // namespace
+
+TEST(CoroutineTest, stepsWithTheChart)
+{
+  /* initial ---> work ---[completion]---> final */
+  Event go{"go"};
+  auto chart = Chart::createChart("chart");
+  auto work = chart->createState("work");
+  chart->getInitialState()->createTransition(work);
+  work->createTransition(chart->getFinalState())->createGuard(
+    [&work]() {return work->isActivityDone();});
+
+  bool flag{false};
+  std::vector<std::string> trace;
+  work->setActivity(
+    coroutineActivity(
+      [&]() -> Task {
+        trace.push_back("start");
+        co_await nextStep();
+        trace.push_back("step");
+        co_await waitFor(go);
+        trace.push_back("go");
+        co_await waitUntil([&flag]() {return flag;});
+        trace.push_back("flag");
+        co_await sleepFor(std::chrono::milliseconds(5));
+        trace.push_back("slept");
+      }));
+
+  chart->spinToState("work");
+  chart->spinOnce();
+  EXPECT_EQ(trace, std::vector<std::string>({"start"}));
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(trace, std::vector<std::string>({"start", "step"}));
+  go.trigger();
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(trace.back(), "go");
+  flag = true;
+  auto start = std::chrono::steady_clock::now();
+  while (chart->getCurrentStateName() != "final") {
+    chart->spinOnce();
+  }
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(5));
+  EXPECT_EQ(trace.back(), "slept");
+  /* the observer of the last waitFor() is gone */
+  EXPECT_EQ(go.observerCount(), 0);
+}
+
+TEST(CoroutineTest, cancelledOnExit)
+{
+  /* events outlive the chart, and the activity waiting on them */
+  Event abort{"abort"}, never{"never"};
+  auto chart = Chart::createChart("chart");
+  auto work = chart->createState("work");
+  auto idle = chart->createState("idle");
+  chart->getInitialState()->createTransition(work);
+  work->createTransition(idle)->addEvent(abort);
+  idle->createTransition(work)->addEvent(abort);
+
+  int started{0}, unwound{0}, finished{0};
+  int unwoundAtExit{-1};
+  work->setCallbackExit([&]() {unwoundAtExit = unwound;});
+  work->setActivity(
+    coroutineActivity(
+      [&]() -> Task {
+        Guard guard{unwound};
+        started++;
+        co_await waitFor(never);
+        finished++;
+      }));
+
+  chart->spinToState("work");
+  chart->spinOnce();
+  EXPECT_EQ(started, 1);
+  EXPECT_EQ(never.observerCount(), 1);
+  abort.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "idle");
+  EXPECT_EQ(unwound, 1);
+  /* cancelled before the exit action runs */
+  EXPECT_EQ(unwoundAtExit, 1);
+  EXPECT_EQ(finished, 0);
+  EXPECT_EQ(never.observerCount(), 0);
+
+  /* a new activity on every entry */
+  abort.trigger();
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(started, 2);
+  EXPECT_FALSE(work->isActivityDone());
+}
+
+TEST(CoroutineTest, nestedTasks)
+{
+  auto chart = Chart::createChart("chart");
+  auto work = chart->createState("work");
+  chart->getInitialState()->createTransition(work);
+
+  int steps{0};
+  bool caught{false};
+  auto child = [&steps](int n) -> Task {
+      for (int i = 0; i < n; ++i) {
+        steps++;
+        co_await nextStep();
+      }
+    };
+  auto failing = []() -> Task {
+      co_await nextStep();
+      throw std::runtime_error("failed");
+    };
+  work->setActivity(
+    coroutineActivity(
+      [&]() -> Task {
+        co_await child(3);
+        try {
+          co_await failing();
+        } catch (const std::runtime_error &) {
+          caught = true;
+        }
+      }));
+
+  chart->spinToState("work");
+  for (int i = 0; i < 10; ++i) {
+    chart->spinOnce();
+  }
+  EXPECT_EQ(steps, 3);
+  EXPECT_TRUE(caught);
+  EXPECT_TRUE(work->isActivityDone());
+}
+
+TEST(CoroutineTest, thousandsInFlight)
+{
+  const int count = 5000;
+  Event tick{"tick"};
+  int done{0};
+  std::vector<std::shared_ptr<Chart>> charts;
+  for (int i = 0; i < count; ++i) {
+    auto chart = Chart::createChart("chart" + std::to_string(i));
+    auto work = chart->createState("work");
+    chart->getInitialState()->createTransition(work);
+    work->setActivity(
+      coroutineActivity(
+        [&tick, &done]() -> Task {
+          co_await waitFor(tick);
+          done++;
+        }));
+    chart->spinToState("work");
+    chart->spinOnce();
+    charts.push_back(chart);
+  }
+  EXPECT_EQ(tick.observerCount(), count);
+  tick.trigger();
+  for (auto & chart : charts) {
+    chart->spinOnce();
+  }
+  EXPECT_EQ(done, count);
+}
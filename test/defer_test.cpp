@@ -0,0 +1,197 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::AbstractState;
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+
+class DeferTest : public ::testing::Test
+{
+protected:
+  DeferTest()
+  {
+    /*
+     * initial ---> busy ---[done]---> cooling ---[done]---> idle ---[job]---> working
+     *             (defers job)       (defers job)
+     */
+    chart = Chart::createChart("chart");
+    busy = chart->createState("busy");
+    cooling = chart->createState("cooling");
+    idle = chart->createState("idle");
+    working = chart->createState("working");
+    chart->getInitialState()->createTransition(busy);
+    busy->createTransition(cooling)->addEvent(done);
+    cooling->createTransition(idle)->addEvent(done);
+    idle->createTransition(working)->addEvent(job);
+    working->createTransition(idle)->addEvent(done);
+    busy->deferEvent(job);
+    cooling->deferEvent(job);
+    chart->spinToState("busy");
+  }
+
+  Event job{"job"}, done{"done"};
+  std::shared_ptr<Chart> chart;
+  std::shared_ptr<AbstractState> busy, cooling, idle, working;
+};
+
+TEST_F(DeferTest, replayedAfterStateChange)
+{
+  EXPECT_TRUE(busy->defersEvent(job));
+  EXPECT_FALSE(idle->defersEvent(job));
+
+  job.trigger();
+  EXPECT_EQ(chart->deferredEventCount(), 1u);
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "busy");
+
+  /* cooling defers it again, it stays queued */
+  done.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "cooling");
+  EXPECT_EQ(chart->deferredEventCount(), 1u);
+
+  /* replayed on the step after the state change, idle consumes it */
+  done.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "idle");
+  EXPECT_EQ(chart->deferredEventCount(), 1u);
+  chart->spinOnce();
+  EXPECT_EQ(chart->deferredEventCount(), 0u);
+  EXPECT_EQ(chart->getCurrentStateName(), "working");
+
+  /* not deferred by working, dropped as usual */
+  job.trigger();
+  EXPECT_EQ(chart->deferredEventCount(), 0u);
+}
+
+TEST_F(DeferTest, consumedEventsAreNotDeferred)
+{
+  Event skip{"skip"};
+  busy->createTransition(idle)->addEvent(skip);
+  busy->deferEvent(skip);
+  skip.trigger();
+  EXPECT_EQ(chart->deferredEventCount(), 0u);
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "idle");
+
+  /* no longer deferred once removed */
+  EXPECT_TRUE(busy->removeDeferredEvent(job));
+  EXPECT_FALSE(busy->removeDeferredEvent(job));
+  chart->reset();
+  chart->spinToState("busy");
+  job.trigger();
+  EXPECT_EQ(chart->deferredEventCount(), 0u);
+}
+
+TEST_F(DeferTest, boundedQueue)
+{
+  chart->setDeferredQueueCapacity(4);
+  for (int i = 0; i < 10; ++i) {
+    job.trigger();
+  }
+  EXPECT_EQ(chart->deferredEventCount(), 4u);
+  EXPECT_EQ(chart->droppedDeferredEventCount(), 6u);
+
+  /* thousands of deferred events, every one of them handled: working
+   * defers job as well, so each round trip idle -> working -> idle takes one
+   */
+  chart->setDeferredQueueCapacity(5000);
+  EXPECT_EQ(chart->deferredEventCount(), 4u);
+  for (int i = 0; i < 4000; ++i) {
+    job.trigger();
+  }
+  EXPECT_EQ(chart->deferredEventCount(), 4004u);
+  working->deferEvent(job);
+  int jobs = 0;
+  auto counter = chart->createStateChangeCallback(
+    [&jobs](const std::string & state) {
+      jobs += state == "working";
+    });
+  done.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "cooling");
+  /* cooling defers the one replayed meanwhile again */
+  done.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "idle");
+  EXPECT_EQ(chart->deferredEventCount(), 4004u);
+  for (int round = 0; round < 5000 && chart->deferredEventCount(); ++round) {
+    chart->spinOnce();
+    EXPECT_EQ(chart->getCurrentStateName(), "working");
+    done.trigger();
+    chart->spinOnce();
+  }
+  EXPECT_EQ(jobs, 4004);
+  EXPECT_EQ(chart->deferredEventCount(), 0u);
+  EXPECT_EQ(chart->droppedDeferredEventCount(), 6u);
+
+  /* shrinking loses what doesn't fit any more, and counts it */
+  chart->reset();
+  chart->spinToState("busy");
+  for (int i = 0; i < 3; ++i) {
+    job.trigger();
+  }
+  chart->setDeferredQueueCapacity(1);
+  EXPECT_EQ(chart->deferredEventCount(), 1u);
+  EXPECT_EQ(chart->droppedDeferredEventCount(), 8u);
+}
+
+TEST_F(DeferTest, oneReplayPerStep)
+{
+  /* two deferred jobs, idle -> working -> idle twice */
+  working->deferEvent(job);
+  job.trigger();
+  job.trigger();
+  done.trigger();
+  chart->spinOnce();
+  done.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "idle");
+  EXPECT_EQ(chart->deferredEventCount(), 2u);
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "working");
+  EXPECT_EQ(chart->deferredEventCount(), 1u);
+  done.trigger();
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "working");
+  EXPECT_EQ(chart->deferredEventCount(), 0u);
+}
+
+TEST_F(DeferTest, subchart)
+{
+  /* the subchart's own queue is replayed on the subchart's state changes */
+  auto big = Chart::createChart("big");
+  big->addSubchart(chart);
+  big->getInitialState()->createTransition(chart);
+  big->spinToState("chart");
+  big->spinOnce();
+  big->spinOnce();
+  EXPECT_EQ(big->getCurrentStateNameFull(), "chart:busy");
+
+  job.trigger();
+  EXPECT_EQ(chart->deferredEventCount(), 1u);
+  EXPECT_EQ(big->deferredEventCount(), 0u);
+  done.trigger();
+  big->spinOnce();
+  done.trigger();
+  big->spinOnce();
+  big->spinOnce();
+  EXPECT_EQ(big->getCurrentStateNameFull(), "chart:working");
+}
@@ -0,0 +1,127 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/dot.hpp"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::DotExporter;
+using mogi::statechart::DotOptions;
+using mogi::statechart::Event;
+
+namespace
+{
+
+bool has(const std::string & dot, const std::string & text)
+{
+  return dot.find(text) != std::string::npos;
+}
+
+std::string node(const mogi::statechart::AbstractState & state)
+{
+  return "s" + std::to_string(state.id());
+}
+
+}  // namespace
+
+TEST(DotTest, structure)
+{
+  /* big: initial ---> idle --go [1 guard]--> sub [initial --> "inner"] ===> final */
+  auto big = Chart::createChart("big");
+  auto idle = big->createState("idle");
+  auto sub = Chart::createChart("sub");
+  auto inner = sub->createState("in \"quotes\"");
+  Event go{"go"};
+  Event alt{"alt"};
+  sub->getInitialState()->createTransition(inner);
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(idle);
+  auto toSub = idle->createTransition(sub);
+  toSub->addEvent(go);
+  toSub->addEvent(alt);
+  toSub->createGuard([]() {return true;});
+  sub->createCompletionTransition(big->getFinalState());
+  big->spinOnce();
+  big->spinOnce();
+
+  auto dot = DotExporter::toString(*big);
+  EXPECT_EQ(dot.rfind("digraph \"big\" {", 0), 0u);
+  EXPECT_TRUE(has(dot, "subgraph cluster_" + std::to_string(sub->id())));
+  EXPECT_TRUE(has(dot, "[label=\"in \\\"quotes\\\"\""));
+  /* the current state in bold */
+  EXPECT_TRUE(has(dot, node(*idle) + " [label=\"idle\", style=\"rounded,bold\"]"));
+  EXPECT_TRUE(
+    has(
+      dot, node(*idle) + " -> " + node(*sub->getInitialState()) +
+      " [label=\"alt, go [1 guard]\", lhead=cluster_" + std::to_string(sub->id()) + "]"));
+  EXPECT_TRUE(
+    has(
+      dot, node(*sub->getFinalState()) + " -> " + node(*big->getFinalState()) +
+      " [label=\"(completion)\", ltail=cluster_"));
+  EXPECT_FALSE(has(dot, "penwidth"));
+  EXPECT_EQ(std::count(dot.begin(), dot.end(), '{'), std::count(dot.begin(), dot.end(), '}'));
+}
+
+TEST(DotTest, heatMap)
+{
+  auto chart = Chart::createChart("loop");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  auto c = chart->createState("c");
+  Event flip{"flip"};
+  Event leave{"leave"};
+  chart->getInitialState()->createTransition(a);
+  auto ab = a->createTransition(b);
+  ab->addEvent(flip);
+  b->createTransition(a)->addEvent(flip);
+  b->createTransition(c)->addEvent(leave);
+  chart->setProfiling(true);
+  EXPECT_TRUE(chart->isProfiling());
+
+  chart->spinOnce();
+  chart->spinOnce();
+  for (int i = 0; i < 6; ++i) {
+    flip.trigger();
+    chart->spinOnce();
+  }
+  EXPECT_EQ(ab->stats().fires, 3u);
+  EXPECT_EQ(a->stats().visits, 3u);
+  EXPECT_GT(a->stats().dwellTime.count(), 0);
+
+  auto dot = DotExporter::toString(*chart, DotOptions{true});
+  EXPECT_TRUE(has(dot, "[label=\"flip\\n3x, "));
+  /* the busiest edges are the widest, unused ones grey */
+  EXPECT_TRUE(has(dot, "penwidth=5.00"));
+  EXPECT_TRUE(has(dot, "[label=\"leave\", color=gray70]"));
+  EXPECT_TRUE(has(dot, "[label=\"a\\n3x, "));
+}
+
+TEST(DotTest, largeChart)
+{
+  auto chart = Chart::createChart("large");
+  std::shared_ptr<mogi::statechart::AbstractState> previous = chart->getInitialState();
+  for (int i = 0; i < 2000; ++i) {
+    auto s = chart->createState("s" + std::to_string(i));
+    previous->createTransition(s);
+    previous = s;
+  }
+  auto dot = DotExporter::toString(*chart, DotOptions{true});
+  EXPECT_EQ(std::count(dot.begin(), dot.end(), '\n'), 4 + 2002 + 2000 + 1);
+}
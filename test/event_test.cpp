@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>
+#include <future>
 #include <memory>
 #include <string>
 #include "gtest/gtest.h"
@@ -439,7 +441,8 @@ TYPED_TEST(EventTest, spinAsync)
    * grant the transition and move us to state2
    */
   eTran.trigger();
-  while (!c.state2->isActive()) {}
+  /* state2 is left for final on the next step, it may be over already */
+  while (c.chart->getCurrentStateName() == c.getState1Name()) {}
   EXPECT_NE(c.chart->getCurrentStateName(), c.getState1Name());
   EXPECT_FALSE(c.state1->isActive());
 
@@ -735,9 +738,15 @@ TEST_F(RunSubchartWithEventTest, asyncRun)
   EXPECT_EQ(subchart->getCurrentStateName(), getSubState1Name());
 
   /* grant subchart transition */
+  auto inSubState2 = subchart->whenState(subState2->id());
   enableTransistionSub1To2 = true;
   eTranSub12.trigger();
-  while (!subState2->isActive()) {}
+  /* substate2 is left for the subchart's final on the next step, the steps
+   * run back to back: its configuration is caught when published
+   */
+  ASSERT_EQ(inSubState2.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(inSubState2.get().path[1], subState2->id());
+  while (subchart->getCurrentStateName() == getSubState1Name()) {}
   EXPECT_NE(subchart->getCurrentStateName(), getSubState1Name());
   EXPECT_EQ(chart->getCurrentStateName(), getState1Name());
   EXPECT_TRUE(state1->isActive());
@@ -763,9 +772,13 @@ TEST_F(RunSubchartWithEventTest, asyncRun)
   EXPECT_EQ(eventLogger.eventFiredCount, 7);
 
   /* grant transition in main chart */
+  auto inState2 = chart->whenState(state2->id());
   enableTransistion1To2 = true;
   eTran12.trigger();
-  while (!state2->isActive()) {}
+  /* state2 is left for final on the next step, see substate2 above */
+  ASSERT_EQ(inState2.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+  EXPECT_EQ(inState2.get().path[0], state2->id());
+  while (chart->getCurrentStateName() == getState1Name()) {}
   EXPECT_NE(chart->getCurrentStateName(), getState1Name());
   EXPECT_FALSE(state1->isActive());
   EXPECT_FALSE(subchart->isActive());
@@ -775,4 +788,7 @@ TEST_F(RunSubchartWithEventTest, asyncRun)
   eFinal.trigger();
   EXPECT_EQ(eventLogger.eventFiredName, "eFinal");
   EXPECT_EQ(eventLogger.eventFiredCount, 8);
+
+  /* stop the chart, its thread may otherwise release the last reference */
+  chart->stop();
 }
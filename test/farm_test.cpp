@@ -0,0 +1,179 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/farm.hpp"
+#include "mogi_statechart/scxml.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::ChartDescription;
+using mogi::statechart::ChartFarm;
+using mogi::statechart::InlineExecutor;
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::ScxmlRegistry;
+using mogi::statechart::StateDescription;
+using mogi::statechart::ThreadPoolExecutor;
+using mogi::statechart::TransitionDescription;
+
+namespace
+{
+
+/* initial ---> idle ---start[charged]---> working ---fault---> error
+ *               ^<------tick[depleted]------/                  |
+ *               ^<-----------------repair----------------------/---halt---> done
+ */
+ChartDescription device()
+{
+  ChartDescription d;
+  d.name = "device";
+  d.initial = "idle";
+  StateDescription idle{"idle", false, {"enterIdle"}, {}, {}, {}, nullptr};
+  idle.transitions.push_back(TransitionDescription{"working", {"start"}, {"charged"}, {}});
+  StateDescription working{"working", false, {}, {"work"}, {}, {}, nullptr};
+  working.transitions.push_back(TransitionDescription{"error", {"fault"}, {}, {"report"}});
+  working.transitions.push_back(TransitionDescription{"idle", {"tick"}, {"depleted"}, {}});
+  StateDescription error{"error", false, {}, {}, {}, {}, nullptr};
+  error.transitions.push_back(TransitionDescription{"idle", {"repair"}, {}, {}});
+  error.transitions.push_back(TransitionDescription{"done", {"halt"}, {}, {}});
+  StateDescription done{"done", true, {}, {}, {}, {}, nullptr};
+  d.states = {idle, working, error, done};
+  return d;
+}
+
+const std::vector<std::string> events{"start", "fault", "tick", "repair", "halt"};
+
+}  // namespace
+
+TEST(ChartFarmTest, matchesRuntimeCharts)
+{
+  const size_t count = 64;
+  std::vector<float> battery(count, 1.0f);
+  std::vector<int> farmCalls(count), runtimeCalls(count);
+
+  ChartFarm farm{device(), count};
+  farm.bindAction("enterIdle", [&farmCalls](size_t i) {farmCalls[i] += 1;});
+  farm.bindAction("work", [&farmCalls](size_t i) {farmCalls[i] += 100;});
+  farm.bindAction("report", [&farmCalls](size_t i) {farmCalls[i] += 10000;});
+  farm.bindGuard("charged", battery.data(), ChartFarm::Comparison::Greater, 0.5f);
+  farm.bindGuard("depleted", [&battery](size_t i) {return battery[i] < 0.2f;});
+
+  std::vector<std::unique_ptr<ScxmlLoader>> loaders;
+  std::vector<std::shared_ptr<Chart>> charts;
+  for (size_t i = 0; i < count; ++i) {
+    ScxmlRegistry registry;
+    registry.registerAction("enterIdle", [&runtimeCalls, i]() {runtimeCalls[i] += 1;});
+    registry.registerAction("work", [&runtimeCalls, i]() {runtimeCalls[i] += 100;});
+    registry.registerAction("report", [&runtimeCalls, i]() {runtimeCalls[i] += 10000;});
+    registry.registerGuard("charged", [&battery, i]() {return battery[i] > 0.5f;});
+    registry.registerGuard("depleted", [&battery, i]() {return battery[i] < 0.2f;});
+    loaders.emplace_back(new ScxmlLoader{registry});
+    charts.push_back(loaders.back()->build(device()));
+  }
+
+  std::mt19937 random{7};
+  std::uniform_int_distribution<int> pick(-1, static_cast<int>(events.size()) - 1);
+  std::uniform_real_distribution<float> level(0.0f, 1.0f);
+  for (int step = 0; step < 300; ++step) {
+    for (size_t i = 0; i < count; ++i) {
+      battery[i] = level(random);
+      /* at most one event per step, so that a single transition applies */
+      auto e = pick(random);
+      if (e >= 0) {
+        loaders[i]->event(events[e]).trigger();
+        farm.trigger(i, farm.eventIndex(events[e]));
+      }
+      charts[i]->spinOnce();
+    }
+    farm.step();
+    for (size_t i = 0; i < count; ++i) {
+      ASSERT_EQ(farm.stateName(farm.currentState(i)), charts[i]->getCurrentStateName()) <<
+        "instance " << i << " step " << step;
+    }
+  }
+  EXPECT_EQ(farmCalls, runtimeCalls);
+  EXPECT_GT(farm.countInState(farm.stateIndex("final")), 0u);
+}
+
+TEST(ChartFarmTest, parallelStepsMatchSerial)
+{
+  const size_t count = 100000;
+  std::vector<uint8_t> ready(count);
+  for (size_t i = 0; i < count; ++i) {
+    ready[i] = i % 3 == 0;
+  }
+  auto make = [&ready, count]() {
+      std::unique_ptr<ChartFarm> farm{new ChartFarm{device(), count}};
+      farm->bindAction("enterIdle", [](size_t) {});
+      farm->bindAction("work", [](size_t) {});
+      farm->bindAction("report", [](size_t) {});
+      farm->bindGuard("charged", ready.data());
+      farm->bindGuard("depleted", [](size_t i) {return i % 2 == 0;});
+      return farm;
+    };
+  auto serial = make();
+  auto parallel = make();
+  ThreadPoolExecutor pool{3};
+  for (int step = 0; step < 6; ++step) {
+    serial->triggerAll(step % 2 ? serial->eventIndex("tick") : serial->eventIndex("start"));
+    parallel->triggerAll(step % 2 ? parallel->eventIndex("tick") : parallel->eventIndex("start"));
+    serial->step();
+    parallel->step(pool, 4096);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    ASSERT_EQ(serial->currentState(i), parallel->currentState(i)) << "instance " << i;
+  }
+  /* only a third was ever charged, the even ones went back to idle */
+  auto working = static_cast<size_t>(serial->stateIndex("working"));
+  EXPECT_EQ(serial->countInState(working), (count + 5) / 6);
+
+  parallel->reset();
+  EXPECT_EQ(parallel->countInState(parallel->stateIndex("initial")), count);
+}
+
+TEST(ChartFarmTest, errors)
+{
+  ChartFarm farm{device(), 4};
+  EXPECT_THROW(farm.step(), std::runtime_error);
+  EXPECT_THROW(farm.bindAction("missing", [](size_t) {}), std::runtime_error);
+  farm.bindAction("enterIdle", [](size_t) {});
+  farm.bindAction("work", [](size_t) {});
+  farm.bindAction("report", [](size_t i) {
+      if (i == 2) {
+        throw std::runtime_error("report failed");
+      }
+    });
+  farm.bindGuard("charged", [](size_t) {return true;});
+  farm.bindGuard("depleted", [](size_t) {return false;});
+  /* unknown events */
+  EXPECT_EQ(farm.eventIndex("typo"), -1);
+  EXPECT_THROW(farm.trigger(0, farm.eventIndex("typo")), std::runtime_error);
+  EXPECT_THROW(farm.triggerAll(64), std::runtime_error);
+  InlineExecutor inline_;
+  farm.step(inline_, 1);
+  farm.step(inline_, 1);
+  farm.triggerAll(farm.eventIndex("start"));
+  farm.step(inline_, 1);
+  farm.triggerAll(farm.eventIndex("fault"));
+  EXPECT_THROW(farm.step(inline_, 1), std::runtime_error);
+
+  auto nested = device();
+  nested.states[0].subchart = std::make_shared<ChartDescription>(device());
+  EXPECT_THROW((ChartFarm{nested, 1}), std::runtime_error);
+}
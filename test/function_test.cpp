@@ -0,0 +1,141 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include "gtest/gtest.h"
+#include "mogi_statechart/function.hpp"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::BasicCallback;
+using mogi::statechart::Chart;
+using mogi::statechart::FunctionPointer;
+using mogi::statechart::FunctionRef;
+using mogi::statechart::InplaceFunction;
+
+namespace
+{
+
+/* counts live copies of itself */
+struct Counted
+{
+  explicit Counted(int & live)
+  : live_(&live) {++*live_;}
+  Counted(const Counted & other)
+  : live_(other.live_) {++*live_;}
+  ~Counted() {--*live_;}
+  int operator()(int x) const {return x + 1;}
+
+  int * live_;
+};
+
+int twice(int x) {return 2 * x;}
+int add(void * to, int x) {return *static_cast<int *>(to) + x;}
+
+}  // namespace
+
+TEST(InplaceFunctionTest, copiesAndDestroysTheCallable)
+{
+  int live = 0;
+  {
+    InplaceFunction<int(int)> f{Counted{live}};
+    EXPECT_EQ(live, 1);
+    auto g = f;
+    EXPECT_EQ(live, 2);
+    auto h = std::move(g);
+    EXPECT_EQ(h(1), 2);
+    f = nullptr;
+    EXPECT_FALSE(f);
+    EXPECT_TRUE(h);
+  }
+  EXPECT_EQ(live, 0);
+}
+
+TEST(InplaceFunctionTest, emptyThrows)
+{
+  InplaceFunction<void()> f;
+  EXPECT_THROW(f(), std::bad_function_call);
+}
+
+TEST(InplaceFunctionTest, mutableCallable)
+{
+  InplaceFunction<int(), 16> counter{[n = 0]() mutable {return ++n;}};
+  counter();
+  EXPECT_EQ(counter(), 2);
+}
+
+TEST(FunctionPointerTest, plainContextAndLambda)
+{
+  FunctionPointer<int(int)> plain{&twice};
+  EXPECT_EQ(plain(3), 6);
+  int base = 10;
+  FunctionPointer<int(int)> withContext{&add, &base};
+  EXPECT_EQ(withContext(3), 13);
+  FunctionPointer<int(int)> lambda{[](int x) {return x - 1;}};
+  EXPECT_EQ(lambda(3), 2);
+}
+
+TEST(FunctionRefTest, seesTheCallable)
+{
+  int calls = 0;
+  auto count = [&calls]() {return ++calls;};
+  FunctionRef<int()> ref{count};
+  auto copy = ref;
+  ref();
+  copy();
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(BasicCallbackTest, everyStorage)
+{
+  int base = 1;
+  auto lambda = [&base](int x) {return base + x;};
+  BasicCallback<std::function<int(int)>, int, int> function{lambda};
+  BasicCallback<InplaceFunction<int(int)>, int, int> inplace{lambda};
+  BasicCallback<FunctionPointer<int(int)>, int, int> pointer{{&add, &base}};
+  BasicCallback<FunctionRef<int(int)>, int, int> ref{lambda};
+  EXPECT_EQ(function.invoke(1), 2);
+  EXPECT_EQ(inplace.invoke(1), 2);
+  EXPECT_EQ(pointer.invoke(1), 2);
+  EXPECT_EQ(ref.invokeCached(1), 2);
+  inplace.set(&twice);
+  pointer.set(&twice);
+  EXPECT_EQ(inplace.invokeCached(2), 4);
+  EXPECT_EQ(pointer.invokeCached(2), 4);
+}
+
+TEST(BasicCallbackTest, guardsFromEveryStorage)
+{
+  auto chart = Chart::createChart("guards");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  auto c = chart->createState("c");
+  bool open = false;
+  auto isOpen = [&open]() {return open;};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->createGuard(FunctionRef<bool()>{isOpen});
+  b->createTransition(c)->createGuard(
+    FunctionPointer<bool()>{[](void * o) {return *static_cast<bool *>(o);}, &open});
+
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "a");
+  open = true;
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "c");
+}
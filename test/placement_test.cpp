@@ -0,0 +1,143 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/executor.hpp"
+#include "mogi_statechart/placement.hpp"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::Placement;
+using mogi::statechart::RealTimeOptions;
+using mogi::statechart::ThreadPoolExecutor;
+
+TEST(PlacementTest, nodesCoverTheCpus)
+{
+  auto nodes = Placement::numaNodes();
+  ASSERT_FALSE(nodes.empty());
+  std::vector<int> cpus;
+  for (const auto & node : nodes) {
+    cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+  }
+  /* the CPU running this test belongs to one of them */
+  EXPECT_NE(std::find(cpus.begin(), cpus.end(), sched_getcpu()), cpus.end());
+  EXPECT_EQ(Placement::cpusOf(nodes.front().id), nodes.front().cpus);
+  EXPECT_THROW(Placement::cpusOf(-2), std::runtime_error);
+}
+
+TEST(PlacementTest, chartRunsOnItsNode)
+{
+  auto node = Placement::numaNodes().front();
+  auto chart = Chart::createChart("placed");
+  auto state = chart->createState("state");
+  Event event{"e"};
+  chart->getInitialState()->createTransition(state)->addEvent(event);
+  chart->setEventQueueCapacity(4);
+  std::atomic<int> cpu{-1};
+  state->setCallbackEntry([&cpu]() {cpu.store(sched_getcpu());});
+
+  RealTimeOptions options;
+  options.numaNode = node.id;
+  chart->spinAsync(options);
+  ASSERT_TRUE(chart->post(event));
+  while (cpu.load() < 0) {
+    std::this_thread::yield();
+  }
+  chart->stop();
+  EXPECT_NE(std::find(node.cpus.begin(), node.cpus.end(), cpu.load()), node.cpus.end());
+  /* the queues were reallocated to the same capacity */
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(chart->post(event));
+  }
+  EXPECT_FALSE(chart->post(event));
+}
+
+TEST(PlacementTest, queuesAllocatedOnTheNode)
+{
+  /* nothing posted nor deferred yet, the queues are allocated lazily */
+  auto chart = Chart::createChart("placed");
+  EXPECT_EQ(chart->eventQueueStats().capacity, 0u);
+  EXPECT_EQ(chart->deferredQueueCapacity(), 0u);
+
+  RealTimeOptions options;
+  options.numaNode = Placement::numaNodes().front().id;
+  chart->spinAsync(options);
+  chart->stop();
+  /* one queue of 1024 events per priority */
+  EXPECT_EQ(chart->eventQueueStats().capacity, 4u * 1024);
+  EXPECT_EQ(chart->deferredQueueCapacity(), 1024u);
+}
+
+TEST(PlacementTest, missingNodeThrows)
+{
+  auto chart = Chart::createChart("placed");
+  RealTimeOptions options;
+  options.numaNode = 4096;
+  EXPECT_THROW(chart->spinAsync(options), std::runtime_error);
+  EXPECT_FALSE(chart->isRunning());
+  EXPECT_THROW(ThreadPoolExecutor(2, options), std::runtime_error);
+}
+
+TEST(PlacementTest, badOptionsThrow)
+{
+  auto chart = Chart::createChart("placed");
+  for (auto cpu : {-1, CPU_SETSIZE}) {
+    RealTimeOptions options;
+    options.cpus = {0, cpu};
+    EXPECT_THROW(chart->spinAsync(options), std::runtime_error);
+    EXPECT_FALSE(chart->isRunning());
+  }
+  /* more than the thread's stack */
+  RealTimeOptions options;
+  options.prefaultStack = size_t{1} << 40;
+  EXPECT_THROW(chart->spinAsync(options), std::runtime_error);
+  EXPECT_FALSE(chart->isRunning());
+  options.prefaultStack = 64 * 1024;
+  chart->spinAsync(options);
+  EXPECT_TRUE(chart->isRunning());
+  chart->stop();
+}
+
+TEST(PlacementTest, pinnedExecutor)
+{
+  auto cpu = Placement::numaNodes().front().cpus.front();
+  RealTimeOptions placement;
+  placement.cpus = {cpu};
+  std::atomic<int> ran{0};
+  std::atomic<int> elsewhere{0};
+  {
+    ThreadPoolExecutor pool{2, placement};
+    for (int i = 0; i < 16; ++i) {
+      pool.execute(
+        [&, cpu]() {
+          if (sched_getcpu() != cpu) {
+            elsewhere++;
+          }
+          ran++;
+        });
+    }
+  }
+  EXPECT_EQ(ran.load(), 16);
+  EXPECT_EQ(elsewhere.load(), 0);
+}
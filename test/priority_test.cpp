@@ -0,0 +1,232 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::AbstractState;
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventPriority;
+using mogi::statechart::OverflowPolicy;
+
+class PriorityTest : public ::testing::Test
+{
+protected:
+  PriorityTest()
+  {
+    /* initial ---> running ---[stop]---> final */
+    chart = Chart::createChart("chart");
+    running = chart->createState("running");
+    chart->getInitialState()->createTransition(running);
+    running->createTransition(chart->getFinalState())->addEvent(stop);
+    for (auto e : {&stop, &telemetry, &command}) {
+      running->createEventCallback(
+        *e, [this](const Event & event) {delivered.push_back(event.name());});
+    }
+    stop.setPriority(EventPriority::Critical);
+    telemetry.setPriority(EventPriority::Low);
+    chart->spinToState("running");
+  }
+
+  Event stop{"stop"}, telemetry{"telemetry"}, command{"command"};
+  std::shared_ptr<Chart> chart;
+  std::shared_ptr<AbstractState> running;
+  std::vector<std::string> delivered;
+};
+
+TEST_F(PriorityTest, highestPriorityFirst)
+{
+  EXPECT_EQ(command.priority(), EventPriority::Normal);
+  chart->setStarvationLimit(0);
+  EXPECT_TRUE(chart->post(telemetry));
+  EXPECT_TRUE(chart->post(command));
+  EXPECT_TRUE(chart->post(telemetry, EventPriority::High));
+  EXPECT_EQ(chart->queuedEventCount(), 3u);
+  EXPECT_TRUE(delivered.empty());
+
+  /* one event per step */
+  chart->spinOnce();
+  EXPECT_EQ(delivered, std::vector<std::string>({"telemetry"}));
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(delivered, std::vector<std::string>({"telemetry", "command", "telemetry"}));
+  EXPECT_EQ(chart->queuedEventCount(), 0u);
+
+  /* critical events jump the queue and take their transition right away */
+  chart->post(telemetry);
+  chart->post(stop);
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "final");
+  EXPECT_EQ(chart->queuedEventCount(), 1u);
+}
+
+TEST_F(PriorityTest, starvationProtection)
+{
+  chart->setStarvationLimit(2);
+  chart->post(telemetry);
+  for (int i = 0; i < 4; ++i) {
+    chart->post(command);
+  }
+  for (int i = 0; i < 5; ++i) {
+    chart->spinOnce();
+  }
+  EXPECT_EQ(
+    delivered,
+    std::vector<std::string>({"command", "command", "telemetry", "command", "command"}));
+}
+
+TEST_F(PriorityTest, boundedQueues)
+{
+  chart->setEventQueueCapacity(2);
+  EXPECT_TRUE(chart->post(telemetry));
+  EXPECT_TRUE(chart->post(telemetry));
+  EXPECT_FALSE(chart->post(telemetry));
+  /* other priorities have queues of their own */
+  EXPECT_TRUE(chart->post(command));
+  EXPECT_EQ(chart->droppedEventCount(), 1u);
+  EXPECT_EQ(chart->queuedEventCount(), 3u);
+}
+
+TEST_F(PriorityTest, postedToThisChartOnly)
+{
+  /* another chart reacting to the same event */
+  auto other = Chart::createChart("other");
+  auto otherRunning = other->createState("running");
+  other->getInitialState()->createTransition(otherRunning);
+  otherRunning->createTransition(other->getFinalState())->addEvent(stop);
+  other->spinToState("running");
+
+  chart->post(stop);
+  chart->spinOnce();
+  other->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "final");
+  EXPECT_EQ(other->getCurrentStateName(), "running");
+
+  other->post(stop);
+  other->spinOnce();
+  EXPECT_EQ(other->getCurrentStateName(), "final");
+}
+
+TEST_F(PriorityTest, postFromAnotherThread)
+{
+  auto big = Chart::createChart("big");
+  big->addSubchart(chart);
+  big->getInitialState()->createTransition(chart);
+  big->spinAsync();
+
+  /* posting to the subchart goes through the running outmost chart */
+  std::thread producer{[this]() {
+      while (!running->isActive()) {
+        std::this_thread::yield();
+      }
+      for (int i = 0; i < 100; ++i) {
+        chart->post(telemetry);
+      }
+      chart->post(stop);
+    }};
+  producer.join();
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((big->getCurrentStateNameFull() != "chart:final" || chart->queuedEventCount()) &&
+    std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::yield();
+  }
+  big->stop();
+  EXPECT_EQ(big->getCurrentStateNameFull(), "chart:final");
+  EXPECT_EQ(chart->queuedEventCount(), 0u);
+}
+
+TEST_F(PriorityTest, overloadPolicies)
+{
+  const auto normal = EventPriority::Normal;
+  chart->setEventQueueCapacity(2);
+  chart->setEventQueuePolicy(OverflowPolicy::DropOldest);
+  chart->post(telemetry, normal);
+  chart->post(command, normal);
+  EXPECT_TRUE(chart->post(stop, normal));
+  auto stats = chart->eventQueueStats();
+  EXPECT_EQ(stats.depth, 2u);
+  EXPECT_EQ(stats.highWater, 2u);
+  EXPECT_EQ(stats.posted, 3u);
+  EXPECT_EQ(stats.dropped, 1u);
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(delivered, (std::vector<std::string>{"command", "stop"}));
+  EXPECT_EQ(chart->eventQueueStats().depth, 0u);
+
+  chart->reset();
+  chart->spinToState("running");
+  delivered.clear();
+  chart->setEventQueuePolicy(OverflowPolicy::Coalesce);
+  chart->post(telemetry, normal);
+  EXPECT_TRUE(chart->post(telemetry, normal));
+  chart->post(command, normal);
+  EXPECT_FALSE(chart->post(stop, normal));
+  stats = chart->eventQueueStats();
+  EXPECT_EQ(stats.coalesced, 1u);
+  EXPECT_EQ(stats.dropped, 2u);
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(delivered, (std::vector<std::string>{"telemetry", "command"}));
+}
+
+TEST_F(PriorityTest, blockingProducer)
+{
+  chart->setEventQueueCapacity(1);
+  chart->setEventQueuePolicy(OverflowPolicy::Block, std::chrono::milliseconds(1));
+  chart->post(telemetry);
+  /* nobody drains the queue */
+  EXPECT_FALSE(chart->post(command, EventPriority::Low));
+  EXPECT_EQ(chart->eventQueueStats().timedOut, 1u);
+
+  chart->setEventQueuePolicy(OverflowPolicy::Block, std::chrono::seconds(10));
+  std::thread producer{[this]() {EXPECT_TRUE(chart->post(command, EventPriority::Low));}};
+  while (delivered.size() < 2) {
+    chart->spinOnce();
+  }
+  producer.join();
+  EXPECT_EQ(delivered, (std::vector<std::string>{"telemetry", "command"}));
+  EXPECT_EQ(chart->eventQueueStats().timedOut, 1u);
+}
+
+TEST_F(PriorityTest, blockingFromCallback)
+{
+  /* stepped by this thread, the chart has no thread of its own */
+  chart->setEventQueueCapacity(1);
+  chart->setEventQueuePolicy(OverflowPolicy::Block, std::chrono::seconds(10));
+  Event flood{"flood"};
+  std::vector<bool> accepted;
+  running->createEventCallback(
+    flood, [this, &accepted](const Event &) {
+      accepted.push_back(chart->post(telemetry));
+      accepted.push_back(chart->post(telemetry));
+    });
+
+  auto start = std::chrono::steady_clock::now();
+  chart->post(flood);
+  chart->spinOnce();
+  EXPECT_EQ(accepted, (std::vector<bool>{true, false}));
+  chart->post(flood);
+  chart->runToQuiescence();
+  EXPECT_EQ(accepted, (std::vector<bool>{true, false, false, false}));
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+  EXPECT_EQ(chart->eventQueueStats().timedOut, 0u);
+}
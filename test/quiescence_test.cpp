@@ -0,0 +1,200 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+
+namespace
+{
+
+/* initial ---> p0 ---> p1 ---> p2 --(go)--> final */
+struct Chain
+{
+  Chain()
+  : chart(Chart::createChart("chain"))
+  {
+    auto previous = chart->getInitialState();
+    for (int i = 0; i < 3; ++i) {
+      auto p = chart->createState("p" + std::to_string(i));
+      p->setCallbackEntry([this, i]() {entered.push_back("p" + std::to_string(i));});
+      previous->createTransition(p);
+      previous = p;
+    }
+    previous->createTransition(chart->getFinalState())->addEvent(go);
+    chart->createStateChangeCallback([this](const std::string &) {changes++;});
+  }
+
+  std::shared_ptr<Chart> chart;
+  Event go{"go"};
+  std::vector<std::string> entered;
+  int changes{0};
+};
+
+}  // namespace
+
+TEST(QuiescenceTest, oneTransitionPerStepByDefault)
+{
+  Chain chain;
+  EXPECT_FALSE(chain.chart->collapsesTransients());
+  chain.chart->spinOnce();
+  EXPECT_EQ(chain.chart->getCurrentStateName(), "initial");
+  chain.chart->spinOnce();
+  EXPECT_EQ(chain.chart->getCurrentStateName(), "p0");
+}
+
+TEST(QuiescenceTest, collapsesTransientStates)
+{
+  for (bool locked : {false, true}) {
+    Chain chain;
+    chain.chart->setCollapseTransients(true);
+    if (locked) {
+      chain.chart->lock();
+    }
+    chain.chart->spinOnce();
+    EXPECT_EQ(chain.chart->getCurrentStateName(), "p2");
+    EXPECT_EQ(chain.entered, (std::vector<std::string>{"p0", "p1", "p2"}));
+    EXPECT_EQ(chain.changes, 4);
+    /* p2 waits for its event */
+    chain.chart->spinOnce();
+    EXPECT_EQ(chain.chart->getCurrentStateName(), "p2");
+    chain.go.trigger();
+    chain.chart->spinOnce();
+    EXPECT_TRUE(chain.chart->isCompleted());
+  }
+}
+
+TEST(QuiescenceTest, collapsesInSubcharts)
+{
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto inner = sub->createState("inner");
+  auto waiting = sub->createState("waiting");
+  Event go{"go"};
+  sub->getInitialState()->createTransition(inner);
+  inner->createTransition(waiting);
+  waiting->createTransition(sub->getFinalState())->addEvent(go);
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+  big->setCollapseTransients(true);
+  EXPECT_TRUE(sub->collapsesTransients());
+
+  /* entering sub, then its own chain on the first Do of sub */
+  big->spinOnce();
+  big->spinOnce();
+  EXPECT_EQ(big->getCurrentStateNameFull(), "sub:waiting");
+}
+
+TEST(QuiescenceTest, cycleOfTransientsEndsTheStep)
+{
+  auto chart = Chart::createChart("cycle");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  int entries = 0;
+  a->setCallbackEntry([&entries]() {entries++;});
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b);
+  b->createTransition(a);
+  chart->setCollapseTransients(true);
+
+  chart->spinOnce();
+  EXPECT_EQ(entries, static_cast<int>(Chart::maxTransientChain / 2));
+}
+
+TEST(QuiescenceTest, runsToQuiescence)
+{
+  Chain chain;
+  EXPECT_EQ(chain.chart->runToQuiescence(), 4u);
+  EXPECT_EQ(chain.chart->getCurrentStateName(), "p2");
+  EXPECT_EQ(chain.chart->runToQuiescence(), 0u);
+  chain.go.trigger();
+  EXPECT_EQ(chain.chart->runToQuiescence(), 1u);
+  EXPECT_TRUE(chain.chart->isCompleted());
+
+  Chain collapsed;
+  collapsed.chart->setCollapseTransients(true);
+  EXPECT_EQ(collapsed.chart->runToQuiescence(), 1u);
+  EXPECT_EQ(collapsed.entered.size(), 3u);
+}
+
+TEST(QuiescenceTest, deliversEveryQueuedEvent)
+{
+  auto chart = Chart::createChart("queued");
+  auto idle = chart->createState("idle");
+  auto done = chart->createState("done");
+  Event noise{"noise"};
+  Event go{"go"};
+  chart->getInitialState()->createTransition(idle);
+  idle->createTransition(done)->addEvent(go);
+  chart->runToQuiescence();
+  EXPECT_EQ(chart->getCurrentStateName(), "idle");
+
+  /* delivered one per step, the first takes no transition */
+  chart->post(noise);
+  chart->post(go);
+  EXPECT_EQ(chart->runToQuiescence(), 1u);
+  EXPECT_EQ(chart->getCurrentStateName(), "done");
+  EXPECT_EQ(chart->queuedEventCount(), 0u);
+}
+
+TEST(QuiescenceTest, detectsLivelock)
+{
+  auto chart = Chart::createChart("livelock");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b);
+  b->createTransition(a);
+
+  try {
+    chart->runToQuiescence(50);
+    FAIL() << "livelock not detected";
+  } catch (const std::runtime_error & e) {
+    std::string what{e.what()};
+    EXPECT_NE(what.find("within 50 steps"), std::string::npos);
+    auto through = what.substr(what.find("moving through ") + 15);
+    EXPECT_TRUE(through == "a, b" || through == "b, a") << what;
+  }
+}
+
+TEST(QuiescenceTest, callbacksSetLaterAreCalled)
+{
+  auto chart = Chart::createChart("late");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event go{"go"};
+  Event back{"back"};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(go);
+  b->createTransition(a)->addEvent(back);
+  chart->runToQuiescence();
+
+  int calls = 0;
+  a->setCallbackExit([&calls]() {calls++;});
+  a->setCallbackEntry([&calls]() {calls++;});
+  a->setCallbackDo([&calls]() {calls++;});
+  go.trigger();
+  chart->runToQuiescence();
+  EXPECT_EQ(calls, 2);
+  back.trigger();
+  chart->runToQuiescence();
+  EXPECT_EQ(calls, 4);
+}
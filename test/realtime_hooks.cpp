@@ -0,0 +1,195 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstdlib>
+#include <new>
+#include "realtime_hooks.hpp"
+#ifdef MOGI_STATECHART_COUNT_LOCKS
+#include <dlfcn.h>
+#include <pthread.h>
+#endif
+
+std::atomic<std::thread::id> realtime_hooks::watched{};
+std::atomic<uint64_t> realtime_hooks::allocations{0};
+std::atomic<uint64_t> realtime_hooks::locks{0};
+
+#ifdef MOGI_STATECHART_COUNT_ALLOCATIONS
+/* Every replaceable form, so that no allocation escapes the count and every
+ * block is freed the way it was allocated: malloc() / free(), or
+ * aligned_alloc() / free() for over-aligned types. Kept out of the tests'
+ * translation unit, where inlining them into the library's allocators
+ * would pair free() with operator new (-Wmismatched-new-delete).
+ */
+namespace
+{
+
+void * allocate(size_t size)
+{
+  if (realtime_hooks::watched.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+    realtime_hooks::allocations++;
+  }
+  return std::malloc(size ? size : 1);
+}
+
+void * allocateOrThrow(size_t size)
+{
+  auto p = allocate(size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+}  // namespace
+
+void * operator new(size_t size)
+{
+  return allocateOrThrow(size);
+}
+
+void * operator new[](size_t size)
+{
+  return allocateOrThrow(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return allocate(size);
+}
+
+void operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p, size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+#if defined(__cpp_aligned_new)
+namespace
+{
+
+void * allocateAligned(size_t size, std::align_val_t alignment)
+{
+  if (realtime_hooks::watched.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+    realtime_hooks::allocations++;
+  }
+  auto align = static_cast<size_t>(alignment);
+  /* aligned_alloc() wants a multiple of the alignment */
+  return std::aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align);
+}
+
+void * allocateAlignedOrThrow(size_t size, std::align_val_t alignment)
+{
+  auto p = allocateAligned(size, alignment);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+}  // namespace
+
+void * operator new(size_t size, std::align_val_t alignment)
+{
+  return allocateAlignedOrThrow(size, alignment);
+}
+
+void * operator new[](size_t size, std::align_val_t alignment)
+{
+  return allocateAlignedOrThrow(size, alignment);
+}
+
+void * operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return allocateAligned(size, alignment);
+}
+
+void * operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return allocateAligned(size, alignment);
+}
+
+void operator delete(void * p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p, size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  std::free(p);
+}
+#endif
+#endif
+
+#ifdef MOGI_STATECHART_COUNT_LOCKS
+/* std::mutex, shared_ptr atomics and the like all end up here */
+extern "C" int pthread_mutex_lock(pthread_mutex_t * mutex)
+{
+  using LockT = int (*)(pthread_mutex_t *);
+  static auto next = reinterpret_cast<LockT>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+  if (realtime_hooks::watched.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+    realtime_hooks::locks++;
+  }
+  return next(mutex);
+}
+#endif
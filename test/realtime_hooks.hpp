@@ -0,0 +1,44 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef REALTIME_HOOKS_HPP_
+#define REALTIME_HOOKS_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+/* the hooks of realtime_hooks.cpp replace operator new and
+ * pthread_mutex_lock for the whole executable, which is why the real-time
+ * tests have one of their own
+ */
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define MOGI_STATECHART_COUNT_ALLOCATIONS 1
+#if defined(__GLIBC__)
+#define MOGI_STATECHART_COUNT_LOCKS 1
+#endif
+#endif
+
+namespace realtime_hooks
+{
+
+/* allocations and mutex locks made by the watched thread */
+extern std::atomic<std::thread::id> watched;
+extern std::atomic<uint64_t> allocations;
+extern std::atomic<uint64_t> locks;
+
+}  // namespace realtime_hooks
+
+#endif  // REALTIME_HOOKS_HPP_
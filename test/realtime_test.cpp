@@ -0,0 +1,138 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+#include "realtime_hooks.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::RealTimeOptions;
+using mogi::statechart::State;
+using realtime_hooks::allocations;
+using realtime_hooks::locks;
+using realtime_hooks::watched;
+
+namespace
+{
+
+/* a ring of states cycled by guards and by events triggered from the test
+ * thread, with every kind of callback set
+ */
+class RealTimeTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    chart = Chart::createChart("rt");
+    for (int i = 0; i < 4; ++i) {
+      states.push_back(chart->createState("s" + std::to_string(i)));
+    }
+    chart->getInitialState()->createTransition(states[0]);
+    for (size_t i = 0; i < states.size(); ++i) {
+      auto next = states[(i + 1) % states.size()];
+      if (i % 2) {
+        states[i]->createTransition(next)->addEvent(event);
+      } else {
+        states[i]->createTransition(next, [this]() {actions++;})->createGuard(
+          [this]() {return ++guards % 3 == 0;});
+      }
+      states[i]->setCallbackEntry([this]() {entries++;});
+      states[i]->setCallbackDo(
+        [this]() {
+          watched.store(std::this_thread::get_id(), std::memory_order_relaxed);
+          dos++;
+        });
+      states[i]->setCallbackExit([this]() {exits++;});
+    }
+    chart->createStateChangeCallback([this](const std::string &) {changes++;});
+  }
+
+  void TearDown() override
+  {
+    chart->stop();
+    watched.store(std::thread::id{});
+  }
+
+  /* triggers the event until the chart went around the ring n more times */
+  void cycle(int n)
+  {
+    auto target = changes.load() + n * static_cast<int>(states.size());
+    while (changes.load() < target) {
+      event.trigger();
+      std::this_thread::yield();
+    }
+  }
+
+  std::shared_ptr<Chart> chart;
+  std::vector<std::shared_ptr<State>> states;
+  Event event{"tick"};
+  std::atomic<int> guards{0};
+  std::atomic<int> actions{0};
+  std::atomic<int> entries{0};
+  std::atomic<int> dos{0};
+  std::atomic<int> exits{0};
+  std::atomic<int> changes{0};
+};
+
+#ifdef MOGI_STATECHART_COUNT_ALLOCATIONS
+TEST_F(RealTimeTest, lockedStepsDoNotAllocateNorLock)
+{
+  chart->lock();
+  chart->spinAsync();
+  /* warm up: every state visited, every cache filled */
+  cycle(2);
+
+  allocations.store(0);
+  locks.store(0);
+  cycle(20);
+  EXPECT_EQ(allocations.load(), 0u);
+  EXPECT_EQ(locks.load(), 0u);
+  EXPECT_GT(dos.load(), 0);
+}
+#endif
+
+TEST_F(RealTimeTest, periodPacesSteps)
+{
+  RealTimeOptions options;
+  options.period = std::chrono::milliseconds(2);
+  options.prefaultStack = 64 * 1024;
+  chart->spinAsync(options);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  chart->stop();
+  /* one do per step at most, 50 steps in 100 ms */
+  EXPECT_GT(dos.load(), 10);
+  EXPECT_LE(dos.load(), 60);
+}
+
+TEST_F(RealTimeTest, refusedSettingThrows)
+{
+  RealTimeOptions options;
+  options.priority = 1000;
+  EXPECT_THROW(chart->spinAsync(options), std::runtime_error);
+  EXPECT_FALSE(chart->isRunning());
+  /* starts fine once the setting is dropped */
+  chart->spinAsync();
+  EXPECT_TRUE(chart->isRunning());
+}
+
+}  // namespace
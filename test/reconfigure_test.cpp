@@ -0,0 +1,170 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/rcu.hpp"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::Rcu;
+
+namespace
+{
+
+/* waits for cond, or gives up after a while */
+template<typename CondT>
+bool eventually(CondT cond)
+{
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!cond()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST(RcuTest, snapshotsOutliveUpdates)
+{
+  Rcu<std::vector<int>> cell{{1, 2}};
+  auto before = cell.read();
+  cell.update([](std::vector<int> & v) {v.push_back(3);});
+  EXPECT_EQ(*before, std::vector<int>({1, 2}));
+  EXPECT_EQ(*cell.read(), std::vector<int>({1, 2, 3}));
+  cell.publish({4});
+  EXPECT_EQ(*cell.read(), std::vector<int>({4}));
+  EXPECT_EQ(cell.version(), 2u);
+}
+
+TEST(RcuTest, writesCopyOnceUntilRead)
+{
+  /* counts the copies of the value */
+  struct Counted
+  {
+    Counted() = default;
+    Counted(const Counted & other)
+    : values(other.values), copies(other.copies + 1) {}
+    std::vector<int> values;
+    int copies{0};
+  };
+  Rcu<Counted> cell;
+  for (int i = 0; i < 1000; ++i) {
+    cell.update([i](Counted & c) {c.values.push_back(i);});
+  }
+  EXPECT_EQ(cell.version(), 1000u);
+  auto snapshot = cell.read();
+  EXPECT_EQ(snapshot->values.size(), 1000u);
+  EXPECT_EQ(snapshot->copies, 1);
+  /* a write after a read copies again, the snapshot stays as it was */
+  cell.update([](Counted & c) {c.values.push_back(-1);});
+  EXPECT_EQ(cell.readCached().copies, 2);
+  EXPECT_EQ(snapshot->values.size(), 1000u);
+
+  /* a failed write leaves the value unchanged */
+  EXPECT_THROW(
+    cell.update([](Counted &) {throw std::runtime_error("no");}),
+    std::runtime_error);
+  EXPECT_EQ(cell.read()->values.size(), 1001u);
+}
+
+TEST(ReconfigureTest, runningChart)
+{
+  /* initial ---> idle, everything else is added while running */
+  Event go{"go"};
+  auto chart = Chart::createChart("chart");
+  auto idle = chart->createState("idle");
+  chart->getInitialState()->createTransition(idle);
+  std::atomic<int> ticks{0};
+  idle->setCallbackDo([&ticks]() {ticks++;});
+  chart->spinAsync();
+  ASSERT_TRUE(eventually([&idle]() {return idle->isActive();}));
+
+  auto busy = chart->createState("busy");
+  std::atomic<bool> entered{false};
+  busy->setCallbackEntry([&entered]() {entered = true;});
+  idle->createTransition(busy)->addEvent(go);
+  std::vector<std::string> changes;
+  std::atomic<size_t> changeCount{0};
+  chart->createStateChangeCallback(
+    [&](const std::string & state) {
+      changes.push_back(state);
+      changeCount++;
+    });
+  /* replaced callbacks take effect without stopping the chart */
+  std::atomic<int> replaced{0};
+  idle->setCallbackDo([&replaced]() {replaced++;});
+  EXPECT_TRUE(eventually([&replaced]() {return replaced.load() > 0;}));
+
+  go.trigger();
+  EXPECT_TRUE(eventually([&entered]() {return entered.load();}));
+  EXPECT_TRUE(eventually([&changeCount]() {return changeCount.load() == 1;}));
+  chart->stop();
+  EXPECT_EQ(chart->getCurrentStateName(), "busy");
+  EXPECT_EQ(changes, std::vector<std::string>({"busy"}));
+}
+
+TEST(ReconfigureTest, writersRaceTheChart)
+{
+  /* initial ---> a <---[flip]---> b, with guards and transitions churning */
+  Event flip{"flip"};
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  chart->getInitialState()->createTransition(a);
+  auto ab = a->createTransition(b);
+  ab->addEvent(flip);
+  b->createTransition(a)->addEvent(flip);
+  chart->spinAsync();
+
+  std::atomic<bool> done{false};
+  std::thread writer{[&]() {
+      int i = 0;
+      while (!done) {
+        /* extra states are never entered, their transitions are free to
+         * change. A transition created out of an active state is live right
+         * away, it would be taken before its guards are added
+         */
+        auto extra = chart->createState("extra" + std::to_string(i % 8));
+        auto t = extra->createTransition(a);
+        t->createGuard([]() {return false;});
+        auto g = ab->createGuard([]() {return true;});
+        a->setCallbackDo([i]() {(void)i;});
+        ab->removeGuard(g);
+        chart->removeState(extra);
+        ++i;
+      }
+    }};
+  for (int i = 0; i < 200; ++i) {
+    flip.trigger();
+  }
+  done = true;
+  writer.join();
+  chart->stop();
+  auto current = chart->getCurrentStateName();
+  EXPECT_TRUE(current == "a" || current == "b");
+  EXPECT_EQ(ab->getGuardCount(), 0);
+  EXPECT_EQ(chart->getStateCount(), 4);
+}
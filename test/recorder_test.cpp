@@ -0,0 +1,167 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include "mogi_statechart/recorder.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::EventLog;
+using mogi::statechart::EventRecorder;
+using mogi::statechart::EventReplayer;
+using mogi::statechart::LogRecord;
+
+namespace
+{
+
+/* initial -> idle -[go]-> running -[stop]-> idle
+ *                         running -[halt]-> final
+ * with swapped set, go leads to final instead
+ */
+std::shared_ptr<Chart> makeChart(Event & go, Event & stop, Event & halt, bool swapped = false)
+{
+  auto chart = Chart::createChart("machine");
+  auto idle = chart->createState("idle");
+  auto running = chart->createState("running");
+  chart->getInitialState()->createTransition(idle);
+  idle->createTransition(swapped ? chart->getFinalState() : running)->addEvent(go);
+  running->createTransition(idle)->addEvent(stop);
+  running->createTransition(chart->getFinalState())->addEvent(halt);
+  return chart;
+}
+
+std::string record(int cycles, std::chrono::milliseconds pause = std::chrono::milliseconds(0))
+{
+  Event go{"go"}, stop{"stop"}, halt{"halt"}, unrelated{"unrelated"};
+  auto chart = makeChart(go, stop, halt);
+  std::ostringstream out;
+  EventRecorder recorder{out};
+  recorder.watch(go);
+  recorder.watch(stop);
+  recorder.watch(halt);
+  recorder.watch(unrelated);
+  recorder.watch(chart);
+
+  chart->spinToState("idle");
+  for (int i = 0; i < cycles; ++i) {
+    go.trigger();
+    chart->spinOnce();
+    unrelated.trigger();
+    std::this_thread::sleep_for(pause);
+    stop.trigger();
+    chart->spinOnce();
+  }
+  go.trigger();
+  chart->spinOnce();
+  halt.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(recorder.recordCount(), 5u * cycles + 6u);
+  recorder.flush();
+  return out.str();
+}
+
+}  // namespace
+
+TEST(RecorderTest, recordAndReplay)
+{
+  std::istringstream in{record(10)};
+  auto log = EventLog::read(in);
+  /* 4 events, the chart and its 4 states */
+  EXPECT_EQ(log.names.size(), 9u);
+  ASSERT_EQ(log.records.size(), 56u);
+  EXPECT_EQ(log.records[0].type, LogRecord::Type::StateChange);
+  EXPECT_EQ(log.name(log.records[0].source), "machine");
+  EXPECT_EQ(log.name(log.records[0].state), "initial");
+  EXPECT_EQ(log.records[2].type, LogRecord::Type::Trigger);
+  EXPECT_EQ(log.name(log.records[2].source), "go");
+  for (size_t i = 1; i < log.records.size(); ++i) {
+    EXPECT_GE(log.records[i].time, log.records[i - 1].time);
+  }
+
+  Event go{"go"}, stop{"stop"}, halt{"halt"};
+  auto chart = makeChart(go, stop, halt);
+  EventReplayer replayer{log};
+  replayer.bind("go", go);
+  replayer.bind("stop", stop);
+  replayer.bind("halt", halt);
+  auto result = replayer.replay(chart);
+  EXPECT_EQ(result.events, 22u);
+  EXPECT_EQ(result.skipped, 10u);
+  EXPECT_EQ(result.transitions, 24u);
+  EXPECT_EQ(result.divergedAt, -1);
+  EXPECT_EQ(chart->getCurrentStateName(), "final");
+
+  /* a chart that behaves differently is caught at the first difference */
+  auto other = makeChart(go, stop, halt, true);
+  result = replayer.replay(other);
+  EXPECT_EQ(result.divergedAt, 2);
+}
+
+TEST(RecorderTest, realTimePace)
+{
+  std::istringstream in{record(2, std::chrono::milliseconds(20))};
+  EventReplayer replayer{EventLog::read(in)};
+  Event go{"go"}, stop{"stop"}, halt{"halt"};
+  replayer.bind("go", go);
+  replayer.bind("stop", stop);
+  replayer.bind("halt", halt);
+
+  auto result = replayer.replay(makeChart(go, stop, halt), EventReplayer::Pace::RealTime);
+  EXPECT_EQ(result.divergedAt, -1);
+  EXPECT_GE(result.elapsed, std::chrono::milliseconds(40));
+}
+
+TEST(RecorderTest, malformedLogs)
+{
+  auto data = record(3);
+  /* a log cut short keeps its complete records */
+  std::istringstream cut{data.substr(0, data.size() - 2)};
+  auto log = EventLog::read(cut);
+  EXPECT_EQ(log.records.size(), 20u);
+
+  std::istringstream garbage{"definitely not a log"};
+  EXPECT_THROW(EventLog::read(garbage), std::runtime_error);
+  EXPECT_THROW(EventLog::readFile("/nonexistent/log.bin"), std::runtime_error);
+}
+
+TEST(RecorderTest, destroyedWhileTriggered)
+{
+  /* the event outlives the recorder, triggers from another thread keep
+   * coming while it is destroyed
+   */
+  Event tick{"tick"};
+  std::atomic<bool> done{false};
+  std::thread producer{[&]() {
+      while (!done.load()) {
+        tick.trigger();
+      }
+    }};
+  for (int i = 0; i < 200; ++i) {
+    std::stringstream out;
+    auto recorder = std::make_unique<EventRecorder>(out);
+    recorder->watch(tick);
+    std::this_thread::yield();
+    recorder.reset();
+  }
+  done.store(true);
+  producer.join();
+  /* the watched event still triggers fine */
+  tick.trigger();
+}
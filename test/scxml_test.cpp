@@ -0,0 +1,247 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include "gtest/gtest.h"
+#include "mogi_statechart/scxml.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::ScxmlRegistry;
+
+TEST(ScxmlTest, flatChart)
+{
+  /*
+   *          [go]<ready>          [stop]/log
+   * initial ---> idle -----> running -----> done(final)
+   */
+  const std::string doc = R"(<?xml version="1.0" encoding="UTF-8"?>
+<!-- a simple machine -->
+<scxml xmlns="http://www.w3.org/2005/07/scxml" version="1.0"
+       name="machine" initial="idle">
+  <datamodel><data id="ignored"/></datamodel>
+  <state id="idle">
+    <onentry><script>enterIdle</script></onentry>
+    <transition event="go" cond="ready &amp;&amp; powered" target="running"/>
+  </state>
+  <state id="running">
+    <onexit><script src="leaveRunning"/></onexit>
+    <transition event="stop" target="done">
+      <script>log</script>
+    </transition>
+  </state>
+  <final id="done"/>
+</scxml>)";
+
+  int idleEntries{0}, runningExits{0}, logs{0};
+  bool ready{false};
+  ScxmlRegistry registry;
+  registry.registerAction("enterIdle", [&idleEntries]() {idleEntries++;});
+  registry.registerAction("leaveRunning", [&runningExits]() {runningExits++;});
+  registry.registerAction("log", [&logs]() {logs++;});
+  registry.registerGuard("ready", [&ready]() {return ready;});
+  registry.registerGuard("powered", []() {return true;});
+
+  ScxmlLoader loader{registry};
+  auto chart = loader.loadString(doc);
+  ASSERT_NE(chart, nullptr);
+  EXPECT_EQ(chart->name(), "machine");
+  EXPECT_EQ(chart->getStateCount(), 4);
+  EXPECT_TRUE(chart->hasState("idle"));
+  EXPECT_TRUE(chart->hasState("running"));
+  ASSERT_TRUE(loader.hasEvent("go"));
+  ASSERT_TRUE(loader.hasEvent("stop"));
+  EXPECT_FALSE(loader.hasEvent("ready"));
+
+  chart->spinToState("idle");
+  EXPECT_EQ(idleEntries, 1);
+
+  /* guard not satisfied, the event is consumed without a transition */
+  loader.event("go").trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "idle");
+
+  ready = true;
+  loader.event("go").trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "running");
+
+  loader.event("stop").trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "final");
+  EXPECT_EQ(runningExits, 1);
+  EXPECT_EQ(logs, 1);
+}
+
+TEST(ScxmlTest, compoundState)
+{
+  /* outer: initial -> work{a -> b -> final} -> done
+   * [finish] out of the compound state is owned by the outer chart
+   */
+  const std::string doc = R"(
+<scxml name="outer">
+  <state id="work">
+    <transition event="finish" target="done"/>
+    <initial><transition target="b"/></initial>
+    <state id="a"/>
+    <state id="b">
+      <transition event="next" target="end"/>
+    </state>
+    <final id="end"/>
+  </state>
+  <final id="done"/>
+</scxml>)";
+
+  Event finish{"finish"};
+  ScxmlRegistry registry;
+  registry.registerEvent("finish", finish);
+  ScxmlLoader loader{registry};
+  auto chart = loader.loadString(doc);
+
+  EXPECT_EQ(&loader.event("finish"), &finish);
+  EXPECT_EQ(chart->getStateCount(), 3);
+  ASSERT_TRUE(chart->hasState("work"));
+
+  chart->spinToState("work");
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateNameFull(), "work:b");
+
+  loader.event("next").trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateNameFull(), "work:final");
+
+  finish.trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "final");
+}
+
+TEST(ScxmlTest, doneState)
+{
+  const std::string doc = R"(
+<scxml name="outer">
+  <state id="work">
+    <transition event="done.state.work" target="done"/>
+    <state id="a">
+      <transition event="next" target="end"/>
+    </state>
+    <final id="end"/>
+  </state>
+  <final id="done"/>
+</scxml>)";
+
+  ScxmlRegistry registry;
+  ScxmlLoader loader{registry};
+  auto chart = loader.loadString(doc);
+  EXPECT_FALSE(loader.hasEvent("done.state.work"));
+
+  chart->spinToState("work");
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateNameFull(), "work:a");
+
+  loader.event("next").trigger();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "final");
+}
+
+TEST(ScxmlTest, finalActionsAreChained)
+{
+  const std::string doc = R"(
+<scxml name="machine" initial="a">
+  <state id="a">
+    <transition event="ok" target="passed"/>
+    <transition event="ko" target="failed"/>
+  </state>
+  <final id="passed"><onentry><script>report</script></onentry></final>
+  <final id="failed"><onentry><script>alarm</script></onentry></final>
+</scxml>)";
+
+  int reports{0}, alarms{0};
+  ScxmlRegistry registry;
+  registry.registerAction("report", [&reports]() {reports++;});
+  registry.registerAction("alarm", [&alarms]() {alarms++;});
+  ScxmlLoader loader{registry};
+  auto chart = loader.loadString(doc);
+
+  /* both are the chart's final state, entering it runs both */
+  chart->spinToState("a");
+  loader.event("ko").trigger();
+  chart->spinOnce();
+  chart->spinOnce();
+  EXPECT_EQ(chart->getCurrentStateName(), "final");
+  EXPECT_EQ(reports, 1);
+  EXPECT_EQ(alarms, 1);
+}
+
+TEST(ScxmlTest, characterReferences)
+{
+  ScxmlLoader loader;
+  auto chart = loader.loadString("<scxml><state id='&#x41;&#66;&#x20AC;'/></scxml>");
+  EXPECT_TRUE(chart->hasState("AB\xE2\x82\xAC"));
+
+  for (auto reference : {"&#xZZ;", "&#;", "&#x;", "&#12a;", "&#x110000;", "&#99999999999999999999;",
+      "&#xD800;", "&#0;"})
+  {
+    EXPECT_THROW(
+      loader.loadString(std::string{"<scxml><state id='"} + reference + "'/></scxml>"),
+      std::runtime_error) << reference;
+  }
+}
+
+TEST(ScxmlTest, rejectedDocuments)
+{
+  ScxmlLoader loader;
+  /* unknown action */
+  EXPECT_THROW(
+    loader.loadString(
+      "<scxml><state id='a'><onentry><script>nope</script></onentry></state></scxml>"),
+    std::runtime_error);
+  /* unknown guard */
+  EXPECT_THROW(
+    loader.loadString(
+      "<scxml><state id='a'><transition cond='nope' target='a'/></state></scxml>"),
+    std::runtime_error);
+  /* target in another chart */
+  EXPECT_THROW(
+    loader.loadString(
+      "<scxml><state id='a'><state id='b'/></state>"
+      "<state id='c'><transition target='b'/></state></scxml>"),
+    std::runtime_error);
+  /* parallel states */
+  EXPECT_THROW(
+    loader.loadString("<scxml><parallel id='p'/></scxml>"),
+    std::runtime_error);
+  /* actions of an initial transition, rejected before looking them up */
+  std::istringstream initialScript{
+    "<scxml><state id='a'><initial><transition target='b'><script>go</script>"
+    "</transition></initial><state id='b'/></state></scxml>"};
+  EXPECT_THROW(ScxmlLoader::parse(initialScript), std::runtime_error);
+  /* duplicated ids */
+  EXPECT_THROW(
+    loader.loadString("<scxml><state id='a'/><state id='a'/></scxml>"),
+    std::runtime_error);
+  /* malformed */
+  EXPECT_THROW(loader.loadString("<scxml><state id='a'>"), std::runtime_error);
+  EXPECT_THROW(loader.loadString("<state id='a'/>"), std::runtime_error);
+  /* content after the document element */
+  EXPECT_THROW(loader.loadString("<scxml></scxml><state id='a'/>"), std::runtime_error);
+  EXPECT_THROW(loader.loadString("<scxml/><final id='a'/>"), std::runtime_error);
+  EXPECT_THROW(loader.loadString("<scxml></scxml><scxml></scxml>"), std::runtime_error);
+  EXPECT_THROW(loader.loadFile("/nonexistent/chart.scxml"), std::runtime_error);
+  EXPECT_THROW(loader.event("nope"), std::runtime_error);
+}
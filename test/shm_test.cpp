@@ -0,0 +1,186 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include "mogi_statechart/shm_transport.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::ShmEventReceiver;
+using mogi::statechart::ShmEventSender;
+
+namespace
+{
+
+std::string ringName(const std::string & test)
+{
+  return "/mogi_statechart_" + test + "_" + std::to_string(getpid());
+}
+
+}  // namespace
+
+TEST(ShmTransportTest, deliversWithPayload)
+{
+  Event go{"go"};
+  auto chart = Chart::createChart("chart");
+  auto s1 = chart->createState("s1");
+  chart->getInitialState()->createTransition(s1);
+  s1->createTransition(chart->getFinalState())->addEvent(go);
+  chart->spinToState("s1");
+
+  ShmEventReceiver receiver{ringName("payload"), chart, 8, 16};
+  int32_t level = 0;
+  receiver.bind(
+    7, go, [&level](const void * data, size_t size) {
+      ASSERT_EQ(size, sizeof(level));
+      std::memcpy(&level, data, size);
+    });
+
+  ShmEventSender sender{receiver.name()};
+  EXPECT_EQ(sender.maxPayload(), 16u);
+  EXPECT_TRUE(sender.sendValue(7, int32_t{42}));
+  EXPECT_TRUE(sender.send(3));
+  EXPECT_EQ(receiver.poll(), 2u);
+  EXPECT_EQ(level, 42);
+  EXPECT_EQ(receiver.receivedCount(), 1u);
+  EXPECT_EQ(receiver.discardedCount(), 1u);
+
+  chart->spinOnce();
+  EXPECT_TRUE(chart->getFinalState()->isActive());
+}
+
+TEST(ShmTransportTest, limits)
+{
+  auto chart = Chart::createChart("chart");
+  EXPECT_THROW(ShmEventSender{ringName("missing")}, std::runtime_error);
+
+  ShmEventReceiver receiver{ringName("limits"), chart, 4, 8};
+  ShmEventSender sender{receiver.name()};
+  char big[9] = {};
+  EXPECT_THROW(sender.send(1, big, sizeof(big)), std::runtime_error);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(sender.send(1, big, 8));
+  }
+  EXPECT_FALSE(sender.send(1));
+  EXPECT_EQ(receiver.droppedCount(), 1u);
+  EXPECT_EQ(receiver.poll(), 4u);
+  EXPECT_TRUE(sender.send(1));
+}
+
+TEST(ShmTransportTest, oversizedPayload)
+{
+  Event go{"go"};
+  auto chart = Chart::createChart("chart");
+  ShmEventReceiver receiver{ringName("oversized"), chart, 4, 8};
+  bool handled = false;
+  receiver.bind(7, go, [&handled](const void *, size_t) {handled = true;});
+  ShmEventSender sender{receiver.name()};
+  EXPECT_TRUE(sender.send(7));
+
+  /* a sender lying about the size, and about the ring's maxPayload */
+  int fd = shm_open(receiver.name().c_str(), O_RDWR, 0);
+  ASSERT_GE(fd, 0);
+  auto memory = static_cast<char *>(
+    mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  close(fd);
+  ASSERT_NE(memory, MAP_FAILED);
+  const uint32_t size = 1 << 20;
+  const uint64_t maxPayload = size;
+  /* RingHeader::maxPayload, then the size of the first slot after the header */
+  std::memcpy(memory + 3 * sizeof(uint64_t), &maxPayload, sizeof(maxPayload));
+  std::memcpy(memory + 256 + sizeof(uint64_t) + sizeof(uint32_t), &size, sizeof(size));
+  munmap(memory, 4096);
+
+  EXPECT_EQ(receiver.poll(), 1u);
+  EXPECT_FALSE(handled);
+  EXPECT_EQ(receiver.receivedCount(), 0u);
+  EXPECT_EQ(receiver.discardedCount(), 1u);
+}
+
+TEST(ShmTransportTest, ownership)
+{
+  auto chart = Chart::createChart("chart");
+  auto name = ringName("ownership");
+  {
+    ShmEventReceiver receiver{name, chart};
+    /* a live receiver keeps its ring */
+    EXPECT_THROW((ShmEventReceiver{name, chart}), std::runtime_error);
+    ShmEventSender sender{name};
+    EXPECT_TRUE(sender.send(1));
+
+    /* a truncated ring is refused by senders */
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(ftruncate(fd, 512), 0);
+    close(fd);
+    EXPECT_THROW(ShmEventSender{name}, std::runtime_error);
+  }
+
+  /* the leftover of a receiver that died is replaced */
+  auto child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    new ShmEventReceiver{name, Chart::createChart("child")};
+    _exit(0);
+  }
+  int status = 0;
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+  ASSERT_TRUE(WIFEXITED(status));
+  ShmEventSender leftover{name};
+  ShmEventReceiver receiver{name, chart};
+  ShmEventSender sender{name};
+  EXPECT_TRUE(sender.send(1));
+  EXPECT_EQ(receiver.poll(), 1u);
+}
+
+TEST(ShmTransportTest, runningChart)
+{
+  Event ping{"ping"};
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(ping);
+
+  ShmEventReceiver receiver{ringName("running"), chart};
+  receiver.bind(1, ping);
+  receiver.start();
+  chart->spinAsync();
+  ShmEventSender sender{receiver.name()};
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!a->isActive() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  sender.send(1);
+  while (!b->isActive() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  EXPECT_TRUE(b->isActive());
+  receiver.stop();
+  chart->stop();
+}
@@ -0,0 +1,174 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::State;
+
+namespace
+{
+
+const int producerCount = 8;
+const int eventsPerProducer = 200;
+
+/* a single state with one self transition per producer, each producer
+ * sending its own event and waiting for the chart to consume it before
+ * sending the next one. See benchmark/producer_stress for the full harness
+ */
+class StressTest : public ::testing::Test
+{
+protected:
+  struct Producer
+  {
+    Event event{"e"};
+    std::atomic<uint64_t> taken{0};
+    std::atomic<uint64_t> consumed{0};
+    uint64_t sent{0};
+  };
+
+  void SetUp() override
+  {
+    chart = Chart::createChart("stress");
+    running = chart->createState("running");
+    chart->getInitialState()->createTransition(running);
+    chart->setEventQueueCapacity(producerCount);
+    for (auto & producer : producers) {
+      auto transition = running->createTransition(
+        running, [&producer, this]() {
+          producer.taken++;
+          steps++;
+        });
+      transition->addEvent(producer.event);
+      transition->createGuard([&producer]() {producer.consumed++; return true;});
+    }
+  }
+
+  void TearDown() override
+  {
+    chart->stop();
+  }
+
+  void waitUntilRunning()
+  {
+    while (!running->isActive()) {
+      std::this_thread::yield();
+    }
+  }
+
+  /* true if every event sent was consumed */
+  bool produce(const std::function<void(Event &)> & send)
+  {
+    std::atomic<bool> ok{true};
+    std::vector<std::thread> threads;
+    for (auto & producer : producers) {
+      threads.emplace_back(
+        [&producer, &send, &ok]() {
+          for (int i = 0; i < eventsPerProducer; ++i) {
+            auto consumedBefore = producer.consumed.load();
+            send(producer.event);
+            producer.sent++;
+            auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (producer.consumed.load() == consumedBefore) {
+              if (std::chrono::steady_clock::now() > giveUp) {
+                ok.store(false);
+                return;
+              }
+              std::this_thread::yield();
+            }
+          }
+        });
+    }
+    for (auto & t : threads) {
+      t.join();
+    }
+    return ok.load();
+  }
+
+  std::shared_ptr<Chart> chart;
+  std::shared_ptr<State> running;
+  Producer producers[producerCount];
+  std::atomic<uint64_t> steps{0};
+};
+
+}  // namespace
+
+TEST_F(StressTest, concurrentTriggers)
+{
+  chart->spinAsync();
+  waitUntilRunning();
+  EXPECT_TRUE(produce([](Event & event) {event.trigger();}));
+  chart->stop();
+
+  uint64_t taken = 0;
+  for (auto & producer : producers) {
+    EXPECT_EQ(producer.consumed.load(), producer.sent);
+    /* triggers consumed in the same step are merged into one transition */
+    EXPECT_LE(producer.taken.load(), producer.sent);
+    taken += producer.taken.load();
+  }
+  EXPECT_EQ(taken, steps.load());
+  EXPECT_GT(taken, 0u);
+}
+
+TEST_F(StressTest, concurrentPosts)
+{
+  chart->spinAsync();
+  waitUntilRunning();
+  EXPECT_TRUE(
+    produce(
+      [this](Event & event) {
+        while (!chart->post(event)) {
+          std::this_thread::yield();
+        }
+      }));
+  chart->stop();
+
+  /* one event per step, none merged */
+  for (auto & producer : producers) {
+    EXPECT_EQ(producer.consumed.load(), producer.sent);
+    EXPECT_EQ(producer.taken.load(), producer.sent);
+  }
+}
+
+TEST_F(StressTest, triggersWhileRestarting)
+{
+  chart->spinAsync();
+  waitUntilRunning();
+  std::atomic<bool> done{false};
+  std::thread restarter{
+    [this, &done]() {
+      while (!done.load()) {
+        chart->stop();
+        chart->spinAsync();
+        chart->lock();
+        chart->unlock();
+      }
+    }};
+  EXPECT_TRUE(produce([](Event & event) {event.trigger();}));
+  done.store(true);
+  restarter.join();
+  EXPECT_TRUE(chart->isRunning());
+  EXPECT_TRUE(running->isActive());
+}
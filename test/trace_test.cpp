@@ -0,0 +1,181 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+#include "mogi_statechart/trace.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::Tracer;
+
+namespace
+{
+
+std::string tracePath()
+{
+  return ::testing::TempDir() + "mogi_statechart_trace.json";
+}
+
+std::string readTrace()
+{
+  std::ifstream file{tracePath()};
+  std::stringstream text;
+  text << file.rdbuf();
+  return text.str();
+}
+
+size_t count(const std::string & text, const std::string & what)
+{
+  size_t n = 0;
+  for (auto at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+/* the first slice called name to end: start and end in us, thread */
+struct Span
+{
+  double start{-1};
+  double end{-1};
+  unsigned tid{0};
+
+  bool contains(const Span & other) const
+  {
+    return start <= other.start && other.end <= end && tid == other.tid;
+  }
+};
+
+Span span(const std::string & trace, const std::string & name)
+{
+  Span s;
+  auto at = trace.find("{\"name\":\"" + name + "\",\"cat\"");
+  if (at == std::string::npos) {
+    return s;
+  }
+  auto line = trace.substr(at, trace.find('\n', at) - at);
+  double duration;
+  if (std::sscanf(
+      line.c_str() + line.find("\"ts\""), "\"ts\":%lf,\"dur\":%lf,\"pid\":%*d,\"tid\":%u",
+      &s.start, &duration, &s.tid) == 3)
+  {
+    s.end = s.start + duration;
+  }
+  return s;
+}
+
+}  // namespace
+
+TEST(TraceTest, applicationSlices)
+{
+  {
+    Tracer::Slice ignored{"test", "before start"};
+  }
+  Tracer::start(tracePath());
+  EXPECT_TRUE(Tracer::isEnabled());
+  EXPECT_THROW(Tracer::start(tracePath()), std::runtime_error);
+  {
+    Tracer::Slice outer{"test", "outer"};
+    Tracer::Slice inner{"test", "in \"quotes\""};
+  }
+  std::thread{[]() {
+      Tracer::setThreadName("worker");
+      Tracer::Slice slice{"test", "other thread"};
+    }}.join();
+  Tracer::stop();
+  EXPECT_FALSE(Tracer::isEnabled());
+  {
+    Tracer::Slice ignored{"test", "after stop"};
+  }
+  Tracer::stop();
+
+  auto trace = readTrace();
+  EXPECT_EQ(trace.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", 0), 0u);
+  EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+  EXPECT_FALSE(trace.find("before start") != std::string::npos);
+  EXPECT_FALSE(trace.find("after stop") != std::string::npos);
+  EXPECT_TRUE(span(trace, "outer").contains(span(trace, "in \\\"quotes\\\"")));
+  auto other = span(trace, "other thread");
+  EXPECT_GE(other.start, 0);
+  EXPECT_NE(other.tid, span(trace, "outer").tid);
+  EXPECT_EQ(
+    count(
+      trace, "\"tid\":" + std::to_string(other.tid) + ",\"args\":{\"name\":\"worker\"}"), 1u);
+}
+
+TEST(TraceTest, buffered)
+{
+  /* several blocks of Tracer::bufferSize, from two threads */
+  const int slices = 5000;
+  Tracer::start(tracePath());
+  auto trace = []() {
+      for (int i = 0; i < slices; ++i) {
+        Tracer::Slice slice{"test", "slice"};
+      }
+    };
+  std::thread other{trace};
+  trace();
+  other.join();
+  Tracer::stop();
+  EXPECT_EQ(count(readTrace(), "\"name\":\"slice\""), 2u * slices);
+
+  EXPECT_THROW(Tracer::start("/nonexistent/directory/trace.json"), std::runtime_error);
+  EXPECT_FALSE(Tracer::isEnabled());
+}
+
+TEST(TraceTest, chartSlices)
+{
+  if (!Tracer::isCompiledIn()) {
+    GTEST_SKIP() << "built without MOGI_STATECHART_TRACING";
+  }
+  /* big: initial -> sub [initial -> a -go [guard]-> b] */
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto a = sub->createState("a");
+  auto b = sub->createState("b");
+  Event go{"go"};
+  sub->getInitialState()->createTransition(a);
+  auto ab = a->createTransition(b);
+  ab->addEvent(go);
+  ab->createGuard([]() {return true;});
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+
+  Tracer::start(tracePath());
+  for (int i = 0; i < 6; ++i) {
+    big->spinOnce();
+  }
+  go.trigger();
+  big->spinOnce();
+  big->spinOnce();
+  Tracer::stop();
+  EXPECT_EQ(big->getCurrentStateNameFull(), "sub:b");
+
+  auto trace = readTrace();
+  for (auto name : {"entry a", "do a", "exit a", "guard", "transition a -> b", "entry b"}) {
+    EXPECT_NE(span(trace, name).end, -1) << name;
+  }
+  /* the subchart's step nests in its parent's Do */
+  auto doSub = span(trace, "do sub");
+  auto stepSub = span(trace, "step sub");
+  EXPECT_TRUE(doSub.contains(stepSub));
+}
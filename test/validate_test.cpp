@@ -0,0 +1,162 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Event;
+using mogi::statechart::ValidationIssue;
+
+namespace
+{
+
+size_t count(const std::vector<ValidationIssue> & issues, ValidationIssue::Kind kind)
+{
+  return std::count_if(
+    issues.begin(), issues.end(),
+    [kind](const ValidationIssue & i) {return i.kind == kind;});
+}
+
+}  // namespace
+
+TEST(ValidateTest, findsIssues)
+{
+  using Kind = ValidationIssue::Kind;
+  auto chart = Chart::createChart("chart");
+  EXPECT_EQ(count(chart->validate(), Kind::MissingInitialTransition), 1u);
+
+  auto s1 = chart->createState("s1");
+  auto orphan = chart->createState("orphan");
+  chart->getInitialState()->createTransition(s1);
+  /* two ways out of s1 taken on every step */
+  s1->createTransition(chart->getFinalState());
+  s1->createTransition(orphan);
+  {
+    auto gone = chart->createState("gone");
+    s1->createTransition(gone)->createGuard([]() {return false;});
+    chart->removeState(gone);
+    auto removed = chart->createState("removed");
+    orphan->createTransition(removed)->createGuard([]() {return false;});
+    chart->removeState("removed");
+    /* removed is still alive through this shared_ptr */
+    auto issues = chart->validate();
+    EXPECT_EQ(count(issues, Kind::RemovedTarget), 2u);
+  }
+
+  auto issues = chart->validate();
+  EXPECT_EQ(count(issues, Kind::MissingInitialTransition), 0u);
+  EXPECT_EQ(count(issues, Kind::DanglingTransition), 2u);
+  EXPECT_EQ(count(issues, Kind::Nondeterministic), 1u);
+  EXPECT_EQ(count(issues, Kind::UnreachableState), 0u);
+  EXPECT_THROW(chart->lock(), std::runtime_error);
+  EXPECT_FALSE(chart->isLocked());
+
+  auto island = chart->createState("island");
+  issues = chart->validate();
+  ASSERT_EQ(count(issues, Kind::UnreachableState), 1u);
+  auto it = std::find_if(
+    issues.begin(), issues.end(),
+    [](const ValidationIssue & i) {return i.kind == Kind::UnreachableState;});
+  EXPECT_EQ(it->chart, "chart");
+  EXPECT_EQ(it->state, "island");
+}
+
+TEST(ValidateTest, subchartsAndTriggers)
+{
+  using Kind = ValidationIssue::Kind;
+  Event e{"e"};
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+  auto a = sub->createState("a");
+  /* same event twice without guards, then once more with a guard */
+  a->createTransition(sub->getFinalState())->addEvent(e);
+  a->createTransition(a)->addEvent(e);
+  a->createTransition(a)->createGuard([]() {return true;});
+
+  auto issues = big->validate();
+  ASSERT_EQ(issues.size(), 3u);
+  EXPECT_EQ(count(issues, Kind::MissingInitialTransition), 1u);
+  EXPECT_EQ(count(issues, Kind::UnreachableState), 1u);
+  EXPECT_EQ(count(issues, Kind::Nondeterministic), 1u);
+  for (const auto & i : issues) {
+    EXPECT_EQ(i.chart, "sub");
+  }
+  sub->getInitialState()->createTransition(a);
+  issues = big->validate();
+  ASSERT_EQ(issues.size(), 1u);
+  EXPECT_EQ(issues[0].kind, Kind::Nondeterministic);
+  EXPECT_EQ(issues[0].state, "a");
+}
+
+TEST(ValidateTest, lockedChartSteps)
+{
+  /* initial ---> a --(go)--> b --<ready>--> a
+   *                           b --(go)<!ready>--> sub [initial ---> final] ===> a
+   * built twice, one of them locked, both must make the same moves
+   */
+  Event go{"go"};
+  bool ready = false;
+  auto build = [&]() {
+      auto chart = Chart::createChart("chart");
+      auto a = chart->createState("a");
+      auto b = chart->createState("b");
+      auto sub = Chart::createChart("sub");
+      sub->getInitialState()->createTransition(sub->getFinalState());
+      chart->addSubchart(sub);
+      chart->getInitialState()->createTransition(a);
+      a->createTransition(b)->addEvent(go);
+      b->createTransition(a)->createGuard([&ready]() {return ready;});
+      auto toSub = b->createTransition(sub);
+      toSub->addEvent(go);
+      toSub->createGuard([&ready]() {return !ready;});
+      sub->createCompletionTransition(a);
+      return chart;
+    };
+  auto plain = build();
+  auto locked = build();
+  locked->lock();
+  EXPECT_TRUE(locked->isLocked());
+  EXPECT_TRUE(plain->validate().empty());
+
+  std::vector<std::string> plainMoves, lockedMoves;
+  for (int i = 0; i < 40; ++i) {
+    if (i % 5 == 0) {
+      go.trigger();
+    }
+    ready = i % 7 == 0;
+    plain->spinOnce();
+    locked->spinOnce();
+    plainMoves.push_back(plain->getCurrentStateNameFull());
+    lockedMoves.push_back(locked->getCurrentStateNameFull());
+  }
+  EXPECT_EQ(plainMoves, lockedMoves);
+
+  EXPECT_THROW(locked->createState("c"), std::runtime_error);
+  EXPECT_THROW(locked->removeState("a"), std::runtime_error);
+  auto initial = locked->getInitialState();
+  EXPECT_THROW(initial->createTransition(locked->getFinalState()), std::runtime_error);
+
+  locked->unlock();
+  EXPECT_FALSE(locked->isLocked());
+  EXPECT_NO_THROW(locked->createState("c"));
+}
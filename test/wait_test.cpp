@@ -0,0 +1,179 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "mogi_statechart/statechart.hpp"
+
+using mogi::statechart::Chart;
+using mogi::statechart::Configuration;
+using mogi::statechart::Event;
+
+namespace
+{
+
+constexpr auto timeout = std::chrono::seconds(5);
+
+}  // namespace
+
+TEST(WaitTest, waitsForStateOfRunningChart)
+{
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event go{"go"};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(go);
+  chart->spinAsync();
+
+  EXPECT_TRUE(chart->waitForState(*a, timeout));
+  EXPECT_FALSE(chart->waitForState(*b, std::chrono::milliseconds(10)));
+  std::vector<std::thread> waiters;
+  std::atomic<int> woken{0};
+  for (int i = 0; i < 4; ++i) {
+    waiters.emplace_back(
+      [&]() {
+        if (chart->waitForState(b->id(), timeout)) {
+          woken++;
+        }
+      });
+  }
+  go.trigger();
+  for (auto & w : waiters) {
+    w.join();
+  }
+  chart->stop();
+  EXPECT_EQ(woken.load(), 4);
+}
+
+TEST(WaitTest, unboundedTimeout)
+{
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event go{"go"};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(go);
+  chart->spinAsync();
+  ASSERT_TRUE(chart->waitForState(*a, timeout));
+
+  /* now + timeout would overflow into a deadline in the past */
+  std::thread trigger{
+    [&go]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      go.trigger();
+    }};
+  EXPECT_TRUE(chart->waitForState(*b, std::chrono::nanoseconds::max()));
+  trigger.join();
+  chart->stop();
+}
+
+TEST(WaitTest, waitsUntilNestedConfiguration)
+{
+  auto big = Chart::createChart("big");
+  auto sub = Chart::createChart("sub");
+  auto inner = sub->createState("inner");
+  Event go{"go"};
+  sub->getInitialState()->createTransition(inner)->addEvent(go);
+  big->addSubchart(sub);
+  big->getInitialState()->createTransition(sub);
+  big->spinAsync();
+
+  auto waiting = std::async(
+    std::launch::async, [&]() {
+      /* asked to the subchart, answered by its outmost chart */
+      return sub->waitUntil(
+        [&](const Configuration & c) {return c.depth == 2 && c.path[1] == inner->id();},
+        timeout);
+    });
+  /* sub's initial state latches go once entered */
+  EXPECT_TRUE(big->waitForState(*sub->getInitialState(), timeout));
+  go.trigger();
+  EXPECT_TRUE(waiting.get());
+  big->stop();
+}
+
+TEST(WaitTest, futuresReadyOnStateChange)
+{
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event go{"go"};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(go);
+  chart->spinOnce();
+  chart->spinOnce();
+
+  auto already = chart->whenState(a->id());
+  ASSERT_EQ(already.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_TRUE(already.get().contains(a->id()));
+
+  auto inB = chart->whenState(b->id());
+  auto final = chart->when(
+    [&chart](const Configuration & c) {return c.contains(chart->getFinalState()->id());});
+  EXPECT_EQ(inB.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+  go.trigger();
+  chart->spinOnce();
+  ASSERT_EQ(inB.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_EQ(inB.get().path[0], b->id());
+  EXPECT_EQ(final.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+}
+
+TEST(WaitTest, futureTimesOut)
+{
+  auto chart = Chart::createChart("chart");
+  auto a = chart->createState("a");
+  auto b = chart->createState("b");
+  Event go{"go"}, back{"back"};
+  chart->getInitialState()->createTransition(a);
+  a->createTransition(b)->addEvent(go);
+  b->createTransition(a)->addEvent(back);
+  chart->spinOnce();
+  chart->spinOnce();
+
+  auto never = chart->whenState(chart->getFinalState()->id(), std::chrono::nanoseconds(0));
+  auto inB = chart->whenState(b->id(), std::chrono::hours(1));
+  EXPECT_EQ(never.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+  /* given up on the next state change */
+  go.trigger();
+  chart->spinOnce();
+  ASSERT_EQ(never.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_THROW(never.get(), std::runtime_error);
+  ASSERT_EQ(inB.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+  EXPECT_EQ(inB.get().path[0], b->id());
+
+  /* an unbounded timeout doesn't overflow */
+  auto inA = chart->whenState(a->id(), std::chrono::nanoseconds::max());
+  back.trigger();
+  chart->spinOnce();
+  ASSERT_EQ(inA.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+}
+
+TEST(WaitTest, pendingFutureOfDestroyedChart)
+{
+  std::future<Configuration> never;
+  {
+    auto chart = Chart::createChart("chart");
+    chart->getInitialState()->createTransition(chart->getFinalState());
+    never = chart->whenState(chart->getFinalState()->id() + 1000);
+  }
+  EXPECT_THROW(never.get(), std::future_error);
+}
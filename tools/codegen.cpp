@@ -0,0 +1,970 @@
+// Copyright 2021 Mogi LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mogi_statechart/description.hpp"
+#include "mogi_statechart/scxml.hpp"
+
+using mogi::statechart::ChartDescription;
+using mogi::statechart::ScxmlLoader;
+using mogi::statechart::StateDescription;
+using mogi::statechart::TransitionDescription;
+
+/* mogi_statechart_codegen: turns a chart definition (SCXML or JSON) into a
+ * header holding a fully specialized state machine class.
+ *
+ * usage: mogi_statechart_codegen <input.scxml|input.json> <output.hpp>
+ *            [--class Name] [--namespace ns]
+ *
+ * The generated class template takes a `Hooks` type, every action and guard
+ * named in the definition is called as a member function of that type:
+ *   void <action>();
+ *   bool <guard>();
+ * so they can be inlined into the switch based dispatch; names that are not
+ * C++ identifiers are rejected. It follows the same
+ * Entry/Do/Exit stepping as Chart::process() and events can be fed either
+ * with trigger(EventId) or by binding a mogi::statechart::Event. As with
+ * ScxmlLoader, a transition on `done.state.<id>` out of state `<id>` is its
+ * completion transition rather than an event.
+ *
+ * JSON definitions mirror ChartDescription:
+ * {
+ *   "name": "chart", "initial": "s1",
+ *   "states": [
+ *     {"name": "s1", "entry": ["a"], "do": ["b"], "exit": ["c"],
+ *      "transitions": [
+ *        {"target": "s2", "events": ["e"], "guards": ["g"], "actions": ["t"]}],
+ *      "chart": { ... nested chart, its name is the state name ... }},
+ *     {"name": "done", "final": true}
+ *   ]
+ * }
+ */
+
+namespace
+{
+
+/* ==== a small JSON reader, just enough for chart definitions ==== */
+struct Json
+{
+  enum class Type {Null, Bool, Number, String, Array, Object} type{Type::Null};
+  bool boolean{false};
+  std::string string;
+  std::vector<Json> array;
+  std::vector<std::pair<std::string, Json>> object;
+
+  const Json * find(const std::string & key) const
+  {
+    for (const auto & kv : object) {
+      if (kv.first == key) {
+        return &kv.second;
+      }
+    }
+    return nullptr;
+  }
+};
+
+class JsonReader
+{
+public:
+  explicit JsonReader(const std::string & text)
+  : text_(text) {}
+
+  Json parse()
+  {
+    auto v = value();
+    skipSpaces();
+    if (pos_ != text_.size()) {
+      fail("trailing characters");
+    }
+    return v;
+  }
+
+private:
+  [[noreturn]] void fail(const std::string & what) const
+  {
+    throw std::runtime_error("json: offset " + std::to_string(pos_) + ": " + what);
+  }
+
+  void skipSpaces()
+  {
+    while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+      ++pos_;
+    }
+  }
+
+  bool consume(const char * s)
+  {
+    auto n = std::char_traits<char>::length(s);
+    if (text_.compare(pos_, n, s) == 0) {
+      pos_ += n;
+      return true;
+    }
+    return false;
+  }
+
+  Json value()
+  {
+    skipSpaces();
+    if (pos_ >= text_.size()) {
+      fail("unexpected end of document");
+    }
+    Json v;
+    char c = text_[pos_];
+    if (c == '{') {
+      ++pos_;
+      v.type = Json::Type::Object;
+      skipSpaces();
+      if (consume("}")) {
+        return v;
+      }
+      do {
+        skipSpaces();
+        auto key = string();
+        skipSpaces();
+        if (!consume(":")) {
+          fail("expected ':'");
+        }
+        v.object.emplace_back(std::move(key), value());
+        skipSpaces();
+      } while (consume(","));
+      if (!consume("}")) {
+        fail("expected '}'");
+      }
+    } else if (c == '[') {
+      ++pos_;
+      v.type = Json::Type::Array;
+      skipSpaces();
+      if (consume("]")) {
+        return v;
+      }
+      do {
+        v.array.push_back(value());
+        skipSpaces();
+      } while (consume(","));
+      if (!consume("]")) {
+        fail("expected ']'");
+      }
+    } else if (c == '"') {
+      v.type = Json::Type::String;
+      v.string = string();
+    } else if (consume("true")) {
+      v.type = Json::Type::Bool;
+      v.boolean = true;
+    } else if (consume("false")) {
+      v.type = Json::Type::Bool;
+    } else if (consume("null")) {
+    } else if (c == '-' || std::isdigit(static_cast<unsigned char>(c))) {
+      v.type = Json::Type::Number;
+      while (pos_ < text_.size() && std::strchr("+-.eE0123456789", text_[pos_])) {
+        v.string.push_back(text_[pos_++]);
+      }
+    } else {
+      fail(std::string("unexpected character '") + c + "'");
+    }
+    return v;
+  }
+
+  std::string string()
+  {
+    if (!consume("\"")) {
+      fail("expected a string");
+    }
+    std::string s;
+    while (true) {
+      if (pos_ >= text_.size()) {
+        fail("unterminated string");
+      }
+      char c = text_[pos_++];
+      if (c == '"') {
+        return s;
+      }
+      if (c != '\\') {
+        s.push_back(c);
+        continue;
+      }
+      if (pos_ >= text_.size()) {
+        fail("unterminated string");
+      }
+      c = text_[pos_++];
+      switch (c) {
+        case 'n': s.push_back('\n'); break;
+        case 't': s.push_back('\t'); break;
+        case 'r': s.push_back('\r'); break;
+        case 'b': s.push_back('\b'); break;
+        case 'f': s.push_back('\f'); break;
+        case 'u':
+          /* names are expected to be ASCII */
+          if (pos_ + 4 > text_.size()) {
+            fail("bad unicode escape");
+          }
+          s.push_back(static_cast<char>(std::stoi(text_.substr(pos_, 4), nullptr, 16)));
+          pos_ += 4;
+          break;
+        default: s.push_back(c); break;
+      }
+    }
+  }
+
+  const std::string & text_;
+  size_t pos_{0};
+};
+
+std::vector<std::string> strings(const Json & parent, const char * key)
+{
+  std::vector<std::string> out;
+  auto v = parent.find(key);
+  if (!v) {
+    return out;
+  }
+  if (v->type != Json::Type::Array) {
+    throw std::runtime_error(std::string("json: '") + key + "' must be an array");
+  }
+  for (const auto & s : v->array) {
+    if (s.type != Json::Type::String) {
+      throw std::runtime_error(std::string("json: '") + key + "' must hold strings");
+    }
+    out.push_back(s.string);
+  }
+  return out;
+}
+
+std::string stringOf(const Json & parent, const char * key)
+{
+  auto v = parent.find(key);
+  if (!v) {
+    return {};
+  }
+  if (v->type != Json::Type::String) {
+    throw std::runtime_error(std::string("json: '") + key + "' must be a string");
+  }
+  return v->string;
+}
+
+ChartDescription chartFromJson(const Json & j, const std::string & defaultName)
+{
+  if (j.type != Json::Type::Object) {
+    throw std::runtime_error("json: a chart must be an object");
+  }
+  ChartDescription chart;
+  chart.name = stringOf(j, "name");
+  if (chart.name.empty()) {
+    chart.name = defaultName;
+  }
+  auto states = j.find("states");
+  if (states) {
+    for (const auto & s : states->array) {
+      StateDescription state;
+      state.name = stringOf(s, "name");
+      if (state.name.empty()) {
+        throw std::runtime_error("json: state without a name in chart " + chart.name);
+      }
+      auto final = s.find("final");
+      state.isFinal = final && final->boolean;
+      state.entry = strings(s, "entry");
+      state.activity = strings(s, "do");
+      state.exit = strings(s, "exit");
+      auto transitions = s.find("transitions");
+      if (transitions) {
+        for (const auto & t : transitions->array) {
+          TransitionDescription transition;
+          transition.target = stringOf(t, "target");
+          transition.events = strings(t, "events");
+          transition.guards = strings(t, "guards");
+          transition.actions = strings(t, "actions");
+          state.transitions.push_back(std::move(transition));
+        }
+      }
+      auto sub = s.find("chart");
+      if (sub) {
+        state.subchart = std::make_shared<ChartDescription>(chartFromJson(*sub, state.name));
+      }
+      chart.states.push_back(std::move(state));
+    }
+  }
+  chart.initial = stringOf(j, "initial");
+  if (chart.initial.empty()) {
+    for (const auto & s : chart.states) {
+      if (!s.isFinal) {
+        chart.initial = s.name;
+        break;
+      }
+    }
+  }
+  return chart;
+}
+
+/* ==== flattened model ==== */
+/* turns a state or event name into a usable C++ identifier */
+std::string identifier(const std::string & name)
+{
+  static const std::set<std::string> keywords{
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
+    "case", "catch", "char", "char16_t", "char32_t", "class", "compl", "const", "constexpr",
+    "const_cast", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast",
+    "else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+    "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+    "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+    "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert",
+    "static_cast", "struct", "switch", "template", "this", "thread_local", "throw", "true",
+    "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void",
+    "volatile", "wchar_t", "while", "xor", "xor_eq"};
+  std::string id;
+  for (char c : name) {
+    id.push_back(std::isalnum(static_cast<unsigned char>(c)) ? c : '_');
+  }
+  if (id.empty() || std::isdigit(static_cast<unsigned char>(id[0]))) {
+    id.insert(0, "_");
+  }
+  if (keywords.count(id)) {
+    id.push_back('_');
+  }
+  return id;
+}
+
+/* name as a C++ string literal */
+std::string quoted(const std::string & text)
+{
+  std::string q{"\""};
+  for (auto c : text) {
+    if (c == '\n') {
+      q += "\\n";
+      continue;
+    }
+    if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\%03o", static_cast<unsigned>(c));
+      q += escaped;
+      continue;
+    }
+    if (c == '"' || c == '\\') {
+      q += '\\';
+    }
+    q += c;
+  }
+  return q + "\"";
+}
+
+struct FlatState
+{
+  std::string name;
+  std::string enumerator;
+  int region{};
+  /* region of the subchart if this state is one, -1 otherwise */
+  int subregion{-1};
+  std::vector<std::string> entry, activity, exit;
+  std::vector<int> transitions;
+};
+
+struct FlatTransition
+{
+  int src{}, dst{};
+  /* taken once the source completes, like done.state.<id> at runtime */
+  bool completion{false};
+  std::vector<int> events;
+  std::vector<std::string> guards, actions;
+};
+
+struct FlatRegion
+{
+  std::string name;
+  /* state representing this region in its parent, -1 for the top chart */
+  int parentState{-1};
+  int initialState{};
+  int finalState{};
+  int initialTarget{-1};
+};
+
+class Model
+{
+public:
+  explicit Model(const ChartDescription & top)
+  {
+    addRegion(top, -1, "");
+  }
+
+  std::vector<FlatRegion> regions;
+  std::vector<FlatState> states;
+  std::vector<FlatTransition> transitions;
+  std::vector<std::string> events;
+  std::set<std::string> actions, guards;
+
+private:
+  int addState(const std::string & name, const std::string & prefix, int region)
+  {
+    FlatState s;
+    s.name = name;
+    s.enumerator = prefix + identifier(name);
+    s.region = region;
+    if (!enumerators_.insert(s.enumerator).second) {
+      throw std::runtime_error("state " + name + " clashes with another state once flattened");
+    }
+    states.push_back(std::move(s));
+    return static_cast<int>(states.size()) - 1;
+  }
+
+  int eventId(const std::string & name)
+  {
+    auto it = eventIds_.find(name);
+    if (it != eventIds_.end()) {
+      return it->second;
+    }
+    if (!eventEnumerators_.insert(identifier(name)).second) {
+      throw std::runtime_error("event " + name + " clashes with another event once flattened");
+    }
+    events.push_back(name);
+    eventIds_.emplace(name, static_cast<int>(events.size()) - 1);
+    return static_cast<int>(events.size()) - 1;
+  }
+
+  int addRegion(const ChartDescription & chart, int parentState, const std::string & prefix)
+  {
+    int r = static_cast<int>(regions.size());
+    regions.emplace_back();
+    regions[r].name = chart.name;
+    regions[r].parentState = parentState;
+    regions[r].initialState = addState("initial", prefix, r);
+    regions[r].finalState = addState("final", prefix, r);
+
+    std::map<std::string, int> byName{
+      {"initial", regions[r].initialState}, {"final", regions[r].finalState}};
+    std::vector<int> ids;
+    for (const auto & s : chart.states) {
+      int id = s.isFinal ? regions[r].finalState : addState(s.name, prefix, r);
+      if (!s.isFinal && !byName.emplace(s.name, id).second) {
+        throw std::runtime_error("duplicated state " + s.name + " in chart " + chart.name);
+      }
+      if (s.isFinal) {
+        byName.emplace(s.name, id);
+      }
+      ids.push_back(id);
+      auto & fs = states[id];
+      fs.entry.insert(fs.entry.end(), s.entry.begin(), s.entry.end());
+      fs.activity.insert(fs.activity.end(), s.activity.begin(), s.activity.end());
+      fs.exit.insert(fs.exit.end(), s.exit.begin(), s.exit.end());
+      actions.insert(s.entry.begin(), s.entry.end());
+      actions.insert(s.activity.begin(), s.activity.end());
+      actions.insert(s.exit.begin(), s.exit.end());
+      if (s.subchart && (!s.entry.empty() || !s.activity.empty() || !s.exit.empty())) {
+        /* same limitation as the runtime, the subchart is the state */
+        throw std::runtime_error(
+                "entry/do/exit actions on compound state " + s.name + " are not supported");
+      }
+      if (s.subchart) {
+        int sub = addRegion(*s.subchart, id, prefix + identifier(s.name) + "_");
+        states[id].subregion = sub;
+      }
+    }
+
+    auto resolve = [&byName, &chart](const std::string & name) {
+        auto it = byName.find(name);
+        if (it == byName.end()) {
+          throw std::runtime_error(
+                  "target '" + name + "' is not a state of chart " + chart.name);
+        }
+        return it->second;
+      };
+
+    for (size_t i = 0; i < chart.states.size(); ++i) {
+      for (const auto & t : chart.states[i].transitions) {
+        FlatTransition ft;
+        ft.src = ids[i];
+        ft.dst = resolve(t.target);
+        ft.completion = t.events.size() == 1 &&
+          t.events.front() == "done.state." + chart.states[i].name;
+        for (const auto & e : t.events) {
+          if (!ft.completion) {
+            ft.events.push_back(eventId(e));
+          }
+        }
+        ft.guards = t.guards;
+        ft.actions = t.actions;
+        guards.insert(t.guards.begin(), t.guards.end());
+        actions.insert(t.actions.begin(), t.actions.end());
+        transitions.push_back(std::move(ft));
+        states[ids[i]].transitions.push_back(static_cast<int>(transitions.size()) - 1);
+      }
+    }
+    if (!chart.initial.empty()) {
+      regions[r].initialTarget = resolve(chart.initial);
+    }
+    return r;
+  }
+
+  std::set<std::string> enumerators_, eventEnumerators_;
+  std::map<std::string, int> eventIds_;
+};
+
+/* ==== code emission ==== */
+class Emitter
+{
+public:
+  Emitter(const Model & m, std::string className, std::string ns, std::string source)
+  : m_(m), class_(std::move(className)), ns_(std::move(ns)), source_(std::move(source)) {}
+
+  std::string emit()
+  {
+    for (const auto & a : m_.actions) {
+      if (m_.guards.count(a)) {
+        throw std::runtime_error("'" + a + "' is used both as an action and a guard");
+      }
+    }
+    /* hooks are called by name, as member functions */
+    for (const auto & hooks : {m_.actions, m_.guards}) {
+      for (const auto & h : hooks) {
+        if (identifier(h) != h) {
+          throw std::runtime_error(
+                  "hook '" + h + "' is not a C++ identifier, it can't name a member function");
+        }
+      }
+    }
+    header();
+    o_ << "template<typename Hooks>\n";
+    o_ << "class " << class_ << "\n{\npublic:\n";
+    enums();
+    publicApi();
+    o_ << "\nprivate:\n";
+    privateMembers();
+    for (size_t r = 0; r < m_.regions.size(); ++r) {
+      region(static_cast<int>(r));
+    }
+    o_ << "};\n\n";
+    /* C++14 needs a definition once the counts are odr-used, e.g. bound to a
+     * const reference
+     */
+    for (auto count : {"stateCount", "eventCount"}) {
+      o_ << "template<typename Hooks>\nconstexpr size_t " << class_ << "<Hooks>::" << count <<
+        ";\n";
+    }
+    o_ << "\n";
+    footer();
+    return o_.str();
+  }
+
+private:
+  std::string state(int s) const {return "StateId::" + m_.states[s].enumerator;}
+
+  void header()
+  {
+    guard_ = "MOGI_STATECHART_GENERATED__";
+    for (char c : ns_ + "_" + class_) {
+      guard_.push_back(std::isalnum(static_cast<unsigned char>(c)) ?
+        static_cast<char>(std::toupper(static_cast<unsigned char>(c))) : '_');
+    }
+    guard_ += "_HPP_";
+    o_ << "// Generated by mogi_statechart_codegen from " << source_ << "\n";
+    o_ << "// Do not edit, regenerate instead.\n\n";
+    o_ << "#ifndef " << guard_ << "\n#define " << guard_ << "\n\n";
+    o_ << "#include <atomic>\n#include <cstdint>\n#include <memory>\n" <<
+      "#include <string>\n#include <vector>\n";
+    o_ << "#include \"mogi_statechart/statechart.hpp\"\n\n";
+    if (!ns_.empty()) {
+      o_ << "namespace " << ns_ << "\n{\n\n";
+    }
+    /* the name must not end the comment */
+    auto chartName = m_.regions[0].name;
+    for (auto end = chartName.find("*/"); end != std::string::npos; end = chartName.find("*/")) {
+      chartName.insert(end + 1, " ");
+    }
+    o_ << "/*!\n @class " << class_ << "\n \\brief Specialized state machine for chart `" <<
+      chartName << "`.\n\n";
+    o_ << " Hooks must provide the following member functions:\n";
+    for (const auto & a : m_.actions) {
+      o_ << " * void " << a << "();\n";
+    }
+    for (const auto & g : m_.guards) {
+      o_ << " * bool " << g << "();\n";
+    }
+    o_ << " */\n";
+  }
+
+  void footer()
+  {
+    if (!ns_.empty()) {
+      o_ << "}  // namespace " << ns_ << "\n\n";
+    }
+    o_ << "#endif  // " << guard_ << "\n";
+  }
+
+  void enums()
+  {
+    o_ << "  enum class StateId : uint16_t\n  {\n";
+    for (size_t s = 0; s < m_.states.size(); ++s) {
+      o_ << "    " << m_.states[s].enumerator << " = " << s << ",\n";
+    }
+    o_ << "  };\n";
+    o_ << "  enum class EventId : uint16_t\n  {\n";
+    for (size_t e = 0; e < m_.events.size(); ++e) {
+      o_ << "    " << eventEnumerator(e) << " = " << e << ",\n";
+    }
+    o_ << "  };\n";
+    o_ << "  static constexpr size_t stateCount = " << m_.states.size() << ";\n";
+    o_ << "  static constexpr size_t eventCount = " << m_.events.size() << ";\n\n";
+  }
+
+  std::string eventEnumerator(size_t e) const {return identifier(m_.events[e]);}
+
+  void publicApi()
+  {
+    o_ << "  explicit " << class_ << "(Hooks & hooks)\n  : hooks_(hooks)\n  {\n";
+    o_ << "    for (auto & a : active_) {\n      a.store(false);\n    }\n";
+    o_ << "    for (auto & t : triggered_) {\n      t.store(false);\n    }\n";
+    for (size_t r = 0; r < m_.regions.size(); ++r) {
+      o_ << "    current_[" << r << "] = " << state(m_.regions[r].initialState) << ";\n";
+      o_ << "    phase_[" << r << "] = Phase::Entry;\n";
+      o_ << "    pending_[" << r << "] = -1;\n";
+    }
+    o_ << "  }\n\n";
+    o_ << "  " << class_ << "(const " << class_ << " &) = delete;\n";
+    o_ << "  " << class_ << " & operator=(const " << class_ << " &) = delete;\n\n";
+
+    o_ << "  /*!\n   \\brief Same as Chart::process(), takes one step of the top chart\n   */\n";
+    o_ << "  void process() {process0();}\n\n";
+    o_ << "  /*!\n   \\brief Same as Chart::spinOnce()\n   */\n";
+    o_ << "  void spinOnce()\n  {\n    do {\n      process0();\n" <<
+      "    } while (phase_[0] != Phase::Do);\n  }\n\n";
+    o_ << "  /*!\n   \\brief Same as Chart::spinToState(), for states of the top chart\n   */\n";
+    o_ << "  void spinToState(StateId s)\n  {\n    while (current_[0] != s) {\n" <<
+      "      process0();\n    }\n  }\n\n";
+    o_ << "  /*!\n   \\brief Same as Chart::reset()\n   */\n";
+    o_ << "  void reset() {reset0();}\n\n";
+    o_ << "  /*!\n   \\brief Active state of the top chart\n   */\n";
+    o_ << "  StateId currentState() const {return current_[0];}\n\n";
+    o_ << "  /*!\n   \\brief Same as AbstractState::isActive()\n   */\n";
+    o_ << "  bool isActive(StateId s) const\n  {\n";
+    o_ << "    for (int i = static_cast<int>(s); i >= 0; i = parent(i)) {\n";
+    o_ << "      if (!active_[i].load()) {\n        return false;\n      }\n    }\n";
+    o_ << "    return true;\n  }\n\n";
+
+    o_ << "  /*!\n   \\brief Same as Chart::getCurrentStateNameFull()\n   */\n";
+    o_ << "  std::string currentStateNameFull() const\n  {\n";
+    o_ << "    std::string name = stateName(current_[0]);\n";
+    o_ << "    for (int r = subregion(static_cast<int>(current_[0])); r >= 0;\n" <<
+      "      r = subregion(static_cast<int>(current_[r])))\n    {\n";
+    o_ << "      name += \":\";\n      name += stateName(current_[r]);\n    }\n";
+    o_ << "    return name;\n  }\n\n";
+
+    o_ << "  static const char * stateName(StateId s)\n  {\n";
+    o_ << "    static const char * const names[] = {\n";
+    for (const auto & s : m_.states) {
+      o_ << "      " << quoted(s.name) << ",\n";
+    }
+    o_ << "    };\n    return names[static_cast<size_t>(s)];\n  }\n\n";
+
+    o_ << "  static const char * eventName(EventId e)\n  {\n";
+    if (m_.events.empty()) {
+      o_ << "    (void)e;\n    return \"\";\n  }\n\n";
+    } else {
+      o_ << "    static const char * const names[] = {\n";
+      for (const auto & e : m_.events) {
+        o_ << "      " << quoted(e) << ",\n";
+      }
+      o_ << "    };\n    return names[static_cast<size_t>(e)];\n  }\n\n";
+    }
+
+    o_ << "  /*!\n   \\brief Signals an event, transitions out of an active state that\n" <<
+      "   subscribe to it become eligible. Safe to call from any thread\n   */\n";
+    o_ << "  void trigger(EventId e)\n  {\n";
+    if (m_.events.empty()) {
+      o_ << "    (void)e;\n";
+    } else {
+      o_ << "    switch (e) {\n";
+      for (size_t e = 0; e < m_.events.size(); ++e) {
+        o_ << "      case EventId::" << eventEnumerator(e) << ":\n";
+        for (size_t t = 0; t < m_.transitions.size(); ++t) {
+          const auto & tr = m_.transitions[t];
+          for (auto te : tr.events) {
+            if (te == static_cast<int>(e)) {
+              o_ << "        if (isActive(" << state(tr.src) << ")) {\n" <<
+                "          triggered_[" << t << "].store(true);\n        }\n";
+              break;
+            }
+          }
+        }
+        o_ << "        break;\n";
+      }
+      o_ << "    }\n";
+    }
+    o_ << "  }\n\n";
+
+    o_ << "  /*!\n   \\brief Forwards every trigger() of a runtime event to this machine.\n" <<
+      "   The binding goes away with the machine\n   */\n";
+    o_ << "  void bind(EventId e, mogi::statechart::Event & event)\n  {\n";
+    o_ << "    auto adapter = std::make_shared<EventAdapter>(*this, e);\n";
+    o_ << "    event.addObserver(adapter);\n";
+    o_ << "    adapters_.push_back(adapter);\n  }\n";
+  }
+
+  void privateMembers()
+  {
+    o_ << "  enum class Phase : uint8_t {Entry, Do, Exit};\n\n";
+    o_ << "  class EventAdapter : public mogi::statechart::EventObserver\n  {\n  public:\n";
+    o_ << "    EventAdapter(" << class_ << " & machine, EventId e)\n" <<
+      "    : machine_(machine), event_(e) {}\n\n  protected:\n";
+    o_ << "    void notify(const mogi::statechart::Event &) override\n" <<
+      "    {\n      machine_.trigger(event_);\n    }\n\n";
+    o_ << "  private:\n    " << class_ << " & machine_;\n    EventId event_;\n  };\n\n";
+
+    o_ << "  static int parent(int s)\n  {\n";
+    o_ << "    static const int parents[] = {\n";
+    for (const auto & s : m_.states) {
+      o_ << "      " << m_.regions[s.region].parentState << ",\n";
+    }
+    o_ << "    };\n    return parents[s];\n  }\n\n";
+    o_ << "  static int subregion(int s)\n  {\n";
+    o_ << "    static const int subregions[] = {\n";
+    for (const auto & s : m_.states) {
+      o_ << "      " << s.subregion << ",\n";
+    }
+    o_ << "    };\n    return subregions[s];\n  }\n\n";
+
+    auto regions = m_.regions.size();
+    auto transitions = std::max<size_t>(m_.transitions.size(), 1);
+    o_ << "  Hooks & hooks_;\n";
+    o_ << "  StateId current_[" << regions << "];\n";
+    o_ << "  Phase phase_[" << regions << "];\n";
+    o_ << "  int pending_[" << regions << "];\n";
+    o_ << "  std::atomic<bool> active_[stateCount];\n";
+    o_ << "  std::atomic<bool> triggered_[" << transitions << "];\n";
+    o_ << "  std::vector<std::shared_ptr<EventAdapter>> adapters_;\n";
+  }
+
+  void actions(const std::vector<std::string> & names, const char * indent)
+  {
+    for (const auto & a : names) {
+      o_ << indent << "hooks_." << a << "();\n";
+    }
+  }
+
+  void region(int r)
+  {
+    const auto & reg = m_.regions[r];
+    std::vector<int> members;
+    for (size_t s = 0; s < m_.states.size(); ++s) {
+      if (m_.states[s].region == r) {
+        members.push_back(static_cast<int>(s));
+      }
+    }
+
+    /* reset */
+    o_ << "\n  void reset" << r << "()\n  {\n";
+    o_ << "    active_[static_cast<size_t>(current_[" << r << "])].store(false);\n";
+    o_ << "    current_[" << r << "] = " << state(reg.initialState) << ";\n";
+    o_ << "    phase_[" << r << "] = Phase::Entry;\n";
+    o_ << "    pending_[" << r << "] = -1;\n  }\n";
+
+    /* transition destinations */
+    o_ << "\n  void process" << r << "()\n  {\n";
+    o_ << "    switch (phase_[" << r << "]) {\n";
+
+    o_ << "      case Phase::Entry:\n";
+    o_ << "        switch (pending_[" << r << "]) {\n";
+    for (size_t t = 0; t < m_.transitions.size(); ++t) {
+      if (m_.states[m_.transitions[t].src].region == r) {
+        o_ << "          case " << t << ": current_[" << r << "] = " <<
+          state(m_.transitions[t].dst) << "; break;\n";
+      }
+    }
+    if (reg.initialTarget >= 0) {
+      o_ << "          case -2: current_[" << r << "] = " << state(reg.initialTarget) <<
+        "; break;\n";
+    }
+    o_ << "          default: break;\n        }\n";
+    o_ << "        pending_[" << r << "] = -1;\n";
+    o_ << "        switch (current_[" << r << "]) {\n";
+    for (int s : members) {
+      const auto & st = m_.states[s];
+      if (st.subregion >= 0) {
+        o_ << "          case " << state(s) << ":\n            reset" << st.subregion <<
+          "();\n            break;\n";
+      } else if (!st.entry.empty()) {
+        o_ << "          case " << state(s) << ":\n";
+        actions(st.entry, "            ");
+        o_ << "            break;\n";
+      }
+    }
+    o_ << "          default: break;\n        }\n";
+    o_ << "        phase_[" << r << "] = Phase::Do;\n";
+    o_ << "        active_[static_cast<size_t>(current_[" << r << "])].store(true);\n";
+    o_ << "        break;\n";
+
+    o_ << "      case Phase::Do:\n";
+    o_ << "        switch (current_[" << r << "]) {\n";
+    for (int s : members) {
+      const auto & st = m_.states[s];
+      bool initialOut = s == reg.initialState && reg.initialTarget >= 0;
+      if (st.subregion < 0 && st.activity.empty() && st.transitions.empty() && !initialOut) {
+        continue;
+      }
+      o_ << "          case " << state(s) << ":\n            {\n";
+      if (st.subregion >= 0) {
+        o_ << "              do {\n                process" << st.subregion <<
+          "();\n              } while (phase_[" << st.subregion << "] != Phase::Do);\n";
+      }
+      actions(st.activity, "              ");
+      o_ << "              int t = -1;\n";
+      if (initialOut) {
+        o_ << "              t = -2;\n";
+      }
+      for (int t : st.transitions) {
+        const auto & tr = m_.transitions[t];
+        std::string cond;
+        if (!tr.events.empty()) {
+          cond = "triggered_[" + std::to_string(t) + "].exchange(false)";
+        }
+        /* a subchart completes in its final state, a plain state right away */
+        if (tr.completion && st.subregion >= 0) {
+          cond = "current_[" + std::to_string(st.subregion) + "] == " +
+            state(m_.regions[st.subregion].finalState);
+        }
+        for (const auto & g : tr.guards) {
+          cond += (cond.empty() ? "" : " && ") + std::string("hooks_.") + g + "()";
+        }
+        if (cond.empty()) {
+          o_ << "              t = " << t << ";\n";
+        } else {
+          o_ << "              if (" << cond << ") {\n                t = " << t <<
+            ";\n              }\n";
+        }
+      }
+      o_ << "              if (t != -1) {\n                pending_[" << r <<
+        "] = t;\n                phase_[" << r << "] = Phase::Exit;\n              }\n";
+      o_ << "            }\n            break;\n";
+    }
+    o_ << "          default: break;\n        }\n";
+    o_ << "        break;\n";
+
+    o_ << "      case Phase::Exit:\n";
+    o_ << "        switch (current_[" << r << "]) {\n";
+    for (int s : members) {
+      if (!m_.states[s].exit.empty()) {
+        o_ << "          case " << state(s) << ":\n";
+        actions(m_.states[s].exit, "            ");
+        o_ << "            break;\n";
+      }
+    }
+    o_ << "          default: break;\n        }\n";
+    o_ << "        switch (pending_[" << r << "]) {\n";
+    for (size_t t = 0; t < m_.transitions.size(); ++t) {
+      const auto & tr = m_.transitions[t];
+      if (m_.states[tr.src].region == r && !tr.actions.empty()) {
+        o_ << "          case " << t << ":\n";
+        actions(tr.actions, "            ");
+        o_ << "            break;\n";
+      }
+    }
+    o_ << "          default: break;\n        }\n";
+    o_ << "        active_[static_cast<size_t>(current_[" << r << "])].store(false);\n";
+    o_ << "        phase_[" << r << "] = Phase::Entry;\n";
+    o_ << "        break;\n";
+    o_ << "    }\n  }\n";
+  }
+
+  const Model & m_;
+  std::string class_;
+  std::string ns_;
+  std::string source_;
+  std::string guard_;
+  std::ostringstream o_;
+};
+
+std::string readFile(const std::string & path)
+{
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    throw std::runtime_error("cannot open " + path);
+  }
+  std::ostringstream s;
+  s << in.rdbuf();
+  return s.str();
+}
+
+bool endsWith(const std::string & s, const std::string & suffix)
+{
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string baseName(const std::string & path)
+{
+  auto slash = path.find_last_of("/\\");
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::vector<std::string> positional;
+  std::string className, ns;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if ((arg == "--class" || arg == "--namespace") && i + 1 < argc) {
+      (arg == "--class" ? className : ns) = argv[++i];
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 2) {
+    std::cerr << "usage: " << argv[0] <<
+      " <input.scxml|input.json> <output.hpp> [--class Name] [--namespace ns]" << std::endl;
+    return 2;
+  }
+
+  try {
+    const auto & input = positional[0];
+    ChartDescription chart;
+    if (endsWith(input, ".json")) {
+      auto text = readFile(input);
+      chart = chartFromJson(JsonReader{text}.parse(), "chart");
+    } else {
+      std::ifstream in{input, std::ios::binary};
+      if (!in) {
+        throw std::runtime_error("cannot open " + input);
+      }
+      chart = ScxmlLoader::parse(in);
+    }
+    if (className.empty()) {
+      className = identifier(chart.name);
+      className[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(className[0])));
+      className += "Machine";
+    } else if (identifier(className) != className) {
+      throw std::runtime_error("class name " + className + " is not a C++ identifier");
+    }
+
+    Model model{chart};
+    auto code = Emitter{model, className, ns, baseName(input)}.emit();
+    std::ofstream out{positional[1], std::ios::binary};
+    if (!out) {
+      throw std::runtime_error("cannot write " + positional[1]);
+    }
+    out << code;
+  } catch (const std::exception & e) {
+    std::cerr << argv[0] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}